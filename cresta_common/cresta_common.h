@@ -4,6 +4,14 @@
 #ifndef _CRESTA_COMMON_H_
 #define _CRESTA_COMMON_H_
 
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/stddef.h>
+#else
+#include <stdint.h>
+#include <stddef.h>
+#endif
+
 //maximum length of a datagram including prefix and checksum bytes
 #define CRESTA_MAXDATA_LEN 14
 
@@ -42,17 +50,51 @@ enum cresta_sensor_type {
 
 
 /*
- * Stores all the data we export to user space
- * via character device. Originally, only the decrypted
- * sensor data was transmitted. However, this structure
- * allows addition of other data, e.g. time of measurement,
- * which isn't contained in the measurement data itself
+ * Record format of the /dev/cresta_* devices and crestad's files
+ * before records were versioned, see CRESTA_RECORD_VERSION. Kept for
+ * readers of files written by older versions, recognized by their size
  */
 struct measurement {
   uint64_t measurement_time_seconds;
   uint8_t decrypted_data[CRESTA_MAXDATA_LEN];
 };
 
+/*
+ * Stores all the data we export to user space via character device.
+ * Records are 8 byte aligned and all have the same size, so readers
+ * can copy a batch of them straight into an array.
+ *
+ * Newer versions only append fields to the header, so data stays
+ * at header_len and readers step through arrays by record_len.
+ * The sequence number counts the measurements of a sensor, it
+ * starts at 1 and is only incremented for new data, so a reader
+ * seeing the same number twice got the same measurement and a gap
+ * means updates were missed. Repeated transmissions of a datagram
+ * don't get a number of their own. Seeded measurements have
+ * sequence number 0.
+ */
+#define CRESTA_RECORD_VERSION 1
+enum cresta_record_flags {
+    CRESTA_RECORD_FLAG_SEEDED = 0x0001	// restored by seeding, not received
+};
+struct cresta_measurement_record {
+    uint16_t version;		// CRESTA_RECORD_VERSION
+    uint16_t header_len;	// offset of decrypted_data
+    uint16_t record_len;	// size of the record
+    uint16_t flags;		// cresta_record_flags
+    uint64_t timestamp_ns;	// CLOCK_REALTIME time of reception
+    uint64_t sequence;		// per sensor, see above
+    uint8_t  sensor_address;
+    uint8_t  sensor_type;
+    uint8_t  len;		// datagram length
+    uint8_t  reserved[5];
+    uint8_t  decrypted_data[CRESTA_MAXDATA_LEN];
+    uint8_t  padding[2];	// keeps the size a multiple of 8
+};
+
+//offsets and size are part of the ABI
+typedef char cresta_measurement_record_size_check[sizeof(struct cresta_measurement_record) == 48 ? 1 : -1];
+
 /*
  * Extends measurement by some additional
  * fields for convenient access of data
@@ -61,7 +103,128 @@ struct cresta_measurement_data {
     uint8_t sensor_address;	//for convenience
     uint8_t len;		//for convenience
     uint8_t sensor_type;	//for convenience
-    struct measurement measurement;
+    struct cresta_measurement_record measurement;
 };
 
+/*
+ * Fills in the header of a record. The sequence number and
+ * flags are left to the caller
+ */
+static inline void cresta_init_measurement_record(struct cresta_measurement_data *data, uint64_t timestamp_ns) {
+    data->measurement.version        = CRESTA_RECORD_VERSION;
+    data->measurement.header_len     = offsetof(struct cresta_measurement_record, decrypted_data);
+    data->measurement.record_len     = sizeof(struct cresta_measurement_record);
+    data->measurement.timestamp_ns   = timestamp_ns;
+    data->measurement.sensor_address = data->sensor_address;
+    data->measurement.sensor_type    = data->sensor_type;
+    data->measurement.len            = data->len;
+}
+
+/*
+ * Edge as exported by /dev/cresta_raw. Capture files
+ * are a plain sequence of these records.
+ */
+struct cresta_raw_edge {
+    uint64_t timestamp_ns;	// CLOCK_MONOTONIC time of the edge
+    uint32_t level;		// level of the receiver's output after the edge
+    uint32_t dropped;		// number of edges lost right before this one
+};
+
+/*
+ * /dev/cresta_raw can be mapped read only. The mapping starts with
+ * this header, followed by edge_count edges at offset header_size.
+ * The kernel writes edge number n to slot n % edge_count and then
+ * increments head, it never waits for readers. Readers keep their own
+ * position and detect overruns by head - position >= edge_count, as
+ * slot head % edge_count may be half written already.
+ */
+#define CRESTA_RAW_MAGIC   0x57415243	// "CRAW"
+#define CRESTA_RAW_VERSION 1
+struct cresta_raw_ring_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;	// offset of the first edge
+    uint32_t edge_count;	// number of edges in the ring, power of 2
+    uint64_t head;		// number of edges written so far
+    uint64_t decoder_dropped;	// edges the decoder lost due to a full FIFO
+};
+
+/*
+ * crestad publishes measurements into a shared memory ring for local
+ * consumers. The ring starts with this header, followed by
+ * record_count records of record_len bytes at offset header_size.
+ * crestad writes measurement number n to slot n % record_count and
+ * then increments head, it never waits for consumers. Every consumer
+ * keeps its own position. A record read at position p is complete
+ * if head - p < record_count still holds after copying it, otherwise
+ * crestad may have overwritten it.
+ */
+#define CRESTA_RING_MAGIC   0x474e5243	// "CRNG"
+#define CRESTA_RING_VERSION 1
+struct cresta_measurement_ring_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;	// offset of the first record
+    uint32_t record_count;	// number of records in the ring, power of 2
+    uint32_t record_len;	// size of a record
+    uint32_t reserved;
+    uint64_t head;		// number of records written so far
+};
+
+/*
+ * The module sends every new measurement to the multicast group
+ * CRESTA_GENL_MCGRP_MEASUREMENTS of the generic netlink family
+ * CRESTA_GENL_NAME, as a CRESTA_GENL_CMD_MEASUREMENT message with the
+ * attributes below. The payload is the decrypted datagram, like
+ * decrypted_data of a record. Repeated transmissions and seeded
+ * measurements aren't sent.
+ */
+#define CRESTA_GENL_NAME               "cresta"
+#define CRESTA_GENL_VERSION            1
+#define CRESTA_GENL_MCGRP_MEASUREMENTS "measurements"
+enum cresta_genl_cmd {
+    CRESTA_GENL_CMD_UNSPEC,
+    CRESTA_GENL_CMD_MEASUREMENT,
+    __CRESTA_GENL_CMD_MAX
+};
+enum cresta_genl_attr {
+    CRESTA_GENL_ATTR_UNSPEC,
+    CRESTA_GENL_ATTR_ADDRESS,		// u8
+    CRESTA_GENL_ATTR_TYPE,		// u8
+    CRESTA_GENL_ATTR_TIMESTAMP,		// u64, as timestamp_ns of a record
+    CRESTA_GENL_ATTR_SEQUENCE,		// u64, as sequence of a record
+    CRESTA_GENL_ATTR_LEN,		// u8, datagram length
+    CRESTA_GENL_ATTR_DATA,		// CRESTA_MAXDATA_LEN bytes
+    CRESTA_GENL_ATTR_PAD,		// empty, aligns the next u64 where needed
+    __CRESTA_GENL_ATTR_MAX
+};
+#define CRESTA_GENL_ATTR_MAX (__CRESTA_GENL_ATTR_MAX - 1)
+
+/*
+ * Returns the base name of the device file of a sensor, e.g.
+ * "cresta_thermohygro_ch1". Thermohygro sensors are named by the
+ * channel encoded in their address. Returns NULL for sensors we
+ * don't know how to name.
+ */
+static inline const char* cresta_sensor_base_name(uint8_t sensor_type, uint8_t sensor_addr) {
+    switch(sensor_type) {
+	case CRESTA_SENSOR_TYPE_ANEMOMETER:
+	    return "cresta_anemometer";
+	case CRESTA_SENSOR_TYPE_UV:
+	    return "cresta_uv";
+	case CRESTA_SENSOR_TYPE_RAIN:
+	    return "cresta_rain";
+	case CRESTA_SENSOR_TYPE_THERMOHYGRO:
+	    switch(sensor_addr & CRESTA_SENSOR_ADDR_MASK) {
+		case CRESTA_AM_THERMOHYGRO_CH1: return "cresta_thermohygro_ch1";
+		case CRESTA_AM_THERMOHYGRO_CH2: return "cresta_thermohygro_ch2";
+		case CRESTA_AM_THERMOHYGRO_CH3: return "cresta_thermohygro_ch3";
+		case CRESTA_AM_THERMOHYGRO_CH4: return "cresta_thermohygro_ch4";
+		case CRESTA_AM_THERMOHYGRO_CH5: return "cresta_thermohygro_ch5";
+	    }
+	    break;
+    }
+    return NULL;
+}
+
 #endif
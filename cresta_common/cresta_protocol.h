@@ -0,0 +1,416 @@
+/*
+ * Protocol handling shared by the kernel module and the user space
+ * tools: manchester decoding of edge durations and decryption of
+ * received datagrams.
+ *
+ * Protocol was reverse engineered by Ruud v Gessel
+ * and documented in "Cresta weather sensor protocol", see
+ * http://members.upc.nl/m.beukelaar/Crestaprotocol.pdf
+ *
+ * The manchester decoder utilizes code of the Arduino
+ * decoder library "433MHzForArduino", see
+ * https://bitbucket.org/fuzzillogic/433mhzforarduino
+ *
+ * Everything in here is static inline, so the same code can be
+ * compiled into the kernel module and into user space binaries
+ * without building a shared object for both worlds.
+ *
+ * License: GPLv3. See license.txt
+ */
+#ifndef _CRESTA_PROTOCOL_H_
+#define _CRESTA_PROTOCOL_H_
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/string.h>
+#include <linux/printk.h>
+#define cresta_protocol_log(...) printk(KERN_INFO __VA_ARGS__)
+#else
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#ifdef CRESTA_PROTOCOL_DEBUG
+#include <stdio.h>
+#define cresta_protocol_log(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define cresta_protocol_log(...) do { } while (0)
+#endif
+#endif
+
+#include "cresta_common.h"
+
+//first byte of every datagram
+#define CRESTA_PREAMBLE 0x75
+
+//maximum number of manchester decoders running in parallel
+#define CRESTA_MAX_HYPOTHESES 8
+
+/*
+ * State of a single manchester decoder. Originally this was a set
+ * of static variables in the kernel module, which limited us to
+ * exactly one decoder.
+ */
+struct cresta_manchester {
+    uint8_t  halfBit;		// 9 bytes of 9 bits each, 2 edges per bit = 162 halfbits for thermo/hygro
+    uint32_t clockTime;		// Measured duration of half a period, i.e. the the duration of a short edge.
+    bool     isOne;		// true if the the last bit is a logic 1.
+    uint8_t  packageLength;
+    uint8_t  halfBitCounter;
+    uint8_t  data[CRESTA_MAXDATA_LEN];	// Maximum number of bytes used by Cresta
+};
+
+/*
+ * A set of manchester decoders, each started at a different edge.
+ * Slot 0 is the primary decoder and behaves exactly like the single
+ * decoder always did. The other slots are candidates, which are started
+ * while the primary is busy with a packet. This way a packet isn't lost
+ * if the primary locked onto noise right before the real preamble or
+ * if two sensors transmit at nearly the same time.
+ */
+struct cresta_manchester_multi {
+    uint8_t  hypotheses;	// number of slots in use, 1 = single decoder
+    struct cresta_manchester slot[CRESTA_MAX_HYPOTHESES];
+    uint8_t  packet[CRESTA_MAXDATA_LEN];	// last completed packet
+    uint32_t packets;		// number of completed packets
+    uint32_t recovered;		// packets completed by a candidate slot
+};
+
+
+/*
+ * Helper routine for checking decrypted data
+ */
+static inline uint8_t second_check(uint8_t b) {
+    uint8_t c;
+
+    if (b&0x80) {
+	b^=0x95;
+    }
+    c = b^(b>>1);
+    if (b&1) {
+	c^=0x5f;
+    }
+
+    if (c&1) {
+	b^=0x5f;
+    }
+
+    return b^(c>>1);
+}
+
+/*
+ * Decrypts a datagram in place and verifies both checksums.
+ * Returns 0 on success, -1 otherwise
+ */
+static inline int decrypt_and_check(uint8_t* raw_data) {
+
+    uint8_t cs1,cs2,i;
+    uint8_t decodedByte;
+    uint8_t packet_length;
+    cs1=0;
+    cs2=0;
+    decodedByte = raw_data[2]^(raw_data[2]<<1);
+    packet_length = (decodedByte >> 1) & 0x1f;
+    if(packet_length >= CRESTA_MIN_ANNOUNCED_LEN && packet_length <= CRESTA_MAX_ANNOUNCED_LEN) {
+
+      for (i=1; i<packet_length+2; i++) {
+	  cs1^=raw_data[i];
+	  cs2 = second_check(raw_data[i]^cs2);
+	  raw_data[i] ^= raw_data[i] << 1;
+      }
+
+      if (cs1) {
+	  return -1;
+      }
+
+      if (cs2 != raw_data[packet_length+2]) {
+	  return -1;
+      }
+
+      return 0;
+    } else {
+      cresta_protocol_log("Bogus packet length: %d. aborting decoding\n", packet_length);
+      return -1;
+    }
+}
+
+/*
+ * Checks preamble and checksums of a raw (still encrypted) datagram
+ * without modifying it
+ */
+static inline bool cresta_packet_is_valid(const uint8_t* raw_data) {
+    uint8_t scratch[CRESTA_MAXDATA_LEN];
+
+    if(raw_data[0] != CRESTA_PREAMBLE) {
+	return false;
+    }
+    memcpy(scratch, raw_data, sizeof(scratch));
+    return decrypt_and_check(scratch) == 0;
+}
+
+
+/*
+ * Puts the decoder into its initial state, i.e. waiting for the
+ * first edge for clock detection
+ */
+static inline void cresta_manchester_init(struct cresta_manchester *m) {
+    memset(m, 0, sizeof(*m));
+    m->halfBitCounter = ~0;
+}
+
+/*
+ * Resets the manchester decoder. The edge causing the reset is used
+ * for clock detection of the next packet
+ */
+static inline void cresta_manchester_reset(struct cresta_manchester *m, uint32_t duration) {
+    m->halfBit = 1;
+    m->clockTime = duration >> 1;
+    m->isOne = true;
+    m->halfBitCounter = ~0;
+}
+
+/*
+ * Feeds the duration of one edge (in microseconds) into the decoder.
+ * Returns 1 if a complete datagram is available in m->data, -1 if the
+ * decoder was reset due to invalid data and 0 otherwise.
+ * m->data is only valid until the next call.
+ */
+static inline int cresta_manchester_decode(struct cresta_manchester *m, uint32_t duration) {
+  /* I'll follow CrestaProtocol documentation here. However, I suspect it is inaccurate at some points:
+  * - there is no stop-bit after every byte. Instead, there's a start-bit (0) before every byte.
+  * - Conversely, there is no start-bit "1" before every byte.
+  * - An up-flank is 0, down-flank is 1, at least with both my receivers.
+  *
+  * However, since the first start-bit 0 is hard to distinguish given the current clock-detecting
+  * algorithm, I pretend there *is* a stop-bit 0 instead of start-bit. However, this means the
+  * last stop-bit of a package must be ignored, as it simply isn't there.
+  *
+  * This manchester decoder is based on the principle that short edges indicate the current bit is the
+  * same as previous bit, and that long edge indicate that the current bit is the complement of the
+  * previous bit.
+  */
+  int complete = 0;
+
+  if (m->halfBit==0) {
+    // Automatic clock detection. One clock-period is half the duration of the first edge.
+    m->clockTime = duration >> 1;
+
+    // Some sanity checking, very short (<200us) or very long (>1000us) signals are ignored.
+    if (m->clockTime < 200 || m->clockTime > 1000) {
+      return 0;
+    }
+    m->isOne = true;
+  }
+  else {
+    // Edge is not too long, nor too short?
+    if (duration < (m->clockTime >> 1) || duration > (m->clockTime << 1) + m->clockTime) { // read as: duration < 0.5 * clockTime || duration > 3 * clockTime
+      // Fail. Abort.
+      cresta_manchester_reset(m, duration);
+      return -1;
+    }
+
+    // Only process every second half bit, i.e. every whole bit.
+    if (m->halfBit & 1) {
+      uint8_t currentByte = m->halfBit / 18;
+      uint8_t currentBit = (m->halfBit >> 1) % 9; // nine bits in a byte.
+      if (currentBit < 8) {
+	//make sure we don't write out of array
+	if(currentByte < CRESTA_MAXDATA_LEN) {
+	  if (m->isOne) {
+	    // Set current bit of current byte
+	    m->data[currentByte] |= 1 << currentBit;
+	  }
+	  else {
+	    // Reset current bit of current byte
+	    m->data[currentByte] &= ~(1 << currentBit);
+	  }
+	}
+      } else {
+	// Ninth bit must be 0
+	if (m->isOne) {
+	  // Bit is 1. Fail. Abort.
+	  cresta_manchester_reset(m, duration);
+	  return -1;
+	}
+      }
+
+
+      if (m->halfBit == 17) { // First byte has been received
+	// First data byte must be x75.
+	if (m->data[0] != CRESTA_PREAMBLE) {
+	  cresta_manchester_reset(m, duration);
+	  return -1;
+	}
+      }
+      else if (m->halfBit == 53) { // Third byte has been received
+	// Obtain the length of the data
+	uint8_t decodedByte = m->data[2]^(m->data[2]<<1);
+	m->packageLength = (decodedByte >> 1) & 0x1f;
+
+	// Do some checking to see if we should proceed
+	if (m->packageLength < CRESTA_MIN_ANNOUNCED_LEN || m->packageLength > CRESTA_MAX_ANNOUNCED_LEN) {
+	  cresta_manchester_reset(m, duration);
+	  return -1;
+	} else {
+	  m->halfBitCounter = (m->packageLength + 3) * 9 * 2 - 2 - 1; // 9 bits per byte, 2 edges per bit, minus last stop-bit (see comment above)
+	}
+      }
+
+
+      // Done?
+      if (m->halfBit >= m->halfBitCounter) {
+      //keep the typecast for (uint8_t) ~0, or the check will fail
+	if (m->halfBitCounter != (uint8_t) ~0) {
+	  //last sanity checks. keep them in, as we still get garbage in very rare cases
+	  uint8_t lengthSanity = m->data[2]^(m->data[2]<<1);
+	  lengthSanity = (lengthSanity >> 1) & 0x1f;
+	  if(m->data[0] == CRESTA_PREAMBLE && lengthSanity >= CRESTA_MIN_ANNOUNCED_LEN && lengthSanity <= CRESTA_MAX_ANNOUNCED_LEN) {
+	    complete = 1;
+	  } else {
+	    cresta_protocol_log("data[0] = %x\n", m->data[0]);
+	    cresta_protocol_log("packet length = %d\n", m->packageLength);
+	    cresta_protocol_log("packet length (final sanity check) = %d\n", lengthSanity);
+	    cresta_protocol_log("halfBitCounter = %d\n", m->halfBitCounter);
+	    cresta_protocol_log("halfBit = %d\n", m->halfBit);
+	  }
+	}
+	// reset
+	cresta_manchester_reset(m, duration);
+	m->halfBit = 0;
+	return complete;
+      }
+    }
+
+    // Edge is long?
+    if (duration > m->clockTime + (m->clockTime >> 1)) { // read as: duration > 1.5 * clockTime
+      // Long edge.
+      m->isOne = !m->isOne;
+      // Long edge takes 2 halfbits
+      m->halfBit++;
+    }
+  }
+
+  m->halfBit++;
+
+  return 0;
+}
+
+
+/*
+ * Initializes a set of decoders. hypotheses is clamped
+ * to 1..CRESTA_MAX_HYPOTHESES
+ */
+static inline void cresta_manchester_multi_init(struct cresta_manchester_multi *mm, uint8_t hypotheses) {
+    uint8_t i;
+
+    memset(mm, 0, sizeof(*mm));
+    if(hypotheses < 1) {
+	hypotheses = 1;
+    } else if(hypotheses > CRESTA_MAX_HYPOTHESES) {
+	hypotheses = CRESTA_MAX_HYPOTHESES;
+    }
+    mm->hypotheses = hypotheses;
+    for(i = 0; i < CRESTA_MAX_HYPOTHESES; i++) {
+	cresta_manchester_init(&mm->slot[i]);
+    }
+}
+
+/*
+ * Resets all decoders of the set. The primary decoder uses the edge
+ * for clock detection, candidates go back to idle.
+ */
+static inline void cresta_manchester_multi_reset(struct cresta_manchester_multi *mm, uint32_t duration) {
+    uint8_t i;
+
+    cresta_manchester_reset(&mm->slot[0], duration);
+    for(i = 1; i < mm->hypotheses; i++) {
+	cresta_manchester_init(&mm->slot[i]);
+    }
+}
+
+/*
+ * Feeds the duration of one edge into every active decoder of the set.
+ * Returns 1 if a datagram was completed, which is then available in
+ * mm->packet until the next call.
+ *
+ * With a single hypothesis, this is exactly the plain decoder. Otherwise
+ * every edge arriving while the primary is busy starts a candidate in a
+ * free slot. Candidates drop back to idle as soon as they fail, and
+ * only datagrams with valid preamble and checksums are accepted. That
+ * way at most one datagram is accepted per edge, even if several slots
+ * end up decoding the same packet.
+ */
+static inline int cresta_manchester_multi_decode(struct cresta_manchester_multi *mm, uint32_t duration) {
+    int ret;
+    int found = 0;
+    bool started = false;
+    uint8_t i;
+
+    if(mm->hypotheses <= 1) {
+	if(cresta_manchester_decode(&mm->slot[0], duration) == 1) {
+	    memcpy(mm->packet, mm->slot[0].data, sizeof(mm->packet));
+	    mm->packets++;
+	    return 1;
+	}
+	return 0;
+    }
+
+    ret = cresta_manchester_decode(&mm->slot[0], duration);
+    if(ret == 1 && cresta_packet_is_valid(mm->slot[0].data)) {
+	memcpy(mm->packet, mm->slot[0].data, sizeof(mm->packet));
+	found = 1;
+    }
+    //primary restarted at (or is still detecting the clock with) this edge
+    if(ret != 0 || mm->slot[0].halfBit <= 1) {
+	started = true;
+    }
+
+    for(i = 1; i < mm->hypotheses; i++) {
+	struct cresta_manchester *m = &mm->slot[i];
+
+	if(m->halfBit == 0) {
+	    if(started) {
+		continue;
+	    }
+	    //idle slot, start a new candidate at this edge
+	    started = true;
+	}
+
+	ret = cresta_manchester_decode(m, duration);
+	if(ret == 1 && !found && cresta_packet_is_valid(m->data)) {
+	    memcpy(mm->packet, m->data, sizeof(mm->packet));
+	    mm->recovered++;
+	    found = 1;
+	}
+	if(ret != 0) {
+	    cresta_manchester_init(m);
+	}
+    }
+
+    if(found) {
+	mm->packets++;
+    }
+    return found;
+}
+
+/*
+ * Sensors transmit every datagram several times in a row, counting
+ * the transmissions in the packet number. A datagram received shortly
+ * after the current one and only differing in the packet number (and
+ * hence the checksums) is one of these repetitions, not a new
+ * measurement
+ */
+#define CRESTA_REPEAT_WINDOW_NS 1000000000ULL
+static inline bool cresta_is_repeated_transmission(const struct cresta_measurement_record *current,
+						   const struct cresta_measurement_record *received) {
+    const uint8_t *a = current->decrypted_data;
+    const uint8_t *b = received->decrypted_data;
+    //announced length, the last data byte is at this index
+    uint8_t len = (b[2] >> 1) & 0x1f;
+
+    return !(current->flags & CRESTA_RECORD_FLAG_SEEDED) &&
+	   received->timestamp_ns - current->timestamp_ns < CRESTA_REPEAT_WINDOW_NS &&
+	   0 == memcmp(a, b, 3) && 0 == ((a[3] ^ b[3]) & 0x1F) &&
+	   0 == memcmp(a + 4, b + 4, len - 3);
+}
+
+#endif
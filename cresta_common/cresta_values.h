@@ -0,0 +1,140 @@
+/*
+ * Decoding of the values in decrypted datagrams, shared by the kernel
+ * module and the user space tools. Values are returned in fixed point,
+ * as integers of the smallest unit the sensors transmit, so the
+ * kernel doesn't need floating point.
+ *
+ * Field positions are documented in "Cresta weather sensor protocol",
+ * see http://members.upc.nl/m.beukelaar/Crestaprotocol.pdf
+ *
+ * Like cresta_protocol.h, everything in here is static inline.
+ *
+ * License: GPLv3. See license.txt
+ */
+#ifndef _CRESTA_VALUES_H_
+#define _CRESTA_VALUES_H_
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#include <stdbool.h>
+#endif
+
+#include "cresta_common.h"
+
+//sign nibbles of temperatures
+#define CRESTA_TEMPERATURE_NEGATIVE 0x4
+#define CRESTA_TEMPERATURE_POSITIVE 0xC
+
+/*
+ * Three BCD digits, the tens in the low nibble of byte[offset+1],
+ * ones and tenths in byte[offset], e.g. temperature
+ */
+static inline int cresta_bcd_tenths(const uint8_t *decrypted_data, uint8_t offset) {
+    return (decrypted_data[offset + 1] & 0x0F) * 100 + (decrypted_data[offset] >> 4) * 10 + (decrypted_data[offset] & 0x0F);
+}
+
+/*
+ * Three BCD digits starting at the high nibble of byte[offset+1],
+ * the tenths in the high nibble of byte[offset], e.g. wind gust
+ */
+static inline int cresta_bcd_tenths_high(const uint8_t *decrypted_data, uint8_t offset) {
+    return (decrypted_data[offset + 1] >> 4) * 100 + (decrypted_data[offset + 1] & 0x0F) * 10 + (decrypted_data[offset] >> 4);
+}
+
+/*
+ * Temperature in 0.1°C at offset, the sign is in the high nibble of
+ * byte[offset+1]. Signs other than CRESTA_TEMPERATURE_NEGATIVE are
+ * taken as positive, callers check cresta_temperature_sign_valid if
+ * they want to report them
+ */
+static inline int cresta_temperature_tenths(const uint8_t *decrypted_data, uint8_t offset) {
+    int tenths = cresta_bcd_tenths(decrypted_data, offset);
+
+    return (decrypted_data[offset + 1] >> 4) == CRESTA_TEMPERATURE_NEGATIVE ? -tenths : tenths;
+}
+
+static inline bool cresta_temperature_sign_valid(const uint8_t *decrypted_data, uint8_t offset) {
+    uint8_t sign = decrypted_data[offset + 1] >> 4;
+
+    return CRESTA_TEMPERATURE_NEGATIVE == sign || CRESTA_TEMPERATURE_POSITIVE == sign;
+}
+
+//thermohygro and anemometer, in 0.1°C
+static inline int cresta_thermohygro_temperature(const uint8_t *decrypted_data) {
+    return cresta_temperature_tenths(decrypted_data, 4);
+}
+
+//in %
+static inline int cresta_thermohygro_humidity(const uint8_t *decrypted_data) {
+    return (decrypted_data[6] >> 4) * 10 + (decrypted_data[6] & 0x0F);
+}
+
+static inline int cresta_anemometer_temperature(const uint8_t *decrypted_data) {
+    return cresta_temperature_tenths(decrypted_data, 4);
+}
+
+static inline int cresta_anemometer_windchill(const uint8_t *decrypted_data) {
+    return cresta_temperature_tenths(decrypted_data, 6);
+}
+
+//in 0.1 mph
+static inline int cresta_anemometer_windspeed(const uint8_t *decrypted_data) {
+    return cresta_bcd_tenths(decrypted_data, 8);
+}
+
+static inline int cresta_anemometer_windgust(const uint8_t *decrypted_data) {
+    return cresta_bcd_tenths_high(decrypted_data, 9);
+}
+
+/*
+ * Where the wind comes from in steps of 22.5°, clockwise from north.
+ * The high nibble of byte[11] is Gray coded and counts
+ * counterclockwise
+ */
+static inline int cresta_anemometer_wind_direction_steps(const uint8_t *decrypted_data) {
+    uint8_t count = decrypted_data[11] >> 4;
+
+    count ^= (count & 8) >> 1;
+    count ^= (count & 4) >> 1;
+    count ^= (count & 2) >> 1;
+    return -count & 0xF;
+}
+
+//in 0.1°
+static inline int cresta_anemometer_wind_direction(const uint8_t *decrypted_data) {
+    return cresta_anemometer_wind_direction_steps(decrypted_data) * 225;
+}
+
+//the UV sensor transmits no sign, in 0.1°C
+static inline int cresta_uv_absolute_temperature(const uint8_t *decrypted_data) {
+    return cresta_bcd_tenths(decrypted_data, 4);
+}
+
+//in 0.1 MED/h
+static inline int cresta_uv_medh(const uint8_t *decrypted_data) {
+    return cresta_bcd_tenths_high(decrypted_data, 5);
+}
+
+//in 0.1
+static inline int cresta_uv_index(const uint8_t *decrypted_data) {
+    return cresta_bcd_tenths(decrypted_data, 7);
+}
+
+//0 low to 4 extremely high
+static inline int cresta_uv_level(const uint8_t *decrypted_data) {
+    return decrypted_data[8] >> 4;
+}
+
+//binary, not BCD
+static inline uint16_t cresta_rain_ticks(const uint8_t *decrypted_data) {
+    return (decrypted_data[5] << 8) | decrypted_data[4];
+}
+
+//bits 7 and 6 of byte[2] are both set unless the battery is below 2.5V
+static inline bool cresta_battery_ok(const uint8_t *decrypted_data) {
+    return 0x03 == ((decrypted_data[2] >> 6) & 0x03);
+}
+
+#endif
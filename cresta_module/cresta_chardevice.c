@@ -21,20 +21,71 @@
 #include <linux/rculist.h>
 #include <linux/cdev.h>
 #include <linux/fs.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
 
-#include <asm/uaccess.h>
+#include <linux/uaccess.h>
 
 
 #include "cresta_chardevice.h"
 #include "cresta_interrupthandler.h"
+#include "cresta_sensor_mgmt.h"
 
 
-struct cresta_sensor_counts* sensor_counts;
+/*
+ * Device names in use per category, bit n set means name index n is
+ * taken. Names of removed sensors are released and reused, so names
+ * don't drift when sensors come and go
+ */
+static const char* const sensor_name_categories[CRESTA_NAME_CATEGORIES] = {
+    "cresta_thermohygro_ch1", "cresta_thermohygro_ch2", "cresta_thermohygro_ch3",
+    "cresta_thermohygro_ch4", "cresta_thermohygro_ch5", "cresta_anemometer",
+    "cresta_uv", "cresta_rain"
+};
+static DECLARE_BITMAP(sensor_names[CRESTA_NAME_CATEGORIES], CRESTA_SENSOR_ADDR_COUNT);
+//device entries are created by work items that may run in parallel
+static DEFINE_MUTEX(device_entry_mutex);
 static struct class* cresta_class;
 static int major;
 static int minors;
+//one character device for all sensors, the minor number is the sensor address
+static struct cdev cresta_cdev;
+static bool cdev_added;
+//woken for every new measurement and removed sensor, see cresta_poll
+static DECLARE_WAIT_QUEUE_HEAD(measurement_wait);
+
+/*
+ * Per reader state. The lock keeps reads from seeing the copy while
+ * it is refreshed, in case a file is shared
+ */
+struct cresta_reader {
+  struct mutex lock;
+  struct cresta_measurement_record record;
+};
+
+
+
+/*
+ * Writing address:type[:data[:seconds]] to /sys/class/cresta/seed
+ * creates a sensor, see cresta_seed_sensor
+ */
+static ssize_t cresta_seed_store(struct class *class, struct class_attribute *attr, const char *buf, size_t count) {
+  char spec[CRESTA_SEED_SPEC_LEN];
+  int error;
 
+  if(count >= sizeof(spec)) {
+    return -EINVAL;
+  }
+  memcpy(spec, buf, count);
+  spec[count] = '\0';
 
+  error = cresta_seed_sensor(spec);
+  return error ? error : count;
+}
+//CLASS_ATTR is gone since 4.13
+static struct class_attribute class_attr_seed = __ATTR(seed, 0200, NULL, cresta_seed_store);
+static bool seed_attr_created;
 
 /*
  * Initializes the part of the kernel module responsible
@@ -48,39 +99,69 @@ int cresta_chardevice_init() {
     int error;
     dev_t dev;
     
-     sensor_counts = kzalloc(sizeof(struct cresta_sensor_counts), GFP_KERNEL);
-     if(NULL == sensor_counts) {
-       printk(KERN_ERR "Cannot allocate memory for sensor_counts\n");
-       return -1;
-     } 
-
-    
-    error = alloc_chrdev_region(&dev, 0, CRESTA_MAX_SENSOR_COUNT, "cresta");
+    error = alloc_chrdev_region(&dev, 0, CRESTA_SENSOR_ADDR_COUNT, "cresta");
     
     if(!error) {
       major = MAJOR(dev);
-      minors = CRESTA_MAX_SENSOR_COUNT;
+      minors = CRESTA_SENSOR_ADDR_COUNT;
       //printk(KERN_INFO "Got major number %d\n", major);
     } else {
       printk(KERN_ERR "Failed to get cresta device numbers\n");
       return -1;
     }
+
+    cdev_init(&cresta_cdev, &cresta_fops);
+    cresta_cdev.owner = THIS_MODULE;
+    if(cdev_add(&cresta_cdev, dev, minors)) {
+      printk(KERN_ERR "Error during cdev_add\n");
+      return -1;
+    }
+    cdev_added = true;
     cresta_class = class_create(THIS_MODULE, "cresta");
+    if(IS_ERR(cresta_class)) {
+      printk(KERN_ERR "Failed to create cresta device class\n");
+      cresta_class = NULL;
+      return -1;
+    }
     cresta_class->dev_uevent = cresta_dev_uevent;
+
+    if(class_create_file(cresta_class, &class_attr_seed)) {
+      printk(KERN_WARNING "Failed to create /sys/class/cresta/seed\n");
+    } else {
+      seed_attr_created = true;
+    }
     return 0;
 }
 
+/*
+ * Removes /sys/class/cresta/seed. Once this returns, no seed write is
+ * running any more and none can start, so sensor management can be
+ * torn down
+ */
+void cresta_chardevice_remove_seed() {
+    if(seed_attr_created) {
+      class_remove_file(cresta_class, &class_attr_seed);
+      seed_attr_created = false;
+    }
+}
+
 /*
  * Cleans up the part of the kernel module responsible
  * for character device handling
  */
 void cresta_chardevice_cleanup() {
+    if(cdev_added) {
+      cdev_del(&cresta_cdev);
+      cdev_added = false;
+    }
     if(major) {
       unregister_chrdev_region(MKDEV(major, 0), minors);
     }
     
-     kfree(sensor_counts);
-     class_destroy(cresta_class);
+     cresta_chardevice_remove_seed();
+     if(NULL != cresta_class) {
+       class_destroy(cresta_class);
+     }
      cresta_class = NULL;
 }
 
@@ -106,7 +187,7 @@ int cresta_open(struct inode *inode, struct file *filp)
    * context switches to user space).
    * What probably _would_ work are reader/writer locks.
    * Reader lock set in cresta_open(), unset in cresta_close(). However,
-   * this might block writer in update_cresta_sensor_data().
+   * this might block writer in handle_decrypted_sensor_data().
    * 
    * As I don't want the update to be blocked by the userspace read access,
    * I decided to take the following approach: make a per reader copy of the data
@@ -115,22 +196,34 @@ int cresta_open(struct inode *inode, struct file *filp)
    * at hand, as we only transfer a few bytes.
    */ 
 
-  struct cresta_dev *dev = container_of(inode->i_cdev, struct cresta_dev, cdev);
-  struct measurement *reader_copy = kmalloc(sizeof(struct measurement), GFP_KERNEL);
+  struct cresta_dev *dev = NULL;
+  struct cresta_reader *reader_copy = kmalloc(sizeof(struct cresta_reader), GFP_KERNEL);
   struct cresta_measurement_data *data = NULL;
+
+  if(NULL == reader_copy) {
+    return -ENOMEM;
+  }
+  mutex_init(&reader_copy->lock);
+
   rcu_read_lock();
+  //the minor number is the sensor address
+  dev = get_cresta_sensor_by_address_rcu(iminor(inode));
+  if(NULL == dev) {
+    rcu_read_unlock();
+    kfree(reader_copy);
+    return -ENODEV;
+  }
   data = rcu_dereference(dev->current_data);
   /*
-   * We have a race condition here: if a sensor was just created and the code
-   * for updating the sensor data wasn't executed yet, measurement data
-   * can be NULL. Although very unlikely, we catch this here
+   * Sensors created by seeding have no measurement data until
+   * they transmit for the first time
    */
   if(NULL == data) {
+    rcu_read_unlock();
     kfree(reader_copy);
-    return -ERESTARTSYS;
-  } else if (NULL != reader_copy) {
-    memcpy(reader_copy, &data->measurement, sizeof(struct measurement));
+    return -ENODATA;
   }
+  memcpy(&reader_copy->record, &data->measurement, sizeof(struct cresta_measurement_record));
   rcu_read_unlock();
   
   filp->private_data = reader_copy;
@@ -159,7 +252,7 @@ loff_t cresta_llseek(struct file *filp, loff_t off, int whence)
     case 2: { /* SEEK_END */
       //NOTE: we always copy complete measurement struct, even if
       //acutal data of current sensor is < CRESTA_MAXDATA_LEN
-      newpos = sizeof(struct measurement) + off;
+      newpos = sizeof(struct cresta_measurement_record) + off;
       break;
     }
 
@@ -179,30 +272,52 @@ loff_t cresta_llseek(struct file *filp, loff_t off, int whence)
 
 int cresta_release(struct inode *inode, struct file *filp)
 {
-  struct measurement *reader_copy = (struct measurement*) filp->private_data;
+  struct cresta_reader *reader_copy = (struct cresta_reader*) filp->private_data;
   kfree(reader_copy);
   return 0;
 }
 
 /*
- * Read from character device file and copy data to userspace
+ * Read from character device file and copy data to userspace.
+ * Reading from offset 0 refreshes the reader's copy, so watchers can
+ * keep the file open and read again at the start once poll reports
+ * new data. Reads at other offsets keep using the same copy, so
+ * a record read in pieces stays consistent
  */
 ssize_t cresta_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos)
 {
-  struct measurement *data = (struct measurement*) filp->private_data;
+  struct cresta_reader *reader = (struct cresta_reader*) filp->private_data;
+  struct cresta_measurement_record *data = &reader->record;
   ssize_t retval = 0;
-  uint8_t maxbytes = sizeof(struct measurement);
+  uint8_t maxbytes = sizeof(struct cresta_measurement_record);
   if (*f_pos >= maxbytes)
     goto out;
   
-  //note: we have to change this when we add timestamp to raw data
   if (*f_pos + count > maxbytes) {
     count = maxbytes - *f_pos;
   }
+  mutex_lock(&reader->lock);
+  if(0 == *f_pos) {
+    struct cresta_dev *dev;
+    struct cresta_measurement_data *current_data;
+
+    rcu_read_lock();
+    //removed sensors keep the last record
+    dev = get_cresta_sensor_by_address_rcu(iminor(file_inode(filp)));
+    if(NULL != dev) {
+      current_data = rcu_dereference(dev->current_data);
+      if(NULL != current_data) {
+	memcpy(data, &current_data->measurement, sizeof(struct cresta_measurement_record));
+      }
+    }
+    rcu_read_unlock();
+  }
   if(copy_to_user(buf, (void*)(data) + *f_pos, count)) {
+    mutex_unlock(&reader->lock);
     retval = -EFAULT;
     goto out;
   }
+  mutex_unlock(&reader->lock);
   *f_pos += count;
   retval = count;
 
@@ -210,6 +325,48 @@ ssize_t cresta_read(struct file *filp, char __user *buf, size_t count, loff_t *f
 	return retval;
 }
 
+/*
+ * Readable once the sensor has a measurement the reader's copy
+ * doesn't hold yet, hung up once the sensor was removed
+ */
+static unsigned int cresta_poll(struct file *filp, poll_table *wait)
+{
+  struct cresta_reader *reader = (struct cresta_reader*) filp->private_data;
+  struct cresta_measurement_data *current_data;
+  struct cresta_dev *dev;
+  unsigned int mask = 0;
+
+  poll_wait(filp, &measurement_wait, wait);
+
+  mutex_lock(&reader->lock);
+  rcu_read_lock();
+  dev = get_cresta_sensor_by_address_rcu(iminor(file_inode(filp)));
+  if(NULL == dev) {
+    mask = POLLHUP;
+  } else {
+    current_data = rcu_dereference(dev->current_data);
+    //the timestamp tells sensors apart that were removed and came back
+    if(NULL != current_data && (current_data->measurement.sequence != reader->record.sequence ||
+			       current_data->measurement.timestamp_ns != reader->record.timestamp_ns)) {
+      mask = POLLIN | POLLRDNORM;
+    }
+  }
+  rcu_read_unlock();
+  mutex_unlock(&reader->lock);
+  return mask;
+}
+
+/*
+ * Wakes up readers waiting in poll, called after a sensor got a new
+ * measurement or was removed
+ */
+void cresta_chardevice_notify(void)
+{
+  if(waitqueue_active(&measurement_wait)) {
+    wake_up_interruptible(&measurement_wait);
+  }
+}
+
 /*
  * File operations the cresta character devices support
  */ 
@@ -217,6 +374,7 @@ struct file_operations cresta_fops = {
 	.owner =    THIS_MODULE,
 	.llseek =   cresta_llseek,
 	.read =     cresta_read,
+	.poll =     cresta_poll,
 	.open =     cresta_open,
 	.release =  cresta_release,
 };
@@ -231,102 +389,67 @@ int cresta_dev_uevent(struct device *dev, struct kobj_uevent_env *env)
 /*
  * Register character device and create entry in /dev
  */
-void make_device_entry(struct cresta_dev* crestadev) {
-  int error = 0; 
- 
-  cdev_init(&crestadev->cdev, &cresta_fops);
-  crestadev->cdev.owner = THIS_MODULE;
-  crestadev->cdev.ops = &cresta_fops;
-  
+int make_device_entry(struct cresta_dev* crestadev) {
+  const char *base = cresta_sensor_base_name(crestadev->sensor_type, crestadev->sensor_addr);
+  struct device *device;
+  int category;
+  int index;
+
+  //the character device already covers all minors
   crestadev->dev = MKDEV(major, crestadev->sensor_addr); //sensor addresses are unique, we use it for minor number
-  error = cdev_add(&crestadev->cdev, crestadev->dev, 1);
-  if(error) {
-    printk(KERN_INFO "Error during cdev_add\n");
-  } else {
-    //for showing up in /dev/...
-    
-    /*
-     * Determine device name. Goal is to keep it consistent with 
-     * naming scheme of weather station (e.g. temperature sensors
-     * numbered by channel.
-     * However: theoretically we could support up to 255 devices, e.g.
-     * by operating multiple temperature sensors on same channel. As this
-     * operation mode isn't intended by device manufacturer, we loosen
-     * device naming policies in that case. Example: two temperature sensors (A+B)
-     * operating on channel one: one sensor is guaranteed to get ID1.
-     * Other sensor gets an ID > 5
-     */
-    
-    switch(crestadev->sensor_type) {
-	case CRESTA_SENSOR_TYPE_ANEMOMETER: {
-	  if(++sensor_counts->anemometer_count == 1) {
-	    device_create(cresta_class, NULL, crestadev->dev, NULL, "%s", "cresta_anemometer");
-	  } else {
-	    device_create(cresta_class, NULL, crestadev->dev, NULL, "%s_%d", "cresta_anemometer", sensor_counts->anemometer_count + 1);
-	  }
-	  break;
-	}
-	case CRESTA_SENSOR_TYPE_UV: {
-	  if(++sensor_counts->uv_count == 1) {
-	     device_create(cresta_class, NULL, crestadev->dev, NULL, "%s", "cresta_uv");
-	  } else {
-	     device_create(cresta_class, NULL, crestadev->dev, NULL, "%s_%d", "cresta_uv", sensor_counts->uv_count);
-	  }
-	  break;
-	}
-	case CRESTA_SENSOR_TYPE_RAIN: {
-	  if(++sensor_counts->rain_count == 1) {
-	     device_create(cresta_class, NULL, crestadev->dev, NULL, "%s", "cresta_rain");
-	  } else {
-	     device_create(cresta_class, NULL, crestadev->dev, NULL, "%s_%d", "cresta_uv", sensor_counts->rain_count);
-	  }
-	  break;
-	}
-	case CRESTA_SENSOR_TYPE_THERMOHYGRO: {
-	  //printk(KERN_INFO "sensor_addr = %x, sensor_addr & %x = %x\n", crestadev->sensor_addr, CRESTA_SENSOR_ADDR_MASK, crestadev->sensor_addr & CRESTA_SENSOR_ADDR_MASK);
-	  if ((crestadev->sensor_addr & CRESTA_SENSOR_ADDR_MASK) == CRESTA_AM_THERMOHYGRO_CH5) {
-	    if(++sensor_counts->thermohygro_ch5_count == 1) {
-	      device_create(cresta_class, NULL, crestadev->dev, NULL, "%s", "cresta_thermohygro_ch5");
-	    } else {
-	      device_create(cresta_class, NULL, crestadev->dev, NULL, "%s_%d", "cresta_thermohygro_ch5", sensor_counts->thermohygro_ch5_count);
-	    }
-	  } else if ((crestadev->sensor_addr & CRESTA_SENSOR_ADDR_MASK) == CRESTA_AM_THERMOHYGRO_CH4) {
-	    if(++sensor_counts->thermohygro_ch4_count == 1) {
-	      device_create(cresta_class, NULL, crestadev->dev, NULL, "%s", "cresta_thermohygro_ch4");
-	    } else {
-	      device_create(cresta_class, NULL, crestadev->dev, NULL, "%s_%d", "cresta_thermohygro_ch4", sensor_counts->thermohygro_ch4_count);
-	    }
-	  } else if ((crestadev->sensor_addr & CRESTA_SENSOR_ADDR_MASK) == CRESTA_AM_THERMOHYGRO_CH3) {
-	    if(++sensor_counts->thermohygro_ch3_count == 1) {
-	      device_create(cresta_class, NULL, crestadev->dev, NULL, "%s", "cresta_thermohygro_ch3");
-	    } else {
-	      device_create(cresta_class, NULL, crestadev->dev, NULL, "%s_%d", "cresta_thermohygro_ch3", sensor_counts->thermohygro_ch3_count);
-	    }
-	  } else if ((crestadev->sensor_addr & CRESTA_SENSOR_ADDR_MASK) == CRESTA_AM_THERMOHYGRO_CH2) {
-	    if(++sensor_counts->thermohygro_ch2_count == 1) {
-	      device_create(cresta_class, NULL, crestadev->dev, NULL, "%s", "cresta_thermohygro_ch2");
-	    } else {
-	      device_create(cresta_class, NULL, crestadev->dev, NULL, "%s_%d", "cresta_thermohygro_ch2", sensor_counts->thermohygro_ch2_count);
-	    }
-	  } else if((crestadev->sensor_addr & CRESTA_SENSOR_ADDR_MASK) == CRESTA_AM_THERMOHYGRO_CH1) {
-	    if(++sensor_counts->thermohygro_ch1_count == 1) {
-	      device_create(cresta_class, NULL, crestadev->dev, NULL, "%s", "cresta_thermohygro_ch1");
-	    } else {
-	      device_create(cresta_class, NULL, crestadev->dev, NULL, "%s_%d", "cresta_thermohygro_ch1", sensor_counts->thermohygro_ch1_count);
-	    }
-	  }
-	  break;
-	}
-	
-      } //switch
+  //for showing up in /dev/...
+  
+  /*
+   * Determine device name. Goal is to keep it consistent with 
+   * naming scheme of weather station (e.g. temperature sensors
+   * numbered by channel.
+   * However: theoretically we could support up to 255 devices, e.g.
+   * by operating multiple temperature sensors on same channel. As this
+   * operation mode isn't intended by device manufacturer, we loosen
+   * device naming policies in that case. Example: two temperature sensors (A+B)
+   * operating on channel one: one sensor is guaranteed to get the name
+   * without index, the other one gets cresta_thermohygro_ch1_2
+   */
+  if(NULL == base) {
+    printk(KERN_WARNING "No device name for sensor %x of type %x\n", crestadev->sensor_addr, crestadev->sensor_type);
+    return -1;
+  }
+  for(category = 0; category < CRESTA_NAME_CATEGORIES; category++) {
+    if(0 == strcmp(sensor_name_categories[category], base)) {
+      break;
     }
+  }
+  if(category == CRESTA_NAME_CATEGORIES) {
+    return -1;
+  }
+
+  mutex_lock(&device_entry_mutex);
+  index = find_first_zero_bit(sensor_names[category], CRESTA_SENSOR_ADDR_COUNT);
+  set_bit(index, sensor_names[category]);
+  mutex_unlock(&device_entry_mutex);
+
+  if(0 == index) {
+    device = device_create(cresta_class, NULL, crestadev->dev, NULL, "%s", base);
+  } else {
+    device = device_create(cresta_class, NULL, crestadev->dev, NULL, "%s_%d", base, index + 1);
+  }
+  if(IS_ERR(device)) {
+    printk(KERN_ERR "Error during device_create\n");
+    clear_bit(index, sensor_names[category]);
+    return -1;
+  }
+
+  crestadev->name_category = category;
+  crestadev->name_index    = index;
+  return 0;
 }
 
 /*
- * Delete character device and remove entry in /dev
+ * Remove entry in /dev
  */ 
 void remove_device_entry(struct cresta_dev* crestadev) {
   
   device_destroy(cresta_class, crestadev->dev);
-  cdev_del(&crestadev->cdev);
+  //name can be used by the next sensor of the category
+  clear_bit(crestadev->name_index, sensor_names[crestadev->name_category]);
 }
@@ -23,53 +23,51 @@
 #include <linux/list.h>
 #include <linux/cdev.h>
 #include <linux/device.h>
+#include <linux/workqueue.h>
 #include "../cresta_common/cresta_common.h"
 
-#define CRESTA_MAX_SENSOR_COUNT 255
+#define CRESTA_SENSOR_ADDR_COUNT 256	//sensor addresses are 8 bit
+#define CRESTA_NAME_CATEGORIES   8	//thermohygro ch1-5, anemometer, UV, rain
 
+struct iio_dev;
 
 /*
- * We create a character device per sensor.
- * Sensor count is used when assigning a name
- * to the sensor.
+ * We create a character device per sensor, its minor
+ * number is the sensor address.
+ * The name comes from the sensor type plus the lowest
+ * index still free within that name category, see
+ * make_device_entry.
  * Typically a weather station only supports one sensor
  * per "channel" or sensor type.
  * With our approach we're able to support up to
- * 255 sensors (entire address space)
+ * 256 sensors (entire address space)
  */ 
-struct cresta_sensor_counts {
-    uint8_t thermohygro_ch1_count;
-    uint8_t thermohygro_ch2_count;
-    uint8_t thermohygro_ch3_count;
-    uint8_t thermohygro_ch4_count;
-    uint8_t thermohygro_ch5_count;
-    uint8_t anemometer_count;
-    uint8_t uv_count;
-    uint8_t rain_count;  
-};
-
-/*
- * Internal representation of a sensor.
- * Note: sensors are stored in a simple linked list
- */
-
 struct cresta_dev {
-    struct list_head list;
     uint8_t	sensor_addr;
     uint8_t	sensor_type;
-    struct cdev cdev; //character device belonging to sensor
     dev_t       dev;
-    struct mutex measurement_data_mutex;
+    struct work_struct devnode_work; //creates /dev entry
+    bool        has_device_entry;
+    uint8_t     name_category;	//device name, see make_device_entry
+    uint8_t     name_index;
+    unsigned long last_seen;	//jiffies of the last measurement
+    uint64_t    sequence;	//number of the last measurement received
+    struct iio_dev *iio;	//NULL without IIO, see cresta_iio.h
+    struct list_head list;	//while being removed, see remove_cresta_sensors
     struct cresta_measurement_data* current_data;
 };
 
 
+extern struct file_operations cresta_fops;
+
 int cresta_chardevice_init(void);
 void cresta_chardevice_cleanup(void);
+void cresta_chardevice_remove_seed(void);
+void cresta_chardevice_notify(void);
 
 
 void remove_device_entry(struct cresta_dev* crestadev);
-void make_device_entry(struct cresta_dev* crestadev);
+int  make_device_entry(struct cresta_dev* crestadev);
 
 int cresta_dev_uevent(struct device *dev, struct kobj_uevent_env *env);
 
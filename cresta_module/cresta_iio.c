@@ -0,0 +1,277 @@
+/*
+ * Module for receiving and decoding of wireless weather station
+ * sensor data (433MHz). Protocol used by Cresta/Irox/Mebus/Nexus/
+ * Honeywell/Hideki/TFA weather stations.
+ * 
+ * Protocol was reverse engineered by Ruud v Gessel
+,* and documented in "Cresta weather sensor protocol", see
+ * http://members.upc.nl/m.beukelaar/Crestaprotocol.pdf
+ *
+ * This module utilizes code of the Arduino
+ * decoder library "433MHzForArduino" for decoding the sensor data,
+ * see https://bitbucket.org/fuzzillogic/433mhzforarduino
+ *
+ * License: GPLv3. See license.txt
+ */
+
+/*
+ * IIO device per sensor, so standard IIO tools read the values
+ * without knowing the datagram format. Channels are raw values in the
+ * units the sensors transmit, decoded in fixed point by
+ * cresta_values.h, with the scale to IIO's units: temperatures in
+ * 0.1°C, humidity in %, wind speed and gust in 0.1 mph, wind direction
+ * in 0.1° and the UV index in 0.1.
+ *
+ * Reading in_*_raw returns the sensor's current measurement. The
+ * buffer gets every new measurement, with its receive time as
+ * timestamp, e.g. via iio_readdev.
+ */
+
+#include "cresta_iio.h"
+
+#ifdef CRESTA_IIO
+
+#include <linux/module.h>
+#include <linux/bitops.h>
+#include <linux/rcupdate.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/kfifo_buf.h>
+
+#include "../cresta_common/cresta_values.h"
+
+//what a channel returns, kept in its address
+enum cresta_iio_value {
+    CRESTA_IIO_TEMPERATURE,
+    CRESTA_IIO_HUMIDITY,
+    CRESTA_IIO_WINDCHILL,
+    CRESTA_IIO_WINDSPEED,
+    CRESTA_IIO_WINDGUST,
+    CRESTA_IIO_WIND_DIRECTION,
+    CRESTA_IIO_UV_TEMPERATURE,
+    CRESTA_IIO_UV_INDEX
+};
+
+struct cresta_iio {
+    struct cresta_dev *sensor;	//outlives the IIO device
+};
+
+#define CRESTA_IIO_CHANNEL(_type, _index, _modifier, _name, _value, _scan, _sign) { \
+    .type = _type, \
+    .indexed = 1, \
+    .channel = _index, \
+    .modified = IIO_NO_MOD != _modifier, \
+    .channel2 = _modifier, \
+    .extend_name = _name, \
+    .address = _value, \
+    .info_mask_separate = BIT(IIO_CHAN_INFO_RAW) | BIT(IIO_CHAN_INFO_SCALE), \
+    .scan_index = _scan, \
+    .scan_type = { \
+	.sign = _sign, \
+	.realbits = 16, \
+	.storagebits = 16, \
+	.endianness = IIO_CPU, \
+    }, \
+}
+
+//wind is the speed in the horizontal plane
+#define CRESTA_IIO_WIND IIO_MOD_ROOT_SUM_SQUARED_X_Y
+
+static const struct iio_chan_spec thermohygro_channels[] = {
+    CRESTA_IIO_CHANNEL(IIO_TEMP, 0, IIO_NO_MOD, NULL, CRESTA_IIO_TEMPERATURE, 0, 's'),
+    CRESTA_IIO_CHANNEL(IIO_HUMIDITYRELATIVE, 0, IIO_NO_MOD, NULL, CRESTA_IIO_HUMIDITY, 1, 'u'),
+    IIO_CHAN_SOFT_TIMESTAMP(2),
+};
+
+static const struct iio_chan_spec anemometer_channels[] = {
+    CRESTA_IIO_CHANNEL(IIO_TEMP, 0, IIO_NO_MOD, NULL, CRESTA_IIO_TEMPERATURE, 0, 's'),
+    CRESTA_IIO_CHANNEL(IIO_TEMP, 1, IIO_NO_MOD, "windchill", CRESTA_IIO_WINDCHILL, 1, 's'),
+    CRESTA_IIO_CHANNEL(IIO_VELOCITY, 0, CRESTA_IIO_WIND, NULL, CRESTA_IIO_WINDSPEED, 2, 'u'),
+    CRESTA_IIO_CHANNEL(IIO_VELOCITY, 1, CRESTA_IIO_WIND, "gust", CRESTA_IIO_WINDGUST, 3, 'u'),
+    CRESTA_IIO_CHANNEL(IIO_ANGL, 0, IIO_NO_MOD, NULL, CRESTA_IIO_WIND_DIRECTION, 4, 'u'),
+    IIO_CHAN_SOFT_TIMESTAMP(5),
+};
+
+static const struct iio_chan_spec uv_channels[] = {
+    CRESTA_IIO_CHANNEL(IIO_TEMP, 0, IIO_NO_MOD, NULL, CRESTA_IIO_UV_TEMPERATURE, 0, 'u'),
+    CRESTA_IIO_CHANNEL(IIO_UVINDEX, 0, IIO_NO_MOD, NULL, CRESTA_IIO_UV_INDEX, 1, 'u'),
+    IIO_CHAN_SOFT_TIMESTAMP(2),
+};
+
+
+static int cresta_iio_value(const uint8_t *decrypted_data, unsigned long value) {
+    switch(value) {
+	case CRESTA_IIO_TEMPERATURE:    return cresta_thermohygro_temperature(decrypted_data);
+	case CRESTA_IIO_HUMIDITY:       return cresta_thermohygro_humidity(decrypted_data);
+	case CRESTA_IIO_WINDCHILL:      return cresta_anemometer_windchill(decrypted_data);
+	case CRESTA_IIO_WINDSPEED:      return cresta_anemometer_windspeed(decrypted_data);
+	case CRESTA_IIO_WINDGUST:       return cresta_anemometer_windgust(decrypted_data);
+	case CRESTA_IIO_WIND_DIRECTION: return cresta_anemometer_wind_direction(decrypted_data);
+	case CRESTA_IIO_UV_TEMPERATURE: return cresta_uv_absolute_temperature(decrypted_data);
+	case CRESTA_IIO_UV_INDEX:       return cresta_uv_index(decrypted_data);
+    }
+    return 0;
+}
+
+/*
+ * Scales from the transmitted units to IIO's: milli °C, milli %, m/s,
+ * radians and UV index
+ */
+static int cresta_iio_scale(const struct iio_chan_spec *chan, int *val, int *val2) {
+    switch(chan->type) {
+	case IIO_TEMP: {
+	    *val = 100;
+	    return IIO_VAL_INT;
+	}
+	case IIO_HUMIDITYRELATIVE: {
+	    *val = 1000;
+	    return IIO_VAL_INT;
+	}
+	case IIO_VELOCITY: {
+	    //0.1 mph
+	    *val = 0;
+	    *val2 = 44704;
+	    return IIO_VAL_INT_PLUS_MICRO;
+	}
+	case IIO_ANGL: {
+	    //0.1° = pi / 1800
+	    *val = 0;
+	    *val2 = 1745329;
+	    return IIO_VAL_INT_PLUS_NANO;
+	}
+	case IIO_UVINDEX: {
+	    *val = 0;
+	    *val2 = 100000;
+	    return IIO_VAL_INT_PLUS_MICRO;
+	}
+	default: {
+	    return -EINVAL;
+	}
+    }
+}
+
+static int cresta_iio_read_raw(struct iio_dev *indio_dev, struct iio_chan_spec const *chan,
+			       int *val, int *val2, long mask) {
+    struct cresta_iio *priv = iio_priv(indio_dev);
+    struct cresta_measurement_data *data;
+
+    switch(mask) {
+	case IIO_CHAN_INFO_RAW: {
+	    rcu_read_lock();
+	    data = rcu_dereference(priv->sensor->current_data);
+	    //seeded sensors may have no measurement yet
+	    if(NULL == data) {
+		rcu_read_unlock();
+		return -ENODATA;
+	    }
+	    *val = cresta_iio_value(data->measurement.decrypted_data, chan->address);
+	    rcu_read_unlock();
+	    return IIO_VAL_INT;
+	}
+	case IIO_CHAN_INFO_SCALE: {
+	    return cresta_iio_scale(chan, val, val2);
+	}
+    }
+    return -EINVAL;
+}
+
+static const struct iio_info cresta_iio_info = {
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 13, 0)
+    .driver_module = THIS_MODULE,
+#endif
+    .read_raw = cresta_iio_read_raw,
+};
+
+
+struct iio_dev* cresta_iio_create(struct cresta_dev *sensor) {
+    const struct iio_chan_spec *channels;
+    struct iio_buffer *buffer;
+    struct iio_dev *indio_dev;
+    struct cresta_iio *priv;
+    int count;
+
+    //rain gauges only count ticks, there is no standard channel for that
+    switch(sensor->sensor_type) {
+	case CRESTA_SENSOR_TYPE_THERMOHYGRO: {
+	    channels = thermohygro_channels;
+	    count = ARRAY_SIZE(thermohygro_channels);
+	    break;
+	}
+	case CRESTA_SENSOR_TYPE_ANEMOMETER: {
+	    channels = anemometer_channels;
+	    count = ARRAY_SIZE(anemometer_channels);
+	    break;
+	}
+	case CRESTA_SENSOR_TYPE_UV: {
+	    channels = uv_channels;
+	    count = ARRAY_SIZE(uv_channels);
+	    break;
+	}
+	default: {
+	    return NULL;
+	}
+    }
+
+    indio_dev = iio_device_alloc(sizeof(struct cresta_iio));
+    buffer = iio_kfifo_allocate();
+    if(NULL == indio_dev || NULL == buffer) {
+	goto err;
+    }
+    priv = iio_priv(indio_dev);
+    priv->sensor = sensor;
+    indio_dev->name = cresta_sensor_base_name(sensor->sensor_type, sensor->sensor_addr);
+    indio_dev->info = &cresta_iio_info;
+    indio_dev->channels = channels;
+    indio_dev->num_channels = count;
+    indio_dev->modes = INDIO_DIRECT_MODE | INDIO_BUFFER_SOFTWARE;
+    iio_device_attach_buffer(indio_dev, buffer);
+
+    if(iio_device_register(indio_dev)) {
+	goto err;
+    }
+    return indio_dev;
+
+err:
+    printk(KERN_WARNING "Couldn't create IIO device of sensor %#x\n", sensor->sensor_addr);
+    if(NULL != buffer) {
+	iio_kfifo_free(buffer);
+    }
+    if(NULL != indio_dev) {
+	iio_device_free(indio_dev);
+    }
+    return NULL;
+}
+
+void cresta_iio_remove(struct iio_dev *indio_dev) {
+    if(NULL == indio_dev) {
+	return;
+    }
+    iio_device_unregister(indio_dev);
+    iio_kfifo_free(indio_dev->buffer);
+    iio_device_free(indio_dev);
+}
+
+/*
+ * Called under the sensor's update lock. The buffer takes the values
+ * of the enabled channels only, in scan order
+ */
+void cresta_iio_push(struct iio_dev *indio_dev, const struct cresta_measurement_record *record) {
+    //values padded to the timestamp's alignment, followed by it
+    s16 scan[ALIGN(CRESTA_IIO_MAX_VALUES, 4) + 4] __aligned(8);
+    int bit;
+    int i = 0;
+
+    if(NULL == indio_dev || !iio_buffer_enabled(indio_dev)) {
+	return;
+    }
+    for_each_set_bit(bit, indio_dev->active_scan_mask, indio_dev->masklength) {
+	const struct iio_chan_spec *chan = &indio_dev->channels[bit];
+
+	if(IIO_TIMESTAMP != chan->type) {
+	    scan[i++] = cresta_iio_value(record->decrypted_data, chan->address);
+	}
+    }
+    iio_push_to_buffers_with_timestamp(indio_dev, scan, record->timestamp_ns);
+}
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ * Module for receiving and decoding of wireless weather station
+ * sensor data (433MHz). Protocol used by Cresta/Irox/Mebus/Nexus/
+ * Honeywell/Hideki/TFA weather stations.
+ * 
+ * Protocol was reverse engineered by Ruud v Gessel
+,* and documented in "Cresta weather sensor protocol", see
+ * http://members.upc.nl/m.beukelaar/Crestaprotocol.pdf
+ *
+ * This module utilizes code of the Arduino
+ * decoder library "433MHzForArduino" for decoding the sensor data,
+ * see https://bitbucket.org/fuzzillogic/433mhzforarduino
+ *
+ * License: GPLv3. See license.txt
+ */
+
+
+#ifndef _CRESTA_IIO_H_
+#define _CRESTA_IIO_H_
+
+#include <linux/kernel.h>
+#include <linux/version.h>
+#include "cresta_chardevice.h"
+
+/*
+ * Sensors get an IIO device if the kernel has the channel types for
+ * humidity, speed and UV index (4.6) and iio_device_alloc doesn't
+ * take a parent yet (before 5.10). Otherwise only the character
+ * devices are there. The rest of the module builds on 3.12 to 6.1,
+ * so this range is covered entirely
+ */
+#if IS_ENABLED(CONFIG_IIO) && LINUX_VERSION_CODE >= KERNEL_VERSION(4, 6, 0) && \
+    LINUX_VERSION_CODE < KERNEL_VERSION(5, 10, 0)
+#define CRESTA_IIO 1
+#endif
+
+//values of the sensor type with the most channels, the anemometer
+#define CRESTA_IIO_MAX_VALUES 5
+
+struct iio_dev;
+
+#ifdef CRESTA_IIO
+
+/*
+ * Creates the IIO device of a sensor. Returns NULL for sensors without
+ * standard channels (rain gauges) and on errors, the sensor works
+ * without it
+ */
+struct iio_dev* cresta_iio_create(struct cresta_dev *sensor);
+void            cresta_iio_remove(struct iio_dev *indio_dev);
+
+//passes a new measurement to the buffer, if it is enabled
+void            cresta_iio_push(struct iio_dev *indio_dev, const struct cresta_measurement_record *record);
+
+#else
+
+static inline struct iio_dev* cresta_iio_create(struct cresta_dev *sensor) { return NULL; }
+static inline void cresta_iio_remove(struct iio_dev *indio_dev) { }
+static inline void cresta_iio_push(struct iio_dev *indio_dev, const struct cresta_measurement_record *record) { }
+
+#endif
+
+
+#endif
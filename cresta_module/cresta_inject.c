@@ -0,0 +1,156 @@
+/*
+ * Module for receiving and decoding of wireless weather station
+ * sensor data (433MHz). Protocol used by Cresta/Irox/Mebus/Nexus/
+ * Honeywell/Hideki/TFA weather stations.
+ * 
+ * Protocol was reverse engineered by Ruud v Gessel
+,* and documented in "Cresta weather sensor protocol", see
+ * http://members.upc.nl/m.beukelaar/Crestaprotocol.pdf
+ *
+ * This module utilizes code of the Arduino
+ * decoder library "433MHzForArduino" for decoding the sensor data,
+ * see https://bitbucket.org/fuzzillogic/433mhzforarduino
+ *
+ * License: GPLv3. See license.txt
+ */
+
+/*
+ * Injection of datagrams and edges via debugfs, so the pipeline can be
+ * load tested without a radio (see cresta_userspace/cresta_load.c):
+ *
+ * /sys/kernel/debug/cresta/inject_datagrams takes raw datagrams of
+ * CRESTA_MAXDATA_LEN bytes as the manchester decoder would produce them
+ * and queues them for decryption.
+ *
+ * /sys/kernel/debug/cresta/inject_edges takes edge durations in us as
+ * uint32_t (see cresta_gen -f dur32). They are decoded by a manchester
+ * decoder of their own, so they don't disturb the live decoder.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/debugfs.h>
+#include <linux/mutex.h>
+
+#include <linux/uaccess.h>
+
+#include "../cresta_common/cresta_protocol.h"
+#include "cresta_inject.h"
+#include "cresta_interrupthandler.h"
+
+static struct dentry *inject_dir;
+
+//decoder for injected edges, writers are serialized by inject_mutex
+static struct cresta_manchester_multi inject_decoder;
+static DEFINE_MUTEX(inject_mutex);
+
+//statistics, see /sys/kernel/debug/cresta, protected by inject_mutex
+static uint32_t datagrams_injected;
+static uint32_t datagrams_rejected;	//rawdata FIFO was full
+
+
+/*
+ * Queues complete datagrams. Returns the number of bytes consumed,
+ * -EAGAIN if the FIFO is full
+ */
+static ssize_t inject_datagrams_write(struct file *filp, const char __user *buf, size_t count, loff_t *f_pos) {
+  uint8_t packet[CRESTA_MAXDATA_LEN];
+  size_t done = 0;
+
+  if (count < sizeof(packet)) {
+    return -EINVAL;
+  }
+
+  mutex_lock(&inject_mutex);
+  while (count - done >= sizeof(packet)) {
+    if (copy_from_user(packet, buf + done, sizeof(packet))) {
+      mutex_unlock(&inject_mutex);
+      return done ? done : -EFAULT;
+    }
+    if (cresta_queue_datagram(packet)) {
+      datagrams_rejected++;
+      break;
+    }
+    datagrams_injected++;
+    done += sizeof(packet);
+  }
+  mutex_unlock(&inject_mutex);
+
+  return done ? done : -EAGAIN;
+}
+
+/*
+ * Decodes edge durations. Datagrams completed while the FIFO is full
+ * are counted as rejected, edges are always consumed
+ */
+static ssize_t inject_edges_write(struct file *filp, const char __user *buf, size_t count, loff_t *f_pos) {
+  uint32_t durations[CRESTA_INJECT_EDGE_BATCH];
+  size_t done = 0;
+
+  count -= count % sizeof(durations[0]);
+  if (0 == count) {
+    return -EINVAL;
+  }
+
+  mutex_lock(&inject_mutex);
+  while (done < count) {
+    size_t len = min(count - done, sizeof(durations));
+    size_t i;
+
+    if (copy_from_user(durations, buf + done, len)) {
+      mutex_unlock(&inject_mutex);
+      return done ? done : -EFAULT;
+    }
+    for (i = 0; i < len / sizeof(durations[0]); i++) {
+      if (cresta_manchester_multi_decode(&inject_decoder, durations[i])) {
+        if (cresta_queue_datagram(inject_decoder.packet)) {
+          datagrams_rejected++;
+        } else {
+          datagrams_injected++;
+        }
+      }
+    }
+    done += len;
+  }
+  mutex_unlock(&inject_mutex);
+
+  return done;
+}
+
+static const struct file_operations inject_datagrams_fops = {
+	.owner =    THIS_MODULE,
+	.write =    inject_datagrams_write,
+};
+
+static const struct file_operations inject_edges_fops = {
+	.owner =    THIS_MODULE,
+	.write =    inject_edges_write,
+};
+
+/*
+ * Creates the debugfs files. Without debugfs the module works as
+ * usual, just without injection
+ */
+int cresta_inject_init(int hypotheses) {
+  //same configuration as the live decoder
+  cresta_manchester_multi_init(&inject_decoder, hypotheses);
+
+  inject_dir = debugfs_create_dir(CRESTA_INJECT_DIR, NULL);
+  if (IS_ERR_OR_NULL(inject_dir)) {
+    printk(KERN_INFO "No debugfs, injection of datagrams is not available\n");
+    inject_dir = NULL;
+    return 0;
+  }
+
+  debugfs_create_file("inject_datagrams", 0200, inject_dir, NULL, &inject_datagrams_fops);
+  debugfs_create_file("inject_edges", 0200, inject_dir, NULL, &inject_edges_fops);
+  debugfs_create_u32("datagrams_injected", 0444, inject_dir, &datagrams_injected);
+  debugfs_create_u32("datagrams_rejected", 0444, inject_dir, &datagrams_rejected);
+  return 0;
+}
+
+void cresta_inject_cleanup(void) {
+  debugfs_remove_recursive(inject_dir);
+  inject_dir = NULL;
+}
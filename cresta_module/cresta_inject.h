@@ -0,0 +1,30 @@
+/*
+ * Module for receiving and decoding of wireless weather station
+ * sensor data (433MHz). Protocol used by Cresta/Irox/Mebus/Nexus/
+ * Honeywell/Hideki/TFA weather stations.
+ * 
+ * Protocol was reverse engineered by Ruud v Gessel
+,* and documented in "Cresta weather sensor protocol", see
+ * http://members.upc.nl/m.beukelaar/Crestaprotocol.pdf
+ *
+ * This module utilizes code of the Arduino
+ * decoder library "433MHzForArduino" for decoding the sensor data,
+ * see https://bitbucket.org/fuzzillogic/433mhzforarduino
+ *
+ * License: GPLv3. See license.txt
+ */
+
+#ifndef _CRESTA_INJECT_H_
+#define _CRESTA_INJECT_H_
+
+#define CRESTA_INJECT_DIR "cresta"
+
+//edge durations copied per iteration in inject_edges_write
+#define CRESTA_INJECT_EDGE_BATCH 64
+
+
+int  cresta_inject_init(int hypotheses);
+void cresta_inject_cleanup(void);
+
+
+#endif
@@ -22,24 +22,55 @@
 #include <linux/gpio.h>
 #include <linux/slab.h>
 #include <linux/kfifo.h>
+#include <linux/moduleparam.h>
+#include <linux/cpumask.h>
+#include <linux/spinlock.h>
+#include "../cresta_common/cresta_protocol.h"
 #include "cresta_chardevice.h"
+#include "cresta_inject.h"
 #include "cresta_interrupthandler.h"
+#include "cresta_netlink.h"
+#include "cresta_rawdevice.h"
 #include "cresta_sensor_mgmt.h"
 
 
 
-//manchester decoder variables
-static uint8_t  halfBit = 0; 			// 9 bytes of 9 bits each, 2 edges per bit = 162 halfbits for thermo/hygro
-static uint32_t clockTime; 			// Measured duration of half a period, i.e. the the duration of a short edge.
-//static uint32_t clockTime = 488; 			// Measured duration of half a period, i.e. the the duration of a short edge.
-
-static bool     isOne;    			// true if the the last bit is a logic 1.
-static uint8_t  packageLength;
-static uint8_t  data[CRESTA_MAXDATA_LEN];	// Maximum number of bytes used by Cresta
+//manchester decoder
+static struct cresta_manchester_multi decoder;
 static ktime_t *ts;				// timestamp for current execution
 static ktime_t *lastChange;			// timestamp of last execution
 
-static uint8_t halfBitCounter = ~0;
+/*
+ * Number of manchester decoders running in parallel. 1 (default) is the
+ * classic single decoder, more hypotheses recover packets following
+ * noise or overlapping transmissions at the cost of CPU time per edge
+ */
+static int decoder_hypotheses = 1;
+module_param(decoder_hypotheses, int, 0444);
+MODULE_PARM_DESC(decoder_hypotheses, "Number of parallel manchester decoders (1-" __stringify(CRESTA_MAX_HYPOTHESES) ")");
+
+//decoder statistics, see /sys/module/cresta/parameters
+static unsigned int packets_decoded;
+module_param(packets_decoded, uint, 0444);
+MODULE_PARM_DESC(packets_decoded, "Number of datagrams completed by the manchester decoder");
+static unsigned int packets_recovered;
+module_param(packets_recovered, uint, 0444);
+MODULE_PARM_DESC(packets_recovered, "Number of datagrams completed by a candidate decoder");
+static unsigned int edges_dropped;
+module_param(edges_dropped, uint, 0444);
+MODULE_PARM_DESC(edges_dropped, "Number of edges lost due to a full edge FIFO");
+
+/*
+ * CPUs the decode and decrypt stages run on, -1 (default) runs
+ * them on the CPU that queued the work. Pinning both stages to
+ * different CPUs lets them pipeline, e.g. decode_cpu=1 decrypt_cpu=2
+ */
+static int decode_cpu = -1;
+module_param(decode_cpu, int, 0444);
+MODULE_PARM_DESC(decode_cpu, "CPU running the manchester decoder (-1: any)");
+static int decrypt_cpu = -1;
+module_param(decrypt_cpu, int, 0444);
+MODULE_PARM_DESC(decrypt_cpu, "CPU running decryption and sensor updates (-1: any)");
 
 //GPIO & IRQ related
 short int cresta_gpio_irq = 0;	// interrupt we're assigned to
@@ -47,19 +78,36 @@ short int cresta_gpio_irq = 0;	// interrupt we're assigned to
 
 struct kfifo_rec_ptr_1 irqtime_kfifo;
 struct kfifo_rec_ptr_1 rawdata_kfifo;
+//the decoder and injection both write to rawdata_kfifo
+static DEFINE_SPINLOCK(rawdata_lock);
 
-static struct workqueue_struct *cresta_workqueue;
+//edge decoding must not wait for decryption or new sensors, so
+//each stage has its own queue
+static struct workqueue_struct *cresta_decode_workqueue;
+static struct workqueue_struct *cresta_decrypt_workqueue;
 struct cresta_work *decryptwork;
 struct cresta_work *manchester_work;
 
 /*
- * Resets the manchester decoder
- */ 
-void reset_manchester_decoder(uint32_t duration) {
-    halfBit = 1;
-    clockTime = duration >> 1;
-    isOne = true;
-    halfBitCounter = ~0;
+ * Queues work on the CPU configured for its stage
+ */
+static inline void cresta_queue_work(int cpu, struct workqueue_struct *wq, struct work_struct *work) {
+  if (cpu >= 0) {
+    queue_work_on(cpu, wq, work);
+  } else {
+    queue_work(wq, work);
+  }
+}
+
+/*
+ * Falls back to any CPU if the configured one isn't usable
+ */
+static int cresta_check_cpu(const char *stage, int cpu) {
+  if (cpu >= 0 && (cpu >= nr_cpu_ids || !cpu_online(cpu))) {
+    printk(KERN_WARNING "CPU %d for %s isn't online, using any CPU\n", cpu, stage);
+    return -1;
+  }
+  return cpu;
 }
 
  
@@ -80,141 +128,28 @@ void cresta_irq_bh(struct work_struct* work) {
   }
 }
 
-void cresta_manchester_decoder (uint32_t duration) {
-  /* I'll follow CrestaProtocol documentation here. However, I suspect it is inaccurate at some points:
-  * - there is no stop-bit after every byte. Instead, there's a start-bit (0) before every byte.
-  * - Conversely, there is no start-bit "1" before every byte.
-  * - An up-flank is 0, down-flank is 1, at least with both my receivers.
-  *
-  * However, since the first start-bit 0 is hard to distinguish given the current clock-detecting
-  * algorithm, I pretend there *is* a stop-bit 0 instead of start-bit. However, this means the
-  * last stop-bit of a package must be ignored, as it simply isn't there.
-  *
-  * This manchester decoder is based on the principle that short edges indicate the current bit is the
-  * same as previous bit, and that long edge indicate that the current bit is the complement of the
-  * previous bit.
-  */
-
-
-
-  
-  if (halfBit==0) {
-    // Automatic clock detection. One clock-period is half the duration of the first edge.
-    clockTime = duration >> 1;
-    
-    // Some sanity checking, very short (<200us) or very long (>1000us) signals are ignored.
-    if (clockTime < 200 || clockTime > 1000) {
-      //printk(KERN_NOTICE "Signal too short or too long: %d Ignoring\n", duration);
-      goto out;
-    }
-    isOne = true;
-  }
-  else {
-    // Edge is not too long, nor too short?
-    if (duration < (clockTime >> 1) || duration > (clockTime << 1) + clockTime) { // read as: duration < 0.5 * clockTime || duration > 3 * clockTime
-      // Fail. Abort.
-      //printk(KERN_NOTICE "Edge is too long or too short. Resetting.\n");
-      reset_manchester_decoder(duration);
-      goto out;
-    }
-
-    // Only process every second half bit, i.e. every whole bit.
-    if (halfBit & 1) {  
-      uint8_t currentByte = halfBit / 18;
-      uint8_t currentBit = (halfBit >> 1) % 9; // nine bits in a byte.
-      if (currentBit < 8) {
-	//make sure we don't write out of array
-	if(currentByte < CRESTA_MAXDATA_LEN) {
-	  if (isOne) {
-	    // Set current bit of current byte
-	    data[currentByte] |= 1 << currentBit;
-	  } 
-	  else {
-	    // Reset current bit of current byte
-	    data[currentByte] &= ~(1 << currentBit);
-	  }
-	}
-      } else {
-	// Ninth bit must be 0
-	if (isOne) {
-	  //printk(KERN_NOTICE "9th bit not 0. Resetting.\n");
-	  // Bit is 1. Fail. Abort.
-	  reset_manchester_decoder(duration);
-	  goto out;
-	}                    
-      }
-
-
-      if (halfBit == 17) { // First byte has been received
-	// First data byte must be x75.
-	if (data[0] != 0x75) {
-	  //printk(KERN_NOTICE "got a byte, but != 0x75 header. Resetting\n");
-	  reset_manchester_decoder(duration);
-	  goto out;
-	}
-      } 
-      else if (halfBit == 53) { // Third byte has been received
-	// Obtain the length of the data
-	uint8_t decodedByte = data[2]^(data[2]<<1);
-	packageLength = (decodedByte >> 1) & 0x1f;
-
-	// Do some checking to see if we should proceed
-	if (packageLength < CRESTA_MIN_ANNOUNCED_LEN || packageLength > CRESTA_MAX_ANNOUNCED_LEN) {
-	  //printk(KERN_NOTICE "Got length information, but length is invalid. Resetting\n");
-	  reset_manchester_decoder(duration);
-	  goto out;
-	} else {
-	  halfBitCounter = (packageLength + 3) * 9 * 2 - 2 - 1; // 9 bits per byte, 2 edges per bit, minus last stop-bit (see comment above)
-	}
-	//printk(KERN_NOTICE "Got length information. Length = %d. \n", packageLength);
-      }
-     // printk(KERN_INFO "writing data[%d]\n", currentByte);
-     // printk(KERN_INFO "currentBit = %d\n", currentBit);
-
-
-      // Done?
-      if (halfBit >= halfBitCounter) {
-	// schedule decrypting
-      //keep the typecast for (uint8_t) ~0, or the check will fail
-	if (halfBitCounter != (uint8_t) ~0) {
-	  //last sanity checks. keep them in, as we still get garbage in very rare cases
-	  uint8_t lengthSanity = data[2]^(data[2]<<1);
-	  lengthSanity = (lengthSanity >> 1) & 0x1f;
-	  if(data[0] == 0x75 && lengthSanity >= CRESTA_MIN_ANNOUNCED_LEN && lengthSanity <= CRESTA_MAX_ANNOUNCED_LEN) {
-	    kfifo_in(&rawdata_kfifo, data, sizeof(data));
-	    queue_work(cresta_workqueue, &decryptwork->ws);
-	  } else {
-	    printk(KERN_INFO "data[0] = %x\n", data[0]);
-	    printk(KERN_INFO "packet length = %d\n", packageLength);
-	    printk(KERN_INFO "packet length (final sanity check) = %d\n", lengthSanity);
-	    printk(KERN_INFO "halfBitCounter = %d\n", halfBitCounter);
-	    printk(KERN_INFO "halfBit = %d\n", halfBit);
-	  }
-	}
-	// reset
-	reset_manchester_decoder(duration);
-	halfBit = 0;
-	goto out;
-      }
-    }
-
-    // Edge is long?
-    if (duration > clockTime + (clockTime >> 1)) { // read as: duration > 1.5 * clockTime
-      // Long edge.
-      isOne = !isOne;
-      // Long edge takes 2 halfbits
-      halfBit++;
-    }
+/*
+ * Queues a datagram for decryption. Returns -ENOSPC if the FIFO is full
+ */
+int cresta_queue_datagram(const uint8_t *packet) {
+  if (!kfifo_in_spinlocked(&rawdata_kfifo, packet, CRESTA_MAXDATA_LEN, &rawdata_lock)) {
+    return -ENOSPC;
   }
+  cresta_queue_work(decrypt_cpu, cresta_decrypt_workqueue, &decryptwork->ws);
+  return 0;
+}
 
-  halfBit++;
- // printk(KERN_INFO "halfBit = %d\n", halfBit);
-
-   
-   
-out:   
-
-  return;
+/*
+ * Feeds an edge into the manchester decoder(s) and schedules
+ * decryption of completed datagrams.
+ * See cresta_common/cresta_protocol.h for the actual decoding
+ */
+void cresta_manchester_decoder (uint32_t duration) {
+  if (cresta_manchester_multi_decode(&decoder, duration)) {
+    cresta_queue_datagram(decoder.packet);
+    packets_decoded = decoder.packets;
+    packets_recovered = decoder.recovered;
+  }
 }
 
 
@@ -224,8 +159,12 @@ out:
 static irqreturn_t cresta_irq_th(int irq, void *dev_id, struct pt_regs *regs) {
   //NOTE: since 2.6.35 IRQs are disabled by default while in an ISR
   ktime_t now = ktime_get();
-  kfifo_in(&irqtime_kfifo, &now, sizeof(now));
-  queue_work(cresta_workqueue, &manchester_work->ws);
+  cresta_raw_record_edge(now, gpio_get_value(CRESTA_GPIO));
+  if (!kfifo_in(&irqtime_kfifo, &now, sizeof(now))) {
+    edges_dropped++;
+    cresta_raw_record_decoder_drop();
+  }
+  cresta_queue_work(decode_cpu, cresta_decode_workqueue, &manchester_work->ws);
 
   return IRQ_HANDLED;
 }
@@ -294,11 +233,23 @@ void release_interrupt(void) {
 int __init cresta_interrupthandler_init(void) {
   printk(KERN_NOTICE "Loading Cresta Module.\n");
 
+  cresta_manchester_multi_init(&decoder, clamp(decoder_hypotheses, 1, CRESTA_MAX_HYPOTHESES));
+  if (decoder_hypotheses > 1) {
+    printk(KERN_INFO "Running %d manchester decoders in parallel\n", decoder.hypotheses);
+  }
+
   //initialize snesor management
-  cresta_sensor_mgmt_init();
+  if(cresta_sensor_mgmt_init()) {
+    return -ENOMEM;
+  }
   
   //initialize character device handling
-  cresta_chardevice_init();
+  if(cresta_chardevice_init()) {
+    goto err;
+  }
+
+  //sensors known in advance get their /dev entries right away
+  cresta_seed_sensors();
 
   if(kfifo_alloc(&irqtime_kfifo, CRESTA_KFIFO_SIZE, GFP_KERNEL)) {
     printk(KERN_ERR "Error, couldn't allocate memory for FIFO buffer\n");
@@ -321,8 +272,14 @@ int __init cresta_interrupthandler_init(void) {
   }
   
   
-  cresta_workqueue = alloc_workqueue(CRESTA_GPIO_DEVICE_DESC, WQ_NON_REENTRANT, 1);
-  if (NULL == cresta_workqueue) {
+  decode_cpu  = cresta_check_cpu("decoding", decode_cpu);
+  decrypt_cpu = cresta_check_cpu("decryption", decrypt_cpu);
+
+  //edges have to be handled before the kfifo fills up, hence high priority.
+  //Work items are non reentrant since 3.7, WQ_NON_REENTRANT is gone
+  cresta_decode_workqueue = alloc_workqueue(CRESTA_DECODE_WQ_DESC, WQ_HIGHPRI, 1);
+  cresta_decrypt_workqueue = alloc_workqueue(CRESTA_DECRYPT_WQ_DESC, 0, 1);
+  if (NULL == cresta_decode_workqueue || NULL == cresta_decrypt_workqueue) {
     goto err;
   }
   
@@ -337,7 +294,15 @@ int __init cresta_interrupthandler_init(void) {
   INIT_WORK(&decryptwork->ws, handle_encrypted_sensor_data);
   INIT_WORK(&manchester_work->ws, cresta_irq_bh);
 
+  //raw edge device has to be ready before the first interrupt
+  if(cresta_rawdevice_init()) {
+    goto err;
+  }
+
+  cresta_inject_init(decoder.hypotheses);
 
+  //listeners are optional, the devices work without netlink
+  cresta_netlink_init();
   
   if(setup_interrupt()) {
     goto err;
@@ -351,11 +316,19 @@ err:
    kfree(lastChange);
    kfifo_free(&irqtime_kfifo);
    kfifo_free(&rawdata_kfifo);
-   if(NULL != cresta_workqueue) {
-     destroy_workqueue(cresta_workqueue);
+   if(NULL != cresta_decode_workqueue) {
+     destroy_workqueue(cresta_decode_workqueue);
+   }
+   if(NULL != cresta_decrypt_workqueue) {
+     destroy_workqueue(cresta_decrypt_workqueue);
    }
    kfree(decryptwork);
    kfree(manchester_work);
+   cresta_netlink_cleanup();
+   cresta_inject_cleanup();
+   cresta_rawdevice_cleanup();
+   //seeding creates sensors, so it has to stop first
+   cresta_chardevice_remove_seed();
    cresta_sensor_mgmt_cleanup();
    cresta_chardevice_cleanup();
    return -1;
@@ -366,12 +339,21 @@ err:
  */ 
 void __exit cresta_interrupthandler_cleanup(void) {
    release_interrupt();
+   //like injection, seeding creates sensors
+   cresta_chardevice_remove_seed();
+   cresta_inject_cleanup();
+   cresta_rawdevice_cleanup();
    kfree(ts);
    kfree(lastChange);
    
-   //cleanup work queue
-   flush_workqueue(cresta_workqueue);
-   destroy_workqueue(cresta_workqueue);
+   //cleanup work queues, decoding first as it queues decryption work
+   flush_workqueue(cresta_decode_workqueue);
+   destroy_workqueue(cresta_decode_workqueue);
+   flush_workqueue(cresta_decrypt_workqueue);
+   destroy_workqueue(cresta_decrypt_workqueue);
+
+   //nothing publishes measurements any more
+   cresta_netlink_cleanup();
    
    kfree(decryptwork);
    kfree(manchester_work);
@@ -393,6 +375,10 @@ void __exit cresta_interrupthandler_cleanup(void) {
    kfifo_free(&irqtime_kfifo);
    kfifo_free(&rawdata_kfifo);
 
+   if (decoder.hypotheses > 1) {
+     printk(KERN_INFO "Decoded %u datagrams, %u recovered by candidate decoders\n", decoder.packets, decoder.recovered);
+   }
+
    printk(KERN_NOTICE "Removed Cresta Module.\n");
    return;
 }
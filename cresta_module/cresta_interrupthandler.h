@@ -33,13 +33,17 @@
 #define CRESTA_GPIO_DESC           "Cresta 433MHz receiver"
 #define CRESTA_GPIO_DEVICE_DESC    "cresta_receiver"
 
+// names of the work queues, see ps
+#define CRESTA_DECODE_WQ_DESC      "cresta_decode"
+#define CRESTA_DECRYPT_WQ_DESC     "cresta_decrypt"
+
 
 struct cresta_work {
     struct work_struct ws;
 };
 
+int  cresta_queue_datagram(const uint8_t *packet);
 void cresta_manchester_decoder (uint32_t);
-void reset_manchester_decoder(uint32_t);
 
 
 #endif
@@ -0,0 +1,153 @@
+/*
+ * Module for receiving and decoding of wireless weather station
+ * sensor data (433MHz). Protocol used by Cresta/Irox/Mebus/Nexus/
+ * Honeywell/Hideki/TFA weather stations.
+ * 
+ * Protocol was reverse engineered by Ruud v Gessel
+,* and documented in "Cresta weather sensor protocol", see
+ * http://members.upc.nl/m.beukelaar/Crestaprotocol.pdf
+ *
+ * This module utilizes code of the Arduino
+ * decoder library "433MHzForArduino" for decoding the sensor data,
+ * see https://bitbucket.org/fuzzillogic/433mhzforarduino
+ *
+ * License: GPLv3. See license.txt
+ */
+
+/*
+ * Pushes new measurements to user space over generic netlink, see
+ * CRESTA_GENL_NAME in cresta_common.h. Any number of listeners join
+ * the multicast group on one socket each and get all sensors there,
+ * instead of polling a device per sensor. Nothing is allocated while
+ * nobody listens.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/version.h>
+#include <net/genetlink.h>
+
+#include "cresta_netlink.h"
+
+/*
+ * Multicast groups belong to the family since 3.13, before they were
+ * registered one by one. Since 4.7 u64 attributes are padded to 8
+ * bytes on architectures without efficient unaligned access (ARM)
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 7, 0)
+#define CRESTA_NLA_U64_SIZE nla_total_size_64bit(sizeof(u64))
+#define cresta_nla_put_u64(skb, attrtype, value) nla_put_u64_64bit(skb, attrtype, value, CRESTA_GENL_ATTR_PAD)
+#else
+#define CRESTA_NLA_U64_SIZE nla_total_size(sizeof(u64))
+#define cresta_nla_put_u64(skb, attrtype, value) nla_put_u64(skb, attrtype, value)
+#endif
+
+//attributes of a CRESTA_GENL_CMD_MEASUREMENT message
+#define CRESTA_GENL_MSG_SIZE (2 * nla_total_size(sizeof(u8)) + 2 * CRESTA_NLA_U64_SIZE + \
+			      nla_total_size(sizeof(u8)) + nla_total_size(CRESTA_MAXDATA_LEN))
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 13, 0)
+static const struct genl_multicast_group cresta_genl_mcgrps[] = {
+    { .name = CRESTA_GENL_MCGRP_MEASUREMENTS },
+};
+
+static struct genl_family cresta_genl_family = {
+    .name     = CRESTA_GENL_NAME,
+    .version  = CRESTA_GENL_VERSION,
+    .maxattr  = CRESTA_GENL_ATTR_MAX,
+    .module   = THIS_MODULE,
+    .mcgrps   = cresta_genl_mcgrps,
+    .n_mcgrps = ARRAY_SIZE(cresta_genl_mcgrps),
+};
+
+//the measurements group is the first and only one of the family
+#define cresta_genl_has_listeners() netlink_has_listeners(init_net.genl_sock, cresta_genl_family.mcgrp_offset)
+#define cresta_genl_multicast(skb)  genlmsg_multicast(&cresta_genl_family, skb, 0, 0, GFP_KERNEL)
+#else
+static struct genl_family cresta_genl_family = {
+    .id      = GENL_ID_GENERATE,
+    .name    = CRESTA_GENL_NAME,
+    .version = CRESTA_GENL_VERSION,
+    .maxattr = CRESTA_GENL_ATTR_MAX,
+};
+
+static struct genl_multicast_group cresta_genl_measurements = {
+    .name = CRESTA_GENL_MCGRP_MEASUREMENTS,
+};
+
+#define cresta_genl_has_listeners() netlink_has_listeners(init_net.genl_sock, cresta_genl_measurements.id)
+#define cresta_genl_multicast(skb)  genlmsg_multicast(skb, 0, cresta_genl_measurements.id, GFP_KERNEL)
+#endif
+
+static bool genl_registered;
+
+//measurements lost for lack of memory
+static unsigned int netlink_dropped;
+module_param(netlink_dropped, uint, 0444);
+MODULE_PARM_DESC(netlink_dropped, "Number of measurements not sent via netlink for lack of memory");
+
+
+/*
+ * Called by handle_decrypted_sensor_data, never concurrently
+ */
+void cresta_netlink_notify(const struct cresta_measurement_record *record) {
+    struct sk_buff *skb;
+    void *hdr;
+
+    if(!genl_registered || !cresta_genl_has_listeners()) {
+	return;
+    }
+
+    skb = genlmsg_new(CRESTA_GENL_MSG_SIZE, GFP_KERNEL);
+    if(NULL == skb) {
+	netlink_dropped++;
+	return;
+    }
+    hdr = genlmsg_put(skb, 0, 0, &cresta_genl_family, 0, CRESTA_GENL_CMD_MEASUREMENT);
+    if(NULL == hdr ||
+       nla_put_u8(skb, CRESTA_GENL_ATTR_ADDRESS, record->sensor_address) ||
+       nla_put_u8(skb, CRESTA_GENL_ATTR_TYPE, record->sensor_type) ||
+       cresta_nla_put_u64(skb, CRESTA_GENL_ATTR_TIMESTAMP, record->timestamp_ns) ||
+       cresta_nla_put_u64(skb, CRESTA_GENL_ATTR_SEQUENCE, record->sequence) ||
+       nla_put_u8(skb, CRESTA_GENL_ATTR_LEN, record->len) ||
+       nla_put(skb, CRESTA_GENL_ATTR_DATA, CRESTA_MAXDATA_LEN, record->decrypted_data)) {
+	//the message is sized for all attributes, so this is a bug
+	printk(KERN_ERR "Error, netlink message too small for a measurement\n");
+	nlmsg_free(skb);
+	return;
+    }
+    genlmsg_end(skb, hdr);
+
+    //fails with -ESRCH if the last listener left in the meantime
+    cresta_genl_multicast(skb);
+}
+
+int cresta_netlink_init(void) {
+    int ret;
+
+    ret = genl_register_family(&cresta_genl_family);
+    if(ret) {
+	printk(KERN_ERR "Error, couldn't register generic netlink family %s\n", CRESTA_GENL_NAME);
+	return ret;
+    }
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3, 13, 0)
+    ret = genl_register_mc_group(&cresta_genl_family, &cresta_genl_measurements);
+    if(ret) {
+	printk(KERN_ERR "Error, couldn't register netlink multicast group %s\n", CRESTA_GENL_MCGRP_MEASUREMENTS);
+	genl_unregister_family(&cresta_genl_family);
+	return ret;
+    }
+#endif
+    genl_registered = true;
+    return 0;
+}
+
+/*
+ * Unregistering the family removes its multicast group as well
+ */
+void cresta_netlink_cleanup(void) {
+    if(genl_registered) {
+	genl_unregister_family(&cresta_genl_family);
+	genl_registered = false;
+    }
+}
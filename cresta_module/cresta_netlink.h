@@ -0,0 +1,31 @@
+/*
+ * Module for receiving and decoding of wireless weather station
+ * sensor data (433MHz). Protocol used by Cresta/Irox/Mebus/Nexus/
+ * Honeywell/Hideki/TFA weather stations.
+ * 
+ * Protocol was reverse engineered by Ruud v Gessel
+,* and documented in "Cresta weather sensor protocol", see
+ * http://members.upc.nl/m.beukelaar/Crestaprotocol.pdf
+ *
+ * This module utilizes code of the Arduino
+ * decoder library "433MHzForArduino" for decoding the sensor data,
+ * see https://bitbucket.org/fuzzillogic/433mhzforarduino
+ *
+ * License: GPLv3. See license.txt
+ */
+
+
+#ifndef _CRESTA_NETLINK_H_
+#define _CRESTA_NETLINK_H_
+
+#include "../cresta_common/cresta_common.h"
+
+
+int  cresta_netlink_init(void);
+void cresta_netlink_cleanup(void);
+
+//sends a new measurement to the multicast group, if anybody listens
+void cresta_netlink_notify(const struct cresta_measurement_record *record);
+
+
+#endif
@@ -0,0 +1,276 @@
+/*
+ * Module for receiving and decoding of wireless weather station
+ * sensor data (433MHz). Protocol used by Cresta/Irox/Mebus/Nexus/
+ * Honeywell/Hideki/TFA weather stations.
+ * 
+ * Protocol was reverse engineered by Ruud v Gessel
+,* and documented in "Cresta weather sensor protocol", see
+ * http://members.upc.nl/m.beukelaar/Crestaprotocol.pdf
+ *
+ * This module utilizes code of the Arduino
+ * decoder library "433MHzForArduino" for decoding the sensor data,
+ * see https://bitbucket.org/fuzzillogic/433mhzforarduino
+ *
+ * License: GPLv3. See license.txt
+ */
+
+/*
+ * /dev/cresta_raw streams the edges received from the 433MHz receiver,
+ * so we can see what the receiver actually produced when decode rates
+ * drop. Edges are written to a ring by the top half of the IRQ handler.
+ * The ring can either be read via read() or mapped into user space,
+ * which doesn't copy any data and doesn't disturb the live decoder.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/miscdevice.h>
+#include <linux/poll.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/version.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+
+#include <linux/uaccess.h>
+
+#include "cresta_rawdevice.h"
+
+//edges copied per iteration in cresta_raw_read
+#define CRESTA_RAW_READ_BATCH 32
+
+//READ_ONCE and WRITE_ONCE came with 3.19, ACCESS_ONCE went with 4.15
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3, 19, 0)
+#define CRESTA_READ_ONCE(x)     ACCESS_ONCE(x)
+#define CRESTA_WRITE_ONCE(x, v) (ACCESS_ONCE(x) = (v))
+#else
+#define CRESTA_READ_ONCE(x)     READ_ONCE(x)
+#define CRESTA_WRITE_ONCE(x, v) WRITE_ONCE(x, v)
+#endif
+
+/*
+ * Per reader state of read() users
+ */
+struct cresta_raw_reader {
+    uint64_t position;	//number of the next edge to deliver
+};
+
+static void *raw_ring;	//header page followed by the edges
+static struct cresta_raw_ring_header *raw_header;
+static struct cresta_raw_edge *raw_edges;
+static unsigned long raw_ring_size;
+static DECLARE_WAIT_QUEUE_HEAD(raw_wait);
+static bool raw_registered;
+
+
+/*
+ * Reads head, ordered before the reads of the edges it covers. On 32
+ * bit, head is read in two halves, which can only go wrong when the
+ * lower one wraps, every 2^32 edges
+ */
+static inline uint64_t cresta_raw_head(void) {
+  uint64_t head = CRESTA_READ_ONCE(raw_header->head);
+
+  smp_rmb();
+  return head;
+}
+
+/*
+ * Called from the top half for every edge. We're the only
+ * writer, so no locking is needed
+ */
+void cresta_raw_record_edge(ktime_t timestamp, int level) {
+  struct cresta_raw_edge *edge;
+  uint64_t head;
+
+  if (NULL == raw_header) {
+    return;
+  }
+
+  head = raw_header->head;
+  edge = &raw_edges[head & (CRESTA_RAW_RING_EDGES - 1)];
+  edge->timestamp_ns = ktime_to_ns(timestamp);
+  edge->level = level;
+  edge->dropped = 0;
+  //publish the edge before advancing head
+  smp_wmb();
+  CRESTA_WRITE_ONCE(raw_header->head, head + 1);
+
+  if (waitqueue_active(&raw_wait)) {
+    wake_up_interruptible(&raw_wait);
+  }
+}
+
+/*
+ * Called from the top half if the decoder's FIFO was full
+ */
+void cresta_raw_record_decoder_drop(void) {
+  if (NULL != raw_header) {
+    raw_header->decoder_dropped++;
+  }
+}
+
+static int cresta_raw_open(struct inode *inode, struct file *filp) {
+  struct cresta_raw_reader *reader = kmalloc(sizeof(struct cresta_raw_reader), GFP_KERNEL);
+  if (NULL == reader) {
+    return -ENOMEM;
+  }
+  //readers get edges arriving after open
+  reader->position = cresta_raw_head();
+  filp->private_data = reader;
+  return nonseekable_open(inode, filp);
+}
+
+static int cresta_raw_release(struct inode *inode, struct file *filp) {
+  kfree(filp->private_data);
+  return 0;
+}
+
+/*
+ * Copies whole edges to user space. If the reader fell behind by more
+ * than the ring size, the lost edges are reported in the dropped field
+ * of the next edge delivered
+ */
+static ssize_t cresta_raw_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos) {
+  struct cresta_raw_reader *reader = filp->private_data;
+  struct cresta_raw_edge batch[CRESTA_RAW_READ_BATCH];
+  size_t max_edges = count / sizeof(struct cresta_raw_edge);
+  ssize_t retval = 0;
+  uint32_t dropped = 0;
+  uint64_t head;
+
+  if (0 == max_edges) {
+    return -EINVAL;
+  }
+
+  head = cresta_raw_head();
+  while (head == reader->position) {
+    if (filp->f_flags & O_NONBLOCK) {
+      return -EAGAIN;
+    }
+    if (wait_event_interruptible(raw_wait, cresta_raw_head() != reader->position)) {
+      return -ERESTARTSYS;
+    }
+    head = cresta_raw_head();
+  }
+
+  while (max_edges > 0 && head != reader->position) {
+    size_t n = 0;
+
+    //the slot of edge head - RING is the one the top half writes next
+    if (head - reader->position >= CRESTA_RAW_RING_EDGES) {
+      dropped += head - reader->position - (CRESTA_RAW_RING_EDGES - 1);
+      reader->position = head - (CRESTA_RAW_RING_EDGES - 1);
+    }
+
+    while (n < CRESTA_RAW_READ_BATCH && n < max_edges && reader->position + n != head) {
+      batch[n] = raw_edges[(reader->position + n) & (CRESTA_RAW_RING_EDGES - 1)];
+      n++;
+    }
+
+    //the top half might have overwritten edges while we were copying
+    smp_rmb();
+    head = cresta_raw_head();
+    if (head - reader->position >= CRESTA_RAW_RING_EDGES) {
+      continue;
+    }
+
+    batch[0].dropped += dropped;
+    dropped = 0;
+    if (copy_to_user(buf + retval, batch, n * sizeof(struct cresta_raw_edge))) {
+      return -EFAULT;
+    }
+    reader->position += n;
+    retval += n * sizeof(struct cresta_raw_edge);
+    max_edges -= n;
+  }
+
+  return retval;
+}
+
+static unsigned int cresta_raw_poll(struct file *filp, poll_table *wait) {
+  struct cresta_raw_reader *reader = filp->private_data;
+
+  poll_wait(filp, &raw_wait, wait);
+  if (cresta_raw_head() != reader->position) {
+    return POLLIN | POLLRDNORM;
+  }
+  return 0;
+}
+
+/*
+ * Maps the ring (read only) into user space
+ */
+static int cresta_raw_mmap(struct file *filp, struct vm_area_struct *vma) {
+  if (vma->vm_flags & VM_WRITE) {
+    return -EPERM;
+  }
+  if (vma->vm_end - vma->vm_start + (vma->vm_pgoff << PAGE_SHIFT) > raw_ring_size) {
+    return -EINVAL;
+  }
+  return remap_vmalloc_range(vma, raw_ring, vma->vm_pgoff);
+}
+
+static const struct file_operations cresta_raw_fops = {
+	.owner =    THIS_MODULE,
+	.llseek =   no_llseek,
+	.read =     cresta_raw_read,
+	.poll =     cresta_raw_poll,
+	.mmap =     cresta_raw_mmap,
+	.open =     cresta_raw_open,
+	.release =  cresta_raw_release,
+};
+
+static struct miscdevice cresta_raw_misc = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name  = CRESTA_RAW_DEVICE_NAME,
+	.fops  = &cresta_raw_fops,
+	.mode  = 0444,
+};
+
+
+/*
+ * Allocates the ring and registers /dev/cresta_raw
+ */
+int cresta_rawdevice_init(void) {
+  raw_ring_size = PAGE_SIZE + PAGE_ALIGN(CRESTA_RAW_RING_EDGES * sizeof(struct cresta_raw_edge));
+  //vmalloc_user zeroes the memory and makes it mappable
+  raw_ring = vmalloc_user(raw_ring_size);
+  if (NULL == raw_ring) {
+    printk(KERN_ERR "Cannot allocate memory for raw edge ring\n");
+    return -1;
+  }
+
+  raw_edges = raw_ring + PAGE_SIZE;
+  raw_header = raw_ring;
+  raw_header->magic = CRESTA_RAW_MAGIC;
+  raw_header->version = CRESTA_RAW_VERSION;
+  raw_header->header_size = PAGE_SIZE;
+  raw_header->edge_count = CRESTA_RAW_RING_EDGES;
+
+  if (misc_register(&cresta_raw_misc)) {
+    printk(KERN_ERR "Failed to register /dev/%s\n", CRESTA_RAW_DEVICE_NAME);
+    cresta_rawdevice_cleanup();
+    return -1;
+  }
+  raw_registered = true;
+
+  return 0;
+}
+
+/*
+ * Removes /dev/cresta_raw and frees the ring. Interrupts
+ * must be released already
+ */
+void cresta_rawdevice_cleanup(void) {
+  if (raw_registered) {
+    misc_deregister(&cresta_raw_misc);
+    raw_registered = false;
+  }
+  raw_header = NULL;
+  raw_edges = NULL;
+  vfree(raw_ring);
+  raw_ring = NULL;
+}
@@ -0,0 +1,37 @@
+/*
+ * Module for receiving and decoding of wireless weather station
+ * sensor data (433MHz). Protocol used by Cresta/Irox/Mebus/Nexus/
+ * Honeywell/Hideki/TFA weather stations.
+ * 
+ * Protocol was reverse engineered by Ruud v Gessel
+,* and documented in "Cresta weather sensor protocol", see
+ * http://members.upc.nl/m.beukelaar/Crestaprotocol.pdf
+ *
+ * This module utilizes code of the Arduino
+ * decoder library "433MHzForArduino" for decoding the sensor data,
+ * see https://bitbucket.org/fuzzillogic/433mhzforarduino
+ *
+ * License: GPLv3. See license.txt
+ */
+
+#ifndef _CRESTA_RAWDEVICE_H_
+#define _CRESTA_RAWDEVICE_H_
+
+#include <linux/ktime.h>
+#include "../cresta_common/cresta_common.h"
+
+#define CRESTA_RAW_DEVICE_NAME "cresta_raw"
+
+//number of edges kept in the ring, must be a power of 2
+//a thermohygro packet has ~120 edges, so this holds more than 100 packets
+#define CRESTA_RAW_RING_EDGES  16384
+
+
+int  cresta_rawdevice_init(void);
+void cresta_rawdevice_cleanup(void);
+
+void cresta_raw_record_edge(ktime_t timestamp, int level);
+void cresta_raw_record_decoder_drop(void);
+
+
+#endif
@@ -16,13 +16,59 @@
 
 #include <linux/kfifo.h>
 #include <linux/mutex.h>
-#include <linux/list.h>
 #include <linux/slab.h>
+#include <linux/moduleparam.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
 #include "cresta_sensor_mgmt.h"
+#include "cresta_iio.h"
+#include "cresta_netlink.h"
 
-struct list_head cresta_sensor_list;
-LIST_HEAD(cresta_sensor_list);
-static DEFINE_MUTEX(mod_sensor_list_mutex);
+/*
+ * Sensors indexed by address. Lookups from the packet path only take
+ * the RCU read lock, adding and removing sensors is serialized by
+ * mod_sensor_registry_mutex
+ */
+static struct cresta_dev __rcu *cresta_sensors[CRESTA_SENSOR_ADDR_COUNT];
+static DEFINE_MUTEX(mod_sensor_registry_mutex);
+
+//serializes updates of current_data of all sensors and their removal
+static DEFINE_MUTEX(measurement_update_mutex);
+
+/*
+ * Sensors get a new random address when their batteries are changed.
+ * Sensors that weren't heard of for sensor_ttl seconds are removed,
+ * 0 (default) keeps them until the module is unloaded
+ */
+static unsigned int sensor_ttl = 0;
+module_param(sensor_ttl, uint, 0644);
+MODULE_PARM_DESC(sensor_ttl, "Seconds after which silent sensors are removed (0: never)");
+static unsigned int sensors_removed;
+module_param(sensors_removed, uint, 0444);
+MODULE_PARM_DESC(sensors_removed, "Number of sensors removed after sensor_ttl");
+
+/*
+ * Sensors created at load time, so their /dev entries exist before
+ * they transmit, e.g. seed_sensors=0x21:thermohygro,0x83:rain
+ */
+static char *seed_sensors[CRESTA_MAX_SEEDS];
+static int seed_sensor_count;
+module_param_array(seed_sensors, charp, &seed_sensor_count, 0444);
+MODULE_PARM_DESC(seed_sensors, "Sensors to create at load time (address:type,...)");
+
+static void cresta_sensor_reaper(struct work_struct* work);
+static DECLARE_DELAYED_WORK(reaper_work, cresta_sensor_reaper);
+
+//measurement records are allocated for valid datagrams only
+static struct kmem_cache *cresta_measurement_cache;
+
+//allocation statistics, see /sys/module/cresta/parameters
+static unsigned int measurements_allocated;
+module_param(measurements_allocated, uint, 0444);
+MODULE_PARM_DESC(measurements_allocated, "Number of measurement records allocated for received datagrams");
+static unsigned int decrypt_failures;
+module_param(decrypt_failures, uint, 0444);
+MODULE_PARM_DESC(decrypt_failures, "Number of datagrams failing decryption or checksum");
 
 
 extern struct kfifo_rec_ptr_1 irqtime_kfifo;
@@ -33,23 +79,118 @@ extern struct kfifo_rec_ptr_1 rawdata_kfifo;
  * for decoding of data
  */ 
 int cresta_sensor_mgmt_init() {
-     mutex_init(&mod_sensor_list_mutex);
+     mutex_init(&mod_sensor_registry_mutex);
+
+     cresta_measurement_cache = KMEM_CACHE(cresta_measurement_data, 0);
+     if(NULL == cresta_measurement_cache) {
+	printk(KERN_ERR "Cannot create measurement cache. Out of memory.\n");
+	return -1;
+     }
+
+     schedule_delayed_work(&reaper_work, CRESTA_REAPER_INTERVAL * HZ);
      
      return 0;
 }
 
+/*
+ * Removes sensors from the registry and frees them. With ttl 0 all
+ * sensors are removed, otherwise the ones not seen for ttl jiffies.
+ * Seeded sensors that never transmitted are kept then.
+ * All of them are unlinked first, so one grace period covers them.
+ * Returns the number of removed sensors
+ */
+static int remove_cresta_sensors(unsigned long ttl) {
+    LIST_HEAD(expired);
+    struct cresta_dev *next;
+    struct cresta_dev *sensor;
+    int removed = 0;
+    int addr;
+
+    for(addr = 0; addr < CRESTA_SENSOR_ADDR_COUNT; addr++) {
+	//holding measurement_update_mutex, nobody else uses the sensor
+	//except for readers under RCU
+	mutex_lock(&measurement_update_mutex);
+	mutex_lock(&mod_sensor_registry_mutex);
+	sensor = rcu_dereference_protected(cresta_sensors[addr], lockdep_is_held(&mod_sensor_registry_mutex));
+	if(NULL != sensor && ttl && !time_after(jiffies, sensor->last_seen + ttl)) {
+	    sensor = NULL;
+	}
+	//seeded sensors wait for their first transmission, however long
+	if(NULL != sensor && ttl && 0 == sensor->sequence) {
+	    sensor = NULL;
+	}
+	if(NULL != sensor) {
+	    RCU_INIT_POINTER(cresta_sensors[addr], NULL);
+	    list_add_tail(&sensor->list, &expired);
+	}
+	mutex_unlock(&mod_sensor_registry_mutex);
+	mutex_unlock(&measurement_update_mutex);
+    }
+    if(list_empty(&expired)) {
+	return 0;
+    }
+
+    //wait for open() still using any of the sensors
+    synchronize_rcu();
+
+    list_for_each_entry_safe(sensor, next, &expired, list) {
+	list_del(&sensor->list);
+	//device entry might still be pending
+	cancel_work_sync(&sensor->devnode_work);
+	if(sensor->has_device_entry) {
+	    remove_device_entry(sensor); //delete the /dev entries
+	}
+	cresta_iio_remove(sensor->iio);
+	delete_cresta_sensor(sensor); //free the memory
+	removed++;
+    }
+    if(removed) {
+	//readers waiting for their sensor see it is gone
+	cresta_chardevice_notify();
+    }
+    return removed;
+}
+
+/*
+ * Periodically removes sensors that fell silent, see sensor_ttl
+ */
+static void cresta_sensor_reaper(struct work_struct* work) {
+    unsigned int ttl = sensor_ttl;
+    int removed;
+
+    if(ttl) {
+	removed = remove_cresta_sensors((unsigned long) ttl * HZ);
+	if(removed) {
+	    printk(KERN_INFO "Removed %d sensors not seen for %u seconds\n", removed, ttl);
+	    sensors_removed += removed;
+	}
+    }
+    schedule_delayed_work(&reaper_work, round_jiffies_relative(CRESTA_REAPER_INTERVAL * HZ));
+}
+
 void cresta_sensor_mgmt_cleanup() {
+    cancel_delayed_work_sync(&reaper_work);
 
-    struct cresta_dev* ret = NULL;
-    struct cresta_dev* cursor = NULL;
-
-    mutex_lock(&mod_sensor_list_mutex);
-    list_for_each_entry_safe(ret, cursor, &cresta_sensor_list, list) {
-	list_del(&ret->list);
-	remove_device_entry(ret); //delete the /dev entries
-	delete_cresta_sensor(ret); //free the memory
-    }	
-    mutex_unlock(&mod_sensor_list_mutex);
+    remove_cresta_sensors(0);
+
+    //all records have been freed with their sensors
+    if(NULL != cresta_measurement_cache) {
+	kmem_cache_destroy(cresta_measurement_cache);
+	cresta_measurement_cache = NULL;
+    }
+}
+
+/*
+ * Allocates a measurement record for a decrypted datagram
+ */
+struct cresta_measurement_data* alloc_cresta_measurement_data(void) {
+    return kmem_cache_zalloc(cresta_measurement_cache, GFP_KERNEL);
+}
+
+void free_cresta_measurement_data(struct cresta_measurement_data *data) {
+    if(NULL != data) {
+	kmem_cache_free(cresta_measurement_cache, data);
+    }
 }
 
 
@@ -59,33 +200,38 @@ void cresta_sensor_mgmt_cleanup() {
  * handle_decrypted_sensor_data for further processing
  */
 void handle_encrypted_sensor_data(struct work_struct* work) {
-  struct timespec measurement_time;
+  //datagrams are decrypted in place, so most of the noise is
+  //discarded without touching the allocator
+  uint8_t packet[CRESTA_MAXDATA_LEN];
+
  //get time of IRQ from FIFO
   while(!kfifo_is_empty(&rawdata_kfifo)) {
-     struct cresta_measurement_data *sensor_data = kzalloc(sizeof(struct cresta_measurement_data), GFP_KERNEL);
+     struct cresta_measurement_data *sensor_data;
+
+     if(kfifo_out(&rawdata_kfifo, packet, sizeof(packet)) != sizeof(packet)) {
+	//fifo returned less bytes than requested 
+	printk(KERN_ERR "Error, kfifo didn't return a complete measurement record\n");
+	continue;
+     }
+     if(decrypt_and_check(packet)) {
+	//decrypt failed
+	//printk(KERN_INFO "Decryption failed\n");
+	decrypt_failures++;
+	continue;
+     }
+
+     sensor_data = alloc_cresta_measurement_data();
      if(NULL != sensor_data) {
-	if(kfifo_out(&rawdata_kfifo, sensor_data->measurement.decrypted_data, sizeof(sensor_data->measurement.decrypted_data)) == sizeof(sensor_data->measurement.decrypted_data)) {
-	  //printk(KERN_INFO "data[0] = %x\n", sensor_data->measurement.decrypted_data[0]);
-	  if(!decrypt_and_check(sensor_data->measurement.decrypted_data)) {
-	     // printk(KERN_INFO "Copied %d bytes.\n", sizeof(sensor_data->measurement.decrypted_data));
-	      sensor_data->sensor_address = get_sensor_address_from_decrypted_data(sensor_data->measurement.decrypted_data);
-	      sensor_data->len            = get_packet_length_from_decrypted_data(sensor_data->measurement.decrypted_data);
-	      sensor_data->sensor_type    = get_sensor_type_from_decrypted_data(sensor_data->measurement.decrypted_data);
-	      getnstimeofday(&measurement_time);
-	      sensor_data->measurement.measurement_time_seconds = measurement_time.tv_sec;
-	      if(handle_decrypted_sensor_data(sensor_data)) {
-		//an error occured
-		kfree(sensor_data);
-	      }
-	  } else {
-	    //decrypt failed
-	    //printk(KERN_INFO "Decryption failed\n");
-	    kfree(sensor_data);
-	  }
-	} else {
-	  //fifo returned less bytes than requested 
-	  printk(KERN_ERR "Error, kfifo didn't return a complete measurement record\n");
-	  kfree(sensor_data);
+	//counted here only, the decrypt work never runs concurrently
+	measurements_allocated++;
+	memcpy(sensor_data->measurement.decrypted_data, packet, sizeof(packet));
+	sensor_data->sensor_address = get_sensor_address_from_decrypted_data(sensor_data->measurement.decrypted_data);
+	sensor_data->len            = get_packet_length_from_decrypted_data(sensor_data->measurement.decrypted_data);
+	sensor_data->sensor_type    = get_sensor_type_from_decrypted_data(sensor_data->measurement.decrypted_data);
+	cresta_init_measurement_record(sensor_data, ktime_to_ns(ktime_get_real()));
+	if(handle_decrypted_sensor_data(sensor_data)) {
+	  //an error occured
+	  free_cresta_measurement_data(sensor_data);
 	}
      } else {
        //out of memory
@@ -96,156 +242,249 @@ void handle_encrypted_sensor_data(struct work_struct* work) {
 }
 
 /*
- * Helper routine for checking decrypted data
- */ 
-uint8_t second_check(uint8_t b) { 
-    uint8_t c;
+ * Makes data the current measurement of its sensor, creating the
+ * sensor if needed. Takes ownership of data unless an error is
+ * returned
+ */
+int handle_decrypted_sensor_data(struct cresta_measurement_data *data) {
+    struct cresta_measurement_data *old_data = NULL;
+    struct cresta_measurement_record record;
+    struct cresta_dev* sensor;
 
-    if (b&0x80) {
-	b^=0x95;
-    }
-    c = b^(b>>1); 
-    if (b&1) {
-	c^=0x5f; 
+    //the sensor must not be removed while we update it
+    mutex_lock(&measurement_update_mutex);
+
+    //get the sensor
+    sensor = get_cresta_sensor_by_address(data->sensor_address);
+    if(NULL == sensor) {
+	printk(KERN_INFO "Received data of new sensor. Asking for device creation.\n");
+	sensor = create_cresta_sensor(data->sensor_address, data->sensor_type);
+	if(NULL == sensor) {
+	    printk(KERN_ERR "Device creation request failed. Aborting.\n");
+	    mutex_unlock(&measurement_update_mutex);
+	    return -1;
+	} else {
+	    if(add_cresta_sensor_to_registry(sensor)) {
+		printk(KERN_ERR "Adding new device to device registry failed. Aborting.\n");
+		delete_cresta_sensor(sensor);
+		mutex_unlock(&measurement_update_mutex);
+		return -1;
+	    } else {
+	        //the character device and entries in /dev are created
+	        //later, so packets queued behind this one don't have to
+	        //wait for udev
+	        schedule_work(&sensor->devnode_work);
+	    }
+	}
     }
-    
-    if (c&1) {
-	b^=0x5f;
+
+    //if we got this far, we have a sensor, that can handle the measurement data
+    sensor->last_seen = jiffies;
+    old_data = sensor->current_data;
+    if(NULL != old_data && cresta_is_repeated_transmission(&old_data->measurement, &data->measurement)) {
+	//readers keep the record they have, it is the same measurement
+	mutex_unlock(&measurement_update_mutex);
+	free_cresta_measurement_data(data);
+	return 0;
     }
-    
-    return b^(c>>1); 
+    data->measurement.sequence = ++sensor->sequence;
+    rcu_assign_pointer(sensor->current_data, data);
+    cresta_iio_push(sensor->iio, &data->measurement);
+    //the reaper may free data as soon as we unlock
+    record = data->measurement;
+    mutex_unlock(&measurement_update_mutex);
+    cresta_chardevice_notify();
+    cresta_netlink_notify(&record);
+
+    synchronize_rcu(); /* Wait for grace period. */
+    free_cresta_measurement_data(old_data);
+    return 0;
 }
 
 /*
- * Helper routine for decrypting data
+ * Parses a sensor type given by name or number
  */
-bool decrypt_and_check(uint8_t* raw_data) {
-  
-    uint8_t cs1,cs2,i; 
-    uint8_t decodedByte;
-    uint8_t packet_length;
-    cs1=0; 
-    cs2=0;
-    decodedByte = raw_data[2]^(raw_data[2]<<1);
-    packet_length = (decodedByte >> 1) & 0x1f;
-    if(packet_length >= CRESTA_MIN_ANNOUNCED_LEN && packet_length <= CRESTA_MAX_ANNOUNCED_LEN) {
-      
-      //printk(KERN_INFO "Packet length = %d.\n", packet_length);
-      
-      
-      for (i=1; i<packet_length+2; i++) { 
-	  cs1^=raw_data[i]; 
-	  cs2 = second_check(raw_data[i]^cs2); 
-	  raw_data[i] ^= raw_data[i] << 1; 
-      } 
-
-      if (cs1) {
-	  return -1; 
-      }
-
-      if (cs2 != raw_data[packet_length+2]) {
-	  return -1;
-      }
-    
-      return 0;
-    } else {
-      printk (KERN_INFO "Bogus packet length: %d. aborting decoding\n", packet_length);
-      return -1;
+static int parse_sensor_type(const char *name, uint8_t *type) {
+    if(0 == strcmp(name, "thermohygro")) {
+	*type = CRESTA_SENSOR_TYPE_THERMOHYGRO;
+    } else if(0 == strcmp(name, "anemometer")) {
+	*type = CRESTA_SENSOR_TYPE_ANEMOMETER;
+    } else if(0 == strcmp(name, "uv")) {
+	*type = CRESTA_SENSOR_TYPE_UV;
+    } else if(0 == strcmp(name, "rain")) {
+	*type = CRESTA_SENSOR_TYPE_RAIN;
+    } else if(kstrtou8(name, 0, type)) {
+	return -EINVAL;
     }
+    return 0;
 }
 
 /*
- * Does most of the work regarding sensor data processing.
- *   - determines sensor for handling data
- *   - if no sensor found, new one will be created
- *   - updates data of sensor responsible for handling the data
+ * Creates a sensor before it transmitted. spec is
+ * address:type[:data[:seconds]], data being the decrypted datagram in
+ * hex as read from the sensor's device at header_len. If the
+ * sensor exists, only missing measurement data is filled in
  */
-int handle_decrypted_sensor_data(struct cresta_measurement_data *data) {
-    int success = 0;
+int cresta_seed_sensor(char *spec) {
+    struct cresta_measurement_data *data = NULL;
+    struct cresta_dev* sensor;
+    char *field;
+    uint8_t sensor_addr;
+    uint8_t sensor_type;
+    bool created = false;
+
+    spec = strim(spec);
+    field = strsep(&spec, ":");
+    if(NULL == field || kstrtou8(field, 0, &sensor_addr)) {
+	return -EINVAL;
+    }
+    field = strsep(&spec, ":");
+    if(NULL == field || parse_sensor_type(field, &sensor_type)) {
+	return -EINVAL;
+    }
 
-    //get the sensor
-    struct cresta_dev* sensor = get_cresta_sensor_by_address(data->sensor_address);
+    //last known measurement
+    field = strsep(&spec, ":");
+    if(NULL != field) {
+	uint64_t timestamp_ns = ktime_to_ns(ktime_get_real());
+	unsigned long long seconds;
+
+	data = alloc_cresta_measurement_data();
+	if(NULL == data) {
+	    return -ENOMEM;
+	}
+	if(strlen(field) > 2 * CRESTA_MAXDATA_LEN || strlen(field) % 2 ||
+	   hex2bin(data->measurement.decrypted_data, field, strlen(field) / 2)) {
+	    free_cresta_measurement_data(data);
+	    return -EINVAL;
+	}
+	data->sensor_address = get_sensor_address_from_decrypted_data(data->measurement.decrypted_data);
+	data->len            = get_packet_length_from_decrypted_data(data->measurement.decrypted_data);
+	data->sensor_type    = get_sensor_type_from_decrypted_data(data->measurement.decrypted_data);
+	if(data->sensor_address != sensor_addr || data->sensor_type != sensor_type) {
+	    free_cresta_measurement_data(data);
+	    return -EINVAL;
+	}
+
+	field = strsep(&spec, ":");
+	if(NULL != field) {
+	    if(kstrtoull(field, 0, &seconds)) {
+		free_cresta_measurement_data(data);
+		return -EINVAL;
+	    }
+	    timestamp_ns = (uint64_t) seconds * NSEC_PER_SEC;
+	}
+	cresta_init_measurement_record(data, timestamp_ns);
+	data->measurement.flags = CRESTA_RECORD_FLAG_SEEDED;
+    }
+
+    mutex_lock(&measurement_update_mutex);
+    sensor = get_cresta_sensor_by_address(sensor_addr);
     if(NULL == sensor) {
-	printk(KERN_INFO "Received data of new sensor. Asking for device creation.\n");
-	sensor = create_cresta_sensor(data->sensor_address, data->sensor_type);
-	if(NULL == sensor) {
-	    printk(KERN_ERR "Device creation request failed. Aborting.\n");
-	    success = -1;
-	    return success;
-	} else {
-	    if(add_cresta_sensor_to_sensor_list(sensor)) {
-		printk(KERN_ERR "Adding new device to device list failed. Aborting.\n");
+	sensor = create_cresta_sensor(sensor_addr, sensor_type);
+	if(NULL == sensor || add_cresta_sensor_to_registry(sensor)) {
+	    mutex_unlock(&measurement_update_mutex);
+	    if(NULL != sensor) {
 		delete_cresta_sensor(sensor);
-		success = -1;
-		return success;
-	    } else {
-	        //add the character device and entries in /dev
-	        make_device_entry(sensor);
-//		printk(KERN_INFO "Adding new device to device list succeeded\n");
 	    }
+	    free_cresta_measurement_data(data);
+	    return -ENOMEM;
 	}
+	created = true;
+    }
+    //never replace data received from the sensor itself
+    if(NULL != data && NULL == sensor->current_data) {
+	rcu_assign_pointer(sensor->current_data, data);
+	data = NULL;
+    }
+    if(created) {
+	//the reaper may free the sensor as soon as we unlock
+	schedule_work(&sensor->devnode_work);
     }
+    mutex_unlock(&measurement_update_mutex);
 
-    //if we got this far, we have a sensor, that can handle the measurement data
-    success = update_cresta_sensor_data(sensor, data);
-    return success;
+    if(created) {
+	printk(KERN_INFO "Seeded sensor %x of type %x\n", sensor_addr, sensor_type);
+    }
+    //no reader can have seen data that wasn't used
+    free_cresta_measurement_data(data);
+    return 0;
 }
 
 /*
- * Updates the sensor data of a sensor. Takes care of locking for
- * thread safe update of data
+ * Creates the sensors given by the seed_sensors parameter
  */
-int update_cresta_sensor_data(struct cresta_dev* sensor, struct cresta_measurement_data *new_data) {
-    struct cresta_measurement_data *old_data = NULL;
-    mutex_lock(&(sensor->measurement_data_mutex));
-    old_data = sensor->current_data;
-    rcu_assign_pointer(sensor->current_data, new_data);
-    mutex_unlock(&(sensor->measurement_data_mutex));
-    synchronize_rcu(); /* Wait for grace period. */
-    kfree(old_data);
-    //printk(KERN_INFO "Measurement data updated\n");
-    return 0;
+void cresta_seed_sensors(void) {
+    char spec[CRESTA_SEED_SPEC_LEN];
+    int i;
+
+    for(i = 0; i < seed_sensor_count; i++) {
+	strlcpy(spec, seed_sensors[i], sizeof(spec));
+	if(cresta_seed_sensor(spec)) {
+	    printk(KERN_WARNING "Invalid sensor in seed_sensors: %s\n", seed_sensors[i]);
+	}
+    }
+}
+
+/*
+ * Deferred creation of the /dev entry
+ */
+static void cresta_sensor_devnode_work(struct work_struct* work) {
+    struct cresta_dev* sensor = container_of(work, struct cresta_dev, devnode_work);
+    struct iio_dev *iio;
+
+    if(!make_device_entry(sensor)) {
+	sensor->has_device_entry = true;
+    }
+
+    //measurements are pushed to the IIO buffer under the update lock
+    iio = cresta_iio_create(sensor);
+    mutex_lock(&measurement_update_mutex);
+    sensor->iio = iio;
+    mutex_unlock(&measurement_update_mutex);
+}
+
+/*
+ * Looks up a sensor, caller has to hold the RCU read lock
+ */
+struct cresta_dev* get_cresta_sensor_by_address_rcu(uint8_t sensor_addr) {
+    return rcu_dereference(cresta_sensors[sensor_addr]);
 }
 
 /*
  * Tries to retrieve the sensor with given address from
- * Internal sensor list. If sensor doesn't exist (e.g. because
+ * internal sensor registry. If sensor doesn't exist (e.g. because
  * it was just turned on), NULL is returned
  */
 struct cresta_dev* get_cresta_sensor_by_address(uint8_t sensor_addr) {
     struct cresta_dev* ret = NULL;
-    bool found = false;
 
+    //NOTE: sensors are only freed under measurement_update_mutex, callers
+    //using the sensor after the lookup have to hold it
     rcu_read_lock();
-    list_for_each_entry_rcu(ret, &cresta_sensor_list, list) {
-	if(ret->sensor_addr == sensor_addr) {
-	    found = true;
-	    break;
-	}
-    }
+    ret = get_cresta_sensor_by_address_rcu(sensor_addr);
     rcu_read_unlock();
 
-    if(!found) {
-	//printk(KERN_INFO "No sensor found with address %x.\n", sensor_addr);
-	ret = NULL;
-    }
-
-
     return ret;
 }
 
 /*
  * Creates a new sensor and fills in some internal meta information.
- * Does NOT add sensor to sensor list (done explicitly after calling
- * this function
+ * Does NOT add sensor to the registry (done explicitly after calling
+ * this function). Its /dev entry and IIO device are created by
+ * devnode_work, once it is in the registry
  */
 struct cresta_dev* create_cresta_sensor(uint8_t sensor_addr, uint8_t sensor_type) {
     struct cresta_dev* new_sensor = kmalloc(sizeof(struct cresta_dev), GFP_KERNEL);
     if(NULL != new_sensor) {
 	new_sensor->sensor_addr = sensor_addr;
 	new_sensor->sensor_type = sensor_type;
-	mutex_init(&(new_sensor->measurement_data_mutex));
 	new_sensor->current_data = NULL;
+	new_sensor->iio = NULL;
+	new_sensor->has_device_entry = false;
+	new_sensor->last_seen = jiffies;
+	new_sensor->sequence = 0;
+	INIT_WORK(&new_sensor->devnode_work, cresta_sensor_devnode_work);
     } else {
 	printk(KERN_ERR "Cannot create cresta device. Out of memory.\n");
     }
@@ -254,17 +493,18 @@ struct cresta_dev* create_cresta_sensor(uint8_t sensor_addr, uint8_t sensor_type
 }
 
 /*
- * We store sensors in an internal list. Whenever we receive data of
- * a sensor we haven't seen yet, we create a new one and add it
- * to our internal list.
- * This helper function takes care of locking the sensor list, so that
- * it can be modified in a thread safe manner
+ * We store sensors in an internal registry, indexed by address and
+ * read under RCU. Whenever we receive data of a sensor we haven't seen
+ * yet, we create a new one and add it to the registry.
+ * This helper function takes care of locking the registry, so that
+ * it can be modified in a thread safe manner. Readers see the sensor
+ * as soon as it is added
  */
-int add_cresta_sensor_to_sensor_list(struct cresta_dev* new_sensor) {
+int add_cresta_sensor_to_registry(struct cresta_dev* new_sensor) {
 /*
  * Due to multithreading we might run into following situation:
  *
- * Thread A and B both try to add a new sensor with same address to list
+ * Thread A and B both try to add a new sensor with same address to registry
  * (this scenario is likely:
      - sensors send measurement data 3 times in with 10ms interarrival time
      - if we don't find a sensor device for handling data, we create a new one
@@ -286,7 +526,7 @@ int add_cresta_sensor_to_sensor_list(struct cresta_dev* new_sensor) {
  *   from the returned pointer of add_list (new_device_a)
  *   Is probably very error prone, hence following solution:
  *
- *   We DO make a sanity check in add_cresta_sensor_to_sensor_list, to see
+ *   We DO make a sanity check in add_cresta_sensor_to_registry, to see
  *   whether the new sensor's address is already handled. If that is the
  *   case, we return a negative value, indicating an error
  *   The caller should then in case of an error free up the memory of the
@@ -298,33 +538,33 @@ int add_cresta_sensor_to_sensor_list(struct cresta_dev* new_sensor) {
  */
     int success = 0;
     if(NULL != new_sensor) {
-        mutex_lock(&mod_sensor_list_mutex);
+        mutex_lock(&mod_sensor_registry_mutex);
 	//due to multi threading we have to do an additional check for
-        //presence in list right here
-	if(get_cresta_sensor_by_address(new_sensor->sensor_addr)) {
-	    printk(KERN_WARNING "Not adding sensor to list, already present.\n");
+        //presence in registry right here
+	if(rcu_dereference_protected(cresta_sensors[new_sensor->sensor_addr], lockdep_is_held(&mod_sensor_registry_mutex))) {
+	    printk(KERN_WARNING "Not adding sensor to registry, already present.\n");
 	    success = -1;
 	} else {
-	    printk(KERN_INFO "Adding new sensor to list.\n");
-	    list_add_rcu(&(new_sensor->list), &cresta_sensor_list);
+	    printk(KERN_INFO "Adding new sensor to registry.\n");
+	    rcu_assign_pointer(cresta_sensors[new_sensor->sensor_addr], new_sensor);
 	}
-        mutex_unlock(&mod_sensor_list_mutex);
+        mutex_unlock(&mod_sensor_registry_mutex);
     } else {
-	printk(KERN_ERR "Sensor device is NULL. Not adding to sensor list.\n");
+	printk(KERN_ERR "Sensor device is NULL. Not adding to sensor registry.\n");
 	success = -2;
     }
     return success;
 }
 
-
 /*
- * Precondition: sensor isn't in sensor list any more
- * Deletes a sensor. Currently only freeing memory and
- * measurement data of sensor
+ * Precondition: sensor isn't in the registry any more, and if it was,
+ * an RCU grace period has passed since, so no reader can have it.
+ * Deletes a sensor. Currently only freeing memory and measurement
+ * data of sensor, the caller removes its /dev entry and IIO device
  */
 void delete_cresta_sensor(struct cresta_dev* sensor) {
     if(NULL != sensor->current_data) {
-      kfree(sensor->current_data);
+      free_cresta_measurement_data(sensor->current_data);
     }
     kfree(sensor);
 }
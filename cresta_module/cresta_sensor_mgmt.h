@@ -18,20 +18,31 @@
 #define _CRESTA_SENSOR_MGMT_H_
 
 #include "cresta_chardevice.h"
+#include "../cresta_common/cresta_protocol.h"
+
+//seconds between checks for silent sensors, see sensor_ttl
+#ifndef CRESTA_REAPER_INTERVAL
+#define CRESTA_REAPER_INTERVAL 60
+#endif
+
+//sensors in the seed_sensors parameter and length of a single one
+#define CRESTA_MAX_SEEDS     16
+#define CRESTA_SEED_SPEC_LEN 64
 
 int                cresta_sensor_mgmt_init(void);
 void               cresta_sensor_mgmt_cleanup(void);
 
+struct cresta_measurement_data* alloc_cresta_measurement_data(void);
+void               free_cresta_measurement_data(struct cresta_measurement_data*);
 void               handle_encrypted_sensor_data(struct work_struct*);
 int                handle_decrypted_sensor_data(struct cresta_measurement_data*);
-uint8_t            second_check(uint8_t);
-bool               decrypt_and_check(uint8_t*);
-int                update_cresta_sensor_data(struct cresta_dev*, struct cresta_measurement_data*);
+int                cresta_seed_sensor(char*);
+void               cresta_seed_sensors(void);
 struct cresta_dev* get_cresta_sensor_by_address(uint8_t);
+struct cresta_dev* get_cresta_sensor_by_address_rcu(uint8_t);
 struct cresta_dev* create_cresta_sensor(uint8_t, uint8_t);
 void               delete_cresta_sensor(struct cresta_dev*);
-int                add_cresta_sensor_to_sensor_list(struct cresta_dev*);
-uint8_t            get_preamble_from_decrypted_data(uint8_t* decrypted_data);
+int                add_cresta_sensor_to_registry(struct cresta_dev*);
 uint8_t            get_sensor_address_from_decrypted_data(uint8_t* decrypted_data);
 uint8_t            get_packet_length_from_decrypted_data(uint8_t* decrypted_data);
 uint8_t            get_sensor_type_from_decrypted_data(uint8_t* decrypted_data);
@@ -0,0 +1,1927 @@
+/*
+ * Kernel API shim for building the module's sensor pipeline as a user
+ * space program, see include/cresta_kernel.h and cresta_shim.h
+ *
+ * License: GPLv3. See license.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include "include/cresta_kernel.h"
+#include "cresta_shim.h"
+
+#define SHIM_MAX_PARAMS   64
+#define SHIM_MAX_REGIONS  8
+#define SHIM_MAX_CDEVS    8
+#define SHIM_MAX_DEVICES  512
+#define SHIM_MAX_MISC     8
+#define SHIM_MAX_CLASSES  4
+#define SHIM_MAX_ATTRS    16
+#define SHIM_MAX_DENTRIES 32
+#define SHIM_MAX_GENL     4
+#define SHIM_NAME_LEN     64
+#define SHIM_PATH_LEN     128
+
+//workers per work queue, more than the kernel would use for max_active 1
+#define SHIM_WORKERS      4
+#define SHIM_IRQ_BASE     100
+#define SHIM_MISC_MAJOR   10
+#define SHIM_DYNAMIC_MAJOR 254
+//generic netlink ids below are used by the kernel itself
+#define SHIM_GENL_ID_BASE  0x20
+
+#define SHIM_PARAMETER_DIR "/sys/module/cresta/parameters/"
+#define SHIM_CLASS_DIR     "/sys/class/"
+#define SHIM_DEBUGFS_DIR   "/sys/kernel/debug/"
+#define SHIM_DEV_DIR       "/dev/"
+
+struct shim_param {
+    char name[SHIM_NAME_LEN];
+    void *value;
+    enum cresta_shim_param_type type;
+    unsigned int max;
+    int *count;
+    umode_t perm;
+    char *storage;	//strings of charp parameters
+};
+
+struct shim_region {
+    char name[SHIM_NAME_LEN];
+    dev_t first;
+    unsigned int count;
+};
+
+struct device {
+    bool in_use;
+    dev_t devt;
+    struct class *class;
+    char name[SHIM_NAME_LEN];
+};
+
+struct shim_class_attr {
+    struct class *class;
+    const struct class_attribute *attr;
+    int active;			//stores running
+    bool removing;
+};
+
+struct dentry {
+    bool in_use;
+    char path[SHIM_PATH_LEN];	//relative to the debugfs root
+    const struct file_operations *fops;
+    u32 *value;
+};
+
+struct workqueue_struct {
+    char name[SHIM_NAME_LEN];
+    struct work_struct *head;
+    struct work_struct *tail;
+    int running;		//work items being executed
+    bool stopping;
+    pthread_cond_t more;	//work queued or stopping
+    pthread_t workers[SHIM_WORKERS];
+};
+
+//protects the registries below
+static pthread_mutex_t shim_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct shim_param params[SHIM_MAX_PARAMS];
+static int param_count;
+static struct shim_region regions[SHIM_MAX_REGIONS];
+static struct cdev *cdevs[SHIM_MAX_CDEVS];
+static struct device devices[SHIM_MAX_DEVICES];
+static struct miscdevice *miscs[SHIM_MAX_MISC];
+static struct class *classes[SHIM_MAX_CLASSES];
+static struct shim_class_attr class_attrs[SHIM_MAX_ATTRS];
+static pthread_cond_t class_attr_idle = PTHREAD_COND_INITIALIZER;	//store finished
+static struct dentry dentries[SHIM_MAX_DENTRIES];
+static int next_major = SHIM_DYNAMIC_MAJOR;
+static struct genl_family *genl_families[SHIM_MAX_GENL];
+static const struct genl_multicast_group *genl_groups[SHIM_MAX_GENL];
+static unsigned int genl_group_ids[SHIM_MAX_GENL];
+static unsigned int next_genl_id = SHIM_GENL_ID_BASE;
+static cresta_shim_genl_listener genl_listener;
+struct net init_net;
+
+//protects all work items and work queues
+static pthread_mutex_t wq_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wq_idle = PTHREAD_COND_INITIALIZER;	//work item finished
+static pthread_cond_t timer_cond;
+static struct delayed_work *timers;
+static pthread_t timer_thread;
+static bool timer_stopping;
+struct workqueue_struct *system_wq;
+
+//interrupt line, the handler runs under irq_lock
+static pthread_mutex_t irq_lock = PTHREAD_MUTEX_INITIALIZER;
+static irq_handler_t irq_handler;
+static void *irq_dev;
+static int irq_disabled;
+static int irq_level;
+static __thread bool irq_time_valid;
+static __thread ktime_t irq_time;
+
+static pthread_rwlock_t rcu_lock;
+__thread int cresta_shim_rcu_depth;
+__thread int cresta_shim_atomic_depth;
+
+int nr_cpu_ids = 1;
+static int loglevel = 4;
+static unsigned int errors;
+
+
+/*
+ * Reports a bug of the module found by the shim
+ */
+static void shim_bug(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static void shim_bug(const char *fmt, ...) {
+    va_list args;
+
+    va_start(args, fmt);
+    flockfile(stderr);
+    fprintf(stderr, "BUG: ");
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    funlockfile(stderr);
+    va_end(args);
+    __atomic_fetch_add(&errors, 1, __ATOMIC_RELAXED);
+}
+
+static uint64_t clock_ns(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void __attribute__((constructor)) shim_init(void) {
+    pthread_rwlockattr_t attr;
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+
+    //writers must not starve while readers keep coming
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&rcu_lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+
+    if (cpus > 0) {
+	nr_cpu_ids = cpus;
+    }
+}
+
+
+/*
+ * Logging and context checks
+ */
+int printk(const char *fmt, ...) {
+    int level = 4;
+    va_list args;
+    int ret = 0;
+
+    if ('<' == fmt[0] && isdigit((unsigned char) fmt[1]) && '>' == fmt[2]) {
+	level = fmt[1] - '0';
+	fmt += 3;
+    }
+    if (level <= 3) {
+	__atomic_fetch_add(&errors, 1, __ATOMIC_RELAXED);
+    }
+    if (level <= loglevel) {
+	va_start(args, fmt);
+	ret = vfprintf(stderr, fmt, args);
+	va_end(args);
+    }
+    return ret;
+}
+
+void cresta_shim_might_sleep(const char *caller) {
+    if (cresta_shim_atomic_depth > 0 || cresta_shim_rcu_depth > 0) {
+	shim_bug("sleeping function called from invalid context by %s", caller);
+    }
+}
+
+void cresta_shim_set_loglevel(int level) {
+    loglevel = level;
+}
+
+unsigned int cresta_shim_errors(void) {
+    return __atomic_load_n(&errors, __ATOMIC_RELAXED);
+}
+
+
+/*
+ * Memory
+ */
+struct kmem_cache {
+    char name[SHIM_NAME_LEN];
+    size_t size;
+    long objects;
+};
+
+void *kmalloc(size_t size, gfp_t flags) {
+    if (GFP_KERNEL == flags) {
+	might_sleep();
+    }
+    return malloc(size);
+}
+
+void *kzalloc(size_t size, gfp_t flags) {
+    if (GFP_KERNEL == flags) {
+	might_sleep();
+    }
+    return calloc(1, size);
+}
+
+void kfree(const void *ptr) {
+    free((void *) ptr);
+}
+
+struct kmem_cache *kmem_cache_create(const char *name, size_t size, size_t align,
+				     unsigned long flags, void (*ctor)(void *)) {
+    struct kmem_cache *cache = calloc(1, sizeof(struct kmem_cache));
+
+    if (NULL != cache) {
+	snprintf(cache->name, sizeof(cache->name), "%s", name);
+	cache->size = size;
+    }
+    return cache;
+}
+
+void *kmem_cache_alloc(struct kmem_cache *cache, gfp_t flags) {
+    void *obj = kmalloc(cache->size, flags);
+
+    if (NULL != obj) {
+	__atomic_fetch_add(&cache->objects, 1, __ATOMIC_RELAXED);
+    }
+    return obj;
+}
+
+void *kmem_cache_zalloc(struct kmem_cache *cache, gfp_t flags) {
+    void *obj = kmem_cache_alloc(cache, flags);
+
+    if (NULL != obj) {
+	memset(obj, 0, cache->size);
+    }
+    return obj;
+}
+
+void kmem_cache_free(struct kmem_cache *cache, void *obj) {
+    if (NULL != obj) {
+	__atomic_fetch_sub(&cache->objects, 1, __ATOMIC_RELAXED);
+	free(obj);
+    }
+}
+
+void kmem_cache_destroy(struct kmem_cache *cache) {
+    long objects = __atomic_load_n(&cache->objects, __ATOMIC_RELAXED);
+
+    if (objects) {
+	shim_bug("kmem_cache_destroy %s: slab cache still has %ld objects", cache->name, objects);
+    }
+    free(cache);
+}
+
+void *vmalloc_user(unsigned long size) {
+    void *addr = aligned_alloc(PAGE_SIZE, PAGE_ALIGN(size));
+
+    if (NULL != addr) {
+	memset(addr, 0, PAGE_ALIGN(size));
+    }
+    return addr;
+}
+
+void vfree(const void *addr) {
+    free((void *) addr);
+}
+
+//mappings can't be shared with the caller of the shim
+int remap_vmalloc_range(struct vm_area_struct *vma, void *addr, unsigned long pgoff) {
+    return -ENODEV;
+}
+
+
+/*
+ * Strings
+ */
+size_t cresta_shim_strlcpy(char *dest, const char *src, size_t size) {
+    size_t len = strlen(src);
+
+    if (size) {
+	size_t copy = len >= size ? size - 1 : len;
+	memcpy(dest, src, copy);
+	dest[copy] = '\0';
+    }
+    return len;
+}
+
+char *strim(char *s) {
+    size_t len;
+
+    while (isspace((unsigned char) *s)) {
+	s++;
+    }
+    len = strlen(s);
+    while (len > 0 && isspace((unsigned char) s[len - 1])) {
+	s[--len] = '\0';
+    }
+    return s;
+}
+
+static int hex_to_bin(char c) {
+    if (c >= '0' && c <= '9') {
+	return c - '0';
+    }
+    c = tolower((unsigned char) c);
+    if (c >= 'a' && c <= 'f') {
+	return c - 'a' + 10;
+    }
+    return -1;
+}
+
+int hex2bin(u8 *dst, const char *src, size_t count) {
+    while (count--) {
+	int hi = hex_to_bin(*src++);
+	int lo;
+
+	if (hi < 0) {
+	    return -EINVAL;
+	}
+	lo = hex_to_bin(*src++);
+	if (lo < 0) {
+	    return -EINVAL;
+	}
+	*dst++ = (hi << 4) | lo;
+    }
+    return 0;
+}
+
+/*
+ * Like the kernel, no leading white space and only a
+ * trailing newline is accepted
+ */
+int kstrtoull(const char *s, unsigned int base, unsigned long long *res) {
+    unsigned long long value;
+    char *end;
+
+    if ('+' == *s) {
+	s++;
+    }
+    if (!isxdigit((unsigned char) *s)) {
+	return -EINVAL;
+    }
+    errno = 0;
+    value = strtoull(s, &end, base);
+    if (ERANGE == errno) {
+	return -ERANGE;
+    }
+    if ('\n' == *end) {
+	end++;
+    }
+    if (end == s || *end) {
+	return -EINVAL;
+    }
+    *res = value;
+    return 0;
+}
+
+int kstrtou8(const char *s, unsigned int base, u8 *res) {
+    unsigned long long value;
+    int ret = kstrtoull(s, base, &value);
+
+    if (ret) {
+	return ret;
+    }
+    if (value > 0xFF) {
+	return -ERANGE;
+    }
+    *res = value;
+    return 0;
+}
+
+
+/*
+ * Time
+ */
+ktime_t ktime_get(void) {
+    if (irq_time_valid) {
+	return irq_time;
+    }
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+ktime_t ktime_get_real(void) {
+    return clock_ns(CLOCK_REALTIME);
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 0, 0)
+void getnstimeofday(struct timespec *ts) {
+    clock_gettime(CLOCK_REALTIME, ts);
+}
+#endif
+
+unsigned long cresta_shim_jiffies(void) {
+    return INITIAL_JIFFIES + clock_ns(CLOCK_MONOTONIC) / (1000000000ULL / HZ);
+}
+
+bool cpu_online(unsigned int cpu) {
+    return cpu < (unsigned int) nr_cpu_ids;
+}
+
+unsigned long find_first_zero_bit(const unsigned long *addr, unsigned long size) {
+    unsigned long i;
+
+    for (i = 0; i < size; i++) {
+	unsigned long word = __atomic_load_n(&addr[i / BITS_PER_LONG], __ATOMIC_RELAXED);
+	if (!(word & (1UL << (i % BITS_PER_LONG)))) {
+	    return i;
+	}
+    }
+    return size;
+}
+
+
+/*
+ * Locks and RCU
+ */
+void mutex_init(struct mutex *lock) {
+    pthread_mutex_init(&lock->lock, NULL);
+}
+
+void mutex_lock(struct mutex *lock) {
+    might_sleep();
+    pthread_mutex_lock(&lock->lock);
+}
+
+void mutex_unlock(struct mutex *lock) {
+    pthread_mutex_unlock(&lock->lock);
+}
+
+void spin_lock(spinlock_t *lock) {
+    pthread_mutex_lock(&lock->lock);
+    cresta_shim_atomic_depth++;
+}
+
+void spin_unlock(spinlock_t *lock) {
+    cresta_shim_atomic_depth--;
+    pthread_mutex_unlock(&lock->lock);
+}
+
+void rcu_read_lock(void) {
+    if (0 == cresta_shim_rcu_depth++) {
+	pthread_rwlock_rdlock(&rcu_lock);
+    }
+}
+
+void rcu_read_unlock(void) {
+    if (cresta_shim_rcu_depth <= 0) {
+	shim_bug("rcu_read_unlock without rcu_read_lock");
+	return;
+    }
+    if (0 == --cresta_shim_rcu_depth) {
+	pthread_rwlock_unlock(&rcu_lock);
+    }
+}
+
+void synchronize_rcu(void) {
+    might_sleep();
+    if (cresta_shim_rcu_depth > 0) {
+	//would deadlock
+	return;
+    }
+    pthread_rwlock_wrlock(&rcu_lock);
+    pthread_rwlock_unlock(&rcu_lock);
+}
+
+
+/*
+ * Wait queues
+ */
+void wake_up_interruptible(wait_queue_head_t *q) {
+    pthread_mutex_lock(&q->lock);
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void cresta_shim_wait(wait_queue_head_t *q) {
+    struct timespec timeout;
+
+    might_sleep();
+    clock_gettime(CLOCK_REALTIME, &timeout);
+    timeout.tv_nsec += 10000000;
+    if (timeout.tv_nsec >= 1000000000) {
+	timeout.tv_sec++;
+	timeout.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&q->lock);
+    pthread_cond_timedwait(&q->cond, &q->lock, &timeout);
+    pthread_mutex_unlock(&q->lock);
+}
+
+
+/*
+ * Work queues. wq_lock has to be held by the functions
+ * starting with wq_
+ */
+static void wq_append(struct workqueue_struct *wq, struct work_struct *work) {
+    work->next = NULL;
+    work->wq = wq;
+    if (NULL == wq->tail) {
+	wq->head = work;
+    } else {
+	wq->tail->next = work;
+    }
+    wq->tail = work;
+    pthread_cond_signal(&wq->more);
+}
+
+static void wq_unlink(struct workqueue_struct *wq, struct work_struct *work) {
+    struct work_struct **link = &wq->head;
+    struct work_struct *previous = NULL;
+
+    while (NULL != *link && *link != work) {
+	previous = *link;
+	link = &(*link)->next;
+    }
+    if (NULL == *link) {
+	return;
+    }
+    *link = work->next;
+    if (wq->tail == work) {
+	wq->tail = previous;
+    }
+    work->next = NULL;
+}
+
+//first item that isn't running on another worker
+static struct work_struct *wq_next(struct workqueue_struct *wq) {
+    struct work_struct *work;
+
+    for (work = wq->head; NULL != work; work = work->next) {
+	if (!work->running) {
+	    return work;
+	}
+    }
+    return NULL;
+}
+
+static void *worker_thread(void *arg) {
+    struct workqueue_struct *wq = arg;
+
+    pthread_mutex_lock(&wq_lock);
+    for (;;) {
+	struct work_struct *work = wq_next(wq);
+
+	if (NULL == work) {
+	    if (wq->stopping) {
+		break;
+	    }
+	    pthread_cond_wait(&wq->more, &wq_lock);
+	    continue;
+	}
+
+	wq_unlink(wq, work);
+	work->pending = false;
+	work->running = true;
+	wq->running++;
+	pthread_mutex_unlock(&wq_lock);
+
+	work->func(work);
+
+	pthread_mutex_lock(&wq_lock);
+	work->running = false;
+	wq->running--;
+	pthread_cond_broadcast(&wq_idle);
+	//items skipped while this one ran
+	pthread_cond_broadcast(&wq->more);
+    }
+    pthread_mutex_unlock(&wq_lock);
+    return NULL;
+}
+
+static void *timer_thread_fn(void *arg) {
+    pthread_mutex_lock(&wq_lock);
+    while (!timer_stopping) {
+	struct delayed_work **link;
+	struct delayed_work *next = NULL;
+	uint64_t now = clock_ns(CLOCK_MONOTONIC);
+
+	for (link = &timers; NULL != *link; ) {
+	    struct delayed_work *dwork = *link;
+
+	    if (dwork->expires_ns <= now) {
+		*link = dwork->timer_next;
+		dwork->timer_armed = false;
+		wq_append(dwork->timer_wq, &dwork->work);
+		continue;
+	    }
+	    if (NULL == next || dwork->expires_ns < next->expires_ns) {
+		next = dwork;
+	    }
+	    link = &dwork->timer_next;
+	}
+
+	if (NULL == next) {
+	    pthread_cond_wait(&timer_cond, &wq_lock);
+	} else {
+	    struct timespec timeout;
+	    timeout.tv_sec = next->expires_ns / 1000000000ULL;
+	    timeout.tv_nsec = next->expires_ns % 1000000000ULL;
+	    pthread_cond_timedwait(&timer_cond, &wq_lock, &timeout);
+	}
+    }
+    pthread_mutex_unlock(&wq_lock);
+    return NULL;
+}
+
+struct workqueue_struct *alloc_workqueue(const char *fmt, unsigned int flags, int max_active, ...) {
+    struct workqueue_struct *wq = calloc(1, sizeof(struct workqueue_struct));
+    int i;
+
+    if (NULL == wq) {
+	return NULL;
+    }
+    snprintf(wq->name, sizeof(wq->name), "%s", fmt);
+    pthread_cond_init(&wq->more, NULL);
+    for (i = 0; i < SHIM_WORKERS; i++) {
+	if (pthread_create(&wq->workers[i], NULL, worker_thread, wq)) {
+	    abort();
+	}
+    }
+    return wq;
+}
+
+void flush_workqueue(struct workqueue_struct *wq) {
+    might_sleep();
+    pthread_mutex_lock(&wq_lock);
+    while (NULL != wq->head || wq->running) {
+	pthread_cond_wait(&wq_idle, &wq_lock);
+    }
+    pthread_mutex_unlock(&wq_lock);
+}
+
+void destroy_workqueue(struct workqueue_struct *wq) {
+    int i;
+
+    flush_workqueue(wq);
+    pthread_mutex_lock(&wq_lock);
+    wq->stopping = true;
+    pthread_cond_broadcast(&wq->more);
+    pthread_mutex_unlock(&wq_lock);
+
+    for (i = 0; i < SHIM_WORKERS; i++) {
+	pthread_join(wq->workers[i], NULL);
+    }
+    pthread_cond_destroy(&wq->more);
+    free(wq);
+}
+
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work) {
+    bool queued = false;
+
+    pthread_mutex_lock(&wq_lock);
+    if (!work->pending && !work->canceling) {
+	work->pending = true;
+	wq_append(wq, work);
+	queued = true;
+    }
+    pthread_mutex_unlock(&wq_lock);
+    return queued;
+}
+
+bool queue_work_on(int cpu, struct workqueue_struct *wq, struct work_struct *work) {
+    return queue_work(wq, work);
+}
+
+bool queue_delayed_work(struct workqueue_struct *wq, struct delayed_work *dwork, unsigned long delay) {
+    bool queued = false;
+
+    pthread_mutex_lock(&wq_lock);
+    if (!dwork->work.pending && !dwork->work.canceling) {
+	dwork->work.pending = true;
+	if (0 == delay) {
+	    wq_append(wq, &dwork->work);
+	} else {
+	    dwork->timer_wq = wq;
+	    dwork->expires_ns = clock_ns(CLOCK_MONOTONIC) + (uint64_t) delay * (1000000000ULL / HZ);
+	    dwork->timer_next = timers;
+	    dwork->timer_armed = true;
+	    timers = dwork;
+	    pthread_cond_signal(&timer_cond);
+	}
+	queued = true;
+    }
+    pthread_mutex_unlock(&wq_lock);
+    return queued;
+}
+
+/*
+ * Cancels a pending work item and waits until it stopped running.
+ * Attempts to queue it in the meantime fail
+ */
+static bool cancel_work(struct work_struct *work, struct delayed_work *dwork) {
+    bool pending;
+
+    might_sleep();
+    pthread_mutex_lock(&wq_lock);
+    work->canceling = true;
+    pending = work->pending;
+    if (NULL != dwork && dwork->timer_armed) {
+	struct delayed_work **link = &timers;
+
+	while (*link != dwork) {
+	    link = &(*link)->timer_next;
+	}
+	*link = dwork->timer_next;
+	dwork->timer_armed = false;
+    } else if (pending) {
+	wq_unlink(work->wq, work);
+    }
+    work->pending = false;
+
+    while (work->running) {
+	pthread_cond_wait(&wq_idle, &wq_lock);
+    }
+    work->canceling = false;
+    pthread_cond_broadcast(&wq_idle);
+    pthread_mutex_unlock(&wq_lock);
+    return pending;
+}
+
+bool cancel_work_sync(struct work_struct *work) {
+    return cancel_work(work, NULL);
+}
+
+bool cancel_delayed_work_sync(struct delayed_work *dwork) {
+    return cancel_work(&dwork->work, dwork);
+}
+
+static void shim_start(void) {
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&timer_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    timer_stopping = false;
+    if (pthread_create(&timer_thread, NULL, timer_thread_fn, NULL)) {
+	abort();
+    }
+    system_wq = alloc_workqueue("events", 0, 0);
+    if (NULL == system_wq) {
+	abort();
+    }
+}
+
+/*
+ * The module must have canceled all its work, only then
+ * it's safe to unload its code
+ */
+static void shim_stop(void) {
+    pthread_mutex_lock(&wq_lock);
+    if (NULL != timers) {
+	shim_bug("delayed work still pending after module exit");
+    }
+    if (NULL != system_wq->head || system_wq->running) {
+	shim_bug("work still queued on system_wq after module exit");
+    }
+    timer_stopping = true;
+    pthread_cond_signal(&timer_cond);
+    pthread_mutex_unlock(&wq_lock);
+
+    pthread_join(timer_thread, NULL);
+    pthread_cond_destroy(&timer_cond);
+    timers = NULL;
+    destroy_workqueue(system_wq);
+    system_wq = NULL;
+}
+
+
+/*
+ * Record kfifo. Records are stored with a 1 byte length, in and out
+ * are free running. A single reader and a single writer need no lock
+ */
+int cresta_shim_kfifo_alloc(struct kfifo_rec_ptr_1 *fifo, unsigned int size) {
+    unsigned int rounded = 2;
+
+    while (rounded < size) {
+	rounded <<= 1;
+    }
+    fifo->data = malloc(rounded);
+    if (NULL == fifo->data) {
+	return -ENOMEM;
+    }
+    fifo->mask = rounded - 1;
+    fifo->in = 0;
+    fifo->out = 0;
+    return 0;
+}
+
+void cresta_shim_kfifo_free(struct kfifo_rec_ptr_1 *fifo) {
+    free(fifo->data);
+    fifo->data = NULL;
+    fifo->mask = 0;
+}
+
+static void kfifo_copy_in(struct kfifo_rec_ptr_1 *fifo, unsigned int offset, const void *buf, unsigned int len) {
+    unsigned int i;
+
+    for (i = 0; i < len; i++) {
+	fifo->data[(offset + i) & fifo->mask] = ((const unsigned char *) buf)[i];
+    }
+}
+
+static void kfifo_copy_out(struct kfifo_rec_ptr_1 *fifo, unsigned int offset, void *buf, unsigned int len) {
+    unsigned int i;
+
+    for (i = 0; i < len; i++) {
+	((unsigned char *) buf)[i] = fifo->data[(offset + i) & fifo->mask];
+    }
+}
+
+unsigned int cresta_shim_kfifo_in(struct kfifo_rec_ptr_1 *fifo, const void *buf, unsigned int len) {
+    unsigned int in = fifo->in;
+    unsigned int out = __atomic_load_n(&fifo->out, __ATOMIC_ACQUIRE);
+    unsigned char reclen = len;
+
+    if (len > 0xFF || fifo->mask + 1 - (in - out) < len + 1) {
+	return 0;
+    }
+    kfifo_copy_in(fifo, in, &reclen, 1);
+    kfifo_copy_in(fifo, in + 1, buf, len);
+    __atomic_store_n(&fifo->in, in + len + 1, __ATOMIC_RELEASE);
+    return len;
+}
+
+//records longer than len are truncated
+unsigned int cresta_shim_kfifo_out(struct kfifo_rec_ptr_1 *fifo, void *buf, unsigned int len) {
+    unsigned int out = fifo->out;
+    unsigned int in = __atomic_load_n(&fifo->in, __ATOMIC_ACQUIRE);
+    unsigned char reclen;
+
+    if (in == out) {
+	return 0;
+    }
+    kfifo_copy_out(fifo, out, &reclen, 1);
+    if (len > reclen) {
+	len = reclen;
+    }
+    kfifo_copy_out(fifo, out + 1, buf, len);
+    __atomic_store_n(&fifo->out, out + reclen + 1, __ATOMIC_RELEASE);
+    return len;
+}
+
+bool cresta_shim_kfifo_is_empty(struct kfifo_rec_ptr_1 *fifo) {
+    return __atomic_load_n(&fifo->in, __ATOMIC_ACQUIRE) == __atomic_load_n(&fifo->out, __ATOMIC_RELAXED);
+}
+
+
+/*
+ * Module parameters
+ */
+void cresta_shim_register_param(const char *name, void *value, enum cresta_shim_param_type type,
+				unsigned int max, int *count, umode_t perm) {
+    struct shim_param *param;
+
+    if (param_count == SHIM_MAX_PARAMS) {
+	abort();
+    }
+    param = &params[param_count++];
+    snprintf(param->name, sizeof(param->name), "%s", name);
+    param->value = value;
+    param->type = type;
+    param->max = max;
+    param->count = count;
+    param->perm = perm;
+}
+
+static struct shim_param *find_param(const char *name) {
+    int i;
+
+    for (i = 0; i < param_count; i++) {
+	if (0 == strcmp(params[i].name, name)) {
+	    return &params[i];
+	}
+    }
+    return NULL;
+}
+
+static int set_param(struct shim_param *param, const char *value) {
+    char *end;
+
+    switch (param->type) {
+	case CRESTA_SHIM_PARAM_int: {
+	    long number = strtol(value, &end, 0);
+	    if (end == value || *end) {
+		return -EINVAL;
+	    }
+	    *(int *) param->value = number;
+	    break;
+	}
+	case CRESTA_SHIM_PARAM_uint: {
+	    unsigned long number = strtoul(value, &end, 0);
+	    if (end == value || *end) {
+		return -EINVAL;
+	    }
+	    *(unsigned int *) param->value = number;
+	    break;
+	}
+	case CRESTA_SHIM_PARAM_charp: {
+	    char **strings = param->value;
+	    char *storage = strdup(value);
+	    char *next = storage;
+	    unsigned int n = 0;
+
+	    if (NULL == storage) {
+		return -ENOMEM;
+	    }
+	    if (NULL == param->count) {
+		strings[0] = storage;
+		n = 1;
+	    } else {
+		char *field;
+		while (NULL != (field = strsep(&next, ","))) {
+		    if (n == param->max) {
+			free(storage);
+			return -EINVAL;
+		    }
+		    strings[n++] = field;
+		}
+		*param->count = n;
+	    }
+	    free(param->storage);
+	    param->storage = storage;
+	    break;
+	}
+    }
+    return 0;
+}
+
+static int format_param(struct shim_param *param, char *buf, size_t count) {
+    switch (param->type) {
+	case CRESTA_SHIM_PARAM_int: {
+	    return snprintf(buf, count, "%d\n", *(int *) param->value);
+	}
+	case CRESTA_SHIM_PARAM_uint: {
+	    return snprintf(buf, count, "%u\n", *(unsigned int *) param->value);
+	}
+	case CRESTA_SHIM_PARAM_charp: {
+	    char **strings = param->value;
+	    int n = NULL == param->count ? 1 : *param->count;
+	    int len = 0;
+	    int i;
+
+	    for (i = 0; i < n && len < (int) count; i++) {
+		len += snprintf(buf + len, count - len, "%s%s", i ? "," : "", strings[i] ? strings[i] : "(null)");
+	    }
+	    if (len < (int) count) {
+		len += snprintf(buf + len, count - len, "\n");
+	    }
+	    return len;
+	}
+    }
+    return -EINVAL;
+}
+
+
+/*
+ * Character devices and the device model
+ */
+int alloc_chrdev_region(dev_t *dev, unsigned int baseminor, unsigned int count, const char *name) {
+    int i;
+
+    pthread_mutex_lock(&shim_lock);
+    for (i = 0; i < SHIM_MAX_REGIONS; i++) {
+	if (0 == regions[i].count) {
+	    snprintf(regions[i].name, sizeof(regions[i].name), "%s", name);
+	    regions[i].first = MKDEV(next_major--, baseminor);
+	    regions[i].count = count;
+	    *dev = regions[i].first;
+	    pthread_mutex_unlock(&shim_lock);
+	    return 0;
+	}
+    }
+    pthread_mutex_unlock(&shim_lock);
+    return -EBUSY;
+}
+
+void unregister_chrdev_region(dev_t from, unsigned int count) {
+    int i;
+
+    pthread_mutex_lock(&shim_lock);
+    for (i = 0; i < SHIM_MAX_REGIONS; i++) {
+	if (regions[i].count && regions[i].first == from) {
+	    regions[i].count = 0;
+	}
+    }
+    pthread_mutex_unlock(&shim_lock);
+}
+
+void cdev_init(struct cdev *cdev, const struct file_operations *fops) {
+    memset(cdev, 0, sizeof(*cdev));
+    cdev->ops = fops;
+}
+
+int cdev_add(struct cdev *cdev, dev_t dev, unsigned int count) {
+    int i;
+
+    pthread_mutex_lock(&shim_lock);
+    for (i = 0; i < SHIM_MAX_CDEVS; i++) {
+	if (NULL == cdevs[i]) {
+	    cdev->dev = dev;
+	    cdev->count = count;
+	    cdevs[i] = cdev;
+	    pthread_mutex_unlock(&shim_lock);
+	    return 0;
+	}
+    }
+    pthread_mutex_unlock(&shim_lock);
+    return -EBUSY;
+}
+
+void cdev_del(struct cdev *cdev) {
+    int i;
+
+    pthread_mutex_lock(&shim_lock);
+    for (i = 0; i < SHIM_MAX_CDEVS; i++) {
+	if (cdevs[i] == cdev) {
+	    cdevs[i] = NULL;
+	}
+    }
+    pthread_mutex_unlock(&shim_lock);
+}
+
+int misc_register(struct miscdevice *misc) {
+    int i;
+
+    pthread_mutex_lock(&shim_lock);
+    for (i = 0; i < SHIM_MAX_MISC; i++) {
+	if (NULL == miscs[i]) {
+	    if (MISC_DYNAMIC_MINOR == misc->minor) {
+		misc->minor = 64 + i;
+	    }
+	    miscs[i] = misc;
+	    pthread_mutex_unlock(&shim_lock);
+	    return 0;
+	}
+    }
+    pthread_mutex_unlock(&shim_lock);
+    return -EBUSY;
+}
+
+int misc_deregister(struct miscdevice *misc) {
+    int i;
+
+    pthread_mutex_lock(&shim_lock);
+    for (i = 0; i < SHIM_MAX_MISC; i++) {
+	if (miscs[i] == misc) {
+	    miscs[i] = NULL;
+	}
+    }
+    pthread_mutex_unlock(&shim_lock);
+    return 0;
+}
+
+struct class *class_create(struct module *owner, const char *name) {
+    struct class *cls = calloc(1, sizeof(struct class));
+    int i;
+
+    if (NULL == cls) {
+	return ERR_PTR(-ENOMEM);
+    }
+    cls->name = name;
+    pthread_mutex_lock(&shim_lock);
+    for (i = 0; i < SHIM_MAX_CLASSES; i++) {
+	if (NULL == classes[i]) {
+	    classes[i] = cls;
+	    pthread_mutex_unlock(&shim_lock);
+	    return cls;
+	}
+    }
+    pthread_mutex_unlock(&shim_lock);
+    free(cls);
+    return ERR_PTR(-EBUSY);
+}
+
+void class_destroy(struct class *cls) {
+    int i;
+
+    if (IS_ERR_OR_NULL(cls)) {
+	return;
+    }
+    pthread_mutex_lock(&shim_lock);
+    for (i = 0; i < SHIM_MAX_DEVICES; i++) {
+	if (devices[i].in_use && devices[i].class == cls) {
+	    shim_bug("class %s destroyed with device %s", cls->name, devices[i].name);
+	    devices[i].in_use = false;
+	}
+    }
+    for (i = 0; i < SHIM_MAX_CLASSES; i++) {
+	if (classes[i] == cls) {
+	    classes[i] = NULL;
+	}
+    }
+    pthread_mutex_unlock(&shim_lock);
+    free(cls);
+}
+
+int class_create_file(struct class *cls, const struct class_attribute *attr) {
+    int i;
+
+    pthread_mutex_lock(&shim_lock);
+    for (i = 0; i < SHIM_MAX_ATTRS; i++) {
+	if (NULL == class_attrs[i].attr) {
+	    class_attrs[i].class = cls;
+	    class_attrs[i].attr = attr;
+	    pthread_mutex_unlock(&shim_lock);
+	    return 0;
+	}
+    }
+    pthread_mutex_unlock(&shim_lock);
+    return -ENOMEM;
+}
+
+/*
+ * Like sysfs, waits for stores still running
+ */
+void class_remove_file(struct class *cls, const struct class_attribute *attr) {
+    int i;
+
+    might_sleep();
+    pthread_mutex_lock(&shim_lock);
+    for (i = 0; i < SHIM_MAX_ATTRS; i++) {
+	if (class_attrs[i].class == cls && class_attrs[i].attr == attr) {
+	    class_attrs[i].removing = true;
+	    while (class_attrs[i].active > 0) {
+		pthread_cond_wait(&class_attr_idle, &shim_lock);
+	    }
+	    class_attrs[i].class = NULL;
+	    class_attrs[i].attr = NULL;
+	    class_attrs[i].removing = false;
+	}
+    }
+    pthread_mutex_unlock(&shim_lock);
+}
+
+/*
+ * Like sysfs, a device number or name can't be used twice
+ */
+struct device *device_create(struct class *cls, struct device *parent, dev_t devt, void *drvdata,
+			     const char *fmt, ...) {
+    char name[SHIM_NAME_LEN];
+    struct device *device = NULL;
+    va_list args;
+    int i;
+
+    va_start(args, fmt);
+    vsnprintf(name, sizeof(name), fmt, args);
+    va_end(args);
+
+    pthread_mutex_lock(&shim_lock);
+    for (i = 0; i < SHIM_MAX_DEVICES; i++) {
+	if (!devices[i].in_use) {
+	    if (NULL == device) {
+		device = &devices[i];
+	    }
+	} else if (devices[i].devt == devt || 0 == strcmp(devices[i].name, name)) {
+	    pthread_mutex_unlock(&shim_lock);
+	    shim_bug("device_create %s (%u:%u): %s (%u:%u) exists", name, MAJOR(devt), MINOR(devt),
+		     devices[i].name, MAJOR(devices[i].devt), MINOR(devices[i].devt));
+	    return ERR_PTR(-EEXIST);
+	}
+    }
+    if (NULL == device) {
+	pthread_mutex_unlock(&shim_lock);
+	return ERR_PTR(-ENOMEM);
+    }
+    device->in_use = true;
+    device->devt = devt;
+    device->class = cls;
+    memcpy(device->name, name, sizeof(name));
+    pthread_mutex_unlock(&shim_lock);
+    return device;
+}
+
+void device_destroy(struct class *cls, dev_t devt) {
+    int i;
+
+    pthread_mutex_lock(&shim_lock);
+    for (i = 0; i < SHIM_MAX_DEVICES; i++) {
+	if (devices[i].in_use && devices[i].class == cls && devices[i].devt == devt) {
+	    devices[i].in_use = false;
+	}
+    }
+    pthread_mutex_unlock(&shim_lock);
+}
+
+int add_uevent_var(struct kobj_uevent_env *env, const char *format, ...) {
+    return 0;
+}
+
+loff_t no_llseek(struct file *filp, loff_t offset, int whence) {
+    return -ESPIPE;
+}
+
+
+/*
+ * debugfs, paths are relative to its root
+ */
+static struct dentry *debugfs_create(const char *name, struct dentry *parent, const struct file_operations *fops, u32 *value) {
+    int i;
+
+    pthread_mutex_lock(&shim_lock);
+    for (i = 0; i < SHIM_MAX_DENTRIES; i++) {
+	if (!dentries[i].in_use) {
+	    size_t len = 0;
+
+	    if (NULL != parent) {
+		len = strlen(parent->path);
+		memcpy(dentries[i].path, parent->path, len);
+		dentries[i].path[len++] = '/';
+	    }
+	    cresta_shim_strlcpy(dentries[i].path + len, name, sizeof(dentries[i].path) - len);
+	    dentries[i].in_use = true;
+	    dentries[i].fops = fops;
+	    dentries[i].value = value;
+	    pthread_mutex_unlock(&shim_lock);
+	    return &dentries[i];
+	}
+    }
+    pthread_mutex_unlock(&shim_lock);
+    return NULL;
+}
+
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent) {
+    return debugfs_create(name, parent, NULL, NULL);
+}
+
+struct dentry *debugfs_create_file(const char *name, umode_t mode, struct dentry *parent, void *data,
+				   const struct file_operations *fops) {
+    return debugfs_create(name, parent, fops, NULL);
+}
+
+struct dentry *debugfs_create_u32(const char *name, umode_t mode, struct dentry *parent, u32 *value) {
+    return debugfs_create(name, parent, NULL, value);
+}
+
+void debugfs_remove_recursive(struct dentry *dentry) {
+    char prefix[SHIM_PATH_LEN + 1];
+    size_t len;
+    int i;
+
+    if (IS_ERR_OR_NULL(dentry)) {
+	return;
+    }
+    pthread_mutex_lock(&shim_lock);
+    len = snprintf(prefix, sizeof(prefix), "%s/", dentry->path);
+    for (i = 0; i < SHIM_MAX_DENTRIES; i++) {
+	if (dentries[i].in_use && 0 == strncmp(dentries[i].path, prefix, len)) {
+	    dentries[i].in_use = false;
+	}
+    }
+    dentry->in_use = false;
+    pthread_mutex_unlock(&shim_lock);
+}
+
+
+/*
+ * Generic netlink. A family has at most one multicast group, which
+ * gets the id of its family. Since 3.13 the group comes with the
+ * family, before it was registered on its own
+ */
+int genl_register_family(struct genl_family *family) {
+    int i;
+
+    might_sleep();
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 13, 0)
+    if (family->n_mcgrps > 1) {
+	return -EINVAL;
+    }
+#endif
+    pthread_mutex_lock(&shim_lock);
+    for (i = 0; i < SHIM_MAX_GENL; i++) {
+	if (NULL != genl_families[i] && 0 == strcmp(genl_families[i]->name, family->name)) {
+	    pthread_mutex_unlock(&shim_lock);
+	    return -EEXIST;
+	}
+    }
+    for (i = 0; i < SHIM_MAX_GENL; i++) {
+	if (NULL == genl_families[i]) {
+	    //GENL_ID_GENERATE, the only choice since 4.10
+	    if (0 == family->id) {
+		family->id = next_genl_id++;
+	    }
+	    genl_families[i] = family;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 13, 0)
+	    if (1 == family->n_mcgrps) {
+		family->mcgrp_offset = family->id;
+		genl_groups[i] = &family->mcgrps[0];
+		genl_group_ids[i] = family->id;
+	    }
+#endif
+	    pthread_mutex_unlock(&shim_lock);
+	    return 0;
+	}
+    }
+    pthread_mutex_unlock(&shim_lock);
+    return -ENOMEM;
+}
+
+int genl_unregister_family(struct genl_family *family) {
+    int i;
+
+    might_sleep();
+    pthread_mutex_lock(&shim_lock);
+    for (i = 0; i < SHIM_MAX_GENL; i++) {
+	if (genl_families[i] == family) {
+	    genl_families[i] = NULL;
+	    genl_groups[i] = NULL;
+	    pthread_mutex_unlock(&shim_lock);
+	    return 0;
+	}
+    }
+    pthread_mutex_unlock(&shim_lock);
+    shim_bug("generic netlink family %s isn't registered", family->name);
+    return -ENOENT;
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3, 13, 0)
+int genl_register_mc_group(struct genl_family *family, struct genl_multicast_group *grp) {
+    int i;
+
+    might_sleep();
+    pthread_mutex_lock(&shim_lock);
+    for (i = 0; i < SHIM_MAX_GENL; i++) {
+	if (genl_families[i] == family) {
+	    if (NULL != genl_groups[i]) {
+		break;
+	    }
+	    grp->id = family->id;
+	    genl_groups[i] = grp;
+	    genl_group_ids[i] = grp->id;
+	    pthread_mutex_unlock(&shim_lock);
+	    return 0;
+	}
+    }
+    pthread_mutex_unlock(&shim_lock);
+    return -EINVAL;
+}
+#endif
+
+void cresta_shim_genl_listen(cresta_shim_genl_listener listener) {
+    __atomic_store_n(&genl_listener, listener, __ATOMIC_RELEASE);
+}
+
+int netlink_has_listeners(struct sock *sk, unsigned int group) {
+    return NULL != __atomic_load_n(&genl_listener, __ATOMIC_ACQUIRE);
+}
+
+struct sk_buff *genlmsg_new(size_t payload, gfp_t flags) {
+    struct sk_buff *skb = kzalloc(sizeof(struct sk_buff), flags);
+
+    if (NULL == skb) {
+	return NULL;
+    }
+    skb->size = NLMSG_ALIGN(NLMSG_HDRLEN + GENL_HDRLEN + payload);
+    skb->data = kzalloc(skb->size, flags);
+    if (NULL == skb->data) {
+	kfree(skb);
+	return NULL;
+    }
+    return skb;
+}
+
+void nlmsg_free(struct sk_buff *skb) {
+    if (NULL != skb) {
+	kfree(skb->data);
+	kfree(skb);
+    }
+}
+
+void *genlmsg_put(struct sk_buff *skb, u32 portid, u32 seq, struct genl_family *family, int flags, u8 cmd) {
+    struct nlmsghdr *nlh = (struct nlmsghdr *) (skb->data + skb->len);
+    struct genlmsghdr *hdr = (struct genlmsghdr *) ((char *) nlh + NLMSG_HDRLEN);
+    unsigned int len = NLMSG_HDRLEN + GENL_HDRLEN + NLMSG_ALIGN(family->hdrsize);
+
+    if (skb->size - skb->len < len) {
+	return NULL;
+    }
+    nlh->nlmsg_type = family->id;
+    nlh->nlmsg_flags = flags;
+    nlh->nlmsg_seq = seq;
+    nlh->nlmsg_pid = portid;
+    hdr->cmd = cmd;
+    hdr->version = family->version;
+    skb->len += len;
+    nlh->nlmsg_len = len;
+    return (char *) hdr + GENL_HDRLEN;
+}
+
+int genlmsg_end(struct sk_buff *skb, void *hdr) {
+    struct nlmsghdr *nlh = (struct nlmsghdr *) ((char *) hdr - GENL_HDRLEN - NLMSG_HDRLEN);
+
+    nlh->nlmsg_len = skb->data + skb->len - (unsigned char *) nlh;
+    return skb->len;
+}
+
+int nla_put(struct sk_buff *skb, int attrtype, int attrlen, const void *data) {
+    struct nlattr *nla = (struct nlattr *) (skb->data + skb->len);
+
+    if (skb->size - skb->len < (unsigned int) nla_total_size(attrlen)) {
+	return -EMSGSIZE;
+    }
+    nla->nla_type = attrtype;
+    nla->nla_len = NLA_HDRLEN + attrlen;
+    memcpy((char *) nla + NLA_HDRLEN, data, attrlen);
+    memset((char *) nla + NLA_HDRLEN + attrlen, 0, nla_total_size(attrlen) - NLA_HDRLEN - attrlen);
+    skb->len += nla_total_size(attrlen);
+    return 0;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 7, 0)
+/*
+ * An empty padattr goes first if the payload wouldn't be 8 byte
+ * aligned otherwise, so listeners get to see it
+ */
+int nla_put_64bit(struct sk_buff *skb, int attrtype, int attrlen, const void *data, int padattr) {
+    if (0 == (uintptr_t) (skb->data + skb->len) % 8 && nla_put(skb, padattr, 0, data)) {
+	return -EMSGSIZE;
+    }
+    return nla_put(skb, attrtype, attrlen, data);
+}
+#endif
+
+/*
+ * Consumes skb, like the kernel. The listener is called without
+ * holding shim_lock
+ */
+static int shim_genl_multicast(struct sk_buff *skb, unsigned int group, gfp_t flags) {
+    cresta_shim_genl_listener listener = __atomic_load_n(&genl_listener, __ATOMIC_ACQUIRE);
+    char family[GENL_NAMSIZ] = "";
+    char name[GENL_NAMSIZ] = "";
+    int i;
+
+    if (GFP_KERNEL == flags) {
+	might_sleep();
+    }
+    pthread_mutex_lock(&shim_lock);
+    for (i = 0; i < SHIM_MAX_GENL; i++) {
+	if (NULL != genl_groups[i] && genl_group_ids[i] == group) {
+	    strcpy(family, genl_families[i]->name);
+	    strcpy(name, genl_groups[i]->name);
+	}
+    }
+    pthread_mutex_unlock(&shim_lock);
+
+    if ('\0' == *name) {
+	shim_bug("multicast to unknown generic netlink group %u", group);
+	nlmsg_free(skb);
+	return -EINVAL;
+    }
+    if (NULL == listener) {
+	nlmsg_free(skb);
+	return -ESRCH;
+    }
+    listener(family, name, skb->data, skb->len);
+    nlmsg_free(skb);
+    return 0;
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3, 13, 0)
+int genlmsg_multicast(struct sk_buff *skb, u32 portid, unsigned int group, gfp_t flags) {
+    return shim_genl_multicast(skb, group, flags);
+}
+#else
+//group is the index in the family's mcgrps
+int genlmsg_multicast(const struct genl_family *family, struct sk_buff *skb, u32 portid, unsigned int group, gfp_t flags) {
+    if (group >= family->n_mcgrps) {
+	shim_bug("multicast to group %u of generic netlink family %s", group, family->name);
+	nlmsg_free(skb);
+	return -EINVAL;
+    }
+    return shim_genl_multicast(skb, family->mcgrp_offset + group, flags);
+}
+#endif
+
+
+/*
+ * GPIO and interrupts
+ */
+int request_irq(unsigned int irq, irq_handler_t handler, unsigned long flags, const char *name, void *dev) {
+    int ret = 0;
+
+    pthread_mutex_lock(&irq_lock);
+    if (NULL != irq_handler) {
+	ret = -EBUSY;
+    } else {
+	irq_handler = handler;
+	irq_dev = dev;
+    }
+    pthread_mutex_unlock(&irq_lock);
+    return ret;
+}
+
+void free_irq(unsigned int irq, void *dev) {
+    pthread_mutex_lock(&irq_lock);
+    if (irq_dev != dev) {
+	shim_bug("free_irq with another dev_id");
+    }
+    irq_handler = NULL;
+    irq_dev = NULL;
+    pthread_mutex_unlock(&irq_lock);
+}
+
+//waits for a running handler, like the kernel
+void disable_irq(unsigned int irq) {
+    might_sleep();
+    pthread_mutex_lock(&irq_lock);
+    irq_disabled++;
+    pthread_mutex_unlock(&irq_lock);
+}
+
+void enable_irq(unsigned int irq) {
+    pthread_mutex_lock(&irq_lock);
+    irq_disabled--;
+    pthread_mutex_unlock(&irq_lock);
+}
+
+int gpio_request(unsigned int gpio, const char *label) {
+    return 0;
+}
+
+void gpio_free(unsigned int gpio) {
+}
+
+int gpio_direction_input(unsigned int gpio) {
+    return 0;
+}
+
+int gpio_to_irq(unsigned int gpio) {
+    return SHIM_IRQ_BASE + gpio;
+}
+
+int gpio_get_value(unsigned int gpio) {
+    return irq_level;
+}
+
+int cresta_shim_irq(int level, int64_t timestamp_ns) {
+    pthread_mutex_lock(&irq_lock);
+    if (NULL == irq_handler || irq_disabled) {
+	pthread_mutex_unlock(&irq_lock);
+	return -ENODEV;
+    }
+    irq_level = level;
+    irq_time = timestamp_ns;
+    irq_time_valid = true;
+    cresta_shim_atomic_depth++;
+    irq_handler(SHIM_IRQ_BASE, irq_dev);
+    cresta_shim_atomic_depth--;
+    irq_time_valid = false;
+    pthread_mutex_unlock(&irq_lock);
+    return 0;
+}
+
+
+/*
+ * Loading the module
+ */
+int  cresta_shim_module_init(void);
+void cresta_shim_module_exit(void);
+
+int cresta_shim_insmod(const char *args) {
+    char *buf = strdup(NULL == args ? "" : args);
+    char *next = buf;
+    char *arg;
+    int ret;
+
+    if (NULL == buf) {
+	return -ENOMEM;
+    }
+    while (NULL != (arg = strsep(&next, " \t\n"))) {
+	struct shim_param *param;
+	char *value = strchr(arg, '=');
+
+	if ('\0' == *arg) {
+	    continue;
+	}
+	if (NULL == value) {
+	    fprintf(stderr, "Missing value of parameter %s\n", arg);
+	    free(buf);
+	    return -EINVAL;
+	}
+	*value++ = '\0';
+	param = find_param(arg);
+	if (NULL == param) {
+	    fprintf(stderr, "Unknown parameter %s\n", arg);
+	    free(buf);
+	    return -ENOENT;
+	}
+	ret = set_param(param, value);
+	if (ret) {
+	    fprintf(stderr, "Invalid value for %s: %s\n", arg, value);
+	    free(buf);
+	    return ret;
+	}
+    }
+    free(buf);
+
+    shim_start();
+    ret = cresta_shim_module_init();
+    if (ret) {
+	shim_stop();
+    }
+    return ret;
+}
+
+void cresta_shim_rmmod(void) {
+    int i;
+
+    cresta_shim_module_exit();
+    shim_stop();
+
+    pthread_mutex_lock(&shim_lock);
+    for (i = 0; i < SHIM_MAX_REGIONS; i++) {
+	if (regions[i].count) {
+	    shim_bug("device numbers of %s still registered", regions[i].name);
+	}
+    }
+    for (i = 0; i < SHIM_MAX_CDEVS; i++) {
+	if (NULL != cdevs[i]) {
+	    shim_bug("character device %u:%u still registered", MAJOR(cdevs[i]->dev), MINOR(cdevs[i]->dev));
+	}
+    }
+    for (i = 0; i < SHIM_MAX_MISC; i++) {
+	if (NULL != miscs[i]) {
+	    shim_bug("misc device %s still registered", miscs[i]->name);
+	}
+    }
+    for (i = 0; i < SHIM_MAX_CLASSES; i++) {
+	if (NULL != classes[i]) {
+	    shim_bug("class %s still registered", classes[i]->name);
+	}
+    }
+    for (i = 0; i < SHIM_MAX_DENTRIES; i++) {
+	if (dentries[i].in_use) {
+	    shim_bug("debugfs entry %s still exists", dentries[i].path);
+	}
+    }
+    for (i = 0; i < SHIM_MAX_GENL; i++) {
+	if (NULL != genl_families[i]) {
+	    shim_bug("generic netlink family %s still registered", genl_families[i]->name);
+	}
+    }
+    for (i = 0; i < param_count; i++) {
+	free(params[i].storage);
+	params[i].storage = NULL;
+    }
+    pthread_mutex_unlock(&shim_lock);
+
+    pthread_mutex_lock(&irq_lock);
+    if (NULL != irq_handler) {
+	shim_bug("interrupt handler still registered");
+    }
+    pthread_mutex_unlock(&irq_lock);
+}
+
+
+/*
+ * Files
+ */
+static int open_fops(const struct file_operations *fops, dev_t devt, int flags, struct file **filp) {
+    struct file *file = calloc(1, sizeof(struct file) + sizeof(struct inode));
+    int ret = 0;
+
+    if (NULL == file) {
+	return -ENOMEM;
+    }
+    file->f_op = fops;
+    file->f_flags = flags;
+    file->f_inode = (struct inode *) (file + 1);
+    file->f_inode->i_rdev = devt;
+    if (NULL != fops->open) {
+	ret = fops->open(file->f_inode, file);
+    }
+    if (ret) {
+	free(file);
+	return ret;
+    }
+    *filp = file;
+    return 0;
+}
+
+static int open_devt(dev_t devt, int flags, struct file **filp) {
+    const struct file_operations *fops = NULL;
+    int i;
+
+    pthread_mutex_lock(&shim_lock);
+    for (i = 0; i < SHIM_MAX_CDEVS; i++) {
+	if (NULL != cdevs[i] && MAJOR(cdevs[i]->dev) == MAJOR(devt) &&
+	    MINOR(devt) >= MINOR(cdevs[i]->dev) && MINOR(devt) < MINOR(cdevs[i]->dev) + cdevs[i]->count) {
+	    fops = cdevs[i]->ops;
+	}
+    }
+    for (i = 0; i < SHIM_MAX_MISC && NULL == fops; i++) {
+	if (NULL != miscs[i] && MKDEV(SHIM_MISC_MAJOR, miscs[i]->minor) == devt) {
+	    fops = miscs[i]->fops;
+	}
+    }
+    pthread_mutex_unlock(&shim_lock);
+
+    if (NULL == fops) {
+	return -ENXIO;
+    }
+    return open_fops(fops, devt, flags, filp);
+}
+
+int cresta_shim_open(const char *path, int flags, struct file **filp) {
+    const struct file_operations *fops = NULL;
+    bool found = false;
+    dev_t devt = 0;
+    int i;
+
+    pthread_mutex_lock(&shim_lock);
+    if (0 == strncmp(path, SHIM_DEV_DIR, strlen(SHIM_DEV_DIR))) {
+	const char *name = path + strlen(SHIM_DEV_DIR);
+
+	for (i = 0; i < SHIM_MAX_DEVICES && !found; i++) {
+	    if (devices[i].in_use && 0 == strcmp(devices[i].name, name)) {
+		devt = devices[i].devt;
+		found = true;
+	    }
+	}
+	for (i = 0; i < SHIM_MAX_MISC && !found; i++) {
+	    if (NULL != miscs[i] && 0 == strcmp(miscs[i]->name, name)) {
+		devt = MKDEV(SHIM_MISC_MAJOR, miscs[i]->minor);
+		found = true;
+	    }
+	}
+    } else if (0 == strncmp(path, SHIM_DEBUGFS_DIR, strlen(SHIM_DEBUGFS_DIR))) {
+	const char *name = path + strlen(SHIM_DEBUGFS_DIR);
+
+	for (i = 0; i < SHIM_MAX_DENTRIES && !found; i++) {
+	    if (dentries[i].in_use && NULL != dentries[i].fops && 0 == strcmp(dentries[i].path, name)) {
+		fops = dentries[i].fops;
+		found = true;
+	    }
+	}
+    }
+    pthread_mutex_unlock(&shim_lock);
+
+    if (!found) {
+	return -ENOENT;
+    }
+    if (NULL != fops) {
+	return open_fops(fops, 0, flags, filp);
+    }
+    return open_devt(devt, flags, filp);
+}
+
+int cresta_shim_open_minor(const char *region, unsigned int minor, int flags, struct file **filp) {
+    dev_t devt = 0;
+    int i;
+
+    pthread_mutex_lock(&shim_lock);
+    for (i = 0; i < SHIM_MAX_REGIONS; i++) {
+	if (regions[i].count && 0 == strcmp(regions[i].name, region) &&
+	    minor >= MINOR(regions[i].first) && minor < MINOR(regions[i].first) + regions[i].count) {
+	    devt = MKDEV(MAJOR(regions[i].first), minor);
+	}
+    }
+    pthread_mutex_unlock(&shim_lock);
+
+    if (0 == devt) {
+	return -ENXIO;
+    }
+    return open_devt(devt, flags, filp);
+}
+
+ssize_t cresta_shim_read(struct file *filp, void *buf, size_t count) {
+    if (NULL == filp->f_op->read) {
+	return -EINVAL;
+    }
+    return filp->f_op->read(filp, buf, count, &filp->f_pos);
+}
+
+ssize_t cresta_shim_write(struct file *filp, const void *buf, size_t count) {
+    if (NULL == filp->f_op->write) {
+	return -EINVAL;
+    }
+    return filp->f_op->write(filp, buf, count, &filp->f_pos);
+}
+
+off_t cresta_shim_llseek(struct file *filp, off_t offset, int whence) {
+    if (NULL == filp->f_op->llseek) {
+	return -ESPIPE;
+    }
+    return filp->f_op->llseek(filp, offset, whence);
+}
+
+unsigned int cresta_shim_poll(struct file *filp) {
+    if (NULL == filp->f_op->poll) {
+	//like the kernel's DEFAULT_POLLMASK
+	return POLLIN | POLLOUT | POLLRDNORM | POLLWRNORM;
+    }
+    return filp->f_op->poll(filp, NULL);
+}
+
+void cresta_shim_close(struct file *filp) {
+    if (NULL != filp->f_op->release) {
+	filp->f_op->release(filp->f_inode, filp);
+    }
+    free(filp);
+}
+
+
+/*
+ * Attributes
+ */
+ssize_t cresta_shim_sysfs_read(const char *path, char *buf, size_t count) {
+    ssize_t ret = -ENOENT;
+    int i;
+
+    pthread_mutex_lock(&shim_lock);
+    if (0 == strncmp(path, SHIM_PARAMETER_DIR, strlen(SHIM_PARAMETER_DIR))) {
+	struct shim_param *param = find_param(path + strlen(SHIM_PARAMETER_DIR));
+
+	if (NULL != param) {
+	    ret = param->perm & 0444 ? format_param(param, buf, count) : -EACCES;
+	}
+    } else if (0 == strncmp(path, SHIM_DEBUGFS_DIR, strlen(SHIM_DEBUGFS_DIR))) {
+	for (i = 0; i < SHIM_MAX_DENTRIES; i++) {
+	    if (dentries[i].in_use && NULL != dentries[i].value &&
+		0 == strcmp(dentries[i].path, path + strlen(SHIM_DEBUGFS_DIR))) {
+		ret = snprintf(buf, count, "%u\n", *dentries[i].value);
+	    }
+	}
+    } else if (0 == strncmp(path, SHIM_CLASS_DIR, strlen(SHIM_CLASS_DIR))) {
+	const char *name = path + strlen(SHIM_CLASS_DIR);
+
+	for (i = 0; i < SHIM_MAX_ATTRS; i++) {
+	    const struct class_attribute *attr = class_attrs[i].attr;
+	    size_t len = NULL == attr ? 0 : strlen(class_attrs[i].class->name);
+
+	    if (NULL != attr && 0 == strncmp(name, class_attrs[i].class->name, len) &&
+		'/' == name[len] && 0 == strcmp(name + len + 1, attr->attr.name)) {
+		ret = NULL == attr->show ? -EACCES : attr->show(class_attrs[i].class, (struct class_attribute *) attr, buf);
+	    }
+	}
+    }
+    pthread_mutex_unlock(&shim_lock);
+    return ret;
+}
+
+/*
+ * Class attributes are called without holding shim_lock, their
+ * store functions may create devices
+ */
+ssize_t cresta_shim_sysfs_write(const char *path, const char *buf) {
+    struct class_attribute *found = NULL;
+    struct shim_class_attr *slot = NULL;
+    struct class *cls = NULL;
+    ssize_t ret = -ENOENT;
+    int i;
+
+    pthread_mutex_lock(&shim_lock);
+    if (0 == strncmp(path, SHIM_PARAMETER_DIR, strlen(SHIM_PARAMETER_DIR))) {
+	struct shim_param *param = find_param(path + strlen(SHIM_PARAMETER_DIR));
+
+	if (NULL != param) {
+	    ret = param->perm & 0222 ? set_param(param, buf) : -EACCES;
+	    if (0 == ret) {
+		ret = strlen(buf);
+	    }
+	}
+    } else if (0 == strncmp(path, SHIM_CLASS_DIR, strlen(SHIM_CLASS_DIR))) {
+	const char *name = path + strlen(SHIM_CLASS_DIR);
+
+	for (i = 0; i < SHIM_MAX_ATTRS; i++) {
+	    const struct class_attribute *attr = class_attrs[i].attr;
+	    size_t len = NULL == attr ? 0 : strlen(class_attrs[i].class->name);
+
+	    if (NULL != attr && !class_attrs[i].removing && 0 == strncmp(name, class_attrs[i].class->name, len) &&
+		'/' == name[len] && 0 == strcmp(name + len + 1, attr->attr.name)) {
+		found = (struct class_attribute *) attr;
+		cls = class_attrs[i].class;
+		slot = &class_attrs[i];
+	    }
+	}
+	if (NULL != slot) {
+	    slot->active++;
+	}
+    }
+    pthread_mutex_unlock(&shim_lock);
+
+    if (NULL != found) {
+	ret = NULL == found->store ? -EACCES : found->store(cls, found, buf, strlen(buf));
+	pthread_mutex_lock(&shim_lock);
+	slot->active--;
+	pthread_cond_broadcast(&class_attr_idle);
+	pthread_mutex_unlock(&shim_lock);
+    }
+    return ret;
+}
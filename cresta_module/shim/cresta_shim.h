@@ -0,0 +1,67 @@
+/*
+ * Control of the module when built in user space on the kernel API
+ * shim (see include/cresta_kernel.h): loading and unloading, the files
+ * it registers, and its interrupt line.
+ *
+ * License: GPLv3. See license.txt
+ */
+#ifndef _CRESTA_SHIM_H_
+#define _CRESTA_SHIM_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+struct file;
+
+/*
+ * Sets the module parameters given as name=value (arrays comma
+ * separated, like modprobe) and runs the module's init function
+ */
+int  cresta_shim_insmod(const char *params);
+//runs the module's exit function and reports what it left behind
+void cresta_shim_rmmod(void);
+
+/*
+ * Files the module registered: /dev/<name> for devices created by
+ * device_create and misc devices, /sys/kernel/debug/... for debugfs
+ * files. Errors are returned as negative errno values
+ */
+int     cresta_shim_open(const char *path, int flags, struct file **filp);
+//opens minor of the character device region registered as region
+int     cresta_shim_open_minor(const char *region, unsigned int minor, int flags, struct file **filp);
+ssize_t cresta_shim_read(struct file *filp, void *buf, size_t count);
+ssize_t cresta_shim_write(struct file *filp, const void *buf, size_t count);
+off_t   cresta_shim_llseek(struct file *filp, off_t offset, int whence);
+//the poll mask, without waiting
+unsigned int cresta_shim_poll(struct file *filp);
+void    cresta_shim_close(struct file *filp);
+
+/*
+ * Attributes: /sys/module/cresta/parameters/<name>,
+ * /sys/class/<class>/<attribute> and debugfs u32 values
+ */
+ssize_t cresta_shim_sysfs_read(const char *path, char *buf, size_t count);
+ssize_t cresta_shim_sysfs_write(const char *path, const char *buf);
+
+/*
+ * Raises the interrupt for an edge to level, happening at timestamp_ns
+ * (CLOCK_MONOTONIC as seen by the handler). Returns -ENODEV if no
+ * handler is registered or the interrupt is disabled
+ */
+int cresta_shim_irq(int level, int64_t timestamp_ns);
+
+/*
+ * Generic netlink multicasts of the module are passed to listener as
+ * they would arrive on a socket that joined the group, starting with
+ * the struct nlmsghdr. It runs in the context of the sender. NULL
+ * stops listening, netlink_has_listeners is false then
+ */
+typedef void (*cresta_shim_genl_listener)(const char *family, const char *group, const void *msg, size_t len);
+void cresta_shim_genl_listen(cresta_shim_genl_listener listener);
+
+//printk messages up to this level are printed, default KERN_WARNING
+void         cresta_shim_set_loglevel(int level);
+//bugs detected by the shim and KERN_ERR messages
+unsigned int cresta_shim_errors(void);
+
+#endif
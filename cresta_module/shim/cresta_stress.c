@@ -0,0 +1,639 @@
+/*
+ * Multi-threaded stress test of the module's sensor pipeline in user
+ * space, built on the kernel API shim (see cresta_shim.h). Datagrams
+ * and edges are injected from several threads and through the IRQ
+ * handler while readers open the sensor devices, some of them keeping
+ * them open and polling like cresta -w, sensors are seeded and silent
+ * ones are removed by the TTL reaper. Every measurement read is
+ * checked against the device it was read from, every one multicast
+ * via netlink against its sensor and the one sent before.
+ *
+ * Run it under TSan, valgrind or perf, see Makefile.
+ *
+ * License: GPLv3. See license.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include "../../cresta_userspace/cresta_encoder.h"
+#include "cresta_shim.h"
+
+#define STRESS_DEBUGFS_DIR   "/sys/kernel/debug/cresta"
+#define STRESS_PARAMETER_DIR "/sys/module/cresta/parameters"
+
+//sensors without a device name (thermohygro outside channels 1-5) aren't used
+#define STRESS_FIRST_ADDRESS 0x20
+#define STRESS_ADDRESSES     0xC0
+#define STRESS_MAX_THREADS   32
+#define STRESS_BATCH         32		//datagrams per write()
+#define STRESS_GAP_US        10000	//silence between datagrams as edges
+#define STRESS_WATCH_POLLS   50		//polls of a watched device, 1 ms apart
+
+struct stress_config {
+    unsigned int seconds;
+    int sensors;		//sensors transmitting at a time
+    unsigned int rotate_ms;	//a quarter of them changes address this often
+    int datagram_threads;
+    int edge_threads;
+    int reader_threads;
+    int irq;
+    unsigned int seeds_per_second;
+    int hypotheses;
+    unsigned int ttl;
+};
+
+struct stress_stats {
+    unsigned long long offered;
+    unsigned long long accepted;
+    unsigned long long edges;
+    unsigned long long opened;
+    unsigned long long no_device;
+    unsigned long long no_data;
+    unsigned long long refreshed;	//new measurements seen by watchers
+    unsigned long long seeded;
+    unsigned long long mismatches;
+    unsigned long long failures;	//unexpected errors
+};
+
+struct stress_thread {
+    pthread_t thread;
+    unsigned int seed;
+    struct stress_stats stats;
+};
+
+static struct stress_config config = {
+    5, 32, 1000, 2, 1, 4, 1, 10, 2, 1
+};
+static struct stress_thread threads[STRESS_MAX_THREADS];
+static int thread_count;
+static int running = 1;
+static uint64_t start_ns;
+
+//written by the netlink listener only, which never runs concurrently
+static unsigned long long netlink_received;
+static unsigned long long netlink_mismatches;
+static uint64_t netlink_sequence[256];
+
+//device names the readers try, see cresta_sensor_base_name
+static const char *const device_names[] = {
+    "cresta_thermohygro_ch1", "cresta_thermohygro_ch2", "cresta_thermohygro_ch3",
+    "cresta_thermohygro_ch4", "cresta_thermohygro_ch5", "cresta_anemometer",
+    "cresta_uv", "cresta_rain"
+};
+
+
+static uint64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static int is_running(void) {
+    return __atomic_load_n(&running, __ATOMIC_RELAXED);
+}
+
+/*
+ * The type of a sensor follows from its address, like in cresta_load
+ */
+static uint8_t sensor_type(uint8_t address) {
+    static const uint8_t types[] = { CRESTA_SENSOR_TYPE_ANEMOMETER, CRESTA_SENSOR_TYPE_UV, CRESTA_SENSOR_TYPE_RAIN };
+
+    if((address & CRESTA_SENSOR_ADDR_MASK) == CRESTA_AM_RAIN_UV_ANEMO) {
+	return types[address % 3];
+    }
+    return CRESTA_SENSOR_TYPE_THERMOHYGRO;
+}
+
+/*
+ * Picks one of the sensors currently transmitting. Every rotate_ms
+ * a quarter of them gets a new address, as after a battery change
+ */
+static void random_sensor(struct stress_thread *self, struct cresta_sensor_values *values) {
+    unsigned int epoch = config.rotate_ms ? (monotonic_ns() - start_ns) / 1000000 / config.rotate_ms : 0;
+    unsigned int shift = config.sensors / 4 ? config.sensors / 4 : 1;
+    uint8_t address = STRESS_FIRST_ADDRESS + (epoch * shift + rand_r(&self->seed) % config.sensors) % STRESS_ADDRESSES;
+
+    memset(values, 0, sizeof(*values));
+    values->sensor_address = address;
+    values->sensor_type = sensor_type(address);
+    values->temperature = -30 + rand_r(&self->seed) % 900 / 10.0;
+    values->humidity = 20 + rand_r(&self->seed) % 70;
+    values->windspeed = rand_r(&self->seed) % 100;
+    values->windgust = values->windspeed + 5;
+    values->uv_index = rand_r(&self->seed) % 12;
+    values->rain_ticks = rand_r(&self->seed);
+}
+
+static struct file *open_or_die(const char *path) {
+    struct file *filp;
+    int ret = cresta_shim_open(path, O_WRONLY, &filp);
+
+    if(ret) {
+	fprintf(stderr, "Couldn't open %s: %s\n", path, strerror(-ret));
+	exit(1);
+    }
+    return filp;
+}
+
+/*
+ * Writes until everything is accepted, the FIFO might be full
+ */
+static void write_all(struct stress_thread *self, struct file *filp, const uint8_t *buf, size_t len) {
+    while(len > 0 && is_running()) {
+	ssize_t ret = cresta_shim_write(filp, buf, len);
+
+	if(-EAGAIN == ret) {
+	    sched_yield();
+	    continue;
+	}
+	if(ret < 0) {
+	    self->stats.failures++;
+	    return;
+	}
+	buf += ret;
+	len -= ret;
+    }
+}
+
+static void *datagram_thread(void *arg) {
+    struct stress_thread *self = arg;
+    struct file *filp = open_or_die(STRESS_DEBUGFS_DIR "/inject_datagrams");
+    uint8_t buf[STRESS_BATCH * CRESTA_MAXDATA_LEN];
+
+    while(is_running()) {
+	struct cresta_sensor_values values;
+	int i;
+
+	memset(buf, 0, sizeof(buf));
+	for(i = 0; i < STRESS_BATCH; i++) {
+	    random_sensor(self, &values);
+	    cresta_encode_datagram(&values, 1, buf + i * CRESTA_MAXDATA_LEN);
+	}
+	write_all(self, filp, buf, sizeof(buf));
+	self->stats.offered += STRESS_BATCH;
+    }
+    cresta_shim_close(filp);
+    return NULL;
+}
+
+static void *edge_thread(void *arg) {
+    struct stress_thread *self = arg;
+    struct file *filp = open_or_die(STRESS_DEBUGFS_DIR "/inject_edges");
+    uint32_t durations[CRESTA_MAX_DATAGRAM_EDGES + 1];
+
+    while(is_running()) {
+	uint8_t raw_data[CRESTA_MAXDATA_LEN] = { 0 };
+	struct cresta_sensor_values values;
+	size_t count;
+
+	random_sensor(self, &values);
+	cresta_encode_datagram(&values, 1, raw_data);
+	count = cresta_manchester_encode(raw_data, CRESTA_DEFAULT_CLOCK_US, durations);
+	durations[count++] = STRESS_GAP_US;
+	write_all(self, filp, (uint8_t*) durations, count * sizeof(uint32_t));
+	self->stats.offered++;
+	self->stats.edges += count;
+    }
+    cresta_shim_close(filp);
+    return NULL;
+}
+
+/*
+ * Raises the interrupt for every edge of a datagram, with timestamps
+ * as the receiver would produce them
+ */
+static void *irq_thread(void *arg) {
+    struct stress_thread *self = arg;
+    uint32_t durations[CRESTA_MAX_DATAGRAM_EDGES + 1];
+    uint64_t timestamp = monotonic_ns();
+    int level = 0;
+
+    while(is_running()) {
+	uint8_t raw_data[CRESTA_MAXDATA_LEN] = { 0 };
+	struct cresta_sensor_values values;
+	size_t count;
+	size_t i;
+
+	random_sensor(self, &values);
+	cresta_encode_datagram(&values, 1, raw_data);
+	count = cresta_manchester_encode(raw_data, CRESTA_DEFAULT_CLOCK_US, durations);
+	durations[count++] = STRESS_GAP_US;
+	for(i = 0; i < count; i++) {
+	    timestamp += durations[i] * 1000ULL;
+	    level = !level;
+	    if(cresta_shim_irq(level, timestamp)) {
+		self->stats.failures++;
+		return NULL;
+	    }
+	}
+	self->stats.offered++;
+	self->stats.edges += count;
+	//let the decoder keep up, like a real radio would
+	sched_yield();
+    }
+    return NULL;
+}
+
+/*
+ * Checks a measurement read from a device against the device
+ */
+static int read_and_check(struct stress_thread *self, struct file *filp, int minor, const char *base,
+			  struct cresta_measurement_record *record) {
+    struct cresta_measurement_record measurement;
+    const uint8_t *data = measurement.decrypted_data;
+    const char *name;
+
+    if(cresta_shim_read(filp, &measurement, sizeof(measurement)) != sizeof(measurement)) {
+	self->stats.failures++;
+	return -1;
+    }
+    //seeded records are the only ones without a sequence number
+    if(measurement.version != CRESTA_RECORD_VERSION || measurement.header_len != offsetof(struct cresta_measurement_record, decrypted_data) ||
+       measurement.record_len != sizeof(measurement) || measurement.sensor_address != data[1] ||
+       !(measurement.flags & CRESTA_RECORD_FLAG_SEEDED) != !!measurement.sequence) {
+	fprintf(stderr, "Invalid record header of sensor %#x: version %u, sequence %llu, flags %#x\n", data[1],
+		measurement.version, (unsigned long long) measurement.sequence, measurement.flags);
+	self->stats.mismatches++;
+	return -1;
+    }
+    name = cresta_sensor_base_name(data[3] & 0x1F, data[1]);
+    if((minor >= 0 && data[1] != minor) || (data[3] & 0x1F) != sensor_type(data[1]) ||
+       (NULL != base && (NULL == name || strcmp(name, base)))) {
+	fprintf(stderr, "Read sensor %#x of type %#x from %s %d\n", data[1], data[3] & 0x1F,
+		NULL != base ? base : "minor", minor);
+	self->stats.mismatches++;
+	return -1;
+    }
+    *record = measurement;
+    return 0;
+}
+
+static const uint8_t *attr_data(const struct nlattr *nla) {
+    return (const uint8_t *) nla + NLA_HDRLEN;
+}
+
+/*
+ * Checks a measurement multicast by the module. Listening starts
+ * before the module is loaded, so a sensor's sequence numbers have to
+ * follow each other without gaps, or start over at 1 if the sensor
+ * was removed in between
+ */
+static void netlink_listener(const char *family, const char *group, const void *msg, size_t len) {
+    const struct nlmsghdr *nlh = msg;
+    const struct genlmsghdr *genl = NLMSG_DATA(nlh);
+    const struct nlattr *attrs[CRESTA_GENL_ATTR_MAX + 1] = { NULL };
+    const struct nlattr *nla;
+    const uint8_t *data;
+    uint64_t sequence;
+    uint8_t address;
+    int remaining;
+
+    netlink_received++;
+    if(strcmp(family, CRESTA_GENL_NAME) || strcmp(group, CRESTA_GENL_MCGRP_MEASUREMENTS) ||
+       len < NLMSG_HDRLEN + GENL_HDRLEN || nlh->nlmsg_len != len ||
+       genl->cmd != CRESTA_GENL_CMD_MEASUREMENT || genl->version != CRESTA_GENL_VERSION) {
+	fprintf(stderr, "Invalid netlink message to %s/%s\n", family, group);
+	netlink_mismatches++;
+	return;
+    }
+    nla = (const struct nlattr *) ((const char *) genl + GENL_HDRLEN);
+    remaining = len - NLMSG_HDRLEN - GENL_HDRLEN;
+    while(remaining >= NLA_HDRLEN && nla->nla_len >= NLA_HDRLEN && nla->nla_len <= remaining) {
+	if(nla->nla_type <= CRESTA_GENL_ATTR_MAX) {
+	    attrs[nla->nla_type] = nla;
+	}
+	remaining -= NLA_ALIGN(nla->nla_len);
+	nla = (const struct nlattr *) ((const char *) nla + NLA_ALIGN(nla->nla_len));
+    }
+    if(NULL == attrs[CRESTA_GENL_ATTR_ADDRESS] || NULL == attrs[CRESTA_GENL_ATTR_TYPE] ||
+       NULL == attrs[CRESTA_GENL_ATTR_TIMESTAMP] || NULL == attrs[CRESTA_GENL_ATTR_SEQUENCE] ||
+       NULL == attrs[CRESTA_GENL_ATTR_LEN] || NULL == attrs[CRESTA_GENL_ATTR_DATA] ||
+       attrs[CRESTA_GENL_ATTR_DATA]->nla_len != NLA_HDRLEN + CRESTA_MAXDATA_LEN) {
+	fprintf(stderr, "Netlink message without all attributes\n");
+	netlink_mismatches++;
+	return;
+    }
+
+    address = *attr_data(attrs[CRESTA_GENL_ATTR_ADDRESS]);
+    data = attr_data(attrs[CRESTA_GENL_ATTR_DATA]);
+    memcpy(&sequence, attr_data(attrs[CRESTA_GENL_ATTR_SEQUENCE]), sizeof(sequence));
+    if(data[1] != address || (data[3] & 0x1F) != sensor_type(address) ||
+       *attr_data(attrs[CRESTA_GENL_ATTR_TYPE]) != (data[3] & 0x1F) ||
+       (sequence != netlink_sequence[address] + 1 && sequence != 1)) {
+	fprintf(stderr, "Netlink message of sensor %#x: sensor %#x, type %#x, sequence %llu after %llu\n", address,
+		data[1], data[3] & 0x1F, (unsigned long long) sequence, (unsigned long long) netlink_sequence[address]);
+	netlink_mismatches++;
+    }
+    netlink_sequence[address] = sequence;
+}
+
+/*
+ * Keeps a device open like cresta -w, reading it again from the
+ * start whenever poll reports a new measurement
+ */
+static void watch_device(struct stress_thread *self, struct file *filp, int minor, const char *base,
+			 const struct cresta_measurement_record *first) {
+    struct cresta_measurement_record last = *first;
+    struct cresta_measurement_record measurement;
+    int i;
+
+    for(i = 0; i < STRESS_WATCH_POLLS && is_running(); i++) {
+	unsigned int mask = cresta_shim_poll(filp);
+
+	if(mask & POLLHUP) {
+	    break;
+	}
+	if(!(mask & POLLIN)) {
+	    usleep(1000);
+	    continue;
+	}
+	if(cresta_shim_llseek(filp, 0, SEEK_SET) || read_and_check(self, filp, minor, base, &measurement)) {
+	    break;
+	}
+	//the sensor may have been removed in between, then the copy is kept
+	if(measurement.sequence != last.sequence || measurement.timestamp_ns != last.timestamp_ns) {
+	    self->stats.refreshed++;
+	    last = measurement;
+	}
+    }
+}
+
+static void *reader_thread(void *arg) {
+    struct stress_thread *self = arg;
+    unsigned long iteration = 0;
+
+    while(is_running()) {
+	const char *base = NULL;
+	struct file *filp;
+	int minor = -1;
+	int ret;
+
+	//mostly by minor, sometimes by name to check device names
+	if(iteration++ % 8) {
+	    minor = rand_r(&self->seed) % 256;
+	    ret = cresta_shim_open_minor("cresta", minor, O_RDONLY, &filp);
+	} else {
+	    char path[64];
+	    int index = rand_r(&self->seed) % 4;
+
+	    base = device_names[rand_r(&self->seed) % (sizeof(device_names) / sizeof(device_names[0]))];
+	    if(index) {
+		snprintf(path, sizeof(path), "/dev/%s_%d", base, index + 1);
+	    } else {
+		snprintf(path, sizeof(path), "/dev/%s", base);
+	    }
+	    ret = cresta_shim_open(path, O_RDONLY, &filp);
+	}
+
+	switch(ret) {
+	    case 0: {
+		struct cresta_measurement_record measurement;
+
+		self->stats.opened++;
+		if(0 == read_and_check(self, filp, minor, base, &measurement) && 0 == iteration % 16) {
+		    watch_device(self, filp, minor, base, &measurement);
+		}
+		cresta_shim_close(filp);
+		break;
+	    }
+	    case -ENODEV:
+	    case -ENOENT: {
+		self->stats.no_device++;
+		break;
+	    }
+	    case -ENODATA: {
+		self->stats.no_data++;
+		break;
+	    }
+	    default: {
+		self->stats.failures++;
+	    }
+	}
+    }
+    return NULL;
+}
+
+/*
+ * Seeds sensors via /sys/class/cresta/seed, half of them with data
+ */
+static void *seed_thread(void *arg) {
+    struct stress_thread *self = arg;
+
+    while(is_running()) {
+	uint8_t data[CRESTA_MAXDATA_LEN] = { 0 };
+	struct cresta_sensor_values values;
+	char spec[128];
+	int len;
+	int i;
+
+	random_sensor(self, &values);
+	len = snprintf(spec, sizeof(spec), "%#x:%u", values.sensor_address, values.sensor_type);
+	if(rand_r(&self->seed) % 2) {
+	    cresta_encode_values(&values, 1, data);
+	    len += snprintf(spec + len, sizeof(spec) - len, ":");
+	    for(i = 0; i < CRESTA_MAXDATA_LEN; i++) {
+		len += snprintf(spec + len, sizeof(spec) - len, "%02x", data[i]);
+	    }
+	    snprintf(spec + len, sizeof(spec) - len, ":%ld\n", (long) time(NULL));
+	}
+
+	if(cresta_shim_sysfs_write("/sys/class/cresta/seed", spec) < 0) {
+	    fprintf(stderr, "Couldn't seed %s", spec);
+	    self->stats.failures++;
+	} else {
+	    self->stats.seeded++;
+	}
+	usleep(1000000 / config.seeds_per_second);
+    }
+    return NULL;
+}
+
+static void start_threads(int count, void *(*fn)(void *)) {
+    int i;
+
+    for(i = 0; i < count; i++) {
+	struct stress_thread *thread = &threads[thread_count];
+
+	thread->seed = thread_count + 1;
+	if(pthread_create(&thread->thread, NULL, fn, thread)) {
+	    fprintf(stderr, "Couldn't start thread\n");
+	    exit(1);
+	}
+	thread_count++;
+    }
+}
+
+static long long read_counter(const char *dir, const char *name) {
+    char path[256];
+    char value[32];
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    if(cresta_shim_sysfs_read(path, value, sizeof(value)) < 0) {
+	return -1;
+    }
+    return atoll(value);
+}
+
+static void usage(const char *name) {
+    printf("Usage: %s [options]\n", name);
+    printf("\t-t seconds\tDuration of the test (default 5)\n");
+    printf("\t-n sensors\tSensors transmitting at a time (1-%d, default 32)\n", STRESS_ADDRESSES);
+    printf("\t-R interval\tA quarter of the sensors changes address every interval ms, 0 never (default 1000)\n");
+    printf("\t-T seconds\tsensor_ttl of the module (default 1)\n");
+    printf("\t-d threads\tThreads injecting datagrams (default 2)\n");
+    printf("\t-e threads\tThreads injecting edges (default 1)\n");
+    printf("\t-r threads\tThreads opening and reading sensor devices (default 4)\n");
+    printf("\t-s seeds\tSensors seeded per second, 0 disables seeding (default 10)\n");
+    printf("\t-H hypotheses\tdecoder_hypotheses of the module (default 2)\n");
+    printf("\t-q\t\tDon't feed edges through the IRQ handler\n");
+    printf("\t-v\t\tPrint all kernel messages\n");
+}
+
+int main(int argc, char *argv[]) {
+    struct stress_stats total;
+    char params[256];
+    long long injected;
+    long long rejected;
+    int seed_threads;
+    double seconds;
+    int i;
+    int c;
+
+    opterr = 0;
+
+    while ((c = getopt (argc, argv, "t:n:R:T:d:e:r:s:H:qv")) != -1) {
+	switch (c) {
+	    case 't': {
+		config.seconds = atoi(optarg);
+		break;
+	    }
+	    case 'n': {
+		config.sensors = atoi(optarg);
+		break;
+	    }
+	    case 'R': {
+		config.rotate_ms = atoi(optarg);
+		break;
+	    }
+	    case 'T': {
+		config.ttl = atoi(optarg);
+		break;
+	    }
+	    case 'd': {
+		config.datagram_threads = atoi(optarg);
+		break;
+	    }
+	    case 'e': {
+		config.edge_threads = atoi(optarg);
+		break;
+	    }
+	    case 'r': {
+		config.reader_threads = atoi(optarg);
+		break;
+	    }
+	    case 's': {
+		config.seeds_per_second = atoi(optarg);
+		break;
+	    }
+	    case 'H': {
+		config.hypotheses = atoi(optarg);
+		break;
+	    }
+	    case 'q': {
+		config.irq = 0;
+		break;
+	    }
+	    case 'v': {
+		cresta_shim_set_loglevel(7);
+		break;
+	    }
+	    case '?': {
+		if (isprint (optopt))
+		    fprintf (stderr, "Unknown option or missing argument `-%c'.\n", optopt);
+		usage(argv[0]);
+		return 1;
+	    }
+	    default: {
+		abort ();
+	    }
+	}
+    }
+
+    seed_threads = config.seeds_per_second > 0;
+    if(config.sensors < 1 || config.sensors > STRESS_ADDRESSES || config.datagram_threads < 0 ||
+       config.edge_threads < 0 || config.reader_threads < 0 ||
+       config.datagram_threads + config.edge_threads + config.reader_threads + config.irq + seed_threads > STRESS_MAX_THREADS) {
+	usage(argv[0]);
+	return 1;
+    }
+
+    snprintf(params, sizeof(params), "decoder_hypotheses=%d sensor_ttl=%u seed_sensors=0x21:thermohygro,0x81:%u",
+	     config.hypotheses, config.ttl, sensor_type(0x81));
+    cresta_shim_genl_listen(netlink_listener);
+    if(cresta_shim_insmod(params)) {
+	fprintf(stderr, "Couldn't load the module\n");
+	return 1;
+    }
+
+    start_ns = monotonic_ns();
+    start_threads(config.datagram_threads, datagram_thread);
+    start_threads(config.edge_threads, edge_thread);
+    start_threads(config.reader_threads, reader_thread);
+    start_threads(config.irq, irq_thread);
+    start_threads(seed_threads, seed_thread);
+
+    sleep(config.seconds);
+    __atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+
+    memset(&total, 0, sizeof(total));
+    for(i = 0; i < thread_count; i++) {
+	struct stress_stats *stats = &threads[i].stats;
+
+	pthread_join(threads[i].thread, NULL);
+	total.offered    += stats->offered;
+	total.edges      += stats->edges;
+	total.opened     += stats->opened;
+	total.no_device  += stats->no_device;
+	total.no_data    += stats->no_data;
+	total.refreshed  += stats->refreshed;
+	total.seeded     += stats->seeded;
+	total.mismatches += stats->mismatches;
+	total.failures   += stats->failures;
+    }
+    seconds = (monotonic_ns() - start_ns) / 1e9;
+
+    //only the injecting threads write these
+    injected = read_counter(STRESS_DEBUGFS_DIR, "datagrams_injected");
+    rejected = read_counter(STRESS_DEBUGFS_DIR, "datagrams_rejected");
+    cresta_shim_rmmod();
+    cresta_shim_genl_listen(NULL);
+    total.mismatches += netlink_mismatches;
+
+    printf("%.1f s, %d sensors, %d datagram, %d edge, %d reader threads%s\n", seconds, config.sensors,
+	   config.datagram_threads, config.edge_threads, config.reader_threads, config.irq ? ", IRQ" : "");
+    printf("Offered %llu datagrams (%.0f/s), %llu edges; injected %lld, rejected %lld (FIFO full)\n",
+	   total.offered, total.offered / seconds, total.edges, injected, rejected);
+    printf("Decoded %lld datagrams (%lld recovered), %lld edges dropped\n",
+	   read_counter(STRESS_PARAMETER_DIR, "packets_decoded"), read_counter(STRESS_PARAMETER_DIR, "packets_recovered"),
+	   read_counter(STRESS_PARAMETER_DIR, "edges_dropped"));
+    printf("Published %lld measurements, %lld decrypt failures, %lld sensors removed, %llu seeded\n",
+	   read_counter(STRESS_PARAMETER_DIR, "measurements_allocated"), read_counter(STRESS_PARAMETER_DIR, "decrypt_failures"),
+	   read_counter(STRESS_PARAMETER_DIR, "sensors_removed"), total.seeded);
+    printf("Opened %llu devices (%.0f/s), %llu without device, %llu without data, %llu refreshed by watchers\n",
+	   total.opened, total.opened / seconds, total.no_device, total.no_data, total.refreshed);
+    printf("Received %llu measurements via netlink, %llu mismatches\n", netlink_received, netlink_mismatches);
+    printf("%llu mismatches, %llu failures, %u bugs and errors reported\n",
+	   total.mismatches, total.failures, cresta_shim_errors());
+
+    return total.mismatches || total.failures || cresta_shim_errors() ? 1 : 0;
+}
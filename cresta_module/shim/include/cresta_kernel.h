@@ -0,0 +1,639 @@
+/*
+ * Kernel API shim for building the module's sensor pipeline as a user
+ * space program (see cresta_stress.c). Every kernel header the module
+ * includes maps to this file.
+ *
+ * Only what the module uses is provided, but with the kernel's
+ * semantics where they matter for concurrency: work items never run
+ * reentrant, synchronize_rcu waits for all readers, record kfifos are
+ * lock free for a single reader and a single writer. Sleeping in atomic
+ * context (IRQ handler, spinlock, RCU read side) is reported as a bug.
+ *
+ * License: GPLv3. See license.txt
+ */
+#ifndef _CRESTA_KERNEL_H_
+#define _CRESTA_KERNEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include "../cresta_shim.h"
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int64_t  s64;
+typedef unsigned int gfp_t;
+typedef unsigned short umode_t;
+
+#define __init
+#define __exit
+#define __user
+#define __rcu
+
+//the kernel the module is built for, without any options. Defaults
+//to the one it was written for, see KERNEL in the Makefile
+#define KERNEL_VERSION(a, b, c) (((a) << 16) + ((b) << 8) + (c))
+#ifndef CRESTA_SHIM_KERNEL
+#define CRESTA_SHIM_KERNEL      KERNEL_VERSION(3, 12, 28)
+#endif
+#define LINUX_VERSION_CODE      CRESTA_SHIM_KERNEL
+#define IS_ENABLED(option)      0
+
+#define __stringify_1(x) #x
+#define __stringify(x)   __stringify_1(x)
+
+#define container_of(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define min(x, y) ((x) < (y) ? (x) : (y))
+#define max(x, y) ((x) > (y) ? (x) : (y))
+#define clamp(val, lo, hi) min(max(val, lo), hi)
+
+/*
+ * Doubly linked lists, the part the module uses
+ */
+struct list_head {
+    struct list_head *next, *prev;
+};
+#define LIST_HEAD(name) struct list_head name = { &(name), &(name) }
+
+static inline void list_add_tail(struct list_head *entry, struct list_head *head) {
+    entry->prev = head->prev;
+    entry->next = head;
+    head->prev->next = entry;
+    head->prev = entry;
+}
+static inline void list_del(struct list_head *entry) {
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+    entry->next = entry->prev = NULL;
+}
+static inline int list_empty(const struct list_head *head) { return head->next == head; }
+
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+#define list_for_each_entry_safe(pos, n, head, member) \
+    for (pos = list_entry((head)->next, __typeof__(*pos), member), \
+	 n = list_entry(pos->member.next, __typeof__(*pos), member); \
+	 &pos->member != (head); \
+	 pos = n, n = list_entry(n->member.next, __typeof__(*n), member))
+
+#ifndef O_NONBLOCK
+#define O_NONBLOCK 04000
+#endif
+#define ERESTARTSYS 512
+
+
+/*
+ * Error pointers
+ */
+#define MAX_ERRNO 4095
+#define IS_ERR_VALUE(x) ((unsigned long)(void *)(x) >= (unsigned long)-MAX_ERRNO)
+
+static inline void *ERR_PTR(long error) { return (void *) error; }
+static inline long PTR_ERR(const void *ptr) { return (long) ptr; }
+static inline bool IS_ERR(const void *ptr) { return IS_ERR_VALUE(ptr); }
+static inline bool IS_ERR_OR_NULL(const void *ptr) { return !ptr || IS_ERR_VALUE(ptr); }
+
+
+/*
+ * Modules and their parameters. module_init/module_exit define the
+ * entry points used by cresta_shim_insmod/cresta_shim_rmmod
+ */
+struct module;
+#define THIS_MODULE ((struct module *) NULL)
+#define MODULE_LICENSE(license)
+#define MODULE_AUTHOR(author)
+#define MODULE_DESCRIPTION(description)
+#define MODULE_PARM_DESC(name, description)
+#define module_init(fn) int cresta_shim_module_init(void) { return fn(); }
+#define module_exit(fn) void cresta_shim_module_exit(void) { fn(); }
+
+enum cresta_shim_param_type {
+    CRESTA_SHIM_PARAM_int,
+    CRESTA_SHIM_PARAM_uint,
+    CRESTA_SHIM_PARAM_charp
+};
+
+void cresta_shim_register_param(const char *name, void *value, enum cresta_shim_param_type type,
+				unsigned int max, int *count, umode_t perm);
+
+#define module_param(name, type, perm) \
+    static void __attribute__((constructor)) cresta_shim_param_##name(void) { \
+	cresta_shim_register_param(#name, &name, CRESTA_SHIM_PARAM_##type, 1, NULL, perm); \
+    }
+#define module_param_array(name, type, nump, perm) \
+    static void __attribute__((constructor)) cresta_shim_param_##name(void) { \
+	cresta_shim_register_param(#name, name, CRESTA_SHIM_PARAM_##type, ARRAY_SIZE(name), nump, perm); \
+    }
+
+
+/*
+ * Logging and context checks
+ */
+#define KERN_EMERG   "<0>"
+#define KERN_ALERT   "<1>"
+#define KERN_CRIT    "<2>"
+#define KERN_ERR     "<3>"
+#define KERN_WARNING "<4>"
+#define KERN_NOTICE  "<5>"
+#define KERN_INFO    "<6>"
+#define KERN_DEBUG   "<7>"
+
+int printk(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+//IRQ handler and spinlocks
+extern __thread int cresta_shim_atomic_depth;
+//RCU read side critical sections
+extern __thread int cresta_shim_rcu_depth;
+
+void cresta_shim_might_sleep(const char *caller);
+#define might_sleep() cresta_shim_might_sleep(__func__)
+
+
+/*
+ * Memory
+ */
+#define GFP_KERNEL 0u
+#define GFP_ATOMIC 1u
+
+void *kmalloc(size_t size, gfp_t flags);
+void *kzalloc(size_t size, gfp_t flags);
+void  kfree(const void *ptr);
+
+struct kmem_cache;
+struct kmem_cache *kmem_cache_create(const char *name, size_t size, size_t align,
+				     unsigned long flags, void (*ctor)(void *));
+void *kmem_cache_alloc(struct kmem_cache *cache, gfp_t flags);
+void *kmem_cache_zalloc(struct kmem_cache *cache, gfp_t flags);
+void  kmem_cache_free(struct kmem_cache *cache, void *obj);
+void  kmem_cache_destroy(struct kmem_cache *cache);
+#define KMEM_CACHE(__struct, __flags) \
+    kmem_cache_create(#__struct, sizeof(struct __struct), __alignof__(struct __struct), (__flags), NULL)
+
+#define PAGE_SHIFT   12
+#define PAGE_SIZE    (1UL << PAGE_SHIFT)
+#define PAGE_ALIGN(x) (((x) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+
+void *vmalloc_user(unsigned long size);
+void  vfree(const void *addr);
+
+struct vm_area_struct {
+    unsigned long vm_start;
+    unsigned long vm_end;
+    unsigned long vm_pgoff;
+    unsigned long vm_flags;
+};
+#define VM_WRITE 0x00000002
+
+int remap_vmalloc_range(struct vm_area_struct *vma, void *addr, unsigned long pgoff);
+
+static inline unsigned long copy_to_user(void *to, const void *from, unsigned long n) {
+    memcpy(to, from, n);
+    return 0;
+}
+
+static inline unsigned long copy_from_user(void *to, const void *from, unsigned long n) {
+    memcpy(to, from, n);
+    return 0;
+}
+
+
+/*
+ * Strings
+ */
+#define strlcpy cresta_shim_strlcpy
+size_t cresta_shim_strlcpy(char *dest, const char *src, size_t size);
+char  *strim(char *s);
+int    hex2bin(u8 *dst, const char *src, size_t count);
+int    kstrtoull(const char *s, unsigned int base, unsigned long long *res);
+int    kstrtou8(const char *s, unsigned int base, u8 *res);
+
+
+/*
+ * Time. jiffies start shortly before wrapping around, like in
+ * the kernel
+ */
+#define NSEC_PER_SEC 1000000000L
+typedef s64 ktime_t;
+
+ktime_t ktime_get(void);
+ktime_t ktime_get_real(void);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 0, 0)
+void    getnstimeofday(struct timespec *ts);
+#endif
+
+static inline s64 ktime_to_ns(ktime_t kt) { return kt; }
+static inline s64 ktime_us_delta(ktime_t later, ktime_t earlier) { return (later - earlier) / 1000; }
+
+#define HZ 100
+#define INITIAL_JIFFIES ((unsigned long)(unsigned int) (-300 * HZ))
+unsigned long cresta_shim_jiffies(void);
+#define jiffies cresta_shim_jiffies()
+#define time_after(a, b) ((long)((b) - (a)) < 0)
+
+static inline unsigned long round_jiffies_relative(unsigned long j) { return j; }
+
+
+/*
+ * CPUs
+ */
+extern int nr_cpu_ids;
+bool cpu_online(unsigned int cpu);
+
+
+/*
+ * Atomic bit operations and barriers
+ */
+#define BITS_PER_LONG     (8 * sizeof(long))
+#define BITS_TO_LONGS(nr) (((nr) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+#define DECLARE_BITMAP(name, bits) unsigned long name[BITS_TO_LONGS(bits)]
+
+static inline void set_bit(long nr, volatile unsigned long *addr) {
+    __atomic_fetch_or(&addr[nr / BITS_PER_LONG], 1UL << (nr % BITS_PER_LONG), __ATOMIC_RELAXED);
+}
+
+static inline void clear_bit(long nr, volatile unsigned long *addr) {
+    __atomic_fetch_and(&addr[nr / BITS_PER_LONG], ~(1UL << (nr % BITS_PER_LONG)), __ATOMIC_RELAXED);
+}
+
+unsigned long find_first_zero_bit(const unsigned long *addr, unsigned long size);
+
+#define smp_mb()  __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define smp_rmb() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define smp_wmb() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define ACCESS_ONCE(x)    (*(volatile __typeof__(x) *) &(x))
+#define READ_ONCE(x)      __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define WRITE_ONCE(x, v)  __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
+
+/*
+ * Locks
+ */
+struct mutex {
+    pthread_mutex_t lock;
+};
+#define DEFINE_MUTEX(name) struct mutex name = { PTHREAD_MUTEX_INITIALIZER }
+
+void mutex_init(struct mutex *lock);
+void mutex_lock(struct mutex *lock);
+void mutex_unlock(struct mutex *lock);
+#define lockdep_is_held(lock) 1
+
+typedef struct {
+    pthread_mutex_t lock;
+} spinlock_t;
+#define DEFINE_SPINLOCK(name) spinlock_t name = { PTHREAD_MUTEX_INITIALIZER }
+
+void spin_lock(spinlock_t *lock);
+void spin_unlock(spinlock_t *lock);
+#define spin_lock_irqsave(lock, flags)      do { (flags) = 0; spin_lock(lock); } while (0)
+#define spin_unlock_irqrestore(lock, flags) do { (void) (flags); spin_unlock(lock); } while (0)
+
+
+/*
+ * RCU. Readers share a rwlock that synchronize_rcu takes for writing,
+ * so grace periods are visible to TSan, helgrind and drd
+ */
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+void synchronize_rcu(void);
+
+#define rcu_dereference(p)              __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define rcu_dereference_protected(p, c) __atomic_load_n(&(p), __ATOMIC_RELAXED)
+#define rcu_assign_pointer(p, v)        __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#define RCU_INIT_POINTER(p, v)          __atomic_store_n(&(p), (v), __ATOMIC_RELAXED)
+
+
+/*
+ * Wait queues. Waiters poll their condition every few ms, so a
+ * missed wakeup only costs latency
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+} wait_queue_head_t;
+#define DECLARE_WAIT_QUEUE_HEAD(name) \
+    wait_queue_head_t name = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER }
+
+static inline int waitqueue_active(wait_queue_head_t *q) { return 1; }
+void wake_up_interruptible(wait_queue_head_t *q);
+void cresta_shim_wait(wait_queue_head_t *q);
+
+#define wait_event_interruptible(wq, condition) ({ \
+    while (!(condition)) { \
+	cresta_shim_wait(&(wq)); \
+    } \
+    0; \
+})
+
+
+/*
+ * Work queues. Each queue has several workers, a work item runs
+ * on one of them at a time, like since 3.7
+ */
+struct work_struct;
+struct workqueue_struct;
+typedef void (*work_func_t)(struct work_struct *work);
+
+struct work_struct {
+    work_func_t func;
+    struct work_struct *next;		//in the queue of wq
+    struct workqueue_struct *wq;
+    bool pending;
+    bool running;
+    bool canceling;
+};
+
+struct delayed_work {
+    struct work_struct work;
+    struct workqueue_struct *timer_wq;	//queue to run on after expiry
+    uint64_t expires_ns;
+    struct delayed_work *timer_next;
+    bool timer_armed;
+};
+
+#define INIT_WORK(w, f) do { memset((w), 0, sizeof(struct work_struct)); (w)->func = (f); } while (0)
+#define DECLARE_DELAYED_WORK(name, f) struct delayed_work name = { .work = { .func = (f) } }
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3, 19, 0)
+#define WQ_NON_REENTRANT (1 << 0)
+#endif
+#define WQ_UNBOUND       (1 << 1)
+#define WQ_HIGHPRI       (1 << 4)
+
+extern struct workqueue_struct *system_wq;
+
+struct workqueue_struct *alloc_workqueue(const char *fmt, unsigned int flags, int max_active, ...);
+void destroy_workqueue(struct workqueue_struct *wq);
+void flush_workqueue(struct workqueue_struct *wq);
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work);
+bool queue_work_on(int cpu, struct workqueue_struct *wq, struct work_struct *work);
+bool queue_delayed_work(struct workqueue_struct *wq, struct delayed_work *dwork, unsigned long delay);
+bool cancel_work_sync(struct work_struct *work);
+bool cancel_delayed_work_sync(struct delayed_work *dwork);
+
+static inline bool schedule_work(struct work_struct *work) {
+    return queue_work(system_wq, work);
+}
+
+static inline bool schedule_delayed_work(struct delayed_work *dwork, unsigned long delay) {
+    return queue_delayed_work(system_wq, dwork, delay);
+}
+
+
+/*
+ * Record kfifo with 1 byte record lengths (struct kfifo_rec_ptr_1)
+ */
+struct kfifo_rec_ptr_1 {
+    unsigned char *data;
+    unsigned int mask;
+    unsigned int in;
+    unsigned int out;
+};
+
+int          cresta_shim_kfifo_alloc(struct kfifo_rec_ptr_1 *fifo, unsigned int size);
+void         cresta_shim_kfifo_free(struct kfifo_rec_ptr_1 *fifo);
+unsigned int cresta_shim_kfifo_in(struct kfifo_rec_ptr_1 *fifo, const void *buf, unsigned int len);
+unsigned int cresta_shim_kfifo_out(struct kfifo_rec_ptr_1 *fifo, void *buf, unsigned int len);
+bool         cresta_shim_kfifo_is_empty(struct kfifo_rec_ptr_1 *fifo);
+
+#define kfifo_alloc(fifo, size, gfp) cresta_shim_kfifo_alloc((fifo), (size))
+#define kfifo_free(fifo)             cresta_shim_kfifo_free(fifo)
+#define kfifo_in(fifo, buf, n)       cresta_shim_kfifo_in((fifo), (buf), (n))
+#define kfifo_out(fifo, buf, n)      cresta_shim_kfifo_out((fifo), (buf), (n))
+#define kfifo_is_empty(fifo)         cresta_shim_kfifo_is_empty(fifo)
+#define kfifo_in_spinlocked(fifo, buf, n, lock) ({ \
+    unsigned int __ret; \
+    spin_lock(lock); \
+    __ret = kfifo_in((fifo), (buf), (n)); \
+    spin_unlock(lock); \
+    __ret; \
+})
+
+
+/*
+ * Files and character devices
+ */
+typedef struct poll_table_struct {
+    int unused;
+} poll_table;
+
+struct inode {
+    dev_t i_rdev;
+};
+
+struct file {
+    const struct file_operations *f_op;
+    unsigned int f_flags;
+    loff_t f_pos;
+    void *private_data;
+    struct inode *f_inode;
+};
+
+struct file_operations {
+    struct module *owner;
+    loff_t (*llseek)(struct file *, loff_t, int);
+    ssize_t (*read)(struct file *, char *, size_t, loff_t *);
+    ssize_t (*write)(struct file *, const char *, size_t, loff_t *);
+    unsigned int (*poll)(struct file *, poll_table *);
+    int (*mmap)(struct file *, struct vm_area_struct *);
+    int (*open)(struct inode *, struct file *);
+    int (*release)(struct inode *, struct file *);
+};
+
+loff_t no_llseek(struct file *filp, loff_t offset, int whence);
+static inline int nonseekable_open(struct inode *inode, struct file *filp) { return 0; }
+static inline void poll_wait(struct file *filp, wait_queue_head_t *q, poll_table *p) { }
+
+#define MINORBITS 20
+#define MINORMASK ((1U << MINORBITS) - 1)
+#define MAJOR(dev)    ((unsigned int) ((dev) >> MINORBITS))
+#define MINOR(dev)    ((unsigned int) ((dev) & MINORMASK))
+#define MKDEV(ma, mi) (((dev_t) (ma) << MINORBITS) | (mi))
+
+static inline unsigned int iminor(const struct inode *inode) { return MINOR(inode->i_rdev); }
+static inline struct inode *file_inode(const struct file *f) { return f->f_inode; }
+
+int  alloc_chrdev_region(dev_t *dev, unsigned int baseminor, unsigned int count, const char *name);
+void unregister_chrdev_region(dev_t from, unsigned int count);
+
+struct cdev {
+    struct module *owner;
+    const struct file_operations *ops;
+    dev_t dev;
+    unsigned int count;
+};
+
+void cdev_init(struct cdev *cdev, const struct file_operations *fops);
+int  cdev_add(struct cdev *cdev, dev_t dev, unsigned int count);
+void cdev_del(struct cdev *cdev);
+
+#define MISC_DYNAMIC_MINOR 255
+struct miscdevice {
+    int minor;
+    const char *name;
+    const struct file_operations *fops;
+    umode_t mode;
+};
+
+int misc_register(struct miscdevice *misc);
+int misc_deregister(struct miscdevice *misc);
+
+
+/*
+ * Device model
+ */
+struct device;
+struct kobj_uevent_env;
+
+struct class {
+    const char *name;
+    int (*dev_uevent)(struct device *dev, struct kobj_uevent_env *env);
+};
+
+struct attribute {
+    const char *name;
+    umode_t mode;
+};
+
+struct class_attribute {
+    struct attribute attr;
+    ssize_t (*show)(struct class *class, struct class_attribute *attr, char *buf);
+    ssize_t (*store)(struct class *class, struct class_attribute *attr, const char *buf, size_t count);
+};
+#define __ATTR(_name, _mode, _show, _store) { .attr = { #_name, _mode }, .show = _show, .store = _store }
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 13, 0)
+#define CLASS_ATTR(_name, _mode, _show, _store) \
+    struct class_attribute class_attr_##_name = __ATTR(_name, _mode, _show, _store)
+#endif
+
+struct class  *class_create(struct module *owner, const char *name);
+void           class_destroy(struct class *cls);
+int            class_create_file(struct class *cls, const struct class_attribute *attr);
+void           class_remove_file(struct class *cls, const struct class_attribute *attr);
+struct device *device_create(struct class *cls, struct device *parent, dev_t devt, void *drvdata,
+			     const char *fmt, ...) __attribute__((format(printf, 5, 6)));
+void           device_destroy(struct class *cls, dev_t devt);
+int            add_uevent_var(struct kobj_uevent_env *env, const char *format, ...);
+
+
+/*
+ * debugfs
+ */
+struct dentry;
+
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent);
+struct dentry *debugfs_create_file(const char *name, umode_t mode, struct dentry *parent, void *data,
+				   const struct file_operations *fops);
+struct dentry *debugfs_create_u32(const char *name, umode_t mode, struct dentry *parent, u32 *value);
+void           debugfs_remove_recursive(struct dentry *dentry);
+
+
+/*
+ * Generic netlink. Messages are built in the wire format, multicasts
+ * are handed to the listener set by cresta_shim_genl_listen. The API
+ * is the one of LINUX_VERSION_CODE
+ */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 10, 0)
+#define GENL_ID_GENERATE 0
+#endif
+#define GENL_NAMSIZ      16
+
+struct sock;
+struct net {
+    struct sock *genl_sock;
+};
+extern struct net init_net;
+
+struct sk_buff {
+    unsigned char *data;
+    unsigned int len;
+    unsigned int size;
+};
+
+struct genl_multicast_group {
+    char name[GENL_NAMSIZ];
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3, 13, 0)
+    u32 id;
+#endif
+};
+
+struct genl_family {
+    unsigned int id;
+    unsigned int hdrsize;
+    char name[GENL_NAMSIZ];
+    unsigned int version;
+    unsigned int maxattr;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 13, 0)
+    struct module *module;
+    const struct genl_multicast_group *mcgrps;
+    unsigned int n_mcgrps;
+    unsigned int mcgrp_offset;
+#endif
+};
+
+int  genl_register_family(struct genl_family *family);
+int  genl_unregister_family(struct genl_family *family);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3, 13, 0)
+int  genl_register_mc_group(struct genl_family *family, struct genl_multicast_group *grp);
+#endif
+int  netlink_has_listeners(struct sock *sk, unsigned int group);
+
+struct sk_buff *genlmsg_new(size_t payload, gfp_t flags);
+void           *genlmsg_put(struct sk_buff *skb, u32 portid, u32 seq, struct genl_family *family, int flags, u8 cmd);
+int             genlmsg_end(struct sk_buff *skb, void *hdr);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3, 13, 0)
+int             genlmsg_multicast(struct sk_buff *skb, u32 portid, unsigned int group, gfp_t flags);
+#else
+int             genlmsg_multicast(const struct genl_family *family, struct sk_buff *skb, u32 portid, unsigned int group, gfp_t flags);
+#endif
+void            nlmsg_free(struct sk_buff *skb);
+
+//attribute header and payload, padded to 4 bytes
+static inline int nla_total_size(int payload) { return (4 + payload + 3) & ~3; }
+
+int nla_put(struct sk_buff *skb, int attrtype, int attrlen, const void *data);
+static inline int nla_put_u8(struct sk_buff *skb, int attrtype, u8 value) { return nla_put(skb, attrtype, sizeof(value), &value); }
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 7, 0)
+static inline int nla_put_u64(struct sk_buff *skb, int attrtype, u64 value) { return nla_put(skb, attrtype, sizeof(value), &value); }
+#else
+//pads like an architecture without efficient unaligned access
+static inline int nla_total_size_64bit(int payload) { return nla_total_size(payload) + nla_total_size(0); }
+int nla_put_64bit(struct sk_buff *skb, int attrtype, int attrlen, const void *data, int padattr);
+static inline int nla_put_u64_64bit(struct sk_buff *skb, int attrtype, u64 value, int padattr) { return nla_put_64bit(skb, attrtype, sizeof(value), &value, padattr); }
+#endif
+
+
+/*
+ * GPIO and interrupts, see cresta_shim_irq
+ */
+typedef enum {
+    IRQ_NONE    = 0,
+    IRQ_HANDLED = 1
+} irqreturn_t;
+typedef irqreturn_t (*irq_handler_t)(int irq, void *dev_id);
+struct pt_regs;
+
+#define IRQF_TRIGGER_RISING  0x00000001
+#define IRQF_TRIGGER_FALLING 0x00000002
+
+int  request_irq(unsigned int irq, irq_handler_t handler, unsigned long flags, const char *name, void *dev);
+void free_irq(unsigned int irq, void *dev);
+void disable_irq(unsigned int irq);
+void enable_irq(unsigned int irq);
+
+int  gpio_request(unsigned int gpio, const char *label);
+void gpio_free(unsigned int gpio);
+int  gpio_direction_input(unsigned int gpio);
+int  gpio_to_irq(unsigned int gpio);
+int  gpio_get_value(unsigned int gpio);
+
+#endif
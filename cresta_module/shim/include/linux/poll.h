@@ -0,0 +1 @@
+#include "../cresta_kernel.h"
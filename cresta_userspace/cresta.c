@@ -0,0 +1,530 @@
+/*
+ * Command line tool for reading sensor data from
+ * cresta character devices
+ *
+ * License: GPLv3. See license.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <poll.h>
+#include <unistd.h>
+#include "cresta_decoder.h"
+#include "cresta_listen.h"
+#include "cresta_ring.h"
+
+//time to sleep when crestad didn't publish anything new
+#define CRESTA_RING_POLL_INTERVAL_US 100000
+//how often watched files are reopened if they can't be polled
+#define CRESTA_WATCH_INTERVAL_US 1000000
+
+static const char *const device_patterns[] = CRESTA_DEVICE_PATTERNS;
+
+/*
+ * Values of a sensor type in JSON output
+ */
+struct json_field {
+  const char *name;
+  char* (*get_string)(uint8_t *decrypted_data, char *buf);
+};
+
+static const struct json_field thermohygro_fields[] = {
+  { "temperature", get_thermohygro_temperature_string },
+  { "humidity",    get_thermohygro_humidity_string },
+  { NULL, NULL }
+};
+
+static const struct json_field anemometer_fields[] = {
+  { "temperature", get_anemometer_temperature_string },
+  { "windchill",   get_anemometer_windchill_string },
+  { "windspeed",   get_anemometer_windspeed_string },
+  { "windgust",    get_anemometer_windgust_string },
+  { "direction",   get_anemometer_wind_direction_string },
+  { NULL, NULL }
+};
+
+static const struct json_field uv_fields[] = {
+  { "temperature", get_uv_absolute_temperature_string },
+  { "medh",        get_uv_medh_string },
+  { "uvindex",     get_uv_uvindex_string },
+  { "uvlevel",     get_uv_uvlevel_string },
+  { NULL, NULL }
+};
+
+static const struct json_field rain_fields[] = {
+  { "ticks", get_rain_tick_count_string },
+  { NULL, NULL }
+};
+
+/*
+ * Prints the measurements crestad publishes into its shared
+ * memory ring until interrupted
+ */
+static int follow_ring(const char *name, int shortoutput) {
+  struct cresta_measurement_record records[16];
+  struct cresta_measurement_data sensor_data;
+  struct cresta_ring ring;
+  uint64_t overruns = 0;
+  int count;
+  int i;
+
+  if(cresta_ring_open(&ring, name)) {
+    return -1;
+  }
+
+  while(1) {
+    count = cresta_ring_read(&ring, records, sizeof(records) / sizeof(records[0]));
+    if(ring.overruns != overruns) {
+      printf("Missed %llu measurements\n", (unsigned long long) (ring.overruns - overruns));
+      overruns = ring.overruns;
+    }
+    if(0 == count) {
+      fflush(stdout);
+      usleep(CRESTA_RING_POLL_INTERVAL_US);
+      continue;
+    }
+    for(i = 0; i < count; i++) {
+      if(parse_measurement_record(&records[i], sizeof(records[i]), &sensor_data)) {
+        continue;
+      }
+      if(shortoutput) {
+        printf("%02x:", sensor_data.sensor_address);
+        print_measurement_data_short(&sensor_data);
+      } else {
+        print_measurement_data(&sensor_data);
+      }
+    }
+  }
+
+  cresta_ring_close(&ring);
+  return 0;
+}
+
+/*
+ * Prints the measurements the module pushes via netlink until
+ * interrupted, those of all sensors
+ */
+static int follow_netlink(int shortoutput) {
+  struct cresta_measurement_record records[CRESTA_LISTEN_BATCH];
+  struct cresta_measurement_data sensor_data;
+  struct cresta_listener listener;
+  uint64_t overflows = 0;
+  int count;
+  int i;
+
+  if(cresta_listen_open(&listener)) {
+    if(ENOENT == errno) {
+      printf("Cresta module isn't loaded or has no netlink support.\n");
+    } else {
+      printf("Couldn't listen for measurements: %s\n", strerror(errno));
+    }
+    return -1;
+  }
+
+  while(1) {
+    count = cresta_listen_read(&listener, records, CRESTA_LISTEN_BATCH);
+    if(count < 0) {
+      printf("Couldn't receive measurements: %s\n", strerror(errno));
+      break;
+    }
+    if(listener.overflows != overflows) {
+      printf("Missed measurements\n");
+      overflows = listener.overflows;
+    }
+    for(i = 0; i < count; i++) {
+      if(parse_measurement_record(&records[i], sizeof(records[i]), &sensor_data)) {
+        continue;
+      }
+      if(shortoutput) {
+        printf("%02x:", sensor_data.sensor_address);
+        print_measurement_data_short(&sensor_data);
+      } else {
+        print_measurement_data(&sensor_data);
+      }
+    }
+    fflush(stdout);
+  }
+
+  cresta_listen_close(&listener);
+  return -1;
+}
+
+/*
+ * Prints the measurements of a device or file until interrupted,
+ * only those whose values changed. The device stays open, poll
+ * tells when the sensor got a new measurement. Files and devices of
+ * modules that can't be polled are reopened every second
+ */
+static int watch_file(const char *filename, int shortoutput) {
+  struct cresta_measurement_data sensor_data;
+  char line[CRESTA_SHORT_LINE_LEN];
+  char last[CRESTA_SHORT_LINE_LEN] = "";
+  uint64_t sequence = 0;
+  uint64_t timestamp_ns = 0;
+  int pollable = 1;
+  int first = 1;
+  char *values;
+  struct pollfd pfd;
+  int fd = open(filename, O_RDONLY);
+
+  if(fd < 0) {
+    printf("Couldn't open file.\n");
+    return -1;
+  }
+
+  while(1) {
+    memset(&sensor_data, 0, sizeof(sensor_data));
+    if(read_measurement_record(fd, &sensor_data)) {
+      printf("Invalid measurement data\n");
+      close(fd);
+      return -1;
+    }
+
+    if(!first && sensor_data.measurement.sequence == sequence && sensor_data.measurement.timestamp_ns == timestamp_ns) {
+      //readable, but the same record: the file only changes when reopened
+      pollable = 0;
+    } else {
+      sequence = sensor_data.measurement.sequence;
+      timestamp_ns = sensor_data.measurement.timestamp_ns;
+      first = 0;
+
+      //the values follow the time
+      format_measurement_data_short(&sensor_data, line);
+      values = strchr(line, ':');
+      if(NULL == values) {
+        values = line;
+      }
+      if(strcmp(values, last)) {
+        strcpy(last, values);
+        if(shortoutput) {
+          fputs(line, stdout);
+        } else {
+          print_measurement_data(&sensor_data);
+        }
+        fflush(stdout);
+      }
+    }
+
+    if(pollable) {
+      pfd.fd = fd;
+      pfd.events = POLLIN;
+      if(poll(&pfd, 1, -1) < 0) {
+        if(EINTR == errno) {
+          continue;
+        }
+        break;
+      }
+      if(pfd.revents & (POLLHUP | POLLERR | POLLNVAL)) {
+        printf("Sensor was removed\n");
+        break;
+      }
+    } else {
+      usleep(CRESTA_WATCH_INTERVAL_US);
+      close(fd);
+      fd = open(filename, O_RDONLY);
+      if(fd < 0) {
+        printf("Couldn't open file.\n");
+        return -1;
+      }
+    }
+  }
+
+  close(fd);
+  return -1;
+}
+
+/*
+ * Prints str as JSON string. Device names need no escaping, names of
+ * other files might
+ */
+static void print_json_string(const char *str) {
+  putchar('"');
+  for(; *str; str++) {
+    if('"' == *str || '\\' == *str) {
+      putchar('\\');
+      putchar(*str);
+    } else if((unsigned char) *str < 0x20) {
+      printf("\\u%04x", *str);
+    } else {
+      putchar(*str);
+    }
+  }
+  putchar('"');
+}
+
+static void print_measurement_data_json(const char *device, struct cresta_measurement_data *data) {
+  const struct json_field *field;
+  char value[CRESTA_VALUE_STRING_LEN];
+  const char *type;
+
+  switch(data->sensor_type) {
+    case(CRESTA_SENSOR_TYPE_THERMOHYGRO): {
+      type = "thermohygro";
+      field = thermohygro_fields;
+      break;
+    }
+    case(CRESTA_SENSOR_TYPE_ANEMOMETER): {
+      type = "anemometer";
+      field = anemometer_fields;
+      break;
+    }
+    case(CRESTA_SENSOR_TYPE_UV): {
+      type = "uv";
+      field = uv_fields;
+      break;
+    }
+    case(CRESTA_SENSOR_TYPE_RAIN): {
+      type = "rain";
+      field = rain_fields;
+      break;
+    }
+    default: {
+      type = "unknown";
+      field = NULL;
+    }
+  }
+
+  fputs("{\"device\":", stdout);
+  print_json_string(device);
+  printf(",\"address\":%u,\"type\":\"%s\",\"time\":%lu,\"sequence\":%llu,\"seeded\":%s",
+         data->sensor_address, type, (unsigned long) get_measurement_time_seconds(data),
+         (unsigned long long) data->measurement.sequence,
+         data->measurement.flags & CRESTA_RECORD_FLAG_SEEDED ? "true" : "false");
+  for(; NULL != field && NULL != field->name; field++) {
+    printf(",\"%s\":%s", field->name, field->get_string(data->measurement.decrypted_data, value));
+  }
+  printf(",\"battery\":%s}", get_battery_status_string(data->measurement.decrypted_data, value));
+}
+
+/*
+ * Prints the measurements of all files matching pattern, or of all
+ * sensor devices if pattern is NULL, in one document. Devices are read
+ * one after the other: reading one doesn't block, it only copies the
+ * record. Sensors seeded without data are left out
+ */
+static int read_all(const char *pattern, int shortoutput, int json) {
+  struct cresta_measurement_data sensor_data;
+  const char *device;
+  glob_t files;
+  int found = 0;
+  int ret = 0;
+  int fd;
+  size_t i;
+
+  memset(&files, 0, sizeof(files));
+  if(NULL != pattern) {
+    glob(pattern, 0, NULL, &files);
+  } else {
+    for(i = 0; i < sizeof(device_patterns) / sizeof(device_patterns[0]); i++) {
+      glob(device_patterns[i], i ? GLOB_APPEND : 0, NULL, &files);
+    }
+  }
+
+  if(json) {
+    fputs("{\"sensors\":[", stdout);
+  }
+  for(i = 0; i < files.gl_pathc; i++) {
+    fd = open(files.gl_pathv[i], O_RDONLY | O_NONBLOCK);
+    if(fd < 0) {
+      if(ENODATA != errno) {
+        fprintf(stderr, "Couldn't open %s: %s\n", files.gl_pathv[i], strerror(errno));
+        ret = -1;
+      }
+      continue;
+    }
+    if(read_measurement_record(fd, &sensor_data)) {
+      fprintf(stderr, "Invalid measurement data in %s\n", files.gl_pathv[i]);
+      close(fd);
+      ret = -1;
+      continue;
+    }
+    close(fd);
+
+    device = strrchr(files.gl_pathv[i], '/');
+    device = NULL != device ? device + 1 : files.gl_pathv[i];
+    if(json) {
+      fputs(found ? ",\n" : "\n", stdout);
+      print_measurement_data_json(device, &sensor_data);
+    } else if(shortoutput) {
+      printf("%02x:", sensor_data.sensor_address);
+      print_measurement_data_short(&sensor_data);
+    } else {
+      printf("%s: ", device);
+      print_measurement_data(&sensor_data);
+    }
+    found++;
+  }
+  if(json) {
+    fputs("\n]}\n", stdout);
+  }
+  globfree(&files);
+
+  if(0 == files.gl_pathc) {
+    fprintf(stderr, "No devices found\n");
+    return -1;
+  }
+  return ret;
+}
+
+
+int main(int argc, char*argv[]) {
+  long filesize = 0;
+  uint8_t record[256];
+  
+  
+  int shortoutput = 0;
+  int watch = 0;
+  int all = 0;
+  int json = 0;
+  int netlink = 0;
+  char *filename = NULL;
+  char *ring_name = NULL;
+  int c;
+
+  opterr = 0;
+
+  while ((c = getopt (argc, argv, "swajnc:m:")) != -1) {
+    switch (c) {
+      case 's': {
+        shortoutput = 1;
+        break;
+      }
+      case 'w': {
+        watch = 1;
+        break;
+      }
+      case 'a': {
+        all = 1;
+        break;
+      }
+      case 'j': {
+        json = 1;
+        break;
+      }
+      case 'n': {
+        netlink = 1;
+        break;
+      }
+      case 'c': {
+        filename = optarg;
+        break;
+      }
+      case 'm': {
+        ring_name = optarg;
+        break;
+      }
+      case '?': {
+        if (optopt == 'c')
+          fprintf (stderr, "Option -%c requires cresta device file as an argument.\n", optopt);
+        else if (optopt == 'm')
+          fprintf (stderr, "Option -%c requires crestad's shared memory ring as an argument.\n", optopt);
+        else if (isprint (optopt))
+          fprintf (stderr, "Unknown option `-%c'.\n", optopt);
+        else
+          fprintf (stderr,
+                   "Unknown option character `\\x%x'.\n",
+                   optopt);
+        return 1;
+      }
+      default: {
+        abort ();
+      }
+    }
+  }
+
+
+  if(NULL != ring_name) {
+    return follow_ring(ring_name, shortoutput);
+  }
+
+  if(netlink) {
+    return follow_netlink(shortoutput);
+  }
+
+  if(all && !watch) {
+    return read_all(filename, shortoutput, json);
+  }
+
+  if(NULL == filename || (watch && (all || json))) {
+    printf("Usage: %s [-s|-j] [-w] -c <devicefile>\n", argv[0]);
+    printf("       %s [-s|-j] -a [-c <pattern>]\n", argv[0]);
+    printf("       %s [-s] -m <ring>\n", argv[0]);
+    printf("       %s [-s] -n\n", argv[0]);
+    printf("\t-c devicefile\tThe cresta character device to read from\n");
+    printf("\t-a\t\tRead all sensor devices, or all files matching\n");
+    printf("\t\t\tpattern, e.g. \"/run/cresta/*\" (crestad -o)\n");
+    printf("\t-m ring\t\tPrint measurements published into crestad's shared memory\n");
+    printf("\t\t\tring (crestad -m) until interrupted, e.g. %s\n", CRESTA_RING_NAME);
+    printf("\t-n\t\tPrint the measurements the module pushes via netlink\n");
+    printf("\t\t\tuntil interrupted, those of all sensors\n");
+    printf("\t-w\t\tKeep the device open and print its measurements\n");
+    printf("\t\t\twhenever their values change, until interrupted\n");
+    printf("\t-s\t\tOnly output raw values. Values are separated\n");
+    printf("\t\t\tby \":\", if multiple values per sensor\n");
+    printf("\t-j\t\tOutput one JSON document\n");
+    return -1;
+  }
+  
+  if(watch) {
+    return watch_file(filename, shortoutput);
+  }
+
+  if(json) {
+    return read_all(filename, shortoutput, json);
+  }
+
+   FILE *fp = fopen(filename,"r");
+   
+   
+ 
+ 
+ 
+  if(NULL == fp) {
+    printf("Couldn't open file.\n");
+    return -1;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  filesize = ftell(fp);
+  //leaves room for records of newer versions
+  if(filesize < 0 || filesize > sizeof(record)) {
+    printf("Invalid measurement data length: %ld\n", filesize);
+    fclose(fp);
+    return -1;
+  }
+   
+  fseek(fp, 0, SEEK_SET);
+
+  struct cresta_measurement_data *sensor_data = calloc(sizeof(struct cresta_measurement_data), 1);
+
+  filesize = fread(record, 1, filesize, fp);
+
+  fclose(fp);
+   
+  if(parse_measurement_record(record, filesize, sensor_data)) {
+    printf("Invalid measurement data length: %ld\n", filesize);
+    free(sensor_data);
+    return -1;
+  }
+  
+  if(shortoutput) {
+    print_measurement_data_short(sensor_data);
+  } else {
+    print_measurement_data(sensor_data);
+  }
+  
+  
+  //free(raw_measurement_data);
+  free(sensor_data);
+
+ 
+ 
+ 
+ return 0;
+ 
+ 
+}
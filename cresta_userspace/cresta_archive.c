@@ -0,0 +1,597 @@
+/*
+ * Decodes archives of edge captures (see cresta_capture) on all cores
+ * and prints the measurements in timestamp order, as address:measurement
+ * lines like cresta -s. Repeated transmissions are left out unless -a
+ * is given.
+ *
+ * Every file is split into tasks of about the same number of edges.
+ * Tasks start and end at silences long enough that the manchester
+ * decoders are back in their initial state afterwards, whatever came
+ * before (see is_cut), so each task runs a decoder of its own. A task
+ * runs on until the first such silence after its share of edges. To
+ * give the same result however the files are split up, the decoders
+ * are also started afresh at every other such silence. Unlike crestad,
+ * a datagram can't pick up bits left over from one before the silence
+ * then.
+ *
+ * Each thread takes the tasks of a contiguous range, so neighbouring
+ * parts of a file stay on one core. Threads running out of tasks steal
+ * the second half of the remaining range of another thread. The packets
+ * of each file come out in order, files are merged by timestamp.
+ *
+ * Timestamps are those of the capture (CLOCK_MONOTONIC of the capturing
+ * machine), so files of different receivers or boots can't be merged
+ * meaningfully.
+ *
+ * License: GPLv3. See license.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../cresta_common/cresta_common.h"
+#include "../cresta_common/cresta_protocol.h"
+#include "cresta_decoder.h"
+
+//edges per task, 4MB of a capture
+#define ARCHIVE_TASK_EDGES 262144
+
+//minimum silence to split at, sensors repeat datagrams after 10 ms
+#define ARCHIVE_DEFAULT_GAP_MS 100
+#define ARCHIVE_MIN_GAP_MS     10
+
+#define ARCHIVE_MAX_THREADS 256
+
+/*
+ * A capture file, mapped read only
+ */
+struct archive_file {
+    const char *path;
+    const struct cresta_raw_edge *edges;
+    size_t count;
+    size_t map_len;
+    size_t first_task;
+    size_t task_count;
+};
+
+//valid datagram, decrypted
+struct archive_packet {
+    uint64_t timestamp_ns;		//of the edge completing it
+    uint8_t  data[CRESTA_MAXDATA_LEN];
+};
+
+struct archive_task {
+    struct archive_file *file;
+    size_t chunk;			//edges from chunk * task_edges on
+    struct archive_packet *packets;
+    size_t packet_count;
+    size_t packet_capacity;
+    unsigned long edges;
+    unsigned long lost;
+    unsigned long decoded;		//datagrams completed by the decoder
+    int failed;				//out of memory
+};
+
+/*
+ * Tasks not taken yet of a thread, [head, tail). The owner
+ * takes from the head, thieves from the tail
+ */
+struct archive_worker {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    size_t head;
+    size_t tail;
+    unsigned long tasks;
+    unsigned long steals;
+};
+
+struct archive_stats {
+    unsigned long long edges;
+    unsigned long long lost;
+    unsigned long decoded;
+    unsigned long valid;
+    unsigned long repeated;
+    unsigned long printed;
+    unsigned long steals;
+};
+
+static struct archive_file *files;
+static size_t file_count;
+static struct archive_task *tasks;
+static size_t task_count;
+static struct archive_worker workers[ARCHIVE_MAX_THREADS];
+static int worker_count;
+static size_t task_edges = ARCHIVE_TASK_EDGES;
+static uint32_t gap_us = ARCHIVE_DEFAULT_GAP_MS * 1000;
+static int hypotheses = 1;
+static int quiet = 0;
+static struct archive_stats stats;
+
+
+static uint64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+//duration fed into the decoder for edge i, as crestad does
+static inline uint32_t edge_duration_us(const struct cresta_raw_edge *edges, size_t i) {
+    uint64_t delta_us = (edges[i].timestamp_ns - (i ? edges[i - 1].timestamp_ns : 0)) / 1000;
+
+    return delta_us > UINT32_MAX ? UINT32_MAX : (uint32_t) delta_us;
+}
+
+/*
+ * Whether a fresh decoder started at edge i ends up in the same state
+ * as one that decoded all edges before, apart from the bits of earlier
+ * datagrams in its buffers. This holds if edge i - 1 ends a silence of
+ * at least gap_us, edge i - 2 is shorter than gap_us / 6 and edge i has
+ * a clock the decoder accepts:
+ *
+ * The silence is more than 3 times the clock of any decoder unless the
+ * decoder was reset by an edge of at least 2/3 of it and accepted every
+ * edge since, none of which can be shorter than gap_us / 6. So the
+ * silence resets every busy decoder and completes no datagram. After
+ * that the primary decoder is either idle or waits with half the silence
+ * as clock, and all candidates are idle. Both take edge i as the clock
+ * of a new datagram, just like a fresh decoder.
+ */
+static inline int is_cut(const struct cresta_raw_edge *edges, size_t i) {
+    uint32_t clock;
+
+    if(i < 3) {
+	return 0;
+    }
+    clock = edge_duration_us(edges, i) >> 1;
+    return edge_duration_us(edges, i - 1) >= gap_us && edge_duration_us(edges, i - 2) < gap_us / 6 &&
+	   clock >= 200 && clock <= 1000;
+}
+
+static int add_packet(struct archive_task *task, uint64_t timestamp_ns, const uint8_t *packet) {
+    struct archive_packet *p;
+    uint8_t len;
+
+    if(task->packet_count == task->packet_capacity) {
+	size_t capacity = task->packet_capacity ? task->packet_capacity * 2 : 64;
+
+	p = realloc(task->packets, capacity * sizeof(*p));
+	if(NULL == p) {
+	    return -1;
+	}
+	task->packets = p;
+	task->packet_capacity = capacity;
+    }
+
+    p = &task->packets[task->packet_count++];
+    p->timestamp_ns = timestamp_ns;
+    memcpy(p->data, packet, sizeof(p->data));
+    //bytes after the checksum are left over from earlier datagrams
+    len = get_packet_length_from_decrypted_data(p->data);
+    if(len + 3 < sizeof(p->data)) {
+	memset(p->data + len + 3, 0, sizeof(p->data) - len - 3);
+    }
+    return 0;
+}
+
+/*
+ * Decodes the edges of a task, from the first cut in its chunk up to
+ * the first cut after it. A chunk without a cut is decoded by the task
+ * before. The decoder starts afresh at every cut
+ */
+static void run_task(struct archive_task *task) {
+    const struct cresta_raw_edge *edges = task->file->edges;
+    size_t count = task->file->count;
+    size_t start = task->chunk * task_edges;
+    size_t end = start + task_edges;
+    struct cresta_manchester_multi decoder;
+    uint8_t packet[CRESTA_MAXDATA_LEN];
+    size_t i;
+
+    if(0 == task_edges || end > count) {
+	end = count;
+    }
+    if(start > 0) {
+	while(start < end && !is_cut(edges, start)) {
+	    start++;
+	}
+	if(start == end) {
+	    return;
+	}
+    }
+
+    cresta_manchester_multi_init(&decoder, hypotheses);
+    for(i = start; i < count; i++) {
+	if(i > start && is_cut(edges, i)) {
+	    if(i >= end) {
+		break;
+	    }
+	    cresta_manchester_multi_init(&decoder, hypotheses);
+	}
+	task->edges++;
+	task->lost += edges[i].dropped;
+	if(cresta_manchester_multi_decode(&decoder, edge_duration_us(edges, i))) {
+	    task->decoded++;
+	    memcpy(packet, decoder.packet, sizeof(packet));
+	    if(0 == decrypt_and_check(packet) && add_packet(task, edges[i].timestamp_ns, packet)) {
+		task->failed = 1;
+		return;
+	    }
+	}
+    }
+}
+
+/*
+ * Takes the next task of the worker, or steals half of the tasks
+ * left to another one. Returns NULL once all are taken
+ */
+static struct archive_task *next_task(struct archive_worker *self) {
+    size_t head = 0;
+    size_t tail = 0;
+    int i;
+
+    pthread_mutex_lock(&self->lock);
+    if(self->head < self->tail) {
+	head = self->head++;
+	pthread_mutex_unlock(&self->lock);
+	return &tasks[head];
+    }
+    pthread_mutex_unlock(&self->lock);
+
+    for(i = 1; i < worker_count && head == tail; i++) {
+	struct archive_worker *victim = &workers[(self - workers + i) % worker_count];
+
+	pthread_mutex_lock(&victim->lock);
+	if(victim->head < victim->tail) {
+	    tail = victim->tail;
+	    head = tail - (victim->tail - victim->head + 1) / 2;
+	    victim->tail = head;
+	}
+	pthread_mutex_unlock(&victim->lock);
+    }
+    if(head == tail) {
+	return NULL;
+    }
+
+    self->steals++;
+    pthread_mutex_lock(&self->lock);
+    self->head = head + 1;
+    self->tail = tail;
+    pthread_mutex_unlock(&self->lock);
+    return &tasks[head];
+}
+
+static void *worker_thread(void *arg) {
+    struct archive_worker *self = arg;
+    struct archive_task *task;
+
+    while(NULL != (task = next_task(self))) {
+	run_task(task);
+	self->tasks++;
+    }
+    return NULL;
+}
+
+static int map_file(struct archive_file *file) {
+    struct stat st;
+    void *map;
+    int fd = open(file->path, O_RDONLY);
+
+    if(fd < 0 || fstat(fd, &st)) {
+	fprintf(stderr, "Couldn't open %s: %s\n", file->path, strerror(errno));
+	if(fd >= 0) {
+	    close(fd);
+	}
+	return -1;
+    }
+    file->count = st.st_size / sizeof(struct cresta_raw_edge);
+    if(st.st_size % sizeof(struct cresta_raw_edge)) {
+	fprintf(stderr, "Ignoring %ld bytes at the end of %s\n", (long) (st.st_size % sizeof(struct cresta_raw_edge)),
+		file->path);
+    }
+    if(0 == file->count) {
+	close(fd);
+	return 0;
+    }
+
+    file->map_len = file->count * sizeof(struct cresta_raw_edge);
+    map = mmap(NULL, file->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(MAP_FAILED == map) {
+	fprintf(stderr, "Couldn't map %s: %s\n", file->path, strerror(errno));
+	return -1;
+    }
+    madvise(map, file->map_len, MADV_SEQUENTIAL);
+    file->edges = map;
+    return 0;
+}
+
+/*
+ * Maps the files and creates their tasks, each
+ * worker gets an equal share of them
+ */
+static int create_tasks(void) {
+    size_t i;
+    size_t j;
+    int w;
+
+    for(i = 0; i < file_count; i++) {
+	if(map_file(&files[i])) {
+	    return -1;
+	}
+	files[i].first_task = task_count;
+	files[i].task_count = task_edges ? (files[i].count + task_edges - 1) / task_edges : files[i].count > 0;
+	task_count += files[i].task_count;
+    }
+
+    tasks = calloc(task_count ? task_count : 1, sizeof(*tasks));
+    if(NULL == tasks) {
+	return -1;
+    }
+    for(i = 0; i < file_count; i++) {
+	for(j = 0; j < files[i].task_count; j++) {
+	    tasks[files[i].first_task + j].file = &files[i];
+	    tasks[files[i].first_task + j].chunk = j;
+	}
+    }
+
+    for(w = 0; w < worker_count; w++) {
+	pthread_mutex_init(&workers[w].lock, NULL);
+	workers[w].head = task_count * w / worker_count;
+	workers[w].tail = task_count * (w + 1) / worker_count;
+    }
+    return 0;
+}
+
+/*
+ * Position in the packets of a file, for merging
+ */
+struct archive_cursor {
+    size_t file;
+    struct archive_task *task;
+    struct archive_task *end;
+    size_t packet;
+};
+
+static inline const struct archive_packet *cursor_packet(const struct archive_cursor *c) {
+    return &c->task->packets[c->packet];
+}
+
+//moves to the next packet, returns 0 at the end of the file
+static int cursor_next(struct archive_cursor *c) {
+    c->packet++;
+    while(c->task < c->end && c->packet >= c->task->packet_count) {
+	c->task++;
+	c->packet = 0;
+    }
+    return c->task < c->end;
+}
+
+//earlier packets first, the file given first on ties
+static inline int cursor_before(const struct archive_cursor *a, const struct archive_cursor *b) {
+    uint64_t ta = cursor_packet(a)->timestamp_ns;
+    uint64_t tb = cursor_packet(b)->timestamp_ns;
+
+    return ta < tb || (ta == tb && a->file < b->file);
+}
+
+static void sift_down(struct archive_cursor *heap, size_t count, size_t i) {
+    for(;;) {
+	size_t smallest = i;
+	size_t child = 2 * i + 1;
+	struct archive_cursor tmp;
+
+	if(child < count && cursor_before(&heap[child], &heap[smallest])) {
+	    smallest = child;
+	}
+	if(child + 1 < count && cursor_before(&heap[child + 1], &heap[smallest])) {
+	    smallest = child + 1;
+	}
+	if(smallest == i) {
+	    return;
+	}
+	tmp = heap[i];
+	heap[i] = heap[smallest];
+	heap[smallest] = tmp;
+	i = smallest;
+    }
+}
+
+/*
+ * Prints a measurement unless it's a repetition of the
+ * last one of its sensor, numbered like crestad does
+ */
+static void print_packet(const struct archive_packet *packet, int all) {
+    static struct cresta_measurement_record last[256];
+    struct cresta_measurement_data data;
+    struct cresta_measurement_record *sensor;
+    char buf[CRESTA_SHORT_LINE_LEN];
+    int len;
+
+    memset(&data, 0, sizeof(data));
+    memcpy(data.measurement.decrypted_data, packet->data, sizeof(data.measurement.decrypted_data));
+    data.sensor_address = get_sensor_address_from_decrypted_data(data.measurement.decrypted_data);
+    data.len            = get_packet_length_from_decrypted_data(data.measurement.decrypted_data);
+    data.sensor_type    = get_sensor_type_from_decrypted_data(data.measurement.decrypted_data);
+    cresta_init_measurement_record(&data, packet->timestamp_ns);
+
+    sensor = &last[data.sensor_address];
+    if(sensor->sequence && cresta_is_repeated_transmission(sensor, &data.measurement)) {
+	stats.repeated++;
+	if(!all) {
+	    return;
+	}
+    } else {
+	data.measurement.sequence = sensor->sequence + 1;
+	*sensor = data.measurement;
+    }
+
+    len = format_measurement_data_short(&data, buf);
+    if(len && !quiet) {
+	printf("%02x:", data.sensor_address);
+	fwrite(buf, 1, len, stdout);
+	stats.printed++;
+    }
+}
+
+/*
+ * Merges the packets of all files by timestamp
+ */
+static int merge_packets(int all) {
+    struct archive_cursor *heap = malloc((file_count ? file_count : 1) * sizeof(*heap));
+    size_t count = 0;
+    size_t i;
+
+    if(NULL == heap) {
+	return -1;
+    }
+    for(i = 0; i < file_count; i++) {
+	struct archive_cursor c = {
+	    .file = i,
+	    .task = &tasks[files[i].first_task],
+	    .end = &tasks[files[i].first_task + files[i].task_count],
+	    .packet = (size_t) -1
+	};
+
+	if(cursor_next(&c)) {
+	    heap[count++] = c;
+	}
+    }
+    for(i = count; i-- > 0;) {
+	sift_down(heap, count, i);
+    }
+
+    while(count) {
+	print_packet(cursor_packet(&heap[0]), all);
+	if(!cursor_next(&heap[0])) {
+	    heap[0] = heap[--count];
+	}
+	sift_down(heap, count, 0);
+    }
+    free(heap);
+    return 0;
+}
+
+static void usage(const char *name) {
+    printf("Usage: %s [-j threads] [-H hypotheses] [-g gap] [-c edges] [-a] [-q] capturefile...\n", name);
+    printf("\t-j threads\tDecoding threads (1-%d, default one per CPU)\n", ARCHIVE_MAX_THREADS);
+    printf("\t-H hypotheses\tNumber of parallel manchester decoders (1-%d, default 1)\n", CRESTA_MAX_HYPOTHESES);
+    printf("\t-g gap\t\tMinimum silence in ms files are split at (at least %d, default %d)\n", ARCHIVE_MIN_GAP_MS,
+	   ARCHIVE_DEFAULT_GAP_MS);
+    printf("\t-c edges\tEdges per task (default %d, 0 doesn't split files)\n", ARCHIVE_TASK_EDGES);
+    printf("\t-a\t\tAlso print repeated transmissions\n");
+    printf("\t-q\t\tOnly print statistics\n");
+}
+
+int main(int argc, char *argv[]) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int all = 0;
+    int failed = 0;
+    uint64_t start;
+    double seconds;
+    size_t i;
+    int c;
+
+    worker_count = cpus > 0 ? (cpus < ARCHIVE_MAX_THREADS ? cpus : ARCHIVE_MAX_THREADS) : 1;
+
+    opterr = 0;
+
+    while ((c = getopt (argc, argv, "j:H:g:c:aq")) != -1) {
+	switch (c) {
+	    case 'j': {
+		worker_count = atoi(optarg);
+		break;
+	    }
+	    case 'H': {
+		hypotheses = atoi(optarg);
+		break;
+	    }
+	    case 'g': {
+		gap_us = atoi(optarg) * 1000;
+		break;
+	    }
+	    case 'c': {
+		task_edges = strtoul(optarg, NULL, 0);
+		break;
+	    }
+	    case 'a': {
+		all = 1;
+		break;
+	    }
+	    case 'q': {
+		quiet = 1;
+		break;
+	    }
+	    case '?': {
+		if (isprint (optopt))
+		    fprintf (stderr, "Unknown option or missing argument `-%c'.\n", optopt);
+		usage(argv[0]);
+		return 1;
+	    }
+	    default: {
+		abort ();
+	    }
+	}
+    }
+
+    if(optind >= argc || worker_count < 1 || worker_count > ARCHIVE_MAX_THREADS || gap_us < ARCHIVE_MIN_GAP_MS * 1000) {
+	usage(argv[0]);
+	return 1;
+    }
+
+    file_count = argc - optind;
+    files = calloc(file_count, sizeof(*files));
+    if(NULL == files) {
+	return -1;
+    }
+    for(i = 0; i < file_count; i++) {
+	files[i].path = argv[optind + i];
+    }
+
+    start = monotonic_ns();
+    if(create_tasks()) {
+	return -1;
+    }
+    for(c = 0; c < worker_count; c++) {
+	if(pthread_create(&workers[c].thread, NULL, worker_thread, &workers[c])) {
+	    fprintf(stderr, "Couldn't start decoding threads\n");
+	    return -1;
+	}
+    }
+    for(c = 0; c < worker_count; c++) {
+	pthread_join(workers[c].thread, NULL);
+	stats.steals += workers[c].steals;
+    }
+
+    for(i = 0; i < task_count; i++) {
+	stats.edges += tasks[i].edges;
+	stats.lost += tasks[i].lost;
+	stats.decoded += tasks[i].decoded;
+	stats.valid += tasks[i].packet_count;
+	failed |= tasks[i].failed;
+    }
+    if(failed) {
+	fprintf(stderr, "Out of memory\n");
+	return -1;
+    }
+    seconds = (monotonic_ns() - start) / 1e9;
+
+    if(merge_packets(all)) {
+	return -1;
+    }
+    fflush(stdout);
+
+    fprintf(stderr, "%zu files, %llu edges (%llu lost) in %zu tasks on %d threads, %lu steals\n",
+	    file_count, stats.edges, stats.lost, task_count, worker_count, stats.steals);
+    fprintf(stderr, "%lu packets, %lu valid, %lu repeated, %lu printed\n",
+	    stats.decoded, stats.valid, stats.repeated, stats.printed);
+    fprintf(stderr, "Decoded in %.3f s, %.1f Medges/s\n", seconds, seconds > 0 ? stats.edges / seconds / 1e6 : 0);
+    return 0;
+}
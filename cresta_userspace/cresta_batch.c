@@ -0,0 +1,352 @@
+/*
+ * Batch decoding of measurement records.
+ *
+ * Most fields are three BCD digits in tenths. For these, the 16 bits
+ * holding the digits (and the sign) of several records are gathered
+ * into a vector and converted at once, with SSE2 or AVX2 on x86 and
+ * NEON on 64 bit ARM. The other fields are cheap, they are taken from
+ * the getters in cresta_decoder.c.
+ *
+ * The vector code does the same IEEE operations as the getters: digits
+ * are summed up as integers and divided by 10 (correctly rounded, like
+ * the getters' sum of the digits), the conversion to km/h is done in
+ * double precision. So results are identical, as long as nothing like
+ * -ffast-math is used.
+ *
+ * License: GPLv3. See license.txt
+ */
+#include <string.h>
+#include "cresta_decoder.h"
+#include "cresta_batch.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CRESTA_BATCH_X86
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CRESTA_BATCH_ARM64
+#endif
+
+//records are decoded in chunks of this size (12kB), small enough to stay in the L1 cache
+#define BATCH_CHUNK 256
+
+//same factor as the getters
+#define BATCH_KMH_PER_MPH 1.60934
+
+/*
+ * A field of three BCD digits. The 16 bits starting at offset hold
+ * the most significant digit at bit shift, followed by the other two
+ */
+struct bcd3_field {
+    uint8_t offset;
+    uint8_t shift;
+    uint8_t flags;
+};
+#define BCD3_SIGNED 0x01	//sign in the nibble above the digits, 4 is negative
+#define BCD3_MPH    0x02	//transmitted in mph
+
+static const struct bcd3_field temperature_field  = { 4, 8,  BCD3_SIGNED };
+static const struct bcd3_field windchill_field    = { 6, 8,  BCD3_SIGNED };
+static const struct bcd3_field windspeed_field    = { 8, 8,  METRIC_UNITS ? BCD3_MPH : 0 };
+static const struct bcd3_field windgust_field     = { 9, 12, METRIC_UNITS ? BCD3_MPH : 0 };
+static const struct bcd3_field uv_temperature_field = { 4, 8, 0 };
+static const struct bcd3_field medh_field         = { 5, 12, 0 };
+static const struct bcd3_field uvindex_field      = { 7, 8,  0 };
+
+typedef void (*bcd3_kernel)(const struct cresta_measurement_record *records, size_t count, const struct bcd3_field *field, float *out);
+
+//the 16 bits holding a field
+static inline uint32_t bcd3_word(const struct cresta_measurement_record *record, const struct bcd3_field *field) {
+    const uint8_t *data = record->decrypted_data + field->offset;
+    return data[0] | data[1] << 8;
+}
+
+static float bcd3_value(uint32_t word, const struct bcd3_field *field) {
+    uint32_t tenths = ((word >> field->shift) & 0x0F) * 100 +
+		      ((word >> (field->shift - 4)) & 0x0F) * 10 +
+		      ((word >> (field->shift - 8)) & 0x0F);
+    float value = tenths / 10.0f;
+
+    if((field->flags & BCD3_SIGNED) && ((word >> (field->shift + 4)) & 0x0F) == 0x04) {
+	value = -value;
+    }
+    if(field->flags & BCD3_MPH) {
+	value = value * BATCH_KMH_PER_MPH;
+    }
+    return value;
+}
+
+static void bcd3_scalar(const struct cresta_measurement_record *records, size_t count, const struct bcd3_field *field, float *out) {
+    size_t i;
+
+    for(i = 0; i < count; i++) {
+	out[i] = bcd3_value(bcd3_word(&records[i], field), field);
+    }
+}
+
+#ifdef CRESTA_BATCH_X86
+__attribute__((target("sse2")))
+static void bcd3_sse2(const struct cresta_measurement_record *records, size_t count, const struct bcd3_field *field, float *out) {
+    const __m128i nibble = _mm_set1_epi32(0x0F);
+    const __m128i shift2 = _mm_cvtsi32_si128(field->shift);
+    const __m128i shift1 = _mm_cvtsi32_si128(field->shift - 4);
+    const __m128i shift0 = _mm_cvtsi32_si128(field->shift - 8);
+    const __m128i shift_sign = _mm_cvtsi32_si128(field->shift + 4);
+    //digits are below 16, so 16 bit multiplies will do
+    const __m128i hundred = _mm_set1_epi32(100);
+    const __m128i ten = _mm_set1_epi32(10);
+    const __m128i negative = _mm_set1_epi32(0x04);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 divisor = _mm_set1_ps(10.0f);
+    const __m128d mph = _mm_set1_pd(BATCH_KMH_PER_MPH);
+    size_t i;
+
+    for(i = 0; i + 4 <= count; i += 4) {
+	__m128i word = _mm_setr_epi32(bcd3_word(&records[i], field), bcd3_word(&records[i + 1], field),
+				      bcd3_word(&records[i + 2], field), bcd3_word(&records[i + 3], field));
+	__m128i tenths = _mm_add_epi32(_mm_add_epi32(
+			    _mm_madd_epi16(_mm_and_si128(_mm_srl_epi32(word, shift2), nibble), hundred),
+			    _mm_madd_epi16(_mm_and_si128(_mm_srl_epi32(word, shift1), nibble), ten)),
+			    _mm_and_si128(_mm_srl_epi32(word, shift0), nibble));
+	__m128 value = _mm_div_ps(_mm_cvtepi32_ps(tenths), divisor);
+
+	if(field->flags & BCD3_SIGNED) {
+	    __m128i is_negative = _mm_cmpeq_epi32(_mm_and_si128(_mm_srl_epi32(word, shift_sign), nibble), negative);
+	    value = _mm_xor_ps(value, _mm_and_ps(_mm_castsi128_ps(is_negative), sign));
+	}
+	if(field->flags & BCD3_MPH) {
+	    __m128d low = _mm_mul_pd(_mm_cvtps_pd(value), mph);
+	    __m128d high = _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(value, value)), mph);
+	    value = _mm_movelh_ps(_mm_cvtpd_ps(low), _mm_cvtpd_ps(high));
+	}
+	_mm_storeu_ps(&out[i], value);
+    }
+    bcd3_scalar(records + i, count - i, field, out + i);
+}
+
+__attribute__((target("avx2")))
+static void bcd3_avx2(const struct cresta_measurement_record *records, size_t count, const struct bcd3_field *field, float *out) {
+    const __m256i nibble = _mm256_set1_epi32(0x0F);
+    const __m128i shift2 = _mm_cvtsi32_si128(field->shift);
+    const __m128i shift1 = _mm_cvtsi32_si128(field->shift - 4);
+    const __m128i shift0 = _mm_cvtsi32_si128(field->shift - 8);
+    const __m128i shift_sign = _mm_cvtsi32_si128(field->shift + 4);
+    const __m256i hundred = _mm256_set1_epi32(100);
+    const __m256i ten = _mm256_set1_epi32(10);
+    const __m256i negative = _mm256_set1_epi32(0x04);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 divisor = _mm256_set1_ps(10.0f);
+    const __m256d mph = _mm256_set1_pd(BATCH_KMH_PER_MPH);
+    size_t i;
+
+    for(i = 0; i + 8 <= count; i += 8) {
+	//plain loads, vpgatherdd is slower than that on many CPUs
+	__m256i word = _mm256_setr_epi32(bcd3_word(&records[i], field), bcd3_word(&records[i + 1], field),
+					 bcd3_word(&records[i + 2], field), bcd3_word(&records[i + 3], field),
+					 bcd3_word(&records[i + 4], field), bcd3_word(&records[i + 5], field),
+					 bcd3_word(&records[i + 6], field), bcd3_word(&records[i + 7], field));
+	__m256i tenths = _mm256_add_epi32(_mm256_add_epi32(
+			    _mm256_mullo_epi32(_mm256_and_si256(_mm256_srl_epi32(word, shift2), nibble), hundred),
+			    _mm256_mullo_epi32(_mm256_and_si256(_mm256_srl_epi32(word, shift1), nibble), ten)),
+			    _mm256_and_si256(_mm256_srl_epi32(word, shift0), nibble));
+	__m256 value = _mm256_div_ps(_mm256_cvtepi32_ps(tenths), divisor);
+
+	if(field->flags & BCD3_SIGNED) {
+	    __m256i is_negative = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_srl_epi32(word, shift_sign), nibble), negative);
+	    value = _mm256_xor_ps(value, _mm256_and_ps(_mm256_castsi256_ps(is_negative), sign));
+	}
+	if(field->flags & BCD3_MPH) {
+	    __m256d low = _mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(value)), mph);
+	    __m256d high = _mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(value, 1)), mph);
+	    value = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(low)), _mm256_cvtpd_ps(high), 1);
+	}
+	_mm256_storeu_ps(&out[i], value);
+    }
+    bcd3_sse2(records + i, count - i, field, out + i);
+}
+#endif
+
+#ifdef CRESTA_BATCH_ARM64
+static void bcd3_neon(const struct cresta_measurement_record *records, size_t count, const struct bcd3_field *field, float *out) {
+    const uint32x4_t nibble = vdupq_n_u32(0x0F);
+    //negative shifts shift to the right
+    const int32x4_t shift2 = vdupq_n_s32(-(int32_t) field->shift);
+    const int32x4_t shift1 = vdupq_n_s32(-(int32_t) field->shift + 4);
+    const int32x4_t shift0 = vdupq_n_s32(-(int32_t) field->shift + 8);
+    const int32x4_t shift_sign = vdupq_n_s32(-(int32_t) field->shift - 4);
+    const uint32x4_t negative = vdupq_n_u32(0x04);
+    const uint32x4_t sign = vdupq_n_u32(0x80000000);
+    const float32x4_t divisor = vdupq_n_f32(10.0f);
+    size_t i;
+
+    for(i = 0; i + 4 <= count; i += 4) {
+	uint32_t gathered[4] = { bcd3_word(&records[i], field), bcd3_word(&records[i + 1], field),
+				 bcd3_word(&records[i + 2], field), bcd3_word(&records[i + 3], field) };
+	uint32x4_t word = vld1q_u32(gathered);
+	uint32x4_t tenths = vandq_u32(vshlq_u32(word, shift0), nibble);
+	float32x4_t value;
+
+	tenths = vmlaq_n_u32(tenths, vandq_u32(vshlq_u32(word, shift1), nibble), 10);
+	tenths = vmlaq_n_u32(tenths, vandq_u32(vshlq_u32(word, shift2), nibble), 100);
+	value = vdivq_f32(vcvtq_f32_u32(tenths), divisor);
+
+	if(field->flags & BCD3_SIGNED) {
+	    uint32x4_t is_negative = vceqq_u32(vandq_u32(vshlq_u32(word, shift_sign), nibble), negative);
+	    value = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(value), vandq_u32(is_negative, sign)));
+	}
+	if(field->flags & BCD3_MPH) {
+	    float64x2_t low = vmulq_n_f64(vcvt_f64_f32(vget_low_f32(value)), BATCH_KMH_PER_MPH);
+	    float64x2_t high = vmulq_n_f64(vcvt_high_f64_f32(value), BATCH_KMH_PER_MPH);
+	    value = vcvt_high_f32_f64(vcvt_f32_f64(low), high);
+	}
+	vst1q_f32(&out[i], value);
+    }
+    bcd3_scalar(records + i, count - i, field, out + i);
+}
+#endif
+
+static const char *impl_names[CRESTA_BATCH_IMPL_COUNT] = { "scalar", "sse2", "avx2", "neon" };
+
+static const bcd3_kernel kernels[CRESTA_BATCH_IMPL_COUNT] = {
+    bcd3_scalar,
+#ifdef CRESTA_BATCH_X86
+    bcd3_sse2,
+    bcd3_avx2,
+#else
+    NULL,
+    NULL,
+#endif
+#ifdef CRESTA_BATCH_ARM64
+    bcd3_neon,
+#else
+    NULL,
+#endif
+};
+
+//CRESTA_BATCH_IMPL_COUNT until the first decode or cresta_batch_select
+static int selected = CRESTA_BATCH_IMPL_COUNT;
+
+
+static int is_supported(enum cresta_batch_impl impl) {
+    if(impl < 0 || impl >= CRESTA_BATCH_IMPL_COUNT || NULL == kernels[impl]) {
+	return 0;
+    }
+#ifdef CRESTA_BATCH_X86
+    if(CRESTA_BATCH_SSE2 == impl) {
+	return __builtin_cpu_supports("sse2");
+    }
+    if(CRESTA_BATCH_AVX2 == impl) {
+	return __builtin_cpu_supports("avx2");
+    }
+#endif
+    return 1;
+}
+
+int cresta_batch_select(enum cresta_batch_impl impl) {
+    if(!is_supported(impl)) {
+	return -1;
+    }
+    __atomic_store_n(&selected, impl, __ATOMIC_RELAXED);
+    return 0;
+}
+
+enum cresta_batch_impl cresta_batch_selected(void) {
+    int impl = __atomic_load_n(&selected, __ATOMIC_RELAXED);
+
+    if(CRESTA_BATCH_IMPL_COUNT == impl) {
+	//the fastest one, threads racing here all pick the same
+	for(impl = CRESTA_BATCH_IMPL_COUNT - 1; !is_supported(impl); impl--);
+	__atomic_store_n(&selected, impl, __ATOMIC_RELAXED);
+    }
+    return impl;
+}
+
+const char* cresta_batch_name(enum cresta_batch_impl impl) {
+    if(impl < 0 || impl >= CRESTA_BATCH_IMPL_COUNT) {
+	return "unknown";
+    }
+    return impl_names[impl];
+}
+
+/*
+ * Decodes a BCD field of all records
+ */
+static void decode_bcd3(const struct cresta_measurement_record *records, size_t count, const struct bcd3_field *field, float *out) {
+    if(NULL != out) {
+	kernels[cresta_batch_selected()](records, count, field, out);
+    }
+}
+
+static void decode_battery(const struct cresta_measurement_record *records, size_t count, uint8_t *out) {
+    size_t i;
+
+    for(i = 0; out && i < count; i++) {
+	out[i] = get_battery_status((uint8_t*) records[i].decrypted_data);
+    }
+}
+
+/*
+ * All fields of a chunk are decoded before moving on, so the
+ * records are read from memory once
+ */
+#define BATCH_FOR_EACH_CHUNK(chunk, n, count) \
+    for(chunk = 0; n = (count) - chunk < BATCH_CHUNK ? (count) - chunk : BATCH_CHUNK, chunk < (count); chunk += BATCH_CHUNK)
+
+//output array of a chunk, fields not asked for stay NULL
+#define BATCH_OUT(array, chunk) (NULL != (array) ? (array) + (chunk) : NULL)
+
+void cresta_batch_decode_thermohygro(const struct cresta_measurement_record *records, size_t count, const struct cresta_thermohygro_batch *out) {
+    size_t chunk;
+    size_t n;
+    size_t i;
+
+    BATCH_FOR_EACH_CHUNK(chunk, n, count) {
+	decode_bcd3(records + chunk, n, &temperature_field, BATCH_OUT(out->temperature, chunk));
+	for(i = chunk; out->humidity && i < chunk + n; i++) {
+	    out->humidity[i] = get_thermohygro_humidity((uint8_t*) records[i].decrypted_data);
+	}
+	decode_battery(records + chunk, n, BATCH_OUT(out->battery, chunk));
+    }
+}
+
+void cresta_batch_decode_anemometer(const struct cresta_measurement_record *records, size_t count, const struct cresta_anemometer_batch *out) {
+    size_t chunk;
+    size_t n;
+    size_t i;
+
+    BATCH_FOR_EACH_CHUNK(chunk, n, count) {
+	decode_bcd3(records + chunk, n, &temperature_field, BATCH_OUT(out->temperature, chunk));
+	decode_bcd3(records + chunk, n, &windchill_field, BATCH_OUT(out->windchill, chunk));
+	decode_bcd3(records + chunk, n, &windspeed_field, BATCH_OUT(out->windspeed, chunk));
+	decode_bcd3(records + chunk, n, &windgust_field, BATCH_OUT(out->windgust, chunk));
+	for(i = chunk; out->direction && i < chunk + n; i++) {
+	    out->direction[i] = get_anemometer_wind_direction((uint8_t*) records[i].decrypted_data);
+	}
+	decode_battery(records + chunk, n, BATCH_OUT(out->battery, chunk));
+    }
+}
+
+void cresta_batch_decode_uv(const struct cresta_measurement_record *records, size_t count, const struct cresta_uv_batch *out) {
+    size_t chunk;
+    size_t n;
+    size_t i;
+
+    BATCH_FOR_EACH_CHUNK(chunk, n, count) {
+	decode_bcd3(records + chunk, n, &uv_temperature_field, BATCH_OUT(out->temperature, chunk));
+	decode_bcd3(records + chunk, n, &medh_field, BATCH_OUT(out->medh, chunk));
+	decode_bcd3(records + chunk, n, &uvindex_field, BATCH_OUT(out->uvindex, chunk));
+	for(i = chunk; out->uvlevel && i < chunk + n; i++) {
+	    out->uvlevel[i] = get_uv_uvlevel((uint8_t*) records[i].decrypted_data);
+	}
+	decode_battery(records + chunk, n, BATCH_OUT(out->battery, chunk));
+    }
+}
+
+void cresta_batch_decode_rain(const struct cresta_measurement_record *records, size_t count, const struct cresta_rain_batch *out) {
+    size_t i;
+
+    for(i = 0; out->ticks && i < count; i++) {
+	out->ticks[i] = get_rain_tick_count((uint8_t*) records[i].decrypted_data);
+    }
+    decode_battery(records, count, out->battery);
+}
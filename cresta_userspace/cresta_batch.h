@@ -0,0 +1,73 @@
+/*
+ * Batch decoding of measurement records, e.g. for reports over
+ * archived measurements. Takes arrays of records of one sensor type
+ * and writes each field into an array of its own.
+ *
+ * Results are the same as those of the getters in cresta_decoder.c,
+ * whichever implementation is used. Unexpected temperature signs are
+ * not reported though, the value is positive then, as with the
+ * getters.
+ *
+ * License: GPLv3. See license.txt
+ */
+#ifndef _CRESTA_BATCH_H_
+#define _CRESTA_BATCH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../cresta_common/cresta_common.h"
+
+enum cresta_batch_impl {
+    CRESTA_BATCH_SCALAR,
+    CRESTA_BATCH_SSE2,
+    CRESTA_BATCH_AVX2,
+    CRESTA_BATCH_NEON,
+    CRESTA_BATCH_IMPL_COUNT
+};
+
+/*
+ * Output arrays, one element per record. Fields whose
+ * array is NULL are not decoded
+ */
+struct cresta_thermohygro_batch {
+    float   *temperature;
+    int8_t  *humidity;
+    uint8_t *battery;
+};
+
+struct cresta_anemometer_batch {
+    float   *temperature;
+    float   *windchill;
+    float   *windspeed;
+    float   *windgust;
+    float   *direction;
+    uint8_t *battery;
+};
+
+struct cresta_uv_batch {
+    float   *temperature;
+    float   *medh;
+    float   *uvindex;
+    uint8_t *uvlevel;
+    uint8_t *battery;
+};
+
+struct cresta_rain_batch {
+    uint16_t *ticks;
+    uint8_t  *battery;
+};
+
+/*
+ * The fastest implementation the CPU supports is used by default.
+ * Selecting one the CPU or build doesn't support returns -1
+ */
+int                    cresta_batch_select(enum cresta_batch_impl impl);
+enum cresta_batch_impl cresta_batch_selected(void);
+const char*            cresta_batch_name(enum cresta_batch_impl impl);
+
+void cresta_batch_decode_thermohygro(const struct cresta_measurement_record *records, size_t count, const struct cresta_thermohygro_batch *out);
+void cresta_batch_decode_anemometer(const struct cresta_measurement_record *records, size_t count, const struct cresta_anemometer_batch *out);
+void cresta_batch_decode_uv(const struct cresta_measurement_record *records, size_t count, const struct cresta_uv_batch *out);
+void cresta_batch_decode_rain(const struct cresta_measurement_record *records, size_t count, const struct cresta_rain_batch *out);
+
+#endif
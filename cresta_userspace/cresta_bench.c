@@ -0,0 +1,816 @@
+/*
+ * Benchmark of the decoding hot path: manchester decoder,
+ * decrypt_and_check, the field getters of cresta_decoder.c and the
+ * batch decoder of cresta_batch.c in every implementation the CPU
+ * supports. Batch results are checked against the getters.
+ *
+ * The SDR front end of cresta_sdr.c is run over generated samples in
+ * every implementation, together with the manchester decoder and the
+ * decryption as in crestad -s, and its edges are compared between the
+ * implementations.
+ *
+ * Corpora are generated with a fixed seed by cresta_encoder.c at
+ * several noise levels, so results are comparable between runs.
+ * Results are written as one JSON object per line and can be compared
+ * to a saved baseline to catch regressions.
+ *
+ * License: GPLv3. See license.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include "../cresta_common/cresta_protocol.h"
+#include "cresta_decoder.h"
+#include "cresta_encoder.h"
+#include "cresta_batch.h"
+#include "cresta_sdr.h"
+
+#define BENCH_ROUNDS      200	//transmissions per sensor and corpus
+#define BENCH_ITERATIONS  10	//best of
+#define BENCH_MAX_RESULTS 48
+#define BENCH_MIN_PACKETS 200000	//per iteration of the stages after decoding
+
+//SDR samples, about 10 s at the upper end of what rtl_sdr users run
+#define BENCH_SDR_ROUNDS  4
+#define BENCH_SDR_RATE    2048000
+#define BENCH_SDR_SNR_DB  12
+#define BENCH_SDR_READ    65536	//bytes per cresta_sdr_process, as crestad reads them
+
+struct bench_corpus {
+    const char *name;
+    uint32_t jitter_us;
+    double   noise_bursts_per_second;
+    double   collisions;
+    uint32_t *durations;
+    size_t   edge_count;
+    unsigned long datagrams;	//datagrams contained in the corpus
+};
+
+struct bench_result {
+    char   name[64];
+    double edges_per_sec;
+    double packets_per_sec;
+    double yield;
+    double ns_per_packet;
+    double samples_per_sec;	//SDR stages only
+};
+
+/*
+ * Samples of the SDR stages, and what the front end makes of them
+ */
+struct bench_sdr_corpus {
+    uint8_t *samples;
+    size_t   sample_count;
+    unsigned long datagrams;
+    struct cresta_manchester_multi decoder;
+    unsigned long valid;
+    uint64_t *edges;		//timestamp and level of every edge
+    size_t   edge_count;
+    size_t   edge_capacity;
+};
+
+static struct bench_corpus corpora[] = {
+    { "clean", 0,  0,   0    },
+    { "noisy", 40, 0.2, 0.02 },
+    { "busy",  80, 2,   0.1  },
+};
+
+//sensors every corpus consists of
+static const char *corpus_sensors[][2] = {
+    { "thermohygro", "0x21" }, { "thermohygro", "0x45" }, { "thermohygro", "0x61" },
+    { "thermohygro", "0xA3" }, { "thermohygro", "0xC7" }, { "anemometer", "0x81" },
+    { "uv", "0x82" }, { "rain", "0x83" },
+};
+#define BENCH_SENSORS (sizeof(corpus_sensors) / sizeof(corpus_sensors[0]))
+
+static struct bench_result results[BENCH_MAX_RESULTS];
+static int result_count = 0;
+static int batch_mismatches = 0;
+static int sdr_mismatches = 0;
+
+//keeps the compiler from dropping getter calls
+static volatile float sink;
+
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void sensor_values(int sensor, unsigned int round, struct cresta_sensor_values *values) {
+    memset(values, 0, sizeof(*values));
+    values->sensor_address = strtoul(corpus_sensors[sensor][1], NULL, 0);
+    values->temperature = -10.0 + (round % 400) / 10.0;
+    if(0 == strcmp(corpus_sensors[sensor][0], "thermohygro")) {
+	values->sensor_type = CRESTA_SENSOR_TYPE_THERMOHYGRO;
+	values->humidity = 20 + round % 70;
+    } else if(0 == strcmp(corpus_sensors[sensor][0], "anemometer")) {
+	values->sensor_type = CRESTA_SENSOR_TYPE_ANEMOMETER;
+	values->windchill = values->temperature - 3;
+	values->windspeed = (round % 300) / 10.0;
+	values->windgust = values->windspeed + 5;
+	values->wind_direction = 22.5 * (round % 16);
+    } else if(0 == strcmp(corpus_sensors[sensor][0], "uv")) {
+	values->sensor_type = CRESTA_SENSOR_TYPE_UV;
+	values->temperature = 25.3;
+	values->uv_medh = (round % 50) / 10.0;
+	values->uv_index = (round % 110) / 10.0;
+	values->uv_level = round % 5;
+    } else {
+	values->sensor_type = CRESTA_SENSOR_TYPE_RAIN;
+	values->rain_ticks = round * 3;
+    }
+}
+
+/*
+ * Generates the edge durations of a corpus
+ */
+static int build_corpus(struct bench_corpus *corpus) {
+    struct cresta_signal_config config;
+    struct cresta_signal signal;
+    uint64_t previous_start = 0;
+    uint64_t previous_end = 1000000000ULL;
+    uint64_t previous = 0;
+    unsigned int round;
+    size_t i;
+    int sensor;
+
+    cresta_signal_config_defaults(&config);
+    config.jitter_us = corpus->jitter_us;
+    config.noise_bursts_per_second = corpus->noise_bursts_per_second;
+    config.seed = 0xC0FFEE;
+    cresta_signal_init(&signal, &config);
+
+    corpus->datagrams = 0;
+    for(round = 0; round < BENCH_ROUNDS; round++) {
+	for(sensor = 0; sensor < BENCH_SENSORS; sensor++) {
+	    struct cresta_sensor_values values;
+	    uint64_t start = previous_end + 50000000ULL;
+
+	    if(corpus->collisions > 0 && cresta_signal_random(&signal) % 1000 < corpus->collisions * 1000) {
+		start = previous_start + cresta_signal_random(&signal) % (previous_end - previous_start + 1);
+	    }
+	    sensor_values(sensor, round, &values);
+	    previous_start = start;
+	    previous_end = cresta_signal_add_transmission(&signal, start, &values);
+	    corpus->datagrams += config.repeats;
+	}
+    }
+    if(cresta_signal_add_noise(&signal, 1000000000ULL, signal.end_ns) || cresta_signal_render(&signal)) {
+	cresta_signal_free(&signal);
+	return -1;
+    }
+
+    corpus->durations = malloc(signal.edge_count * sizeof(uint32_t));
+    if(NULL == corpus->durations) {
+	cresta_signal_free(&signal);
+	return -1;
+    }
+    for(i = 0; i < signal.edge_count; i++) {
+	uint64_t duration = (signal.edges[i].timestamp_ns - previous) / 1000;
+	corpus->durations[i] = duration > UINT32_MAX ? UINT32_MAX : duration;
+	previous = signal.edges[i].timestamp_ns;
+    }
+    corpus->edge_count = signal.edge_count;
+
+    cresta_signal_free(&signal);
+    return 0;
+}
+
+static void add_result(const char *corpus, const char *stage, double seconds, size_t edges, size_t packets, double yield) {
+    struct bench_result *result;
+
+    if(result_count == BENCH_MAX_RESULTS) {
+	return;
+    }
+    result = &results[result_count++];
+    snprintf(result->name, sizeof(result->name), "%s/%s", corpus, stage);
+    result->edges_per_sec = edges ? edges / seconds : 0;
+    result->packets_per_sec = packets / seconds;
+    result->yield = yield;
+    result->ns_per_packet = packets ? seconds * 1e9 / packets : 0;
+    result->samples_per_sec = 0;
+
+    printf("%-24s %12.0f %12.0f %8.4f %12.1f\n", result->name, result->edges_per_sec,
+	   result->packets_per_sec, result->yield, result->ns_per_packet);
+}
+
+/*
+ * Calls the getters cresta_decoder.c offers for the sensor's type
+ */
+static void decode_fields(struct cresta_measurement_data *data) {
+    uint8_t *d = data->measurement.decrypted_data;
+
+    switch(data->sensor_type) {
+	case CRESTA_SENSOR_TYPE_THERMOHYGRO: {
+	    sink += get_thermohygro_temperature(d);
+	    sink += get_thermohygro_humidity(d);
+	    break;
+	}
+	case CRESTA_SENSOR_TYPE_ANEMOMETER: {
+	    sink += get_anemometer_temperature(d);
+	    sink += get_anemometer_windchill(d);
+	    sink += get_anemometer_windspeed(d);
+	    sink += get_anemometer_windgust(d);
+	    sink += get_anemometer_wind_direction(d);
+	    break;
+	}
+	case CRESTA_SENSOR_TYPE_UV: {
+	    sink += get_uv_absolute_temperature(d);
+	    sink += get_uv_medh(d);
+	    sink += get_uv_uvindex(d);
+	    sink += get_uv_uvlevel(d);
+	    break;
+	}
+	case CRESTA_SENSOR_TYPE_RAIN: {
+	    sink += get_rain_tick_count(d);
+	    break;
+	}
+    }
+    sink += get_battery_status(d);
+}
+
+/*
+ * Records of one sensor type and the fields the batch decoder
+ * produces for them
+ */
+struct bench_batch {
+    uint8_t sensor_type;
+    struct cresta_measurement_record *records;
+    size_t count;
+    float *values[5];
+    int8_t *humidity;
+    uint8_t *small[2];
+    uint16_t *ticks;
+};
+
+static void batch_decode(struct bench_batch *batch) {
+    switch(batch->sensor_type) {
+	case CRESTA_SENSOR_TYPE_THERMOHYGRO: {
+	    struct cresta_thermohygro_batch out = { batch->values[0], batch->humidity, batch->small[0] };
+	    cresta_batch_decode_thermohygro(batch->records, batch->count, &out);
+	    break;
+	}
+	case CRESTA_SENSOR_TYPE_ANEMOMETER: {
+	    struct cresta_anemometer_batch out = { batch->values[0], batch->values[1], batch->values[2],
+						   batch->values[3], batch->values[4], batch->small[0] };
+	    cresta_batch_decode_anemometer(batch->records, batch->count, &out);
+	    break;
+	}
+	case CRESTA_SENSOR_TYPE_UV: {
+	    struct cresta_uv_batch out = { batch->values[0], batch->values[1], batch->values[2], batch->small[1], batch->small[0] };
+	    cresta_batch_decode_uv(batch->records, batch->count, &out);
+	    break;
+	}
+	case CRESTA_SENSOR_TYPE_RAIN: {
+	    struct cresta_rain_batch out = { batch->ticks, batch->small[0] };
+	    cresta_batch_decode_rain(batch->records, batch->count, &out);
+	    break;
+	}
+    }
+}
+
+/*
+ * Compares the batch results to the getters, bit by bit.
+ * Returns the number of differing records
+ */
+static int batch_check(struct bench_batch *batch) {
+    int mismatches = 0;
+    size_t i;
+
+    for(i = 0; i < batch->count; i++) {
+	uint8_t *d = batch->records[i].decrypted_data;
+	float expected[5] = { 0 };
+	int fields = 0;
+	int differs = get_battery_status(d) != batch->small[0][i];
+
+	switch(batch->sensor_type) {
+	    case CRESTA_SENSOR_TYPE_THERMOHYGRO: {
+		expected[fields++] = get_thermohygro_temperature(d);
+		differs |= get_thermohygro_humidity(d) != batch->humidity[i];
+		break;
+	    }
+	    case CRESTA_SENSOR_TYPE_ANEMOMETER: {
+		expected[fields++] = get_anemometer_temperature(d);
+		expected[fields++] = get_anemometer_windchill(d);
+		expected[fields++] = get_anemometer_windspeed(d);
+		expected[fields++] = get_anemometer_windgust(d);
+		expected[fields++] = get_anemometer_wind_direction(d);
+		break;
+	    }
+	    case CRESTA_SENSOR_TYPE_UV: {
+		expected[fields++] = get_uv_absolute_temperature(d);
+		expected[fields++] = get_uv_medh(d);
+		expected[fields++] = get_uv_uvindex(d);
+		differs |= get_uv_uvlevel(d) != batch->small[1][i];
+		break;
+	    }
+	    case CRESTA_SENSOR_TYPE_RAIN: {
+		differs |= get_rain_tick_count(d) != batch->ticks[i];
+		break;
+	    }
+	}
+	while(fields--) {
+	    differs |= 0 != memcmp(&expected[fields], &batch->values[fields][i], sizeof(float));
+	}
+	mismatches += differs;
+    }
+    return mismatches;
+}
+
+/*
+ * Runs the batch decoder over the valid records, grouped by sensor type
+ */
+static int bench_batch(struct bench_corpus *corpus, struct cresta_measurement_data *records, size_t valid) {
+    static const uint8_t types[] = { CRESTA_SENSOR_TYPE_THERMOHYGRO, CRESTA_SENSOR_TYPE_ANEMOMETER,
+				     CRESTA_SENSOR_TYPE_UV, CRESTA_SENSOR_TYPE_RAIN };
+    struct bench_batch batches[sizeof(types)];
+    int repeat = valid ? BENCH_MIN_PACKETS / valid + 1 : 1;
+    int impl;
+    int t;
+    int f;
+    size_t i;
+
+    memset(batches, 0, sizeof(batches));
+    for(t = 0; t < sizeof(types); t++) {
+	batches[t].sensor_type = types[t];
+	batches[t].records = calloc(valid + 1, sizeof(struct cresta_measurement_record));
+	for(f = 0; f < 5; f++) {
+	    batches[t].values[f] = calloc(valid + 1, sizeof(float));
+	}
+	batches[t].humidity = calloc(valid + 1, sizeof(int8_t));
+	batches[t].small[0] = calloc(valid + 1, sizeof(uint8_t));
+	batches[t].small[1] = calloc(valid + 1, sizeof(uint8_t));
+	batches[t].ticks = calloc(valid + 1, sizeof(uint16_t));
+	if(NULL == batches[t].records || NULL == batches[t].values[4] || NULL == batches[t].ticks) {
+	    return -1;
+	}
+	for(i = 0; i < valid; i++) {
+	    if(records[i].sensor_type == types[t]) {
+		batches[t].records[batches[t].count++] = records[i].measurement;
+	    }
+	}
+    }
+
+    for(impl = 0; impl < CRESTA_BATCH_IMPL_COUNT; impl++) {
+	char stage[32];
+	double best = 1e9;
+	int iteration;
+
+	if(cresta_batch_select(impl)) {
+	    continue;
+	}
+	for(iteration = 0; iteration < BENCH_ITERATIONS; iteration++) {
+	    uint64_t start = now_ns();
+	    int r;
+
+	    for(r = 0; r < repeat; r++) {
+		for(t = 0; t < sizeof(types); t++) {
+		    batch_decode(&batches[t]);
+		}
+	    }
+	    if((now_ns() - start) / 1e9 < best) {
+		best = (now_ns() - start) / 1e9;
+	    }
+	}
+	for(t = 0; t < sizeof(types); t++) {
+	    int mismatches = batch_check(&batches[t]);
+	    if(mismatches) {
+		fprintf(stderr, "%s/%s: %d records of type %x differ from the getters\n", corpus->name,
+			cresta_batch_name(impl), mismatches, types[t]);
+		batch_mismatches += mismatches;
+	    }
+	}
+	snprintf(stage, sizeof(stage), "batch_%s", cresta_batch_name(impl));
+	add_result(corpus->name, stage, best, 0, valid * repeat, (double) valid / corpus->datagrams);
+    }
+
+    for(t = 0; t < sizeof(types); t++) {
+	free(batches[t].records);
+	for(f = 0; f < 5; f++) {
+	    free(batches[t].values[f]);
+	}
+	free(batches[t].humidity);
+	free(batches[t].small[0]);
+	free(batches[t].small[1]);
+	free(batches[t].ticks);
+    }
+    return 0;
+}
+
+/*
+ * Runs all stages over a corpus
+ */
+static int bench_corpus(struct bench_corpus *corpus) {
+    static const int hypotheses[] = { 1, 4 };
+    uint8_t (*packets)[CRESTA_MAXDATA_LEN] = malloc(corpus->datagrams * 2 * CRESTA_MAXDATA_LEN);
+    struct cresta_measurement_data *records = calloc(corpus->datagrams * 2, sizeof(struct cresta_measurement_data));
+    size_t packet_count = 0;
+    size_t valid = 0;
+    double best;
+    int repeat;
+    int h;
+    int iteration;
+    size_t i;
+
+    if(NULL == packets || NULL == records) {
+	free(packets);
+	free(records);
+	return -1;
+    }
+
+    //manchester decoder
+    for(h = 0; h < sizeof(hypotheses) / sizeof(hypotheses[0]); h++) {
+	struct cresta_manchester_multi decoder;
+	char stage[32];
+
+	best = 1e9;
+	for(iteration = 0; iteration < BENCH_ITERATIONS; iteration++) {
+	    uint64_t start = now_ns();
+
+	    cresta_manchester_multi_init(&decoder, hypotheses[h]);
+	    packet_count = 0;
+	    for(i = 0; i < corpus->edge_count; i++) {
+		if(cresta_manchester_multi_decode(&decoder, corpus->durations[i]) && packet_count < corpus->datagrams * 2) {
+		    memcpy(packets[packet_count++], decoder.packet, CRESTA_MAXDATA_LEN);
+		}
+	    }
+	    if((now_ns() - start) / 1e9 < best) {
+		best = (now_ns() - start) / 1e9;
+	    }
+	}
+
+	//yield counts datagrams passing the checksum
+	valid = 0;
+	for(i = 0; i < packet_count; i++) {
+	    if(cresta_packet_is_valid(packets[i])) {
+		valid++;
+	    }
+	}
+	snprintf(stage, sizeof(stage), "manchester_h%d", hypotheses[h]);
+	add_result(corpus->name, stage, best, corpus->edge_count, packet_count, (double) valid / corpus->datagrams);
+    }
+
+    //decryption of the packets of the last decoder run, repeated as
+    //the noisy corpora don't yield enough packets for a stable timing
+    repeat = packet_count ? BENCH_MIN_PACKETS / packet_count + 1 : 1;
+    best = 1e9;
+    for(iteration = 0; iteration < BENCH_ITERATIONS; iteration++) {
+	uint64_t start = now_ns();
+	int r;
+
+	for(r = 0; r < repeat; r++) {
+	    valid = 0;
+	    for(i = 0; i < packet_count; i++) {
+		struct cresta_measurement_data *data = &records[valid];
+
+		memcpy(data->measurement.decrypted_data, packets[i], CRESTA_MAXDATA_LEN);
+		if(!decrypt_and_check(data->measurement.decrypted_data)) {
+		    data->sensor_address = get_sensor_address_from_decrypted_data(data->measurement.decrypted_data);
+		    data->len            = get_packet_length_from_decrypted_data(data->measurement.decrypted_data);
+		    data->sensor_type    = get_sensor_type_from_decrypted_data(data->measurement.decrypted_data);
+		    valid++;
+		}
+	    }
+	}
+	if((now_ns() - start) / 1e9 < best) {
+	    best = (now_ns() - start) / 1e9;
+	}
+    }
+    add_result(corpus->name, "decrypt", best, 0, packet_count * repeat, (double) valid / corpus->datagrams);
+
+    //field getters
+    repeat = valid ? BENCH_MIN_PACKETS / valid + 1 : 1;
+    best = 1e9;
+    for(iteration = 0; iteration < BENCH_ITERATIONS; iteration++) {
+	uint64_t start = now_ns();
+	int r;
+
+	for(r = 0; r < repeat; r++) {
+	    for(i = 0; i < valid; i++) {
+		decode_fields(&records[i]);
+	    }
+	}
+	if((now_ns() - start) / 1e9 < best) {
+	    best = (now_ns() - start) / 1e9;
+	}
+    }
+    add_result(corpus->name, "getters", best, 0, valid * repeat, (double) valid / corpus->datagrams);
+
+    //lines of the cresta tool's short output
+    best = 1e9;
+    for(iteration = 0; iteration < BENCH_ITERATIONS; iteration++) {
+	uint64_t start = now_ns();
+	char line[CRESTA_SHORT_LINE_LEN];
+	int r;
+
+	for(r = 0; r < repeat; r++) {
+	    for(i = 0; i < valid; i++) {
+		sink += format_measurement_data_short(&records[i], line);
+	    }
+	}
+	if((now_ns() - start) / 1e9 < best) {
+	    best = (now_ns() - start) / 1e9;
+	}
+    }
+    add_result(corpus->name, "format_short", best, 0, valid * repeat, (double) valid / corpus->datagrams);
+
+    if(bench_batch(corpus, records, valid)) {
+	free(packets);
+	free(records);
+	return -1;
+    }
+
+    free(packets);
+    free(records);
+    return 0;
+}
+
+/*
+ * Generates the samples of the SDR stages, with the noise
+ * of the noisy corpus on top of the sample noise
+ */
+static int build_sdr_corpus(struct bench_sdr_corpus *corpus) {
+    struct cresta_signal_config config;
+    struct cresta_sample_config sample_config;
+    struct cresta_signal signal;
+    uint64_t start = 1000000000ULL;
+    unsigned int round;
+    int sensor;
+
+    memset(corpus, 0, sizeof(*corpus));
+    cresta_signal_config_defaults(&config);
+    config.jitter_us = 40;
+    config.noise_bursts_per_second = 0.2;
+    config.seed = 0xC0FFEE;
+    cresta_signal_init(&signal, &config);
+
+    for(round = 0; round < BENCH_SDR_ROUNDS; round++) {
+	for(sensor = 0; sensor < BENCH_SENSORS; sensor++) {
+	    struct cresta_sensor_values values;
+
+	    sensor_values(sensor, round, &values);
+	    start = cresta_signal_add_transmission(&signal, start, &values) + 50000000ULL;
+	    corpus->datagrams += config.repeats;
+	}
+    }
+    cresta_signal_add_noise(&signal, 1000000000ULL, signal.end_ns);
+
+    cresta_sample_config_defaults(&sample_config);
+    sample_config.rate = BENCH_SDR_RATE;
+    sample_config.snr_db = BENCH_SDR_SNR_DB;
+    corpus->sample_count = (start + 10000000ULL) / 1000 * BENCH_SDR_RATE / 1000000;
+    corpus->samples = malloc(corpus->sample_count * cresta_sdr_sample_size(sample_config.format));
+    if(NULL == corpus->samples || cresta_signal_render(&signal)) {
+	free(corpus->samples);
+	cresta_signal_free(&signal);
+	return -1;
+    }
+    cresta_signal_samples(&signal, &sample_config, 0, corpus->sample_count, corpus->samples);
+    cresta_signal_free(&signal);
+    return 0;
+}
+
+static void sdr_edge(void *arg, uint64_t timestamp_ns, uint32_t level) {
+    static uint64_t last_edge_ns;
+    struct bench_sdr_corpus *corpus = arg;
+    uint64_t delta_us;
+
+    if(0 == corpus->edge_count) {
+	last_edge_ns = 0;
+    }
+    delta_us = (timestamp_ns - last_edge_ns) / 1000;
+    last_edge_ns = timestamp_ns;
+    if(corpus->edge_count < corpus->edge_capacity) {
+	corpus->edges[corpus->edge_count] = timestamp_ns << 1 | level;
+    }
+    corpus->edge_count++;
+
+    if(cresta_manchester_multi_decode(&corpus->decoder, delta_us > UINT32_MAX ? UINT32_MAX : (uint32_t) delta_us)) {
+	uint8_t packet[CRESTA_MAXDATA_LEN];
+
+	memcpy(packet, corpus->decoder.packet, sizeof(packet));
+	if(!decrypt_and_check(packet)) {
+	    corpus->valid++;
+	}
+    }
+}
+
+/*
+ * Runs the SDR front end, manchester decoder and decryption over the
+ * samples in every implementation. Edges have to be the same for all
+ */
+static int bench_sdr(struct bench_sdr_corpus *corpus) {
+    size_t len = corpus->sample_count * cresta_sdr_sample_size(CRESTA_SDR_CU8);
+    uint64_t *reference = NULL;
+    size_t reference_count = 0;
+    struct cresta_sdr *sdr = malloc(sizeof(*sdr));
+    int impl;
+
+    corpus->edge_capacity = corpus->datagrams * CRESTA_MAX_DATAGRAM_EDGES * 2;
+    corpus->edges = malloc(corpus->edge_capacity * sizeof(uint64_t));
+    if(NULL == sdr || NULL == corpus->edges) {
+	free(sdr);
+	free(corpus->edges);
+	return -1;
+    }
+
+    for(impl = 0; impl < CRESTA_SDR_IMPL_COUNT; impl++) {
+	char stage[32];
+	double best = 1e9;
+	int iteration;
+
+	if(cresta_sdr_select(impl)) {
+	    continue;
+	}
+	for(iteration = 0; iteration < BENCH_ITERATIONS; iteration++) {
+	    uint64_t start = now_ns();
+	    size_t offset;
+
+	    corpus->edge_count = 0;
+	    corpus->valid = 0;
+	    cresta_manchester_multi_init(&corpus->decoder, 4);
+	    cresta_sdr_init(sdr, CRESTA_SDR_CU8, BENCH_SDR_RATE, CRESTA_SDR_DEFAULT_LEVEL_DB, sdr_edge, corpus);
+	    for(offset = 0; offset < len; offset += BENCH_SDR_READ) {
+		cresta_sdr_process(sdr, corpus->samples + offset, len - offset < BENCH_SDR_READ ? len - offset : BENCH_SDR_READ);
+	    }
+	    cresta_sdr_flush(sdr);
+	    if((now_ns() - start) / 1e9 < best) {
+		best = (now_ns() - start) / 1e9;
+	    }
+	}
+
+	if(NULL == reference) {
+	    reference_count = corpus->edge_count;
+	    reference = malloc(reference_count * sizeof(uint64_t));
+	    if(NULL == reference || reference_count > corpus->edge_capacity) {
+		free(reference);
+		free(sdr);
+		free(corpus->edges);
+		return -1;
+	    }
+	    memcpy(reference, corpus->edges, reference_count * sizeof(uint64_t));
+	} else if(corpus->edge_count != reference_count ||
+		  memcmp(reference, corpus->edges, reference_count * sizeof(uint64_t))) {
+	    fprintf(stderr, "sdr/%s: edges differ from %s\n", cresta_sdr_name(impl), cresta_sdr_name(0));
+	    sdr_mismatches++;
+	}
+
+	snprintf(stage, sizeof(stage), "sdr_%s", cresta_sdr_name(impl));
+	add_result("sdr", stage, best, corpus->edge_count, corpus->valid, (double) corpus->valid / corpus->datagrams);
+	results[result_count - 1].samples_per_sec = corpus->sample_count / best;
+	printf("%-24s %9.1f MS/s, %.0fx realtime at %.3f MS/s\n", "", corpus->sample_count / best / 1e6,
+	       (double) corpus->sample_count / BENCH_SDR_RATE / best, BENCH_SDR_RATE / 1e6);
+    }
+
+    free(reference);
+    free(sdr);
+    free(corpus->edges);
+    return 0;
+}
+
+static int write_results(const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    int i;
+
+    if(NULL == fp) {
+	perror(filename);
+	return -1;
+    }
+    for(i = 0; i < result_count; i++) {
+	fprintf(fp, "{\"name\": \"%s\", \"edges_per_sec\": %.0f, \"packets_per_sec\": %.0f, \"yield\": %.4f, \"ns_per_packet\": %.1f, \"samples_per_sec\": %.0f}\n",
+		results[i].name, results[i].edges_per_sec, results[i].packets_per_sec, results[i].yield, results[i].ns_per_packet,
+		results[i].samples_per_sec);
+    }
+    fclose(fp);
+    return 0;
+}
+
+/*
+ * Compares the results to a baseline written by write_results.
+ * Returns the number of regressions
+ */
+static int compare_baseline(const char *filename, double threshold) {
+    FILE *fp = fopen(filename, "r");
+    char line[256];
+    int regressions = 0;
+
+    if(NULL == fp) {
+	perror(filename);
+	return -1;
+    }
+
+    printf("\nComparison to %s (threshold %.0f%%):\n", filename, threshold);
+    while(fgets(line, sizeof(line), fp)) {
+	struct bench_result base;
+	int i;
+
+	//baselines from before samples_per_sec end after ns_per_packet
+	if(sscanf(line, "{\"name\": \"%63[^\"]\", \"edges_per_sec\": %lf, \"packets_per_sec\": %lf, \"yield\": %lf, \"ns_per_packet\": %lf",
+		  base.name, &base.edges_per_sec, &base.packets_per_sec, &base.yield, &base.ns_per_packet) != 5) {
+	    continue;
+	}
+	for(i = 0; i < result_count; i++) {
+	    double change;
+	    const char *verdict = "ok";
+
+	    if(strcmp(results[i].name, base.name)) {
+		continue;
+	    }
+	    change = base.ns_per_packet ? (results[i].ns_per_packet / base.ns_per_packet - 1) * 100 : 0;
+	    if(change > threshold) {
+		verdict = "SLOWER";
+		regressions++;
+	    } else if(results[i].yield < base.yield - 0.0001) {
+		verdict = "LOWER YIELD";
+		regressions++;
+	    }
+	    printf("%-24s %10.1f -> %10.1f ns/packet (%+6.1f%%), yield %.4f -> %.4f  %s\n", base.name,
+		   base.ns_per_packet, results[i].ns_per_packet, change, base.yield, results[i].yield, verdict);
+	}
+    }
+    fclose(fp);
+    return regressions;
+}
+
+static void usage(const char *name) {
+    printf("Usage: %s [-o results] [-b baseline] [-t threshold]\n", name);
+    printf("\t-o results\tWrite results as JSON lines to this file\n");
+    printf("\t-b baseline\tCompare to results of an earlier run, exit with 1 on regressions\n");
+    printf("\t-t threshold\tAllowed slowdown in percent (default 15)\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *output = NULL;
+    const char *baseline = NULL;
+    double threshold = 15;
+    struct bench_sdr_corpus sdr_corpus;
+    int regressions = 0;
+    int i;
+    int c;
+
+    opterr = 0;
+
+    while ((c = getopt (argc, argv, "o:b:t:")) != -1) {
+	switch (c) {
+	    case 'o': {
+		output = optarg;
+		break;
+	    }
+	    case 'b': {
+		baseline = optarg;
+		break;
+	    }
+	    case 't': {
+		threshold = atof(optarg);
+		break;
+	    }
+	    case '?': {
+		if (isprint (optopt))
+		    fprintf (stderr, "Unknown option or missing argument `-%c'.\n", optopt);
+		usage(argv[0]);
+		return 1;
+	    }
+	    default: {
+		abort ();
+	    }
+	}
+    }
+
+    printf("%-24s %12s %12s %8s %12s\n", "benchmark", "edges/s", "packets/s", "yield", "ns/packet");
+    for(i = 0; i < sizeof(corpora) / sizeof(corpora[0]); i++) {
+	if(build_corpus(&corpora[i]) || bench_corpus(&corpora[i])) {
+	    fprintf(stderr, "Out of memory\n");
+	    return -1;
+	}
+	free(corpora[i].durations);
+    }
+    if(build_sdr_corpus(&sdr_corpus) || bench_sdr(&sdr_corpus)) {
+	fprintf(stderr, "Out of memory\n");
+	return -1;
+    }
+    free(sdr_corpus.samples);
+
+    if(NULL != output && write_results(output)) {
+	return -1;
+    }
+    if(NULL != baseline) {
+	regressions = compare_baseline(baseline, threshold);
+	if(regressions < 0) {
+	    return -1;
+	}
+	printf("%d regression(s)\n", regressions);
+    }
+
+    if(batch_mismatches) {
+	printf("%d batch decoded record(s) differ from the getters\n", batch_mismatches);
+    }
+    if(sdr_mismatches) {
+	printf("%d SDR implementation(s) differ in their edges\n", sdr_mismatches);
+    }
+    return regressions || batch_mismatches || sdr_mismatches ? 1 : 0;
+}
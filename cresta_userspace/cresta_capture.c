@@ -0,0 +1,268 @@
+/*
+ * Captures the edges received by the kernel module from /dev/cresta_raw
+ * for offline analysis, e.g. with crestad -r.
+ *
+ * By default the edge ring of the kernel module is mapped into our
+ * address space and written to the output file straight from the
+ * mapping, so capturing doesn't involve copying edges through read().
+ * The capture file is a plain sequence of struct cresta_raw_edge.
+ *
+ * License: GPLv3. See license.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "../cresta_common/cresta_common.h"
+
+#define CRESTA_RAW_DEVICE "/dev/cresta_raw"
+
+//time to sleep when there are no new edges in the ring
+#define CAPTURE_POLL_INTERVAL_US 20000
+
+//number of edges per read() without mmap
+#define CAPTURE_READ_BATCH 256
+
+struct capture_stats {
+    unsigned long long edges;
+    unsigned long long dropped;
+    unsigned long long torn;
+};
+
+static struct capture_stats stats;
+static volatile sig_atomic_t running = 1;
+
+
+static void handle_signal(int sig) {
+    running = 0;
+}
+
+/*
+ * Writes edges to the output file. The first edge is written from a
+ * copy if we have to report lost edges, as the mapping is read only
+ */
+static int write_edges(FILE *out, const struct cresta_raw_edge *edges, size_t count, uint32_t dropped) {
+    if(dropped) {
+	struct cresta_raw_edge first = edges[0];
+	first.dropped += dropped;
+	if(fwrite(&first, sizeof(first), 1, out) != 1) {
+	    return -1;
+	}
+	edges++;
+	count--;
+    }
+    if(count && fwrite(edges, sizeof(edges[0]), count, out) != count) {
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * Captures edges from the mapped ring
+ */
+static int capture_mmap(int fd, FILE *out, unsigned long long max_edges) {
+    struct cresta_raw_ring_header *header;
+    struct cresta_raw_edge *edges;
+    size_t size;
+    void *ring;
+    uint64_t position;
+    uint32_t dropped = 0;
+
+    //map the header first to learn the size of the ring
+    header = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+    if(MAP_FAILED == header) {
+	fprintf(stderr, "Couldn't map %s: %s\n", CRESTA_RAW_DEVICE, strerror(errno));
+	return -1;
+    }
+    if(header->magic != CRESTA_RAW_MAGIC || header->version != CRESTA_RAW_VERSION) {
+	fprintf(stderr, "Unsupported edge ring version\n");
+	munmap(header, sysconf(_SC_PAGESIZE));
+	return -1;
+    }
+    size = header->header_size + (size_t) header->edge_count * sizeof(struct cresta_raw_edge);
+    munmap(header, sysconf(_SC_PAGESIZE));
+
+    ring = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if(MAP_FAILED == ring) {
+	fprintf(stderr, "Couldn't map %s: %s\n", CRESTA_RAW_DEVICE, strerror(errno));
+	return -1;
+    }
+    header = ring;
+    edges = (struct cresta_raw_edge*) ((char*) ring + header->header_size);
+
+    position = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+    while(running && (0 == max_edges || stats.edges < max_edges)) {
+	uint64_t head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+	uint64_t start;
+	size_t count;
+
+	if(head == position) {
+	    fflush(out);
+	    usleep(CAPTURE_POLL_INTERVAL_US);
+	    continue;
+	}
+	if(head - position >= header->edge_count) {
+	    dropped += head - position - (header->edge_count - 1);
+	    position = head - (header->edge_count - 1);
+	}
+
+	//write up to the end of the ring, the rest in the next iteration
+	start = position & (header->edge_count - 1);
+	count = head - position;
+	if(start + count > header->edge_count) {
+	    count = header->edge_count - start;
+	}
+	if(max_edges && count > max_edges - stats.edges) {
+	    count = max_edges - stats.edges;
+	}
+
+	if(write_edges(out, &edges[start], count, dropped)) {
+	    fprintf(stderr, "Couldn't write capture: %s\n", strerror(errno));
+	    break;
+	}
+
+	//edges overwritten while we wrote them can't be trusted
+	head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+	if(head - position >= header->edge_count) {
+	    stats.torn += head - position - (header->edge_count - 1);
+	}
+
+	stats.dropped += dropped;
+	dropped = 0;
+	stats.edges += count;
+	position += count;
+    }
+
+    munmap(ring, size);
+    return 0;
+}
+
+/*
+ * Captures edges using read(). The kernel reports lost
+ * edges in the records itself
+ */
+static int capture_read(int fd, FILE *out, unsigned long long max_edges) {
+    struct cresta_raw_edge edges[CAPTURE_READ_BATCH];
+
+    while(running && (0 == max_edges || stats.edges < max_edges)) {
+	ssize_t len = read(fd, edges, sizeof(edges));
+	size_t count;
+	size_t i;
+
+	if(len < 0) {
+	    if(errno == EINTR) {
+		continue;
+	    }
+	    fprintf(stderr, "Couldn't read %s: %s\n", CRESTA_RAW_DEVICE, strerror(errno));
+	    return -1;
+	}
+
+	count = len / sizeof(edges[0]);
+	if(max_edges && count > max_edges - stats.edges) {
+	    count = max_edges - stats.edges;
+	}
+	for(i = 0; i < count; i++) {
+	    stats.dropped += edges[i].dropped;
+	}
+	if(write_edges(out, edges, count, 0)) {
+	    fprintf(stderr, "Couldn't write capture: %s\n", strerror(errno));
+	    return -1;
+	}
+	stats.edges += count;
+    }
+    return 0;
+}
+
+static void usage(const char *name) {
+    printf("Usage: %s [-r] [-n edges] [-d device] [-o capturefile]\n", name);
+    printf("\t-d device\tRaw edge device (default %s)\n", CRESTA_RAW_DEVICE);
+    printf("\t-o capturefile\tFile to write edges to (default stdout)\n");
+    printf("\t-n edges\tStop after this number of edges (default: until interrupted)\n");
+    printf("\t-r\t\tUse read() instead of mapping the edge ring\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *device = CRESTA_RAW_DEVICE;
+    const char *filename = NULL;
+    unsigned long long max_edges = 0;
+    int use_read = 0;
+    struct sigaction sa;
+    FILE *out = stdout;
+    int ret;
+    int fd;
+    int c;
+
+    opterr = 0;
+
+    while ((c = getopt (argc, argv, "rn:d:o:")) != -1) {
+	switch (c) {
+	    case 'r': {
+		use_read = 1;
+		break;
+	    }
+	    case 'n': {
+		max_edges = strtoull(optarg, NULL, 0);
+		break;
+	    }
+	    case 'd': {
+		device = optarg;
+		break;
+	    }
+	    case 'o': {
+		filename = optarg;
+		break;
+	    }
+	    case '?': {
+		if (isprint (optopt))
+		    fprintf (stderr, "Unknown option or missing argument `-%c'.\n", optopt);
+		usage(argv[0]);
+		return 1;
+	    }
+	    default: {
+		abort ();
+	    }
+	}
+    }
+
+    fd = open(device, O_RDONLY);
+    if(fd < 0) {
+	fprintf(stderr, "Couldn't open %s: %s\n", device, strerror(errno));
+	return -1;
+    }
+
+    if(NULL != filename) {
+	out = fopen(filename, "wb");
+	if(NULL == out) {
+	    fprintf(stderr, "Couldn't open %s: %s\n", filename, strerror(errno));
+	    close(fd);
+	    return -1;
+	}
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if(use_read) {
+	ret = capture_read(fd, out, max_edges);
+    } else {
+	ret = capture_mmap(fd, out, max_edges);
+    }
+
+    fclose(out);
+    close(fd);
+
+    fprintf(stderr, "Captured %llu edges, %llu lost", stats.edges, stats.dropped);
+    if(stats.torn) {
+	fprintf(stderr, ", %llu possibly overwritten while writing", stats.torn);
+    }
+    fprintf(stderr, "\n");
+    return ret;
+}
@@ -1,109 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
-#include <unistd.h>
 #include <time.h>
+#include <math.h>
+#include <unistd.h>
 #include "cresta_decoder.h"
-
-
-int main(int argc, char*argv[]) {
-  long filesize = 0;
-  
-  
-  int shortoutput = 0;
-  char *filename = NULL;
-  int c;
-
-  opterr = 0;
-
-  while ((c = getopt (argc, argv, "sc:")) != -1) {
-    switch (c) {
-      case 's': {
-        shortoutput = 1;
-        break;
-      }
-      case 'c': {
-        filename = optarg;
-        break;
-      }
-      case '?': {
-        if (optopt == 'c')
-          fprintf (stderr, "Option -%c requires cresta device file as an argument.\n", optopt);
-        else if (isprint (optopt))
-          fprintf (stderr, "Unknown option `-%c'.\n", optopt);
-        else
-          fprintf (stderr,
-                   "Unknown option character `\\x%x'.\n",
-                   optopt);
-        return 1;
-      }
-      default: {
-        abort ();
-      }
-    }
-  }
-
-
-  if(NULL == filename) {
-    printf("Usage: %s [-s]-c <devicefile>\n", argv[0]);
-    printf("\t-c devicefile\tThe cresta character device to read from\n");
-    printf("\t-s\t\tOnly output raw values. Values are separated\n");
-    printf("\t\t\tby \":\", if multiple values per sensor\n");
-    return -1;
-  }
-  
-   FILE *fp = fopen(filename,"r");
-   
-   
- 
- 
- 
-  if(NULL == fp) {
-    printf("Couldn't open file.\n");
-    return -1;
-  }
-
-  fseek(fp, 0, SEEK_END);
-  filesize = ftell(fp);
-  if(filesize > sizeof(struct measurement)) {
-    printf("Invalid measurement data length: %ld\n", filesize);
-    fclose(fp);
-    return -1;
-  }
-   
-  fseek(fp, 0, SEEK_SET);
-
-  struct cresta_measurement_data *sensor_data = calloc(sizeof(struct cresta_measurement_data), 1);
-
-  //struct measurement *raw_measurement_data = calloc(sizeof(struct measurement), 1);
-  fread(&sensor_data->measurement, filesize, 1, fp);
-
-  fclose(fp);
-   
-  //sensor_data->measurement = raw_measurement_data;
-  sensor_data->sensor_address = get_sensor_address_from_decrypted_data(sensor_data->measurement.decrypted_data);
-  sensor_data->len            = get_packet_length_from_decrypted_data(sensor_data->measurement.decrypted_data);
-  sensor_data->sensor_type    = get_sensor_type_from_decrypted_data(sensor_data->measurement.decrypted_data);
-  
-  if(shortoutput) {
-    print_measurement_data_short(sensor_data);
-  } else {
-    print_measurement_data(sensor_data);
-  }
-  
-  
-  //free(raw_measurement_data);
-  free(sensor_data);
-
- 
- 
- 
- return 0;
- 
- 
-}
-
+#include "../cresta_common/cresta_values.h"
 
 
 uint8_t get_preamble_from_decrypted_data(uint8_t* decrypted_data) {
@@ -133,8 +35,50 @@ uint8_t get_sensor_type_from_decrypted_data(uint8_t* decrypted_data) {
 }
 
 
+/*
+ * Fills data from a record as read from a cresta device or crestad's
+ * files. Records of newer versions are accepted as long as their data
+ * is complete, the unversioned format of older versions is recognized
+ * by its size. Returns -1 for anything else
+ */
+int parse_measurement_record(const void *buf, size_t len, struct cresta_measurement_data *data) {
+    const struct cresta_measurement_record *record = buf;
+
+    memset(data, 0, sizeof(*data));
+    if(len >= offsetof(struct measurement, decrypted_data) + CRESTA_MAXDATA_LEN && len <= sizeof(struct measurement)) {
+	const struct measurement *old = buf;
+
+	data->measurement.timestamp_ns = old->measurement_time_seconds * 1000000000ULL;
+	memcpy(data->measurement.decrypted_data, old->decrypted_data, CRESTA_MAXDATA_LEN);
+    } else if(len >= offsetof(struct cresta_measurement_record, decrypted_data) &&
+	      record->version >= CRESTA_RECORD_VERSION &&
+	      record->header_len >= offsetof(struct cresta_measurement_record, decrypted_data) &&
+	      record->header_len + CRESTA_MAXDATA_LEN <= len) {
+	memcpy(&data->measurement, record, offsetof(struct cresta_measurement_record, decrypted_data));
+	memcpy(data->measurement.decrypted_data, (const uint8_t*) buf + record->header_len, CRESTA_MAXDATA_LEN);
+    } else {
+	return -1;
+    }
+
+    data->sensor_address = get_sensor_address_from_decrypted_data(data->measurement.decrypted_data);
+    data->len            = get_packet_length_from_decrypted_data(data->measurement.decrypted_data);
+    data->sensor_type    = get_sensor_type_from_decrypted_data(data->measurement.decrypted_data);
+    return 0;
+}
+
+int read_measurement_record(int fd, struct cresta_measurement_data *data) {
+    uint8_t record[256];	//leaves room for records of newer versions
+    ssize_t len = pread(fd, record, sizeof(record), 0);
+
+    if(len < 0) {
+	return -1;
+    }
+    return parse_measurement_record(record, len, data);
+}
 
- 
+time_t get_measurement_time_seconds(struct cresta_measurement_data* data) {
+    return data->measurement.timestamp_ns / 1000000000ULL;
+}
 
 /**
  * Several sensors use same encoding, however have a different
@@ -142,97 +86,44 @@ uint8_t get_sensor_type_from_decrypted_data(uint8_t* decrypted_data) {
  * function to avoid code duplication.
  * 
  * Offset is index of lowest byte containing temperature data.
+ * Values are decoded by cresta_values.h, like in the kernel. A
+ * negative sign keeps -0.0, so it is printed as such.
  */
 float get_temperature_from_cresta_encoding(uint8_t* decrypted_data, uint8_t offset) {
-      float temperature = 0.0;
-
-      /**
-       * according to cresta.pdf temperature bcd encoded
-       * 1st digit: byte[n+1], lower nibble
-       * 2nd digit: byte[n],   higher nibble
-       * 3rd digit: byte[n],   lower nibble
-       * 
-       * sign:
-       * byte[n+1], high nibble (maybe + additional mask?)
-       *            = 0x04 -> negastive
-       *            = 0x0C -> positive
-       */ 
-      
-      temperature += (decrypted_data[offset+1] & 0x0F) * 10.0;
-      temperature += (decrypted_data[offset] >> 4);
-      temperature += (decrypted_data[offset] & 0x0F) / 10.0;
+      float temperature = cresta_bcd_tenths(decrypted_data, offset) / 10.0;
 
       //check whether temperature is positive or negative
-      if((decrypted_data[offset+1] >> 4) == 0x04) {
+      if((decrypted_data[offset+1] >> 4) == CRESTA_TEMPERATURE_NEGATIVE) {
 	//temperature is negative
 	temperature *= -1;
-      } else if((decrypted_data[offset+1] >> 4) == 0x0C) {
-	//do nothing
-      } else {
+      } else if(!cresta_temperature_sign_valid(decrypted_data, offset)) {
 	printf("Unexpected value for temperature sign: %x\n", (decrypted_data[offset+1] >> 4));
       }
       return temperature;
 }
 
 
-/**
- * Returns temperature. We avoid floating point, by returning temperature in
- * degree celsius * 10
- */
 float get_thermohygro_temperature(uint8_t* decrypted_data) {
-      /*
-       * Temperature is BCD encoded.
-       * byte[4] holds last two digits of temperature
-       * byte[5] holds sign and first digit of temperature
-       */
     return get_temperature_from_cresta_encoding(decrypted_data, 4);
 }
 
 int8_t get_thermohygro_humidity(uint8_t* decrypted_data) {
-    int8_t humidity = 0;
-      /*
-       * humidity is BCD encoded
-       * byte[6] holds humidity
-       */
-      humidity += ((decrypted_data[6] >> 4) * 10);
-      humidity += (decrypted_data[6] & 0x0F);
-      
-    
-    return humidity;
+    return cresta_thermohygro_humidity(decrypted_data);
 }
 
 
 
 float get_anemometer_temperature(uint8_t* decrypted_data) {
-      /*
-       * Temperature is BCD encoded.
-       * byte[4] holds last two digits of temperature
-       * byte[5] holds sign and first digit of temperature
-       */
       return get_temperature_from_cresta_encoding(decrypted_data, 4);
 }
 
 float get_anemometer_windchill(uint8_t* decrypted_data) {
-    /*
-     * Windchill is BCD encoded in byte[6] and byte[7]
-     */
     return get_temperature_from_cresta_encoding(decrypted_data, 6);
-
 }
 
 float get_anemometer_windspeed(uint8_t* decrypted_data) {
-    float windspeed = 0.0;
-    
-    /*
-     * Windspeed: BCD encoded, miles per hour
-     * 1st digit: byte[9], lower nibble 
-     * 2nd digit: byte[8], upper nibble
-     * 3rd digit: byte[8], lower nibble
-     */
-    
-	windspeed += (decrypted_data[9] & 0x0F) * 10.0;
-	windspeed += (decrypted_data[8] >> 4);
-	windspeed += (decrypted_data[8] & 0x0F) / 10.0;
+    //transmitted in miles per hour
+    float windspeed = cresta_anemometer_windspeed(decrypted_data) / 10.0;
 	
     if(METRIC_UNITS) {
       windspeed *= 1.60934; 
@@ -242,17 +133,7 @@ float get_anemometer_windspeed(uint8_t* decrypted_data) {
 }
 
 float get_anemometer_windgust(uint8_t* decrypted_data) {
-    float windgust = 0.0;
-    
-    /*
-     * Windgust: BCD encoded, mph
-     * 1st digit: byte[10], upper nibble
-     * 2nd digit: byte[10], lower nibble
-     * 3rd digit: byte[9], upper nibble
-     */
-      windgust += (decrypted_data[10] >> 4) * 10.0;
-      windgust += (decrypted_data[10] & 0x0F);
-      windgust += (decrypted_data[9] >> 4) / 10.0;
+    float windgust = cresta_anemometer_windgust(decrypted_data) / 10.0;
       
     if(METRIC_UNITS) {
       windgust *= 1.60934; 
@@ -262,21 +143,7 @@ float get_anemometer_windgust(uint8_t* decrypted_data) {
 }
 
 float get_anemometer_wind_direction(uint8_t* decrypted_data) {
-    /*
-     * direction in byte[11]
-     * decoding code from cresta.pdf
-     */
-    uint8_t count = decrypted_data[11] >> 4;
-    float direction = 22.5;
-    
-    count ^= (count & 8) >> 1;
-    count ^= (count & 4) >> 1;
-    count ^= (count & 2) >> 1;
-    count = -count & 0xF;
-    
-
-    return direction*count;
-
+    return 22.5f * cresta_anemometer_wind_direction_steps(decrypted_data);
 }
 
 float get_uv_absolute_temperature(uint8_t* decrypted_data) {
@@ -284,58 +151,16 @@ float get_uv_absolute_temperature(uint8_t* decrypted_data) {
    * accordig to cresta.pdf, UV sensor uses special temperature
    * format, not having a sign, thus only giving only
    * absolute temperature values
-   *
-   * 1st digit: byte[5], low nibble
-   * 2nd digit: byte[4], high nibble
-   * 3rd digit: byte[4], low nibble
    */
-   
-  float temperature = 0.0;
-  temperature += (decrypted_data[5] & 0x0F) * 10.0;
-  temperature += (decrypted_data[4] >> 4);
-  temperature += (decrypted_data[4] & 0x0F) / 10.0;
-  return temperature;
+  return cresta_uv_absolute_temperature(decrypted_data) / 10.0;
 }
 
-/**
- * Note: to avoid floating point, value is scaled by 10
- */
 float get_uv_medh(uint8_t* decrypted_data) {
-  /*
-   * according to cresta.pdf, medh is BCD coded
-   * 
-   * 1st digit: byte[6], high nibble
-   * 2nd digit: byte[6], low nibble
-   * 3rd digit: byte[5], high nibble
-   */ 
-
-  float medh = 0.0;
-  
-  medh += (decrypted_data[6] >> 4) * 10.0;
-  medh += (decrypted_data[6] & 0x0F);
-  medh += (decrypted_data[5] >> 4) / 10.0;
-
-  return medh;
-  
+  return cresta_uv_medh(decrypted_data) / 10.0;
 }
 
-/**
- * Note: to avoid floating point, value is scaled by 10
- */
 float get_uv_uvindex(uint8_t* decrypted_data) {
-  /**
-   * cresta.pdf: BCD encoded.
-   * 1st digit: byte[8], low nibble
-   * 2nd digit: byte[7], high nibble
-   * 3rd digit: byte[7], low nibble
-   */
-  
-  float uv_index = 0.0;
-  uv_index += (decrypted_data[8] & 0x0F) * 10.0;
-  uv_index += (decrypted_data[7] >> 4);
-  uv_index += (decrypted_data[7] & 0x0F) / 10.0;
-
-  return uv_index;
+  return cresta_uv_index(decrypted_data) / 10.0;
 }
 
 /**
@@ -348,144 +173,288 @@ float get_uv_uvindex(uint8_t* decrypted_data) {
  * 4   above 10.9    EXTREMELY HIGH
  */ 
 uint8_t get_uv_uvlevel(uint8_t* decrypted_data) {
-   /**
-    * according to cresta.pdf UV level encoded in
-    * byte[8], high nibble
-    */
-   
-   uint8_t uv_level = 0;
-      uv_level = decrypted_data[8] >> 4;
-  return uv_level;
+  return cresta_uv_level(decrypted_data);
 }
 
 
 uint16_t get_rain_tick_count(uint8_t* decrypted_data) {
-  /* according to cresta.pdf
-   * rain ticks are encoded BINARY (not BCD)
-   * most significant byte: byte[5];
-   * least significant byte: byte[4];
-   */
-  
-    uint16_t rain_ticks = 0;
-      rain_ticks = (decrypted_data[5] << 8);
-      rain_ticks |= decrypted_data[4];
-    
-    return rain_ticks;
+    return cresta_rain_ticks(decrypted_data);
 }
 
 int get_battery_status(uint8_t* decrypted_data) {
-  //according to cresta PDF:
-  //
-  //bits 7+6 of byte[2] (length) encode battery status
   //Battery OK: both 1
   //Battery < 2.5V: both 0
-  int is_good = 0;
-  
-  uint8_t status = (decrypted_data[2] >> 6) & 0x03;
-  if(status == 0x03) {
-    is_good = 1;
-  } else {
-    is_good = 0;
-  }
-  
-  return is_good;
+  return cresta_battery_ok(decrypted_data);
 }
   
 
 
+/*
+ * Writes value with the given number of decimals, rounded like
+ * printf does (to nearest, ties to even) and returns the end of the
+ * string. Values are scaled exactly in double precision, so the
+ * result is the same as that of printf("%.1f") or printf("%.2f")
+ */
+static char* format_fixed(char *buf, float value, int decimals) {
+    double scaled = value * (decimals == 2 ? 100.0 : 10.0);
+    unsigned long n;
+    double fraction;
+    char digits[24];
+    int count = 0;
+
+    if(signbit(value)) {
+	*buf++ = '-';
+	scaled = -scaled;
+    }
+    n = (unsigned long) scaled;
+    fraction = scaled - n;
+    if(fraction > 0.5 || (fraction == 0.5 && (n & 1))) {
+	n++;
+    }
+
+    do {
+	digits[count++] = '0' + n % 10;
+	n /= 10;
+    } while(n || count <= decimals);
+    while(count > decimals) {
+	*buf++ = digits[--count];
+    }
+    *buf++ = '.';
+    while(count) {
+	*buf++ = digits[--count];
+    }
+    *buf = '\0';
+    return buf;
+}
+
+static char* format_integer(char *buf, long value) {
+    char digits[24];
+    unsigned long n = value < 0 ? -(unsigned long) value : value;
+    int count = 0;
+
+    if(value < 0) {
+	*buf++ = '-';
+    }
+    do {
+	digits[count++] = '0' + n % 10;
+	n /= 10;
+    } while(n);
+    while(count) {
+	*buf++ = digits[--count];
+    }
+    *buf = '\0';
+    return buf;
+}
+
+char* get_temperature_string(uint8_t* decrypted_data, uint8_t offset, char *buf) {
+    format_fixed(buf, get_temperature_from_cresta_encoding(decrypted_data, offset), 1);
+    return buf;
+}
+
+char* get_thermohygro_temperature_string(uint8_t* decrypted_data, char *buf) {
+    format_fixed(buf, get_thermohygro_temperature(decrypted_data), 1);
+    return buf;
+}
+
+char* get_thermohygro_humidity_string(uint8_t* decrypted_data, char *buf) {
+    format_integer(buf, get_thermohygro_humidity(decrypted_data));
+    return buf;
+}
+
+char* get_anemometer_temperature_string(uint8_t* decrypted_data, char *buf) {
+    format_fixed(buf, get_anemometer_temperature(decrypted_data), 1);
+    return buf;
+}
+
+char* get_anemometer_windchill_string(uint8_t* decrypted_data, char *buf) {
+    format_fixed(buf, get_anemometer_windchill(decrypted_data), 1);
+    return buf;
+}
+
+char* get_anemometer_windspeed_string(uint8_t* decrypted_data, char *buf) {
+    format_fixed(buf, get_anemometer_windspeed(decrypted_data), 2);
+    return buf;
+}
+
+char* get_anemometer_windgust_string(uint8_t* decrypted_data, char *buf) {
+    format_fixed(buf, get_anemometer_windgust(decrypted_data), 2);
+    return buf;
+}
+
+char* get_anemometer_wind_direction_string(uint8_t *decrypted_data, char *buf) {
+    format_fixed(buf, get_anemometer_wind_direction(decrypted_data), 1);
+    return buf;
+}
+
+char* get_uv_absolute_temperature_string(uint8_t* decrypted_data, char *buf) {
+    format_fixed(buf, get_uv_absolute_temperature(decrypted_data), 1);
+    return buf;
+}
+
+char* get_uv_medh_string(uint8_t* decrypted_data, char *buf) {
+    format_fixed(buf, get_uv_medh(decrypted_data), 1);
+    return buf;
+}
+
+char* get_uv_uvindex_string(uint8_t* decrypted_data, char *buf) {
+    format_fixed(buf, get_uv_uvindex(decrypted_data), 1);
+    return buf;
+}
+
+char* get_uv_uvlevel_string(uint8_t* decrypted_data, char *buf) {
+    format_integer(buf, get_uv_uvlevel(decrypted_data));
+    return buf;
+}
+
+char* get_rain_tick_count_string(uint8_t* decrypted_data, char *buf) {
+    format_integer(buf, get_rain_tick_count(decrypted_data));
+    return buf;
+}
+
+char* get_battery_status_string(uint8_t* decrypted_data, char *buf) {
+    format_integer(buf, get_battery_status(decrypted_data));
+    return buf;
+}
+
+
+/*
+ * Appends str and returns the new end
+ */
+static char* append(char *end, const char *str) {
+    while(*str) {
+	*end++ = *str++;
+    }
+    *end = '\0';
+    return end;
+}
+
+//appends a value written by one of the string getters in place
+#define APPEND_VALUE(end, getter) ((end) + strlen(getter(data->measurement.decrypted_data, (end))))
+
+
 void print_measurement_data(struct cresta_measurement_data* data) {
+    time_t seconds = get_measurement_time_seconds(data);
+    char buf[512];
+    char *end = buf;
+
     switch(data->sensor_type) {
       case(CRESTA_SENSOR_TYPE_ANEMOMETER): {
-	printf("Anenometer sensor data:\n");
-	printf("\tTime = %s",  ctime((time_t*)&data->measurement.measurement_time_seconds));
-	printf("\tTemperature = %.1f °C\n", get_anemometer_temperature(data->measurement.decrypted_data));
-	printf("\tWind chill = %.1f °C\n", get_anemometer_windchill(data->measurement.decrypted_data));
-	printf("\tWind speed = %.2f km/h\n", get_anemometer_windspeed(data->measurement.decrypted_data));
-	printf("\tWind gust = %.2f km/h\n", get_anemometer_windgust(data->measurement.decrypted_data));
-	printf("\tWind direction = %.1f °\n", get_anemometer_wind_direction(data->measurement.decrypted_data));
-	if(get_battery_status(data->measurement.decrypted_data)) {
-	  printf("\tBattery = OK\n");
-	} else {
-	  printf("\tBattery = LOW\n");
-	}
+	end = append(end, "Anenometer sensor data:\n\tTime = ");
+	end = append(end, ctime(&seconds));
+	end = append(end, "\tTemperature = ");
+	end = APPEND_VALUE(end, get_anemometer_temperature_string);
+	end = append(end, " °C\n\tWind chill = ");
+	end = APPEND_VALUE(end, get_anemometer_windchill_string);
+	end = append(end, " °C\n\tWind speed = ");
+	end = APPEND_VALUE(end, get_anemometer_windspeed_string);
+	end = append(end, " km/h\n\tWind gust = ");
+	end = APPEND_VALUE(end, get_anemometer_windgust_string);
+	end = append(end, " km/h\n\tWind direction = ");
+	end = APPEND_VALUE(end, get_anemometer_wind_direction_string);
+	end = append(end, " °\n");
 	break;
       }
       case(CRESTA_SENSOR_TYPE_UV): {
-	printf("UV sensor data:\n");
-	printf("\tTime = %s",  ctime((time_t*)&data->measurement.measurement_time_seconds));
-	printf("\tAbsolute temperature = %.1f °C\n", get_uv_absolute_temperature(data->measurement.decrypted_data));
-	printf("\tUV med/h = %.1f\n", get_uv_medh(data->measurement.decrypted_data));
-	printf("\tUV index = %.1f\n", get_uv_uvindex(data->measurement.decrypted_data));
-	printf("\tUV level = %d\n", get_uv_uvlevel(data->measurement.decrypted_data));
-	if(get_battery_status(data->measurement.decrypted_data)) {
-	  printf("\tBattery = OK\n");
-	} else {
-	  printf("\tBattery = LOW\n");
-	}
+	end = append(end, "UV sensor data:\n\tTime = ");
+	end = append(end, ctime(&seconds));
+	end = append(end, "\tAbsolute temperature = ");
+	end = APPEND_VALUE(end, get_uv_absolute_temperature_string);
+	end = append(end, " °C\n\tUV med/h = ");
+	end = APPEND_VALUE(end, get_uv_medh_string);
+	end = append(end, "\n\tUV index = ");
+	end = APPEND_VALUE(end, get_uv_uvindex_string);
+	end = append(end, "\n\tUV level = ");
+	end = APPEND_VALUE(end, get_uv_uvlevel_string);
+	end = append(end, "\n");
 	break;
       }
       case(CRESTA_SENSOR_TYPE_RAIN): {
-	printf("Rain sensor data:\n");
-	printf("\tTime = %s",  ctime((time_t*)&data->measurement.measurement_time_seconds));
-	printf("\train ticks = %d\n", get_rain_tick_count(data->measurement.decrypted_data));
-	if(get_battery_status(data->measurement.decrypted_data)) {
-	  printf("\tBattery = OK\n");
-	} else {
-	  printf("\tBattery = LOW\n");
-	}
+	end = append(end, "Rain sensor data:\n\tTime = ");
+	end = append(end, ctime(&seconds));
+	end = append(end, "\train ticks = ");
+	end = APPEND_VALUE(end, get_rain_tick_count_string);
+	end = append(end, "\n");
 	break;
       }
       case(CRESTA_SENSOR_TYPE_THERMOHYGRO): {
-	printf("ThermoHygro sensor data:\n");
-	printf("\tTime = %s",  ctime((time_t*)&data->measurement.measurement_time_seconds));
-	printf("\tTemperature = %.1f °C\n", get_thermohygro_temperature(data->measurement.decrypted_data));
-	printf("\tHumidity = %d %%\n", get_thermohygro_humidity(data->measurement.decrypted_data));
-	if(get_battery_status(data->measurement.decrypted_data)) {
-	  printf("\tBattery = OK\n");
-	} else {
-	  printf("\tBattery = LOW\n");
-	}
+	end = append(end, "ThermoHygro sensor data:\n\tTime = ");
+	end = append(end, ctime(&seconds));
+	end = append(end, "\tTemperature = ");
+	end = APPEND_VALUE(end, get_thermohygro_temperature_string);
+	end = append(end, " °C\n\tHumidity = ");
+	end = APPEND_VALUE(end, get_thermohygro_humidity_string);
+	end = append(end, " %\n");
 	break;
       }
       default: {
 	printf("Unknown sensor type: %x\n", data->sensor_type);
+	return;
       }
     }
+
+    if(get_battery_status(data->measurement.decrypted_data)) {
+      end = append(end, "\tBattery = OK\n");
+    } else {
+      end = append(end, "\tBattery = LOW\n");
+    }
+    fwrite(buf, 1, end - buf, stdout);
 }
 
-void print_measurement_data_short(struct cresta_measurement_data* data) {
+int format_measurement_data_short(struct cresta_measurement_data* data, char *buf) {
+    char *end = format_integer(buf, (unsigned long) get_measurement_time_seconds(data));
+
     switch(data->sensor_type) {
       case(CRESTA_SENSOR_TYPE_ANEMOMETER): {
-	printf("%lu:%.1f:%.1f:%.2f:%.2f:%.1f:%d\n",(unsigned long) data->measurement.measurement_time_seconds
-	                                        , get_anemometer_temperature(data->measurement.decrypted_data)
-	                                        , get_anemometer_windchill(data->measurement.decrypted_data)
-						, get_anemometer_windspeed(data->measurement.decrypted_data)
-						, get_anemometer_windgust(data->measurement.decrypted_data)
-						, get_anemometer_wind_direction(data->measurement.decrypted_data)
-						, get_battery_status(data->measurement.decrypted_data));
+	*end++ = ':';
+	end = APPEND_VALUE(end, get_anemometer_temperature_string);
+	*end++ = ':';
+	end = APPEND_VALUE(end, get_anemometer_windchill_string);
+	*end++ = ':';
+	end = APPEND_VALUE(end, get_anemometer_windspeed_string);
+	*end++ = ':';
+	end = APPEND_VALUE(end, get_anemometer_windgust_string);
+	*end++ = ':';
+	end = APPEND_VALUE(end, get_anemometer_wind_direction_string);
 	break;
       }
       case(CRESTA_SENSOR_TYPE_UV): {
-	printf("%lu:%.1f:%.1f:%.1f:%d:%d\n",(unsigned long) data->measurement.measurement_time_seconds
-	                               , get_uv_absolute_temperature(data->measurement.decrypted_data)
-				       , get_uv_medh(data->measurement.decrypted_data)
-				       , get_uv_uvindex(data->measurement.decrypted_data)
-				       , get_uv_uvlevel(data->measurement.decrypted_data)
-				       , get_battery_status(data->measurement.decrypted_data));
+	*end++ = ':';
+	end = APPEND_VALUE(end, get_uv_absolute_temperature_string);
+	*end++ = ':';
+	end = APPEND_VALUE(end, get_uv_medh_string);
+	*end++ = ':';
+	end = APPEND_VALUE(end, get_uv_uvindex_string);
+	*end++ = ':';
+	end = APPEND_VALUE(end, get_uv_uvlevel_string);
 	break;
       }
       case(CRESTA_SENSOR_TYPE_RAIN): {
-	printf("%lu:%d:%d\n", (unsigned long) data->measurement.measurement_time_seconds
-	                 , get_rain_tick_count(data->measurement.decrypted_data)
-			 , get_battery_status(data->measurement.decrypted_data));
+	*end++ = ':';
+	end = APPEND_VALUE(end, get_rain_tick_count_string);
 	break;
       }
       case(CRESTA_SENSOR_TYPE_THERMOHYGRO): {
-	printf("%lu:%.1f:%d:%d\n",(unsigned long) data->measurement.measurement_time_seconds
-	                      , get_thermohygro_temperature(data->measurement.decrypted_data)
-			      , get_thermohygro_humidity(data->measurement.decrypted_data)
-			      , get_battery_status(data->measurement.decrypted_data));
+	*end++ = ':';
+	end = APPEND_VALUE(end, get_thermohygro_temperature_string);
+	*end++ = ':';
+	end = APPEND_VALUE(end, get_thermohygro_humidity_string);
 	break;
       }
+      default: {
+	buf[0] = '\0';
+	return 0;
+      }
     }
+    *end++ = ':';
+    end = APPEND_VALUE(end, get_battery_status_string);
+    *end++ = '\n';
+    *end = '\0';
+    return end - buf;
+}
+
+void print_measurement_data_short(struct cresta_measurement_data* data) {
+    char buf[CRESTA_SHORT_LINE_LEN];
+    int len = format_measurement_data_short(data, buf);
+
+    fwrite(buf, 1, len, stdout);
 }
@@ -5,6 +5,7 @@
 #define _CRESTA_DECODER_H_
 
 #include <stdint.h>
+#include <time.h>
 #include "../cresta_common/cresta_common.h"
 
 #define METRIC_UNITS 1
@@ -12,6 +13,27 @@
 void print_measurement_data(struct cresta_measurement_data* data);
 void print_measurement_data_short(struct cresta_measurement_data* data);
 
+/*
+ * The line print_measurement_data_short prints, written to buf, which
+ * has to hold CRESTA_SHORT_LINE_LEN bytes. Returns its length, 0 for
+ * unknown sensor types
+ */
+#define CRESTA_SHORT_LINE_LEN 128
+int    format_measurement_data_short(struct cresta_measurement_data* data, char *buf);
+
+int    parse_measurement_record(const void *buf, size_t len, struct cresta_measurement_data *data);
+/*
+ * Reads and parses the record from the start of a device or file. For
+ * devices of the module, this refreshes the measurement the open file
+ * holds
+ */
+int    read_measurement_record(int fd, struct cresta_measurement_data *data);
+
+//the module's sensor devices, see cresta_sensor_base_name
+#define CRESTA_DEVICE_PATTERNS { "/dev/cresta_thermohygro_ch*", "/dev/cresta_anemometer*", \
+				 "/dev/cresta_uv*", "/dev/cresta_rain*" }
+time_t get_measurement_time_seconds(struct cresta_measurement_data* data);
+
 uint8_t get_preamble_from_decrypted_data(uint8_t* decrypted_data);
 uint8_t get_sensor_address_from_decrypted_data(uint8_t* decrypted_data);
 uint8_t get_packet_length_from_decrypted_data(uint8_t* decrypted_data);
@@ -19,6 +41,7 @@ uint8_t get_sensor_type_from_decrypted_data(uint8_t* decrypted_data);
 
 
 int get_battery_low_status(uint8_t* decrypted_data);
+int get_battery_status(uint8_t* decrypted_data);
 
 float get_temperature_from_cresta_encoding(uint8_t* decrypted_data, uint8_t offset);
 float get_thermohygro_temperature(uint8_t* decrypted_data);
@@ -38,22 +61,30 @@ uint8_t get_uv_uvlevel(uint8_t* decrypted_data);
 uint16_t get_rain_tick_count(uint8_t* decrypted_data);
 
 
-char* get_temperature_string(uint8_t* decrypted_data, uint8_t offset);
+/*
+ * Values as printed by the cresta tool, e.g. "21.5", written to buf,
+ * which has to hold CRESTA_VALUE_STRING_LEN bytes. Return buf
+ */
+#define CRESTA_VALUE_STRING_LEN 16
+
+char* get_temperature_string(uint8_t* decrypted_data, uint8_t offset, char *buf);
+
+char* get_thermohygro_temperature_string(uint8_t* decrypted_data, char *buf);
+char* get_thermohygro_humidity_string(uint8_t* decrypted_data, char *buf);
 
-char* get_thermohygro_temperature_string(uint8_t* decrypted_data);
-char* get_thermohygro_humidity_string(uint8_t* decrypted_data);
+char* get_anemometer_temperature_string(uint8_t* decrypted_data, char *buf);
+char* get_anemometer_windchill_string(uint8_t* decrypted_data, char *buf);
+char* get_anemometer_windspeed_string(uint8_t* decrypted_data, char *buf);
+char* get_anemometer_windgust_string(uint8_t* decrypted_data, char *buf);
+char* get_anemometer_wind_direction_string(uint8_t *decrypted_data, char *buf);
 
-char* get_anemometer_temperature_string(uint8_t* decrypted_data);
-char* get_anemometer_windchill_string(uint8_t* decrypted_data);
-char* get_anemometer_windspeed_string(uint8_t* decrypted_data);
-char* get_anemometer_windgust_string(uint8_t* decrypted_data);
-char* get_anemometer_wind_direction_string(uint8_t *decrypted_data);
+char* get_uv_absolute_temperature_string(uint8_t* decrypted_data, char *buf);
+char* get_uv_medh_string(uint8_t* decrypted_data, char *buf);
+char* get_uv_uvindex_string(uint8_t* decrypted_data, char *buf);
+char* get_uv_uvlevel_string(uint8_t* decrypted_data, char *buf);
 
-char* get_uv_absolute_temperature_string(uint8_t* decrypted_data);
-char* get_uv_medh_string(uint8_t* decrypted_data);
-char* get_uv_uvindex_string(uint8_t* decrypted_data);
-char* get_uv_uvlevel_string(uint8_t* decrypted_data);
+char* get_rain_tick_count_string(uint8_t* decrypted_data, char *buf);
 
-char* get_rain_tick_count_string(uint8_t* decrypted_data);
+char* get_battery_status_string(uint8_t* decrypted_data, char *buf);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,180 @@
+/*
+ * Values derived from the measurements of a sensor.
+ *
+ * The rain gauge transmits a 16 bit tick counter. Its steps are taken
+ * modulo 2^16, so wraparounds don't matter; steps larger than
+ * CRESTA_RAIN_MAX_TICKS mean the sensor was reset and are dropped.
+ * Wind is averaged as vectors, otherwise north winds between 350° and
+ * 10° would average to south.
+ *
+ * License: GPLv3. See license.txt
+ */
+#include <string.h>
+#include <math.h>
+#include "cresta_decoder.h"
+#include "cresta_derived.h"
+
+#define NS_PER_MINUTE (60 * 1000000000ULL)
+#define DEG_TO_RAD    (M_PI / 180.0)
+
+//Magnus coefficients over water, -45°C to 60°C
+#define MAGNUS_A 17.62
+#define MAGNUS_B 243.12
+
+
+void cresta_derived_init(struct cresta_derived *derived) {
+    memset(derived, 0, sizeof(*derived));
+    derived->dew_point = NAN;
+}
+
+double cresta_dew_point(double temperature, double humidity) {
+    double gamma;
+
+    if(humidity <= 0 || humidity > 100) {
+	return NAN;
+    }
+    gamma = log(humidity / 100.0) + MAGNUS_A * temperature / (MAGNUS_B + temperature);
+    return MAGNUS_B * gamma / (MAGNUS_A - gamma);
+}
+
+/*
+ * Moves the buckets on to the given minute, clearing those
+ * that fall out of the windows
+ */
+static void rain_advance(struct cresta_rain_state *rain, uint64_t minute) {
+    uint64_t m;
+    uint64_t h;
+
+    //everything older than the window is cleared after as many steps
+    for(m = rain->minute + 1; m <= minute && m <= rain->minute + 60; m++) {
+	rain->last_hour -= rain->minute_ticks[m % 60];
+	rain->minute_ticks[m % 60] = 0;
+    }
+    for(h = rain->minute / 60 + 1; h <= minute / 60 && h <= rain->minute / 60 + 24; h++) {
+	rain->last_day -= rain->hour_ticks[h % 24];
+	rain->hour_ticks[h % 24] = 0;
+    }
+    rain->minute = minute;
+}
+
+static void rain_update(struct cresta_derived *derived, uint8_t *decrypted_data, uint64_t timestamp_ns) {
+    struct cresta_rain_state *rain = &derived->rain;
+    uint16_t ticks = get_rain_tick_count(decrypted_data);
+    uint16_t step = ticks - rain->last_ticks;
+    uint64_t minute = timestamp_ns / NS_PER_MINUTE;
+
+    rain->last_ticks = ticks;
+    if(0 == derived->sensor_type) {
+	//the first measurement is the baseline
+	rain->minute = minute;
+	return;
+    }
+    rain_advance(rain, minute);
+    if(step > CRESTA_RAIN_MAX_TICKS) {
+	return;
+    }
+    rain->total_ticks += step;
+    rain->minute_ticks[minute % 60] += step;
+    rain->hour_ticks[(minute / 60) % 24] += step;
+    rain->last_hour += step;
+    rain->last_day += step;
+}
+
+static void wind_update(struct cresta_wind_state *wind, uint8_t *decrypted_data, uint64_t timestamp_ns) {
+    uint64_t window_ns = CRESTA_WIND_WINDOW_S * 1000000000ULL;
+    struct cresta_wind_sample *sample;
+    double speed = get_anemometer_windspeed(decrypted_data);
+    double direction = get_anemometer_wind_direction(decrypted_data) * DEG_TO_RAD;
+
+    //drop samples that left the window, or the oldest one to make room
+    while(wind->count && (wind->count == CRESTA_WIND_SAMPLES ||
+			  wind->samples[wind->first].timestamp_ns + window_ns <= timestamp_ns)) {
+	sample = &wind->samples[wind->first];
+	wind->sum_u -= sample->u;
+	wind->sum_v -= sample->v;
+	wind->sum_speed -= sample->speed;
+	wind->first = (wind->first + 1) % CRESTA_WIND_SAMPLES;
+	wind->count--;
+    }
+    if(0 == wind->count) {
+	//no rounding errors of removed samples are carried on
+	wind->sum_u = wind->sum_v = wind->sum_speed = 0;
+    }
+
+    //direction is where the wind comes from, clockwise from north
+    sample = &wind->samples[(wind->first + wind->count) % CRESTA_WIND_SAMPLES];
+    sample->timestamp_ns = timestamp_ns;
+    sample->u = speed * sin(direction);
+    sample->v = speed * cos(direction);
+    sample->speed = speed;
+    wind->sum_u += sample->u;
+    wind->sum_v += sample->v;
+    wind->sum_speed += speed;
+    wind->count++;
+}
+
+int cresta_derived_update(struct cresta_derived *derived, struct cresta_measurement_data *data) {
+    uint8_t *d = data->measurement.decrypted_data;
+    uint64_t timestamp_ns = data->measurement.timestamp_ns;
+
+    if((0 != derived->sensor_type && derived->sensor_type != data->sensor_type) ||
+       (0 != derived->sensor_type && timestamp_ns <= derived->timestamp_ns)) {
+	return -1;
+    }
+
+    switch(data->sensor_type) {
+	case CRESTA_SENSOR_TYPE_THERMOHYGRO: {
+	    derived->dew_point = cresta_dew_point(get_thermohygro_temperature(d), get_thermohygro_humidity(d));
+	    break;
+	}
+	case CRESTA_SENSOR_TYPE_RAIN: {
+	    rain_update(derived, d, timestamp_ns);
+	    break;
+	}
+	case CRESTA_SENSOR_TYPE_ANEMOMETER: {
+	    wind_update(&derived->wind, d, timestamp_ns);
+	    break;
+	}
+    }
+    derived->sensor_type = data->sensor_type;
+    derived->timestamp_ns = timestamp_ns;
+    return 0;
+}
+
+double cresta_derived_rain_last_hour(const struct cresta_derived *derived) {
+    return derived->rain.last_hour * CRESTA_RAIN_MM_PER_TICK;
+}
+
+double cresta_derived_rain_last_day(const struct cresta_derived *derived) {
+    return derived->rain.last_day * CRESTA_RAIN_MM_PER_TICK;
+}
+
+double cresta_derived_wind_average_speed(const struct cresta_derived *derived) {
+    return derived->wind.count ? derived->wind.sum_speed / derived->wind.count : 0;
+}
+
+double cresta_derived_wind_vector_speed(const struct cresta_derived *derived) {
+    const struct cresta_wind_state *wind = &derived->wind;
+
+    return wind->count ? hypot(wind->sum_u, wind->sum_v) / wind->count : 0;
+}
+
+double cresta_derived_wind_vector_direction(const struct cresta_derived *derived) {
+    const struct cresta_wind_state *wind = &derived->wind;
+    double direction;
+
+    //components cancelling out leave rounding noise
+    if(0 == wind->count || hypot(wind->sum_u, wind->sum_v) < 1e-9 * (wind->sum_speed + 1)) {
+	return NAN;
+    }
+    direction = atan2(wind->sum_u, wind->sum_v) / DEG_TO_RAD;
+    if(direction < 0) {
+	direction += 360.0;
+    }
+    //-0 and what rounds up to 360 are north as well
+    return direction >= 360.0 || 0 == direction ? 0.0 : direction;
+}
+
+unsigned int cresta_derived_wind_samples(const struct cresta_derived *derived) {
+    return derived->wind.count;
+}
@@ -0,0 +1,100 @@
+/*
+ * Values derived from the measurements of a sensor: rain over the
+ * last hour and day, wind averaged over the last minutes and the dew
+ * point. The state is kept per sensor and updated with every new
+ * measurement in constant time, so consumers neither keep the history
+ * nor scan it.
+ *
+ * License: GPLv3. See license.txt
+ */
+#ifndef _CRESTA_DERIVED_H_
+#define _CRESTA_DERIVED_H_
+
+#include <stdint.h>
+#include "../cresta_common/cresta_common.h"
+
+//rain per tick of the rain gauge
+#define CRESTA_RAIN_MM_PER_TICK 0.7
+//larger steps of the tick counter are taken as a reset of the sensor
+#define CRESTA_RAIN_MAX_TICKS   1000
+
+//wind is averaged over this time, as in weather reports
+#define CRESTA_WIND_WINDOW_S    600
+//anemometers transmit every 12 seconds or more, 50 per window
+#define CRESTA_WIND_SAMPLES     64
+
+struct cresta_wind_sample {
+    uint64_t timestamp_ns;
+    double u;			//east component
+    double v;			//north component
+    double speed;
+};
+
+/*
+ * Rain gauge. Ticks are counted in buckets of a minute for the last
+ * hour and of an hour for the last day
+ */
+struct cresta_rain_state {
+    uint16_t last_ticks;
+    uint64_t total_ticks;	//since the first measurement, without wraparounds
+    uint64_t minute;		//of the newest measurement, since the epoch
+    uint32_t minute_ticks[60];
+    uint32_t hour_ticks[24];
+    uint32_t last_hour;		//sums of the buckets
+    uint32_t last_day;
+};
+
+/*
+ * Anemometer. The samples of the window are kept with running sums
+ * of their components
+ */
+struct cresta_wind_state {
+    struct cresta_wind_sample samples[CRESTA_WIND_SAMPLES];
+    unsigned int first;
+    unsigned int count;
+    double sum_u;
+    double sum_v;
+    double sum_speed;
+};
+
+struct cresta_derived {
+    uint8_t  sensor_type;	//0 until the first measurement
+    uint64_t timestamp_ns;	//of the newest measurement
+    double   dew_point;		//NAN unless thermohygro
+    union {
+	struct cresta_rain_state rain;
+	struct cresta_wind_state wind;
+    };
+};
+
+void cresta_derived_init(struct cresta_derived *derived);
+
+/*
+ * Takes a new measurement into account. Returns -1 for measurements
+ * not newer than the last one and those of another sensor type, the
+ * state is left alone then. Repeated transmissions have to be filtered
+ * out before, see cresta_is_repeated_transmission
+ */
+int cresta_derived_update(struct cresta_derived *derived, struct cresta_measurement_data *data);
+
+/*
+ * Rain in mm during the last hour and the last 24 hours, in whole
+ * minutes and whole hours respectively, counting the current ones
+ */
+double cresta_derived_rain_last_hour(const struct cresta_derived *derived);
+double cresta_derived_rain_last_day(const struct cresta_derived *derived);
+
+/*
+ * Wind over the last CRESTA_WIND_WINDOW_S seconds: the mean speed, the
+ * speed and direction of the mean wind vector (direction NAN if that
+ * is zero, e.g. when calm) and the number of samples
+ */
+double       cresta_derived_wind_average_speed(const struct cresta_derived *derived);
+double       cresta_derived_wind_vector_speed(const struct cresta_derived *derived);
+double       cresta_derived_wind_vector_direction(const struct cresta_derived *derived);
+unsigned int cresta_derived_wind_samples(const struct cresta_derived *derived);
+
+//Magnus formula, from temperature in °C and relative humidity in %
+double cresta_dew_point(double temperature, double humidity);
+
+#endif
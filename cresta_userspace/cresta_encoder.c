@@ -0,0 +1,530 @@
+/*
+ * Synthetic Cresta sensor signals for load and accuracy testing.
+ *
+ * Sensor values are encoded the way cresta_decoder.c decodes them,
+ * encrypted the reverse way of decrypt_and_check and turned into
+ * manchester coded edges the way the manchester decoder expects them.
+ * Jitter, noise bursts, repeated and overlapping transmissions make the
+ * signal look like the output of a real 433MHz receiver.
+ *
+ * License: GPLv3. See license.txt
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../cresta_common/cresta_protocol.h"
+#include "cresta_decoder.h"
+#include "cresta_encoder.h"
+
+//announced length of the datagrams of each sensor type
+#define CRESTA_LEN_THERMOHYGRO 6
+#define CRESTA_LEN_ANEMOMETER  11
+#define CRESTA_LEN_UV          8
+#define CRESTA_LEN_RAIN        6
+
+//noise pulses are between these durations
+#define CRESTA_NOISE_MIN_US 60
+#define CRESTA_NOISE_MAX_US 1200
+
+
+void cresta_signal_config_defaults(struct cresta_signal_config *config) {
+    memset(config, 0, sizeof(*config));
+    config->clock_us = CRESTA_DEFAULT_CLOCK_US;
+    config->repeats = CRESTA_DEFAULT_REPEATS;
+    config->repeat_gap_us = CRESTA_DEFAULT_REPEAT_GAP_US;
+    config->noise_edges_per_burst = 16;
+    config->seed = 1;
+}
+
+/*
+ * Returns the absolute value in tenths, limited to three BCD digits
+ */
+static unsigned int to_tenths(float value) {
+    long tenths = lroundf(fabsf(value) * 10);
+    return tenths > 999 ? 999 : tenths;
+}
+
+/*
+ * Reverse of get_temperature_from_cresta_encoding
+ */
+static void encode_temperature(uint8_t *decrypted_data, uint8_t offset, float temperature) {
+    unsigned int tenths = to_tenths(temperature);
+    uint8_t sign = (temperature < 0 && tenths) ? 0x04 : 0x0C;
+
+    decrypted_data[offset]   = ((tenths / 10) % 10) << 4 | tenths % 10;
+    decrypted_data[offset+1] = sign << 4 | (tenths / 100) % 10;
+}
+
+/*
+ * Speeds are transmitted in mph
+ */
+static unsigned int to_mph_tenths(float speed) {
+    if(METRIC_UNITS) {
+	speed /= 1.60934;
+    }
+    return to_tenths(speed);
+}
+
+/*
+ * Fills in the decrypted datagram for the given sensor values,
+ * without checksums. Returns the total length of the datagram
+ * or -1 for unknown sensor types
+ */
+int cresta_encode_values(const struct cresta_sensor_values *values, uint8_t packet_number, uint8_t *decrypted_data) {
+    uint8_t len;
+    unsigned int tenths;
+
+    memset(decrypted_data, 0, CRESTA_MAXDATA_LEN);
+
+    switch(values->sensor_type) {
+	case CRESTA_SENSOR_TYPE_THERMOHYGRO: {
+	    len = CRESTA_LEN_THERMOHYGRO;
+	    encode_temperature(decrypted_data, 4, values->temperature);
+	    decrypted_data[6] = ((values->humidity / 10) % 10) << 4 | values->humidity % 10;
+	    break;
+	}
+	case CRESTA_SENSOR_TYPE_ANEMOMETER: {
+	    uint8_t count;
+
+	    len = CRESTA_LEN_ANEMOMETER;
+	    encode_temperature(decrypted_data, 4, values->temperature);
+	    encode_temperature(decrypted_data, 6, values->windchill);
+
+	    tenths = to_mph_tenths(values->windspeed);
+	    decrypted_data[8] = ((tenths / 10) % 10) << 4 | tenths % 10;
+	    decrypted_data[9] = (tenths / 100) % 10;
+
+	    tenths = to_mph_tenths(values->windgust);
+	    decrypted_data[9] |= (tenths % 10) << 4;
+	    decrypted_data[10] = ((tenths / 100) % 10) << 4 | (tenths / 10) % 10;
+
+	    //reverse of get_anemometer_wind_direction: negate and gray code
+	    count = -lroundf(values->wind_direction / 22.5) & 0x0F;
+	    decrypted_data[11] = (count ^ (count >> 1)) << 4;
+	    break;
+	}
+	case CRESTA_SENSOR_TYPE_UV: {
+	    len = CRESTA_LEN_UV;
+	    tenths = to_tenths(values->temperature);
+	    decrypted_data[4] = ((tenths / 10) % 10) << 4 | tenths % 10;
+	    decrypted_data[5] = (tenths / 100) % 10;
+
+	    tenths = to_tenths(values->uv_medh);
+	    decrypted_data[5] |= (tenths % 10) << 4;
+	    decrypted_data[6] = ((tenths / 100) % 10) << 4 | (tenths / 10) % 10;
+
+	    tenths = to_tenths(values->uv_index);
+	    decrypted_data[7] = ((tenths / 10) % 10) << 4 | tenths % 10;
+	    decrypted_data[8] = (values->uv_level & 0x0F) << 4 | (tenths / 100) % 10;
+	    break;
+	}
+	case CRESTA_SENSOR_TYPE_RAIN: {
+	    len = CRESTA_LEN_RAIN;
+	    decrypted_data[4] = values->rain_ticks & 0xFF;
+	    decrypted_data[5] = values->rain_ticks >> 8;
+	    decrypted_data[6] = 0x66;
+	    break;
+	}
+	default: {
+	    return -1;
+	}
+    }
+
+    decrypted_data[0] = CRESTA_PREAMBLE;
+    decrypted_data[1] = values->sensor_address;
+    //bits 7+6: battery status, bits 5..1: length
+    decrypted_data[2] = (values->battery_low ? 0x00 : 0xC0) | len << 1;
+    //bits 6+5: packet number in stream, bits 4..0: sensor type
+    decrypted_data[3] = (packet_number & 0x03) << 5 | values->sensor_type;
+
+    return len + 3;
+}
+
+/*
+ * Reverse of decrypt_and_check. Encrypts the data bytes in place
+ * and appends both checksums
+ */
+void cresta_encrypt_datagram(uint8_t *data) {
+    uint8_t len = (data[2] >> 1) & 0x1F;
+    uint8_t cs1 = 0;
+    uint8_t cs2 = 0;
+    uint8_t i;
+
+    for(i = 1; i <= len; i++) {
+	//decryption is d = r ^ (r << 1), so every bit of r is the
+	//xor of the same bit of d and the next lower bit of r
+	uint8_t decrypted = data[i];
+	uint8_t raw = decrypted & 1;
+	uint8_t bit;
+
+	for(bit = 1; bit < 8; bit++) {
+	    raw |= (((decrypted >> bit) ^ (raw >> (bit - 1))) & 1) << bit;
+	}
+	data[i] = raw;
+	cs1 ^= raw;
+    }
+
+    //xor over all bytes including the first checksum must be 0
+    data[len+1] = cs1;
+    for(i = 1; i <= len + 1; i++) {
+	cs2 = second_check(data[i] ^ cs2);
+    }
+    data[len+2] = cs2;
+}
+
+/*
+ * Encodes and encrypts the datagram for the given values.
+ * Returns the total length of the datagram or -1
+ */
+int cresta_encode_datagram(const struct cresta_sensor_values *values, uint8_t packet_number, uint8_t *raw_data) {
+    int len = cresta_encode_values(values, packet_number, raw_data);
+    if(len > 0) {
+	cresta_encrypt_datagram(raw_data);
+    }
+    return len;
+}
+
+/*
+ * Converts a datagram to edge durations (in microseconds), reverse of
+ * the manchester decoder: the first edge is a long one for clock
+ * detection, followed by two short edges for every bit that equals its
+ * predecessor and one long edge for every bit that differs. Bytes are
+ * sent LSB first, each followed by a 0, except for the last byte.
+ * Returns the number of durations, at most CRESTA_MAX_DATAGRAM_EDGES
+ */
+size_t cresta_manchester_encode(const uint8_t *raw_data, uint32_t clock_us, uint32_t *durations) {
+    uint8_t len = ((raw_data[2] ^ (raw_data[2] << 1)) >> 1) & 0x1F;
+    unsigned int bits = (len + 3) * 9 - 1;
+    unsigned int i;
+    size_t count = 0;
+    int previous = 1;
+
+    durations[count++] = clock_us * 2;
+    for(i = 0; i < bits; i++) {
+	int bit = (i % 9 == 8) ? 0 : (raw_data[i / 9] >> (i % 9)) & 1;
+
+	if(i > 0) {
+	    if(bit == previous) {
+		durations[count++] = clock_us;
+		durations[count++] = clock_us;
+	    } else {
+		durations[count++] = clock_us * 2;
+	    }
+	}
+	previous = bit;
+    }
+    //the decoder takes the last bit when the next edge arrives
+    durations[count++] = clock_us;
+
+    return count;
+}
+
+
+void cresta_signal_init(struct cresta_signal *signal, const struct cresta_signal_config *config) {
+    memset(signal, 0, sizeof(*signal));
+    signal->config = *config;
+    signal->rng = config->seed ? config->seed : 1;
+}
+
+void cresta_signal_free(struct cresta_signal *signal) {
+    free(signal->intervals);
+    free(signal->edges);
+    signal->intervals = NULL;
+    signal->edges = NULL;
+    signal->interval_count = 0;
+    signal->interval_capacity = 0;
+    signal->edge_count = 0;
+}
+
+/*
+ * xorshift64*, so signals are reproducible for a given seed
+ */
+uint64_t cresta_signal_random(struct cresta_signal *signal) {
+    signal->rng ^= signal->rng >> 12;
+    signal->rng ^= signal->rng << 25;
+    signal->rng ^= signal->rng >> 27;
+    return signal->rng * 2685821657736338717ULL;
+}
+
+static uint32_t random_between(struct cresta_signal *signal, uint32_t min, uint32_t max) {
+    return min + cresta_signal_random(signal) % (max - min + 1);
+}
+
+static int add_interval(struct cresta_signal *signal, uint64_t start_ns, uint64_t end_ns) {
+    if(signal->interval_count == signal->interval_capacity) {
+	size_t capacity = signal->interval_capacity ? signal->interval_capacity * 2 : 1024;
+	struct cresta_signal_interval *intervals = realloc(signal->intervals, capacity * sizeof(*intervals));
+	if(NULL == intervals) {
+	    signal->failed = 1;
+	    return -1;
+	}
+	signal->intervals = intervals;
+	signal->interval_capacity = capacity;
+    }
+    signal->intervals[signal->interval_count].start_ns = start_ns;
+    signal->intervals[signal->interval_count].end_ns = end_ns;
+    signal->interval_count++;
+    if(end_ns > signal->end_ns) {
+	signal->end_ns = end_ns;
+    }
+    return 0;
+}
+
+/*
+ * Adds a single datagram starting at start_ns. The receiver's output
+ * is low before the datagram and goes high with the first edge.
+ * Returns the time of the last edge. If we run out of memory, the
+ * datagram is cut short and signal->failed is set
+ */
+uint64_t cresta_signal_add_datagram(struct cresta_signal *signal, uint64_t start_ns, const uint8_t *raw_data) {
+    uint32_t durations[CRESTA_MAX_DATAGRAM_EDGES + 1];
+    size_t count = cresta_manchester_encode(raw_data, signal->config.clock_us, durations);
+    uint64_t t = start_ns;
+    uint64_t rise = start_ns;
+    size_t i;
+
+    //keep the number of edges even, so the output ends low
+    if(count % 2 == 0) {
+	durations[count++] = signal->config.clock_us;
+    }
+
+    for(i = 0; i < count; i++) {
+	int32_t duration = durations[i];
+
+	if(signal->config.jitter_us) {
+	    duration += (int32_t) random_between(signal, 0, 2 * signal->config.jitter_us) - (int32_t) signal->config.jitter_us;
+	    if(duration < 1) {
+		duration = 1;
+	    }
+	}
+	t += (uint64_t) duration * 1000;
+
+	//edge i+1 is a falling edge if i is even
+	if(i % 2 == 0) {
+	    if(add_interval(signal, rise, t)) {
+		return t;
+	    }
+	} else {
+	    rise = t;
+	}
+    }
+
+    return t;
+}
+
+/*
+ * Adds a complete transmission of a sensor, including repeats.
+ * Returns the time of the last edge, see cresta_signal_add_datagram
+ */
+uint64_t cresta_signal_add_transmission(struct cresta_signal *signal, uint64_t start_ns, const struct cresta_sensor_values *values) {
+    uint8_t raw_data[CRESTA_MAXDATA_LEN];
+    uint32_t repeat;
+    uint64_t t = start_ns;
+
+    for(repeat = 0; repeat < signal->config.repeats; repeat++) {
+	if(cresta_encode_datagram(values, repeat + 1, raw_data) < 0) {
+	    return start_ns;
+	}
+	if(repeat > 0) {
+	    t += (uint64_t) signal->config.repeat_gap_us * 1000;
+	}
+	t = cresta_signal_add_datagram(signal, t, raw_data);
+	if(signal->failed) {
+	    break;
+	}
+    }
+    return t;
+}
+
+/*
+ * Adds random noise bursts between start_ns and end_ns, according to
+ * the configured rate. Returns 0 on success
+ */
+int cresta_signal_add_noise(struct cresta_signal *signal, uint64_t start_ns, uint64_t end_ns) {
+    double seconds = (end_ns - start_ns) / 1e9;
+    uint64_t bursts = (uint64_t) (seconds * signal->config.noise_bursts_per_second + 0.5);
+    uint64_t burst;
+
+    for(burst = 0; burst < bursts; burst++) {
+	uint64_t t = start_ns + cresta_signal_random(signal) % (end_ns - start_ns);
+	uint32_t edge;
+
+	for(edge = 0; edge < signal->config.noise_edges_per_burst; edge += 2) {
+	    uint64_t high = (uint64_t) random_between(signal, CRESTA_NOISE_MIN_US, CRESTA_NOISE_MAX_US) * 1000;
+	    uint64_t low = (uint64_t) random_between(signal, CRESTA_NOISE_MIN_US, CRESTA_NOISE_MAX_US) * 1000;
+
+	    if(add_interval(signal, t, t + high)) {
+		return -1;
+	    }
+	    t += high + low;
+	}
+    }
+    return 0;
+}
+
+static int compare_intervals(const void *a, const void *b) {
+    const struct cresta_signal_interval *ia = a;
+    const struct cresta_signal_interval *ib = b;
+
+    if(ia->start_ns != ib->start_ns) {
+	return ia->start_ns < ib->start_ns ? -1 : 1;
+    }
+    return 0;
+}
+
+/*
+ * Combines all intervals (OR) and converts them to edges,
+ * available in signal->edges. Returns 0 on success, -1 if
+ * adding intervals failed before
+ */
+int cresta_signal_render(struct cresta_signal *signal) {
+    struct cresta_raw_edge *edges;
+    size_t i;
+
+    free(signal->edges);
+    signal->edges = NULL;
+    signal->edge_count = 0;
+    if(signal->failed) {
+	return -1;
+    }
+    if(0 == signal->interval_count) {
+	return 0;
+    }
+
+    edges = malloc(signal->interval_count * 2 * sizeof(*edges));
+    if(NULL == edges) {
+	return -1;
+    }
+
+    qsort(signal->intervals, signal->interval_count, sizeof(signal->intervals[0]), compare_intervals);
+
+    for(i = 0; i < signal->interval_count; ) {
+	uint64_t start = signal->intervals[i].start_ns;
+	uint64_t end = signal->intervals[i].end_ns;
+
+	//merge everything overlapping this interval
+	for(i++; i < signal->interval_count && signal->intervals[i].start_ns <= end; i++) {
+	    if(signal->intervals[i].end_ns > end) {
+		end = signal->intervals[i].end_ns;
+	    }
+	}
+
+	edges[signal->edge_count].timestamp_ns = start;
+	edges[signal->edge_count].level = 1;
+	edges[signal->edge_count].dropped = 0;
+	signal->edge_count++;
+	edges[signal->edge_count].timestamp_ns = end;
+	edges[signal->edge_count].level = 0;
+	edges[signal->edge_count].dropped = 0;
+	signal->edge_count++;
+    }
+
+    signal->edges = edges;
+    return 0;
+}
+
+void cresta_sample_config_defaults(struct cresta_sample_config *config) {
+    memset(config, 0, sizeof(*config));
+    config->format = CRESTA_SDR_CU8;
+    config->rate = CRESTA_SDR_DEFAULT_RATE;
+    config->snr_db = CRESTA_DEFAULT_SNR_DB;
+    config->offset_hz = CRESTA_DEFAULT_OFFSET_HZ;
+}
+
+/*
+ * Two independent normally distributed values, Box-Muller
+ */
+static void random_gaussian(struct cresta_signal *signal, double sigma, double *a, double *b) {
+    double u = ((cresta_signal_random(signal) >> 11) + 1) * 0x1.0p-53;
+    double v = (cresta_signal_random(signal) >> 11) * 0x1.0p-53;
+    double r = sigma * sqrt(-2 * log(u));
+
+    *a = r * cos(2 * M_PI * v);
+    *b = r * sin(2 * M_PI * v);
+}
+
+static int32_t clamp_sample(double value, int32_t min, int32_t max) {
+    long rounded = lround(value);
+    return rounded < min ? min : rounded > max ? max : rounded;
+}
+
+static uint64_t sample_time_ns(uint64_t sample, uint32_t rate) {
+    return sample / rate * 1000000000ULL + sample % rate * 1000000000ULL / rate;
+}
+
+static void put_le16(uint8_t *p, int32_t value) {
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+}
+
+/*
+ * Writes count samples of the rendered signal, starting with sample
+ * number first, as an SDR tuned close to the sensors would receive
+ * them: the carrier while the receiver's output is high, Gaussian
+ * noise all the time. Noise is drawn from the signal's generator, so
+ * samples are reproducible when written in order. Returns the number
+ * of bytes written
+ */
+size_t cresta_signal_samples(struct cresta_signal *signal, const struct cresta_sample_config *config,
+			     uint64_t first, size_t count, void *out) {
+    double full_scale = CRESTA_SDR_CU8 == config->format || CRESTA_SDR_CS8 == config->format ? 127 : 32767;
+    double amplitude = full_scale / 2;
+    double sigma = amplitude / sqrt(2 * pow(10, config->snr_db / 10));
+    size_t size = cresta_sdr_sample_size(config->format);
+    uint8_t *p = out;
+    size_t low = 0;
+    size_t high = signal->edge_count;
+    size_t n;
+
+    //first edge after the first sample
+    while(low < high) {
+	size_t middle = (low + high) / 2;
+
+	if(signal->edges[middle].timestamp_ns <= sample_time_ns(first, config->rate)) {
+	    low = middle + 1;
+	} else {
+	    high = middle;
+	}
+    }
+
+    for(n = 0; n < count; n++, p += size) {
+	uint64_t sample = first + n;
+	uint64_t t_ns = sample_time_ns(sample, config->rate);
+	double i;
+	double q;
+
+	while(low < signal->edge_count && signal->edges[low].timestamp_ns <= t_ns) {
+	    low++;
+	}
+	random_gaussian(signal, sigma, &i, &q);
+	if(low > 0 && signal->edges[low - 1].level) {
+	    double phase = 2 * M_PI * fmod(config->offset_hz * sample / config->rate, 1.0);
+
+	    i += amplitude * cos(phase);
+	    q += amplitude * sin(phase);
+	}
+
+	switch(config->format) {
+	    case CRESTA_SDR_CU8: {
+		p[0] = clamp_sample(127.5 + i, 0, 255);
+		p[1] = clamp_sample(127.5 + q, 0, 255);
+		break;
+	    }
+	    case CRESTA_SDR_CS8: {
+		p[0] = (uint8_t) clamp_sample(i, -128, 127);
+		p[1] = (uint8_t) clamp_sample(q, -128, 127);
+		break;
+	    }
+	    case CRESTA_SDR_CS16: {
+		put_le16(p, clamp_sample(i, -32768, 32767));
+		put_le16(p + 2, clamp_sample(q, -32768, 32767));
+		break;
+	    }
+	    default: {
+		put_le16(p, clamp_sample(hypot(i, q), 0, 32767));
+		break;
+	    }
+	}
+    }
+    return count * size;
+}
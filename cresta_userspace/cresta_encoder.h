@@ -0,0 +1,116 @@
+/*
+ * Synthetic Cresta sensor signals. Does the reverse of
+ * cresta_decoder.c, decrypt_and_check and the manchester decoder.
+ *
+ * License: GPLv3. See license.txt
+ */
+#ifndef _CRESTA_ENCODER_H_
+#define _CRESTA_ENCODER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../cresta_common/cresta_common.h"
+#include "cresta_sdr.h"
+
+//nominal duration of a short edge, see clockTime of the manchester decoder
+#define CRESTA_DEFAULT_CLOCK_US 488
+
+//sensors repeat each transmission
+#define CRESTA_DEFAULT_REPEATS 3
+#define CRESTA_DEFAULT_REPEAT_GAP_US 10000
+
+//synthetic SDR samples, see struct cresta_sample_config
+#define CRESTA_DEFAULT_SNR_DB 20
+#define CRESTA_DEFAULT_OFFSET_HZ 25000
+
+//maximum number of edge durations of a single datagram
+#define CRESTA_MAX_DATAGRAM_EDGES (CRESTA_MAXDATA_LEN * 9 * 2 + 2)
+
+/*
+ * Values of a sensor, in the units the cresta tool prints them
+ * (degree celsius, km/h, degree). Only the fields matching
+ * sensor_type are used.
+ */
+struct cresta_sensor_values {
+    uint8_t sensor_type;
+    uint8_t sensor_address;
+    uint8_t battery_low;
+    float   temperature;	//thermohygro, anemometer, UV (absolute value only)
+    uint8_t humidity;		//thermohygro
+    float   windchill;		//anemometer
+    float   windspeed;		//anemometer
+    float   windgust;		//anemometer
+    float   wind_direction;	//anemometer
+    float   uv_medh;		//UV
+    float   uv_index;		//UV
+    uint8_t uv_level;		//UV
+    uint16_t rain_ticks;	//rain
+};
+
+/*
+ * Parameters of a synthetic signal
+ */
+struct cresta_signal_config {
+    uint32_t clock_us;			//duration of a short edge
+    uint32_t jitter_us;			//maximum deviation of every edge
+    uint32_t repeats;			//transmissions per measurement
+    uint32_t repeat_gap_us;		//silence between repeated transmissions
+    double   noise_bursts_per_second;	//rate of random noise bursts
+    uint32_t noise_edges_per_burst;
+    uint64_t seed;
+};
+
+/*
+ * Samples of a software defined radio receiving the signal, see
+ * cresta_signal_samples. The carrier is at half the full scale
+ * of the format
+ */
+struct cresta_sample_config {
+    enum cresta_sdr_format format;
+    uint32_t rate;			//samples per second
+    double   snr_db;			//carrier to noise in the bandwidth of the samples
+    double   offset_hz;			//of the carrier from the center frequency
+};
+
+/*
+ * High intervals of the receiver's output. Overlapping transmissions
+ * and noise are combined by OR, like a receiver would.
+ */
+struct cresta_signal_interval {
+    uint64_t start_ns;
+    uint64_t end_ns;
+};
+
+struct cresta_signal {
+    struct cresta_signal_config config;
+    uint64_t rng;
+    struct cresta_signal_interval *intervals;
+    size_t interval_count;
+    size_t interval_capacity;
+    struct cresta_raw_edge *edges;	//result of cresta_signal_render
+    size_t edge_count;
+    uint64_t end_ns;			//end of the last interval
+    int failed;				//out of memory while adding intervals
+};
+
+
+void     cresta_signal_config_defaults(struct cresta_signal_config *config);
+
+int      cresta_encode_values(const struct cresta_sensor_values *values, uint8_t packet_number, uint8_t *decrypted_data);
+void     cresta_encrypt_datagram(uint8_t *data);
+int      cresta_encode_datagram(const struct cresta_sensor_values *values, uint8_t packet_number, uint8_t *raw_data);
+size_t   cresta_manchester_encode(const uint8_t *raw_data, uint32_t clock_us, uint32_t *durations);
+
+void     cresta_signal_init(struct cresta_signal *signal, const struct cresta_signal_config *config);
+void     cresta_signal_free(struct cresta_signal *signal);
+uint64_t cresta_signal_random(struct cresta_signal *signal);
+uint64_t cresta_signal_add_datagram(struct cresta_signal *signal, uint64_t start_ns, const uint8_t *raw_data);
+uint64_t cresta_signal_add_transmission(struct cresta_signal *signal, uint64_t start_ns, const struct cresta_sensor_values *values);
+int      cresta_signal_add_noise(struct cresta_signal *signal, uint64_t start_ns, uint64_t end_ns);
+int      cresta_signal_render(struct cresta_signal *signal);
+
+void     cresta_sample_config_defaults(struct cresta_sample_config *config);
+size_t   cresta_signal_samples(struct cresta_signal *signal, const struct cresta_sample_config *config,
+			       uint64_t first, size_t count, void *out);
+
+#endif
@@ -0,0 +1,871 @@
+/*
+ * Serves the measurements of all sensors in the Prometheus text
+ * format over HTTP, on a local TCP port or a unix socket.
+ *
+ * Measurements are taken from the devices of the kernel module, which
+ * are polled, from crestad's files or from crestad's shared memory
+ * ring. The response is rendered when measurements arrive, formatting
+ * only the lines of the sensors that got one; the lines of the others
+ * are copied. A scrape just writes the rendered response.
+ *
+ * Requests are served one after the other, scrapes are rare and the
+ * response is ready, so a slow client only delays measurements.
+ *
+ * License: GPLv3. See license.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../cresta_common/cresta_protocol.h"
+#include "cresta_decoder.h"
+#include "cresta_derived.h"
+#include "cresta_ring.h"
+
+#define EXPORTER_PORT    9433
+#define EXPORTER_ADDRESS "127.0.0.1"
+
+#define EXPORTER_RESCAN_INTERVAL_MS 10000	//new devices are found this often
+#define EXPORTER_REOPEN_INTERVAL_MS 1000	//files that can't be polled are read this often
+#define EXPORTER_RING_INTERVAL_MS   100		//crestad's ring is read this often
+#define EXPORTER_TIMEOUT_S          2		//for reading a request and writing the response together
+#define EXPORTER_REQUEST_LEN        1024
+#define EXPORTER_MAX_FILES          256
+#define EXPORTER_SAMPLE_LEN         160
+#define EXPORTER_HEADER_LEN         128		//room for the HTTP response header
+
+enum exporter_metric {
+    METRIC_TEMPERATURE,
+    METRIC_HUMIDITY,
+    METRIC_WINDCHILL,
+    METRIC_WINDSPEED,
+    METRIC_WINDGUST,
+    METRIC_WIND_DIRECTION,
+    METRIC_UV_MEDH,
+    METRIC_UV_INDEX,
+    METRIC_UV_LEVEL,
+    METRIC_RAIN_TICKS,
+    METRIC_DEW_POINT,
+    METRIC_RAIN_LAST_HOUR,
+    METRIC_RAIN_LAST_DAY,
+    METRIC_WIND_AVERAGE_SPEED,
+    METRIC_WIND_VECTOR_SPEED,
+    METRIC_WIND_VECTOR_DIRECTION,
+    METRIC_BATTERY,
+    METRIC_TIMESTAMP,
+    METRIC_MEASUREMENTS,
+    METRIC_COUNT
+};
+
+struct exporter_family {
+    const char *name;
+    const char *type;
+    const char *help;
+};
+
+static const struct exporter_family families[METRIC_COUNT] = {
+    { "cresta_temperature_celsius",      "gauge",   "Temperature" },
+    { "cresta_humidity_percent",         "gauge",   "Relative humidity" },
+    { "cresta_windchill_celsius",        "gauge",   "Wind chill temperature" },
+    { "cresta_wind_speed_kmh",           "gauge",   "Wind speed" },
+    { "cresta_wind_gust_kmh",            "gauge",   "Wind gust speed" },
+    { "cresta_wind_direction_degrees",   "gauge",   "Wind direction" },
+    { "cresta_uv_medh",                  "gauge",   "UV dose in MED per hour" },
+    { "cresta_uv_index",                 "gauge",   "UV index" },
+    { "cresta_uv_level",                 "gauge",   "UV level" },
+    { "cresta_rain_ticks_total",         "counter", "Rain gauge ticks, wraps at 65536" },
+    { "cresta_dew_point_celsius",        "gauge",   "Dew point" },
+    { "cresta_rain_last_hour_mm",        "gauge",   "Rain during the last hour" },
+    { "cresta_rain_last_day_mm",         "gauge",   "Rain during the last 24 hours" },
+    { "cresta_wind_average_speed_kmh",   "gauge",   "Mean wind speed of the last 10 minutes" },
+    { "cresta_wind_vector_speed_kmh",    "gauge",   "Speed of the mean wind vector of the last 10 minutes" },
+    { "cresta_wind_vector_direction_degrees", "gauge", "Direction of the mean wind vector of the last 10 minutes" },
+    { "cresta_battery_ok",               "gauge",   "1 if the battery is OK, 0 if it is low" },
+    { "cresta_measurement_timestamp_seconds", "gauge", "Time the last measurement was received" },
+    { "cresta_measurements_total",       "counter", "Measurements received, 0 for seeded ones" }
+};
+
+/*
+ * Values of a sensor type, besides battery, time and sequence number
+ */
+struct exporter_value {
+    enum exporter_metric metric;
+    char* (*get_string)(uint8_t *decrypted_data, char *buf);
+};
+
+static const struct exporter_value thermohygro_values[] = {
+    { METRIC_TEMPERATURE, get_thermohygro_temperature_string },
+    { METRIC_HUMIDITY,    get_thermohygro_humidity_string },
+    { METRIC_COUNT, NULL }
+};
+
+static const struct exporter_value anemometer_values[] = {
+    { METRIC_TEMPERATURE,    get_anemometer_temperature_string },
+    { METRIC_WINDCHILL,      get_anemometer_windchill_string },
+    { METRIC_WINDSPEED,      get_anemometer_windspeed_string },
+    { METRIC_WINDGUST,       get_anemometer_windgust_string },
+    { METRIC_WIND_DIRECTION, get_anemometer_wind_direction_string },
+    { METRIC_COUNT, NULL }
+};
+
+static const struct exporter_value uv_values[] = {
+    { METRIC_TEMPERATURE, get_uv_absolute_temperature_string },
+    { METRIC_UV_MEDH,     get_uv_medh_string },
+    { METRIC_UV_INDEX,    get_uv_uvindex_string },
+    { METRIC_UV_LEVEL,    get_uv_uvlevel_string },
+    { METRIC_COUNT, NULL }
+};
+
+static const struct exporter_value rain_values[] = {
+    { METRIC_RAIN_TICKS, get_rain_tick_count_string },
+    { METRIC_COUNT, NULL }
+};
+
+/*
+ * Rendered lines of a sensor, indexed by sensor address
+ */
+struct exporter_sensor {
+    int present;
+    struct cresta_derived derived;
+    uint16_t len[METRIC_COUNT];		//0 if the sensor has no such value
+    char samples[METRIC_COUNT][EXPORTER_SAMPLE_LEN];
+};
+
+/*
+ * A device or file measurements are read from
+ */
+struct exporter_file {
+    char *path;
+    int fd;
+    int pollable;		//poll tells about new measurements
+    int address;		//sensor of the last measurement, -1 if none
+    int seen;			//matched by the last rescan
+    uint64_t sequence;
+    uint64_t timestamp_ns;
+};
+
+static struct exporter_sensor sensors[256];
+static struct exporter_file files[EXPORTER_MAX_FILES];
+static int file_count;
+static char family_headers[METRIC_COUNT][EXPORTER_SAMPLE_LEN];
+static char *response;			//HTTP header and body, rendered
+static char *response_start;
+static size_t response_len;
+static size_t response_size;
+static volatile sig_atomic_t running = 1;
+
+static const char not_found[] = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+
+static void handle_signal(int sig) {
+    running = 0;
+}
+
+static uint64_t monotonic_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000ULL + now.tv_nsec / 1000000;
+}
+
+static const struct exporter_value* sensor_values(uint8_t sensor_type, const char **type) {
+    switch(sensor_type) {
+	case CRESTA_SENSOR_TYPE_THERMOHYGRO: {
+	    *type = "thermohygro";
+	    return thermohygro_values;
+	}
+	case CRESTA_SENSOR_TYPE_ANEMOMETER: {
+	    *type = "anemometer";
+	    return anemometer_values;
+	}
+	case CRESTA_SENSOR_TYPE_UV: {
+	    *type = "uv";
+	    return uv_values;
+	}
+	case CRESTA_SENSOR_TYPE_RAIN: {
+	    *type = "rain";
+	    return rain_values;
+	}
+    }
+    return NULL;
+}
+
+static void set_sample(struct exporter_sensor *sensor, enum exporter_metric metric, const char *labels, const char *value) {
+    int len = snprintf(sensor->samples[metric], EXPORTER_SAMPLE_LEN, "%s%s %s\n", families[metric].name, labels, value);
+
+    sensor->len[metric] = len < EXPORTER_SAMPLE_LEN ? len : 0;
+}
+
+static void set_derived_sample(struct exporter_sensor *sensor, enum exporter_metric metric, const char *labels,
+			       const char *format, double value) {
+    char value_string[CRESTA_VALUE_STRING_LEN];
+
+    if(!isnan(value)) {
+	snprintf(value_string, sizeof(value_string), format, value);
+	set_sample(sensor, metric, labels, value_string);
+    }
+}
+
+/*
+ * Updates the derived values of a sensor and renders them
+ */
+static void render_derived(struct exporter_sensor *sensor, struct cresta_measurement_data *data, const char *labels) {
+    struct cresta_derived *derived = &sensor->derived;
+
+    //state of a sensor that was gone or changed its type starts over
+    if(!sensor->present || (derived->sensor_type && derived->sensor_type != data->sensor_type)) {
+	cresta_derived_init(derived);
+    }
+    cresta_derived_update(derived, data);
+
+    switch(data->sensor_type) {
+	case CRESTA_SENSOR_TYPE_THERMOHYGRO: {
+	    set_derived_sample(sensor, METRIC_DEW_POINT, labels, "%.1f", derived->dew_point);
+	    break;
+	}
+	case CRESTA_SENSOR_TYPE_RAIN: {
+	    set_derived_sample(sensor, METRIC_RAIN_LAST_HOUR, labels, "%.1f", cresta_derived_rain_last_hour(derived));
+	    set_derived_sample(sensor, METRIC_RAIN_LAST_DAY, labels, "%.1f", cresta_derived_rain_last_day(derived));
+	    break;
+	}
+	case CRESTA_SENSOR_TYPE_ANEMOMETER: {
+	    set_derived_sample(sensor, METRIC_WIND_AVERAGE_SPEED, labels, "%.2f", cresta_derived_wind_average_speed(derived));
+	    set_derived_sample(sensor, METRIC_WIND_VECTOR_SPEED, labels, "%.2f", cresta_derived_wind_vector_speed(derived));
+	    set_derived_sample(sensor, METRIC_WIND_VECTOR_DIRECTION, labels, "%.1f", cresta_derived_wind_vector_direction(derived));
+	    break;
+	}
+    }
+}
+
+/*
+ * Renders the lines of the sensor a measurement is from. name is
+ * used as the sensor label, characters that would need escaping are
+ * replaced
+ */
+static void render_sensor(struct cresta_measurement_data *data, const char *name) {
+    struct exporter_sensor *sensor = &sensors[data->sensor_address];
+    uint8_t *d = data->measurement.decrypted_data;
+    const struct exporter_value *value;
+    char value_string[CRESTA_VALUE_STRING_LEN];
+    char labels[EXPORTER_SAMPLE_LEN / 2];
+    const char *type;
+    char *c;
+    int len;
+
+    value = sensor_values(data->sensor_type, &type);
+    if(NULL == value) {
+	return;
+    }
+    len = snprintf(labels, sizeof(labels), "{sensor=\"%s", name);
+    for(c = labels + strlen("{sensor=\""); *c; c++) {
+	if('"' == *c || '\\' == *c || !isprint((unsigned char) *c)) {
+	    *c = '_';
+	}
+    }
+    if(len >= sizeof(labels) ||
+       snprintf(labels + len, sizeof(labels) - len, "\",address=\"0x%02x\",type=\"%s\"}", data->sensor_address, type) >= sizeof(labels) - len) {
+	return;
+    }
+
+    memset(sensor->len, 0, sizeof(sensor->len));
+    for(; NULL != value->get_string; value++) {
+	set_sample(sensor, value->metric, labels, value->get_string(d, value_string));
+    }
+    render_derived(sensor, data, labels);
+    set_sample(sensor, METRIC_BATTERY, labels, get_battery_status_string(d, value_string));
+    snprintf(value_string, sizeof(value_string), "%lu", (unsigned long) get_measurement_time_seconds(data));
+    set_sample(sensor, METRIC_TIMESTAMP, labels, value_string);
+    snprintf(value_string, sizeof(value_string), "%llu", (unsigned long long) data->measurement.sequence);
+    set_sample(sensor, METRIC_MEASUREMENTS, labels, value_string);
+    sensor->present = 1;
+}
+
+/*
+ * Puts the rendered lines together, grouped by metric as the format
+ * requires, and the HTTP header in front of them
+ */
+static void render_response(void) {
+    char *body = response + EXPORTER_HEADER_LEN;
+    char *end = body;
+    char header[EXPORTER_HEADER_LEN];
+    int header_len;
+    int metric;
+    int addr;
+
+    for(metric = 0; metric < METRIC_COUNT; metric++) {
+	int first = 1;
+
+	for(addr = 0; addr < 256; addr++) {
+	    struct exporter_sensor *sensor = &sensors[addr];
+
+	    if(!sensor->present || 0 == sensor->len[metric]) {
+		continue;
+	    }
+	    if(first) {
+		end = stpcpy(end, family_headers[metric]);
+		first = 0;
+	    }
+	    memcpy(end, sensor->samples[metric], sensor->len[metric]);
+	    end += sensor->len[metric];
+	}
+    }
+
+    header_len = snprintf(header, sizeof(header),
+			  "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+			  "Content-Length: %zu\r\nConnection: close\r\n\r\n", (size_t) (end - body));
+    response_start = body - header_len;
+    memcpy(response_start, header, header_len);
+    response_len = end - response_start;
+}
+
+static int init_response(void) {
+    int metric;
+
+    response_size = EXPORTER_HEADER_LEN;
+    for(metric = 0; metric < METRIC_COUNT; metric++) {
+	snprintf(family_headers[metric], EXPORTER_SAMPLE_LEN, "# HELP %s %s\n# TYPE %s %s\n",
+		 families[metric].name, families[metric].help, families[metric].name, families[metric].type);
+	response_size += strlen(family_headers[metric]) + 256 * EXPORTER_SAMPLE_LEN;
+    }
+    response = malloc(response_size);
+    if(NULL == response) {
+	fprintf(stderr, "Out of memory\n");
+	return -1;
+    }
+    render_response();
+    return 0;
+}
+
+/*
+ * Waits until the non-blocking client socket is ready for events.
+ * Returns -1 once deadline (monotonic_ms) has passed, so a slow
+ * client can't hold up the measurement updates for longer
+ */
+static int wait_client(int fd, short events, uint64_t deadline) {
+    struct pollfd pfd = { fd, events, 0 };
+    uint64_t now;
+    int ret;
+
+    do {
+	now = monotonic_ms();
+	if(now >= deadline) {
+	    return -1;
+	}
+	ret = poll(&pfd, 1, (int) (deadline - now));
+    } while(ret < 0 && EINTR == errno);
+    return ret > 0 ? 0 : -1;
+}
+
+static int write_all(int fd, const char *buf, size_t len, uint64_t deadline) {
+    ssize_t n;
+
+    while(len) {
+	if(wait_client(fd, POLLOUT, deadline)) {
+	    return -1;
+	}
+	n = write(fd, buf, len);
+	if(n < 0) {
+	    if(EINTR == errno || EAGAIN == errno) {
+		continue;
+	    }
+	    return -1;
+	}
+	buf += n;
+	len -= n;
+    }
+    return 0;
+}
+
+/*
+ * Answers one request. Only GET / and GET /metrics are served
+ */
+static void serve(int listen_fd) {
+    uint64_t deadline = monotonic_ms() + EXPORTER_TIMEOUT_S * 1000;
+    char request[EXPORTER_REQUEST_LEN];
+    size_t len = 0;
+    ssize_t n;
+    int fd = accept(listen_fd, NULL, NULL);
+
+    if(fd < 0) {
+	return;
+    }
+    if(fcntl(fd, F_SETFL, O_NONBLOCK)) {
+	close(fd);
+	return;
+    }
+
+    //only the request line matters, but the client may expect its header to be read
+    request[0] = '\0';
+    while(len < sizeof(request) - 1 && 0 == wait_client(fd, POLLIN, deadline)) {
+	n = read(fd, request + len, sizeof(request) - 1 - len);
+	if(n < 0 && (EINTR == errno || EAGAIN == errno)) {
+	    continue;
+	}
+	if(n <= 0) {
+	    break;
+	}
+	len += n;
+	request[len] = '\0';
+	if(NULL != strstr(request, "\r\n\r\n") || NULL != strstr(request, "\n\n")) {
+	    break;
+	}
+    }
+
+    if(0 == strncmp(request, "GET /metrics ", strlen("GET /metrics ")) || 0 == strncmp(request, "GET / ", strlen("GET / "))) {
+	write_all(fd, response_start, response_len, deadline);
+    } else {
+	write_all(fd, not_found, strlen(not_found), deadline);
+    }
+    close(fd);
+}
+
+static int listen_tcp(const char *address, int port) {
+    struct sockaddr_in addr;
+    int one = 1;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if(1 != inet_pton(AF_INET, address, &addr.sin_addr)) {
+	fprintf(stderr, "Invalid address %s\n", address);
+	return -1;
+    }
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ||
+       bind(fd, (struct sockaddr*) &addr, sizeof(addr)) || listen(fd, 16)) {
+	fprintf(stderr, "Couldn't listen on %s:%d: %s\n", address, port, strerror(errno));
+	if(fd >= 0) {
+	    close(fd);
+	}
+	return -1;
+    }
+    return fd;
+}
+
+static int listen_unix(const char *path) {
+    struct sockaddr_un addr;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(addr.sun_path)) {
+	fprintf(stderr, "Socket path too long: %s\n", path);
+	return -1;
+    }
+    strcpy(addr.sun_path, path);
+    //left by a previous run
+    unlink(path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0 || bind(fd, (struct sockaddr*) &addr, sizeof(addr)) || listen(fd, 16)) {
+	fprintf(stderr, "Couldn't listen on %s: %s\n", path, strerror(errno));
+	if(fd >= 0) {
+	    close(fd);
+	}
+	return -1;
+    }
+    return fd;
+}
+
+/*
+ * The sensor's lines are dropped unless another file holds the sensor
+ */
+static void forget_sensor(int address, struct exporter_file *except) {
+    int i;
+
+    if(address < 0) {
+	return;
+    }
+    for(i = 0; i < file_count; i++) {
+	if(&files[i] != except && files[i].address == address) {
+	    return;
+	}
+    }
+    sensors[address].present = 0;
+}
+
+static void remove_file(int index) {
+    struct exporter_file *file = &files[index];
+
+    if(file->fd >= 0) {
+	close(file->fd);
+    }
+    forget_sensor(file->address, file);
+    free(file->path);
+    files[index] = files[--file_count];
+}
+
+/*
+ * Reads the file's measurement. Returns 1 if it is new, 0 if not and
+ * -1 if it can't be read
+ */
+static int update_file(struct exporter_file *file) {
+    struct cresta_measurement_data data;
+    const char *name;
+
+    if(read_measurement_record(file->fd, &data)) {
+	return -1;
+    }
+    if(file->address == data.sensor_address && file->sequence == data.measurement.sequence &&
+       file->timestamp_ns == data.measurement.timestamp_ns) {
+	return 0;
+    }
+    //device names are reused by sensors with a new address
+    if(file->address != data.sensor_address) {
+	int old = file->address;
+
+	file->address = data.sensor_address;
+	forget_sensor(old, file);
+    }
+    file->sequence = data.measurement.sequence;
+    file->timestamp_ns = data.measurement.timestamp_ns;
+
+    name = strrchr(file->path, '/');
+    render_sensor(&data, NULL != name ? name + 1 : file->path);
+    return 1;
+}
+
+/*
+ * Opens files matching pattern (the module's devices if NULL) that
+ * aren't open yet and drops those that are gone. Returns 1 if any
+ * sensor's lines changed
+ */
+static int rescan(const char *pattern) {
+    static const char *const device_patterns[] = CRESTA_DEVICE_PATTERNS;
+    glob_t matches;
+    int changed = 0;
+    size_t i;
+    int j;
+
+    memset(&matches, 0, sizeof(matches));
+    if(NULL != pattern) {
+	glob(pattern, 0, NULL, &matches);
+    } else {
+	for(i = 0; i < sizeof(device_patterns) / sizeof(device_patterns[0]); i++) {
+	    glob(device_patterns[i], i ? GLOB_APPEND : 0, NULL, &matches);
+	}
+    }
+
+    for(j = 0; j < file_count; j++) {
+	files[j].seen = 0;
+    }
+    for(i = 0; i < matches.gl_pathc; i++) {
+	struct exporter_file *file = NULL;
+	int fd;
+
+	for(j = 0; j < file_count; j++) {
+	    if(0 == strcmp(files[j].path, matches.gl_pathv[i])) {
+		file = &files[j];
+		break;
+	    }
+	}
+	if(NULL != file) {
+	    file->seen = 1;
+	    continue;
+	}
+	if(file_count == EXPORTER_MAX_FILES) {
+	    break;
+	}
+
+	//seeded sensors without data are tried again on the next rescan
+	fd = open(matches.gl_pathv[i], O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if(fd < 0) {
+	    continue;
+	}
+	file = &files[file_count];
+	memset(file, 0, sizeof(*file));
+	file->path = strdup(matches.gl_pathv[i]);
+	file->fd = fd;
+	file->pollable = 1;
+	file->address = -1;
+	file->seen = 1;
+	if(NULL == file->path) {
+	    close(fd);
+	    continue;
+	}
+	file_count++;
+	if(update_file(file) > 0) {
+	    changed = 1;
+	}
+    }
+    globfree(&matches);
+
+    for(j = file_count - 1; j >= 0; j--) {
+	if(!files[j].seen) {
+	    remove_file(j);
+	    changed = 1;
+	}
+    }
+    return changed;
+}
+
+/*
+ * Reads files that can't be polled again, reopening them, so
+ * replaced files are seen as well. Returns 1 if any sensor's lines
+ * changed
+ */
+static int reopen_files(void) {
+    int changed = 0;
+    int ret;
+    int i;
+
+    for(i = file_count - 1; i >= 0; i--) {
+	struct exporter_file *file = &files[i];
+
+	if(file->pollable) {
+	    continue;
+	}
+	close(file->fd);
+	file->fd = open(file->path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if(file->fd < 0 || (ret = update_file(file)) < 0) {
+	    remove_file(i);
+	    changed = 1;
+	} else if(ret > 0) {
+	    changed = 1;
+	}
+    }
+    return changed;
+}
+
+/*
+ * Serves measurements of devices or files until interrupted
+ */
+static int export_files(int listen_fd, const char *pattern) {
+    struct pollfd pfds[EXPORTER_MAX_FILES + 1];
+    int indices[EXPORTER_MAX_FILES + 1];
+    uint64_t next_rescan = 0;
+    uint64_t next_reopen = 0;
+    int changed = 0;
+    int count;
+    int i;
+
+    while(running) {
+	uint64_t now = monotonic_ms();
+
+	if(now >= next_rescan) {
+	    changed |= rescan(pattern);
+	    next_rescan = now + EXPORTER_RESCAN_INTERVAL_MS;
+	}
+	if(now >= next_reopen) {
+	    changed |= reopen_files();
+	    next_reopen = now + EXPORTER_REOPEN_INTERVAL_MS;
+	}
+	if(changed) {
+	    render_response();
+	    changed = 0;
+	}
+
+	pfds[0].fd = listen_fd;
+	pfds[0].events = POLLIN;
+	count = 1;
+	for(i = 0; i < file_count; i++) {
+	    if(files[i].pollable) {
+		pfds[count].fd = files[i].fd;
+		pfds[count].events = POLLIN;
+		indices[count++] = i;
+	    }
+	}
+
+	if(poll(pfds, count, EXPORTER_REOPEN_INTERVAL_MS) < 0) {
+	    if(EINTR == errno) {
+		continue;
+	    }
+	    fprintf(stderr, "poll failed: %s\n", strerror(errno));
+	    return -1;
+	}
+
+	//backwards, so removing a file doesn't move the ones still to check
+	for(i = count - 1; i > 0; i--) {
+	    struct exporter_file *file = &files[indices[i]];
+	    int ret;
+
+	    if(pfds[i].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+		remove_file(indices[i]);
+		changed = 1;
+		continue;
+	    }
+	    if(!(pfds[i].revents & POLLIN)) {
+		continue;
+	    }
+	    ret = update_file(file);
+	    if(ret < 0) {
+		remove_file(indices[i]);
+		changed = 1;
+	    } else if(0 == ret) {
+		//readable without news: a file or a module without poll
+		file->pollable = 0;
+	    } else {
+		changed = 1;
+	    }
+	}
+	if(changed) {
+	    render_response();
+	    changed = 0;
+	}
+	if(pfds[0].revents & POLLIN) {
+	    serve(listen_fd);
+	}
+    }
+    return 0;
+}
+
+/*
+ * Serves the measurements crestad publishes into its shared memory
+ * ring until interrupted
+ */
+static int export_ring(int listen_fd, const char *name) {
+    struct cresta_measurement_record records[64];
+    struct cresta_measurement_data data;
+    struct cresta_ring ring;
+    struct pollfd pfd;
+    const char *sensor_name;
+    char fallback_name[16];
+    int changed;
+    int count;
+    int i;
+
+    if(cresta_ring_open(&ring, name)) {
+	return -1;
+    }
+
+    while(running) {
+	changed = 0;
+	while((count = cresta_ring_read(&ring, records, sizeof(records) / sizeof(records[0]))) > 0) {
+	    for(i = 0; i < count; i++) {
+		if(parse_measurement_record(&records[i], sizeof(records[i]), &data)) {
+		    continue;
+		}
+		sensor_name = cresta_sensor_base_name(data.sensor_type, data.sensor_address);
+		if(NULL == sensor_name) {
+		    snprintf(fallback_name, sizeof(fallback_name), "cresta_%02x", data.sensor_address);
+		    sensor_name = fallback_name;
+		}
+		render_sensor(&data, sensor_name);
+		changed = 1;
+	    }
+	}
+	if(changed) {
+	    render_response();
+	}
+
+	pfd.fd = listen_fd;
+	pfd.events = POLLIN;
+	if(poll(&pfd, 1, EXPORTER_RING_INTERVAL_MS) < 0) {
+	    if(EINTR == errno) {
+		continue;
+	    }
+	    fprintf(stderr, "poll failed: %s\n", strerror(errno));
+	    cresta_ring_close(&ring);
+	    return -1;
+	}
+	if(pfd.revents & POLLIN) {
+	    serve(listen_fd);
+	}
+    }
+
+    cresta_ring_close(&ring);
+    return 0;
+}
+
+static void usage(const char *name) {
+    printf("Usage: %s [-p port] [-l address] [-u socket] [-c pattern | -m ring]\n", name);
+    printf("\t-p port\t\tTCP port to serve /metrics on (default %d)\n", EXPORTER_PORT);
+    printf("\t-l address\tIPv4 address to listen on (default %s)\n", EXPORTER_ADDRESS);
+    printf("\t-u socket\tServe on this unix socket instead of TCP\n");
+    printf("\t-c pattern\tRead the files matching pattern instead of the module's\n");
+    printf("\t\t\tdevices, e.g. \"/run/cresta/*\" (crestad -o)\n");
+    printf("\t-m ring\t\tRead crestad's shared memory ring instead, e.g. %s\n", CRESTA_RING_NAME);
+}
+
+int main(int argc, char *argv[]) {
+    const char *address = EXPORTER_ADDRESS;
+    const char *socket_path = NULL;
+    const char *pattern = NULL;
+    const char *ring_name = NULL;
+    int port = EXPORTER_PORT;
+    struct sigaction sa;
+    int listen_fd;
+    int ret;
+    int c;
+
+    opterr = 0;
+
+    while ((c = getopt (argc, argv, "p:l:u:c:m:")) != -1) {
+	switch (c) {
+	    case 'p': {
+		port = atoi(optarg);
+		break;
+	    }
+	    case 'l': {
+		address = optarg;
+		break;
+	    }
+	    case 'u': {
+		socket_path = optarg;
+		break;
+	    }
+	    case 'c': {
+		pattern = optarg;
+		break;
+	    }
+	    case 'm': {
+		ring_name = optarg;
+		break;
+	    }
+	    case '?': {
+		if (isprint (optopt))
+		    fprintf (stderr, "Unknown option or missing argument `-%c'.\n", optopt);
+		usage(argv[0]);
+		return 1;
+	    }
+	    default: {
+		abort ();
+	    }
+	}
+    }
+
+    if(port <= 0 || port > 65535 || (NULL != pattern && NULL != ring_name)) {
+	usage(argv[0]);
+	return 1;
+    }
+
+    if(init_response()) {
+	return -1;
+    }
+    listen_fd = NULL != socket_path ? listen_unix(socket_path) : listen_tcp(address, port);
+    if(listen_fd < 0) {
+	return -1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    //clients closing early must not end the exporter
+    signal(SIGPIPE, SIG_IGN);
+
+    if(NULL != ring_name) {
+	ret = export_ring(listen_fd, ring_name);
+    } else {
+	ret = export_files(listen_fd, pattern);
+    }
+
+    close(listen_fd);
+    if(NULL != socket_path) {
+	unlink(socket_path);
+    }
+    return ret;
+}
@@ -0,0 +1,352 @@
+/*
+ * Generates synthetic Cresta sensor signals for load and
+ * accuracy testing of the decoder, see cresta_encoder.c
+ *
+ * License: GPLv3. See license.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include "cresta_decoder.h"
+#include "cresta_encoder.h"
+
+#define GEN_MAX_SENSORS 255
+
+//samples are written in chunks of this many
+#define GEN_SAMPLE_CHUNK 65536
+
+enum gen_format {
+    GEN_FORMAT_RAW,	//struct cresta_raw_edge, like cresta_capture
+    GEN_FORMAT_TEXT,	//one edge duration in us per line
+    GEN_FORMAT_DUR32,	//uint32_t edge durations in us
+    GEN_FORMAT_SAMPLES	//SDR samples, see struct cresta_sample_config
+};
+
+static struct cresta_sensor_values sensors[GEN_MAX_SENSORS];
+static int sensor_count = 0;
+
+
+/*
+ * Parses a sensor specification, see usage()
+ */
+static int parse_sensor(const char *spec, struct cresta_sensor_values *values) {
+    char type[16];
+    unsigned int address;
+    unsigned int humidity;
+    unsigned int level;
+    unsigned int ticks;
+
+    memset(values, 0, sizeof(*values));
+    if(sscanf(spec, "%15[a-z]:%i", type, &address) != 2 || address > 0xFF) {
+	return -1;
+    }
+    values->sensor_address = address;
+    spec = strchr(strchr(spec, ':') + 1, ':');
+    if(NULL == spec) {
+	return -1;
+    }
+    spec++;
+
+    if(0 == strcmp(type, "thermohygro")) {
+	values->sensor_type = CRESTA_SENSOR_TYPE_THERMOHYGRO;
+	if(sscanf(spec, "%f:%u", &values->temperature, &humidity) != 2) {
+	    return -1;
+	}
+	values->humidity = humidity;
+    } else if(0 == strcmp(type, "anemometer")) {
+	values->sensor_type = CRESTA_SENSOR_TYPE_ANEMOMETER;
+	if(sscanf(spec, "%f:%f:%f:%f:%f", &values->temperature, &values->windchill, &values->windspeed,
+		  &values->windgust, &values->wind_direction) != 5) {
+	    return -1;
+	}
+    } else if(0 == strcmp(type, "uv")) {
+	values->sensor_type = CRESTA_SENSOR_TYPE_UV;
+	if(sscanf(spec, "%f:%f:%f:%u", &values->temperature, &values->uv_medh, &values->uv_index, &level) != 4) {
+	    return -1;
+	}
+	values->uv_level = level;
+    } else if(0 == strcmp(type, "rain")) {
+	values->sensor_type = CRESTA_SENSOR_TYPE_RAIN;
+	if(sscanf(spec, "%u", &ticks) != 1) {
+	    return -1;
+	}
+	values->rain_ticks = ticks;
+    } else {
+	return -1;
+    }
+    return 0;
+}
+
+static int write_signal(FILE *out, struct cresta_signal *signal, enum gen_format format) {
+    uint64_t previous = 0;
+    size_t i;
+
+    if(GEN_FORMAT_RAW == format) {
+	return fwrite(signal->edges, sizeof(signal->edges[0]), signal->edge_count, out) == signal->edge_count ? 0 : -1;
+    }
+
+    for(i = 0; i < signal->edge_count; i++) {
+	uint64_t duration = (signal->edges[i].timestamp_ns - previous) / 1000;
+	uint32_t duration32 = duration > UINT32_MAX ? UINT32_MAX : duration;
+
+	previous = signal->edges[i].timestamp_ns;
+	if(GEN_FORMAT_TEXT == format) {
+	    if(fprintf(out, "%u\n", duration32) < 0) {
+		return -1;
+	    }
+	} else if(fwrite(&duration32, sizeof(duration32), 1, out) != 1) {
+	    return -1;
+	}
+    }
+    return 0;
+}
+
+/*
+ * Writes samples from the start until a little after the last edge,
+ * so the last pulse ends within the samples
+ */
+static int write_samples(FILE *out, struct cresta_signal *signal, const struct cresta_sample_config *config) {
+    uint64_t end = (signal->end_ns + 10000000ULL) / 1000000000ULL * config->rate +
+		   (signal->end_ns + 10000000ULL) % 1000000000ULL * config->rate / 1000000000ULL;
+    uint8_t *chunk = malloc(GEN_SAMPLE_CHUNK * cresta_sdr_sample_size(config->format));
+    uint64_t sample;
+    int ret = 0;
+
+    if(NULL == chunk) {
+	return -1;
+    }
+    for(sample = 0; 0 == ret && sample < end; sample += GEN_SAMPLE_CHUNK) {
+	size_t count = end - sample < GEN_SAMPLE_CHUNK ? end - sample : GEN_SAMPLE_CHUNK;
+	size_t len = cresta_signal_samples(signal, config, sample, count, chunk);
+
+	if(fwrite(chunk, 1, len, out) != len) {
+	    ret = -1;
+	}
+    }
+    free(chunk);
+    return ret;
+}
+
+static void print_datagram(uint64_t t, const struct cresta_sensor_values *values) {
+    uint8_t raw_data[CRESTA_MAXDATA_LEN];
+    int len = cresta_encode_datagram(values, 1, raw_data);
+    int i;
+
+    fprintf(stderr, "%llu.%06llu %02x:", (unsigned long long) (t / 1000000000ULL), (unsigned long long) (t / 1000 % 1000000), values->sensor_address);
+    for(i = 0; i < len; i++) {
+	fprintf(stderr, " %02x", raw_data[i]);
+    }
+    fprintf(stderr, "\n");
+}
+
+static void usage(const char *name) {
+    printf("Usage: %s -S sensor [-S sensor ...] [options]\n", name);
+    printf("\t-S sensor\tSensor to simulate, one of\n");
+    printf("\t\t\t  thermohygro:address:temperature:humidity\n");
+    printf("\t\t\t  anemometer:address:temperature:windchill:speed:gust:direction\n");
+    printf("\t\t\t  uv:address:temperature:medh:uvindex:uvlevel\n");
+    printf("\t\t\t  rain:address:ticks\n");
+    printf("\t\t\tUnits as printed by the cresta tool (rain ticks increase each round)\n");
+    printf("\t-n rounds\tNumber of transmissions per sensor (default 1)\n");
+    printf("\t-i interval\tTime between rounds in ms (default 1000)\n");
+    printf("\t-c clock\tDuration of a short edge in us (default %d)\n", CRESTA_DEFAULT_CLOCK_US);
+    printf("\t-j jitter\tMaximum deviation of every edge in us (default 0)\n");
+    printf("\t-r repeats\tDatagrams per transmission (default %d)\n", CRESTA_DEFAULT_REPEATS);
+    printf("\t-g gap\t\tSilence between repeated datagrams in us (default %d)\n", CRESTA_DEFAULT_REPEAT_GAP_US);
+    printf("\t-N bursts\tNoise bursts per second (default 0)\n");
+    printf("\t-E edges\tEdges per noise burst (default 16)\n");
+    printf("\t-C probability\tProbability a transmission overlaps the previous one (0-1, default 0)\n");
+    printf("\t-s seed\t\tSeed for jitter, noise and collisions (default 1)\n");
+    printf("\t-f format\traw: edge records as written by cresta_capture, for crestad -r (default)\n");
+    printf("\t\t\ttext: one edge duration in us per line\n");
+    printf("\t\t\tdur32: 32 bit edge durations in us, for kernel injection\n");
+    printf("\t\t\tcu8, cs8, cs16, am16: samples of an SDR, for crestad -s\n");
+    printf("\t-R rate\t\tSamples per second (default %d)\n", CRESTA_SDR_DEFAULT_RATE);
+    printf("\t-q snr\t\tSignal to noise ratio of the samples in dB (default %d)\n", CRESTA_DEFAULT_SNR_DB);
+    printf("\t-o file\t\tOutput file (default stdout)\n");
+    printf("\t-v\t\tList generated datagrams on stderr\n");
+}
+
+int main(int argc, char *argv[]) {
+    struct cresta_signal_config config;
+    struct cresta_sample_config sample_config;
+    struct cresta_signal signal;
+    enum gen_format format = GEN_FORMAT_RAW;
+    const char *filename = NULL;
+    unsigned int rounds = 1;
+    unsigned int interval_ms = 1000;
+    double collisions = 0;
+    unsigned long transmissions = 0;
+    int verbose = 0;
+    FILE *out = stdout;
+    unsigned int round;
+    uint64_t previous_end = 0;
+    int ret;
+    int c;
+
+    cresta_signal_config_defaults(&config);
+    cresta_sample_config_defaults(&sample_config);
+    opterr = 0;
+
+    while ((c = getopt (argc, argv, "S:n:i:c:j:r:g:N:E:C:s:f:R:q:o:v")) != -1) {
+	switch (c) {
+	    case 'S': {
+		if(sensor_count == GEN_MAX_SENSORS || parse_sensor(optarg, &sensors[sensor_count])) {
+		    fprintf(stderr, "Invalid sensor: %s\n", optarg);
+		    return 1;
+		}
+		sensor_count++;
+		break;
+	    }
+	    case 'n': {
+		rounds = atoi(optarg);
+		break;
+	    }
+	    case 'i': {
+		interval_ms = atoi(optarg);
+		break;
+	    }
+	    case 'c': {
+		config.clock_us = atoi(optarg);
+		break;
+	    }
+	    case 'j': {
+		config.jitter_us = atoi(optarg);
+		break;
+	    }
+	    case 'r': {
+		config.repeats = atoi(optarg);
+		break;
+	    }
+	    case 'g': {
+		config.repeat_gap_us = atoi(optarg);
+		break;
+	    }
+	    case 'N': {
+		config.noise_bursts_per_second = atof(optarg);
+		break;
+	    }
+	    case 'E': {
+		config.noise_edges_per_burst = atoi(optarg);
+		break;
+	    }
+	    case 'C': {
+		collisions = atof(optarg);
+		break;
+	    }
+	    case 's': {
+		config.seed = strtoull(optarg, NULL, 0);
+		break;
+	    }
+	    case 'f': {
+		if(0 == strcmp(optarg, "raw")) {
+		    format = GEN_FORMAT_RAW;
+		} else if(0 == strcmp(optarg, "text")) {
+		    format = GEN_FORMAT_TEXT;
+		} else if(0 == strcmp(optarg, "dur32")) {
+		    format = GEN_FORMAT_DUR32;
+		} else if(0 == cresta_sdr_parse_format(optarg, &sample_config.format)) {
+		    format = GEN_FORMAT_SAMPLES;
+		} else {
+		    fprintf(stderr, "Unknown format: %s\n", optarg);
+		    return 1;
+		}
+		break;
+	    }
+	    case 'R': {
+		sample_config.rate = atoi(optarg);
+		break;
+	    }
+	    case 'q': {
+		sample_config.snr_db = atof(optarg);
+		break;
+	    }
+	    case 'o': {
+		filename = optarg;
+		break;
+	    }
+	    case 'v': {
+		verbose = 1;
+		break;
+	    }
+	    case '?': {
+		if (isprint (optopt))
+		    fprintf (stderr, "Unknown option or missing argument `-%c'.\n", optopt);
+		usage(argv[0]);
+		return 1;
+	    }
+	    default: {
+		abort ();
+	    }
+	}
+    }
+
+    if(0 == sensor_count || 0 == sample_config.rate) {
+	usage(argv[0]);
+	return -1;
+    }
+
+    cresta_signal_init(&signal, &config);
+
+    //sensors are spread evenly over the interval, unless they collide
+    for(round = 0; round < rounds; round++) {
+	uint64_t round_start = 1000000000ULL + (uint64_t) round * interval_ms * 1000000ULL;
+	uint64_t previous_start = round_start;
+	int i;
+
+	for(i = 0; i < sensor_count; i++) {
+	    uint64_t start = round_start + (uint64_t) i * interval_ms * 1000000ULL / sensor_count;
+
+	    if(i > 0 && collisions > 0 &&
+	       cresta_signal_random(&signal) % 1000000 < collisions * 1000000) {
+		start = previous_start + cresta_signal_random(&signal) % (previous_end - previous_start + 1);
+	    } else if(start < previous_end + config.repeat_gap_us * 1000ULL) {
+		//don't overlap by accident if the interval is too short
+		start = previous_end + config.repeat_gap_us * 1000ULL;
+	    }
+	    if(verbose) {
+		print_datagram(start, &sensors[i]);
+	    }
+	    previous_start = start;
+	    previous_end = cresta_signal_add_transmission(&signal, start, &sensors[i]);
+	    transmissions++;
+
+	    if(CRESTA_SENSOR_TYPE_RAIN == sensors[i].sensor_type) {
+		sensors[i].rain_ticks++;
+	    }
+	}
+    }
+
+    if(cresta_signal_add_noise(&signal, 1000000000ULL, signal.end_ns) || cresta_signal_render(&signal)) {
+	fprintf(stderr, "Out of memory\n");
+	cresta_signal_free(&signal);
+	return -1;
+    }
+
+    if(NULL != filename) {
+	out = fopen(filename, "wb");
+	if(NULL == out) {
+	    perror(filename);
+	    cresta_signal_free(&signal);
+	    return -1;
+	}
+    }
+
+    if(GEN_FORMAT_SAMPLES == format) {
+	ret = write_samples(out, &signal, &sample_config);
+    } else {
+	ret = write_signal(out, &signal, format);
+    }
+    if(ret) {
+	perror("Couldn't write signal");
+    }
+    if(out != stdout) {
+	fclose(out);
+    }
+
+    fprintf(stderr, "%lu transmissions, %lu datagrams, %zu edges\n", transmissions, transmissions * config.repeats, signal.edge_count);
+    cresta_signal_free(&signal);
+    return ret;
+}
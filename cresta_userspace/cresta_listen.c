@@ -0,0 +1,239 @@
+/*
+ * Listener of the module's generic netlink family.
+ *
+ * The family and its multicast group get their ids when the module is
+ * loaded, they are looked up by name via the generic netlink
+ * controller. Measurements are taken off the socket with recvmmsg, so
+ * a burst of them costs one system call.
+ *
+ * License: GPLv3. See license.txt
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include "cresta_listen.h"
+
+//replies of the controller list all groups and operations of a family
+#define CTRL_REPLY_LEN 4096
+
+struct ctrl_request {
+    struct nlmsghdr nlh;
+    struct genlmsghdr genl;
+    uint8_t attrs[NLA_HDRLEN + NLA_ALIGN(sizeof(CRESTA_GENL_NAME))];
+};
+
+
+static const void* attr_data(const struct nlattr *nla) {
+    return (const uint8_t*) nla + NLA_HDRLEN;
+}
+
+static int attr_len(const struct nlattr *nla) {
+    return nla->nla_len - NLA_HDRLEN;
+}
+
+/*
+ * Collects the attributes of a message or a nested attribute, later
+ * ones of the same type win. Unknown types are skipped
+ */
+static void parse_attrs(const void *data, int len, const struct nlattr **attrs, int max) {
+    const struct nlattr *nla = data;
+
+    memset(attrs, 0, (max + 1) * sizeof(attrs[0]));
+    while(len >= NLA_HDRLEN && nla->nla_len >= NLA_HDRLEN && nla->nla_len <= len) {
+	if((nla->nla_type & NLA_TYPE_MASK) <= max) {
+	    attrs[nla->nla_type & NLA_TYPE_MASK] = nla;
+	}
+	len -= NLA_ALIGN(nla->nla_len);
+	nla = (const struct nlattr*) ((const uint8_t*) nla + NLA_ALIGN(nla->nla_len));
+    }
+}
+
+/*
+ * Looks up the group in a CTRL_ATTR_MCAST_GROUPS attribute, a list of
+ * nested attributes, one per group
+ */
+static int find_group(const struct nlattr *groups, const char *name, uint32_t *id) {
+    const struct nlattr *group = attr_data(groups);
+    const struct nlattr *attrs[CTRL_ATTR_MCAST_GRP_MAX + 1];
+    int len = attr_len(groups);
+
+    while(len >= NLA_HDRLEN && group->nla_len >= NLA_HDRLEN && group->nla_len <= len) {
+	parse_attrs(attr_data(group), attr_len(group), attrs, CTRL_ATTR_MCAST_GRP_MAX);
+	if(NULL != attrs[CTRL_ATTR_MCAST_GRP_NAME] && NULL != attrs[CTRL_ATTR_MCAST_GRP_ID] &&
+	   0 == strncmp(attr_data(attrs[CTRL_ATTR_MCAST_GRP_NAME]), name, attr_len(attrs[CTRL_ATTR_MCAST_GRP_NAME]))) {
+	    memcpy(id, attr_data(attrs[CTRL_ATTR_MCAST_GRP_ID]), sizeof(*id));
+	    return 0;
+	}
+	len -= NLA_ALIGN(group->nla_len);
+	group = (const struct nlattr*) ((const uint8_t*) group + NLA_ALIGN(group->nla_len));
+    }
+    return -1;
+}
+
+/*
+ * Asks the controller for the ids of our family and group
+ */
+static int resolve_family(struct cresta_listener *listener) {
+    struct ctrl_request request;
+    struct nlattr *name = (struct nlattr*) request.attrs;
+    const struct nlattr *attrs[CTRL_ATTR_MAX + 1];
+    uint8_t reply[CTRL_REPLY_LEN];
+    const struct nlmsghdr *nlh = (const struct nlmsghdr*) reply;
+    ssize_t len;
+
+    memset(&request, 0, sizeof(request));
+    request.nlh.nlmsg_len = sizeof(request);
+    request.nlh.nlmsg_type = GENL_ID_CTRL;
+    request.nlh.nlmsg_flags = NLM_F_REQUEST;
+    request.nlh.nlmsg_seq = 1;
+    request.genl.cmd = CTRL_CMD_GETFAMILY;
+    request.genl.version = 1;
+    name->nla_type = CTRL_ATTR_FAMILY_NAME;
+    name->nla_len = NLA_HDRLEN + sizeof(CRESTA_GENL_NAME);
+    memcpy(request.attrs + NLA_HDRLEN, CRESTA_GENL_NAME, sizeof(CRESTA_GENL_NAME));
+
+    if(send(listener->fd, &request, sizeof(request), 0) < 0) {
+	return -1;
+    }
+    len = recv(listener->fd, reply, sizeof(reply), 0);
+    if(len < 0) {
+	return -1;
+    }
+    if(!NLMSG_OK(nlh, len)) {
+	errno = EPROTO;
+	return -1;
+    }
+    if(NLMSG_ERROR == nlh->nlmsg_type) {
+	//the controller doesn't know the family unless the module is loaded
+	const struct nlmsgerr *err = NLMSG_DATA(nlh);
+	errno = err->error ? -err->error : EPROTO;
+	return -1;
+    }
+
+    parse_attrs((const uint8_t*) NLMSG_DATA(nlh) + GENL_HDRLEN, nlh->nlmsg_len - NLMSG_HDRLEN - GENL_HDRLEN,
+		attrs, CTRL_ATTR_MAX);
+    if(NULL == attrs[CTRL_ATTR_FAMILY_ID] || NULL == attrs[CTRL_ATTR_MCAST_GROUPS] ||
+       find_group(attrs[CTRL_ATTR_MCAST_GROUPS], CRESTA_GENL_MCGRP_MEASUREMENTS, &listener->group_id)) {
+	errno = EPROTO;
+	return -1;
+    }
+    memcpy(&listener->family_id, attr_data(attrs[CTRL_ATTR_FAMILY_ID]), sizeof(listener->family_id));
+    return 0;
+}
+
+int cresta_listen_open(struct cresta_listener *listener) {
+    struct sockaddr_nl addr;
+
+    memset(listener, 0, sizeof(*listener));
+    listener->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+    if(listener->fd < 0) {
+	return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if(bind(listener->fd, (struct sockaddr*) &addr, sizeof(addr)) || resolve_family(listener) ||
+       setsockopt(listener->fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &listener->group_id, sizeof(listener->group_id))) {
+	int err = errno;
+
+	close(listener->fd);
+	listener->fd = -1;
+	errno = err;
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * Turns a measurement message into a record. Returns -1 for other
+ * messages and incomplete ones
+ */
+static int parse_measurement(struct cresta_listener *listener, const struct nlmsghdr *nlh,
+			     struct cresta_measurement_record *record) {
+    const struct genlmsghdr *genl = NLMSG_DATA(nlh);
+    const struct nlattr *attrs[CRESTA_GENL_ATTR_MAX + 1];
+
+    if(nlh->nlmsg_type != listener->family_id || nlh->nlmsg_len < NLMSG_HDRLEN + GENL_HDRLEN ||
+       CRESTA_GENL_CMD_MEASUREMENT != genl->cmd) {
+	return -1;
+    }
+    parse_attrs((const uint8_t*) genl + GENL_HDRLEN, nlh->nlmsg_len - NLMSG_HDRLEN - GENL_HDRLEN,
+		attrs, CRESTA_GENL_ATTR_MAX);
+    if(NULL == attrs[CRESTA_GENL_ATTR_ADDRESS] || NULL == attrs[CRESTA_GENL_ATTR_TYPE] ||
+       NULL == attrs[CRESTA_GENL_ATTR_TIMESTAMP] || NULL == attrs[CRESTA_GENL_ATTR_SEQUENCE] ||
+       NULL == attrs[CRESTA_GENL_ATTR_LEN] || NULL == attrs[CRESTA_GENL_ATTR_DATA] ||
+       attr_len(attrs[CRESTA_GENL_ATTR_DATA]) != CRESTA_MAXDATA_LEN) {
+	return -1;
+    }
+
+    memset(record, 0, sizeof(*record));
+    record->version = CRESTA_RECORD_VERSION;
+    record->header_len = offsetof(struct cresta_measurement_record, decrypted_data);
+    record->record_len = sizeof(*record);
+    memcpy(&record->timestamp_ns, attr_data(attrs[CRESTA_GENL_ATTR_TIMESTAMP]), sizeof(record->timestamp_ns));
+    memcpy(&record->sequence, attr_data(attrs[CRESTA_GENL_ATTR_SEQUENCE]), sizeof(record->sequence));
+    record->sensor_address = *(const uint8_t*) attr_data(attrs[CRESTA_GENL_ATTR_ADDRESS]);
+    record->sensor_type = *(const uint8_t*) attr_data(attrs[CRESTA_GENL_ATTR_TYPE]);
+    record->len = *(const uint8_t*) attr_data(attrs[CRESTA_GENL_ATTR_LEN]);
+    memcpy(record->decrypted_data, attr_data(attrs[CRESTA_GENL_ATTR_DATA]), CRESTA_MAXDATA_LEN);
+    return 0;
+}
+
+int cresta_listen_read(struct cresta_listener *listener, struct cresta_measurement_record *records, int count) {
+    struct mmsghdr msgs[CRESTA_LISTEN_BATCH];
+    struct iovec iov[CRESTA_LISTEN_BATCH];
+    int received;
+    int n = 0;
+    int i;
+
+    if(count > CRESTA_LISTEN_BATCH) {
+	count = CRESTA_LISTEN_BATCH;
+    }
+    memset(msgs, 0, count * sizeof(msgs[0]));
+    for(i = 0; i < count; i++) {
+	iov[i].iov_base = listener->buffers[i];
+	iov[i].iov_len = CRESTA_LISTEN_MSG_LEN;
+	msgs[i].msg_hdr.msg_iov = &iov[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while(0 == n) {
+	//blocks for the first message only
+	received = recvmmsg(listener->fd, msgs, count, MSG_WAITFORONE, NULL);
+	if(received < 0) {
+	    if(ENOBUFS == errno) {
+		//the kernel dropped messages, the socket works on
+		listener->overflows++;
+		continue;
+	    }
+	    if(EINTR == errno) {
+		continue;
+	    }
+	    return -1;
+	}
+
+	//the module sends one measurement per datagram
+	for(i = 0; i < received; i++) {
+	    const struct nlmsghdr *nlh = (const struct nlmsghdr*) listener->buffers[i];
+
+	    if(!(msgs[i].msg_hdr.msg_flags & MSG_TRUNC) && NLMSG_OK(nlh, msgs[i].msg_len) &&
+	       0 == parse_measurement(listener, nlh, &records[n])) {
+		n++;
+	    }
+	}
+    }
+    return n;
+}
+
+void cresta_listen_close(struct cresta_listener *listener) {
+    if(listener->fd >= 0) {
+	close(listener->fd);
+	listener->fd = -1;
+    }
+}
@@ -0,0 +1,45 @@
+/*
+ * Listener of the module's generic netlink family, see
+ * CRESTA_GENL_NAME in cresta_common.h. The module pushes every new
+ * measurement of any sensor to all listeners, so one socket replaces
+ * polling a device per sensor.
+ *
+ * License: GPLv3. See license.txt
+ */
+#ifndef _CRESTA_LISTEN_H_
+#define _CRESTA_LISTEN_H_
+
+#include <stdint.h>
+#include "../cresta_common/cresta_common.h"
+
+//messages received per system call at most
+#define CRESTA_LISTEN_BATCH   32
+
+//a measurement message is about 80 bytes
+#define CRESTA_LISTEN_MSG_LEN 256
+
+struct cresta_listener {
+    int fd;
+    uint16_t family_id;
+    uint32_t group_id;
+    uint64_t overflows;		//times measurements were lost, the socket's buffer was full
+    uint8_t buffers[CRESTA_LISTEN_BATCH][CRESTA_LISTEN_MSG_LEN];
+};
+
+/*
+ * Resolves the family and joins its multicast group. Fails with errno
+ * ENOENT if the module isn't loaded
+ */
+int cresta_listen_open(struct cresta_listener *listener);
+
+/*
+ * Waits for measurements and returns up to count of them as records,
+ * or -1 on errors. All messages already queued on the socket up to
+ * count are taken with one system call. Records have no flags set and
+ * the header of CRESTA_RECORD_VERSION
+ */
+int cresta_listen_read(struct cresta_listener *listener, struct cresta_measurement_record *records, int count);
+
+void cresta_listen_close(struct cresta_listener *listener);
+
+#endif
@@ -0,0 +1,417 @@
+/*
+ * Load generator for the kernel module. Simulates up to 255 sensors
+ * by injecting datagrams or edges via debugfs (see
+ * cresta_module/cresta_inject.c) and reports the sustained throughput
+ * of the pipeline and the latency until a datagram is readable from
+ * its sensor's device.
+ *
+ * License: GPLv3. See license.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include "cresta_decoder.h"
+#include "cresta_encoder.h"
+
+#define LOAD_DEBUGFS_DIR   "/sys/kernel/debug/cresta"
+#define LOAD_PARAMETER_DIR "/sys/module/cresta/parameters"
+#define LOAD_PROBE_DEVICE  "/dev/cresta_thermohygro_ch1"
+
+//the probe sensor transmits on thermohygro channel 1
+#define LOAD_PROBE_ADDRESS 0x21
+
+#define LOAD_MAX_SENSORS   255	//all addresses except the probe's
+#define LOAD_BATCH         256	//datagrams per write()
+#define LOAD_GAP_US        10000	//silence between datagrams in edge mode
+#define LOAD_MAX_PROBES    100000
+#define LOAD_PROBE_TIMEOUT_NS 2000000000ULL
+
+struct load_config {
+    int      sensors;
+    double   rate;		//datagrams per second and sensor
+    unsigned int seconds;
+    int      edges;		//inject edges instead of datagrams
+    const char *debugfs_dir;
+    const char *probe_device;
+    unsigned int probe_interval_ms;
+};
+
+struct load_stats {
+    unsigned long long offered;
+    unsigned long long accepted;
+    unsigned long long rejected;
+    unsigned long long edges;
+};
+
+struct probe_stats {
+    uint64_t *latencies_ns;
+    size_t   count;
+    unsigned long timeouts;
+};
+
+static struct load_config config = {
+    16, 1, 10, 0, LOAD_DEBUGFS_DIR, LOAD_PROBE_DEVICE, 100
+};
+static struct cresta_sensor_values sensors[LOAD_MAX_SENSORS];
+static struct load_stats stats;
+static struct probe_stats probes;
+static int inject_fd = -1;
+static pthread_mutex_t inject_mutex = PTHREAD_MUTEX_INITIALIZER;
+static volatile sig_atomic_t running = 1;
+
+
+static void handle_signal(int sig) {
+    running = 0;
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/*
+ * Reads a counter of the module, -1 if it isn't available
+ */
+static long long read_counter(const char *dir, const char *name) {
+    char path[256];
+    long long value = -1;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    fp = fopen(path, "r");
+    if(NULL != fp) {
+	if(fscanf(fp, "%lld", &value) != 1) {
+	    value = -1;
+	}
+	fclose(fp);
+    }
+    return value;
+}
+
+/*
+ * Addresses are handed out in order after the probe's, wrapping
+ * around, so all addresses except the probe's can be used.
+ * Sensors on the rain/UV/anemometer address range get one of
+ * these types, all others are thermohygro sensors
+ */
+static void init_sensors(void) {
+    uint8_t address = LOAD_PROBE_ADDRESS;
+    int i;
+
+    for(i = 0; i < config.sensors; i++) {
+	struct cresta_sensor_values *values = &sensors[i];
+
+	address++;
+
+	memset(values, 0, sizeof(*values));
+	values->sensor_address = address;
+	if((address & CRESTA_SENSOR_ADDR_MASK) == CRESTA_AM_RAIN_UV_ANEMO) {
+	    static const uint8_t types[] = { CRESTA_SENSOR_TYPE_ANEMOMETER, CRESTA_SENSOR_TYPE_UV, CRESTA_SENSOR_TYPE_RAIN };
+	    values->sensor_type = types[address % 3];
+	    values->temperature = 20.5;
+	    values->windspeed = 10;
+	    values->windgust = 15;
+	    values->uv_index = 3;
+	} else {
+	    values->sensor_type = CRESTA_SENSOR_TYPE_THERMOHYGRO;
+	    values->temperature = 21.5;
+	    values->humidity = 50;
+	}
+    }
+}
+
+/*
+ * Appends a datagram to buf in the format of the selected
+ * injection file, returns the number of bytes appended
+ */
+static size_t encode_datagram(const struct cresta_sensor_values *values, uint8_t *buf) {
+    uint8_t raw_data[CRESTA_MAXDATA_LEN] = { 0 };
+    size_t count;
+
+    cresta_encode_datagram(values, 1, raw_data);
+    if(!config.edges) {
+	memcpy(buf, raw_data, sizeof(raw_data));
+	return sizeof(raw_data);
+    }
+
+    count = cresta_manchester_encode(raw_data, CRESTA_DEFAULT_CLOCK_US, (uint32_t*) buf);
+    ((uint32_t*) buf)[count++] = LOAD_GAP_US;
+    stats.edges += count;
+    return count * sizeof(uint32_t);
+}
+
+/*
+ * Writes the buffer, returns the number of datagrams accepted
+ */
+static size_t inject(const uint8_t *buf, size_t len, size_t datagrams) {
+    ssize_t ret;
+
+    pthread_mutex_lock(&inject_mutex);
+    ret = write(inject_fd, buf, len);
+    pthread_mutex_unlock(&inject_mutex);
+
+    if(ret < 0) {
+	if(errno != EAGAIN) {
+	    perror("Couldn't inject");
+	    running = 0;
+	}
+	return 0;
+    }
+    //edges are always consumed, the module counts rejected datagrams
+    return config.edges ? datagrams : ret / CRESTA_MAXDATA_LEN;
+}
+
+/*
+ * Sends a datagram of the probe sensor with a unique temperature
+ * and waits until its device returns it
+ */
+static void *probe_thread(void *arg) {
+    uint8_t buf[CRESTA_MAX_DATAGRAM_EDGES * sizeof(uint32_t) + CRESTA_MAXDATA_LEN];
+    struct cresta_sensor_values values;
+    unsigned int sequence = 0;
+
+    memset(&values, 0, sizeof(values));
+    values.sensor_address = LOAD_PROBE_ADDRESS;
+    values.sensor_type = CRESTA_SENSOR_TYPE_THERMOHYGRO;
+    values.humidity = 50;
+
+    while(running && probes.count < LOAD_MAX_PROBES) {
+	uint8_t expected[CRESTA_MAXDATA_LEN] = { 0 };
+	struct cresta_measurement_record measurement;
+	uint64_t start;
+	size_t len;
+	int len_expected;
+
+	values.temperature = -30 + (sequence++ % 900) / 10.0;
+	//checksums are added by encryption, so compare the data only
+	len_expected = cresta_encode_values(&values, 1, expected) - 2;
+	len = encode_datagram(&values, buf);
+
+	start = monotonic_ns();
+	while(running && 0 == inject(buf, len, 1)) {
+	    usleep(100);
+	}
+
+	//the device makes a copy of the measurement on open
+	while(running) {
+	    int fd = open(config.probe_device, O_RDONLY);
+	    if(fd >= 0) {
+		ssize_t ret = read(fd, &measurement, sizeof(measurement));
+		close(fd);
+		if(ret == sizeof(measurement) && 0 == memcmp(measurement.decrypted_data, expected, len_expected)) {
+		    probes.latencies_ns[probes.count++] = monotonic_ns() - start;
+		    break;
+		}
+	    }
+	    if(monotonic_ns() - start > LOAD_PROBE_TIMEOUT_NS) {
+		probes.timeouts++;
+		break;
+	    }
+	    usleep(100);
+	}
+	usleep(config.probe_interval_ms * 1000);
+    }
+    return NULL;
+}
+
+static int compare_latencies(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Offers datagrams at the configured rate until the time is up
+ */
+static void run_load(void) {
+    static uint8_t buf[LOAD_BATCH * (CRESTA_MAX_DATAGRAM_EDGES + 1) * sizeof(uint32_t)];
+    double total_rate = config.sensors * config.rate;
+    uint64_t start = monotonic_ns();
+    uint64_t end = start + (uint64_t) config.seconds * 1000000000ULL;
+    int next_sensor = 0;
+
+    while(running && monotonic_ns() < end) {
+	unsigned long long due = (monotonic_ns() - start) / 1e9 * total_rate;
+	size_t datagrams = 0;
+	size_t len = 0;
+	size_t accepted;
+
+	if(due <= stats.offered) {
+	    usleep(1000);
+	    continue;
+	}
+	while(stats.offered + datagrams < due && datagrams < LOAD_BATCH) {
+	    struct cresta_sensor_values *values = &sensors[next_sensor];
+
+	    len += encode_datagram(values, buf + len);
+	    datagrams++;
+	    values->rain_ticks++;
+	    values->humidity = 20 + (values->humidity + 1) % 70;
+	    next_sensor = (next_sensor + 1) % config.sensors;
+	}
+
+	accepted = inject(buf, len, datagrams);
+	stats.offered += datagrams;
+	stats.accepted += accepted;
+	stats.rejected += datagrams - accepted;
+    }
+}
+
+static void usage(const char *name) {
+    printf("Usage: %s [-n sensors] [-r rate] [-t seconds] [-e] [-D dir] [-P device] [-i interval]\n", name);
+    printf("\t-n sensors\tNumber of simulated sensors (1-%d, default 16)\n", LOAD_MAX_SENSORS);
+    printf("\t-r rate\t\tDatagrams per second and sensor (default 1)\n");
+    printf("\t-t seconds\tDuration of the test (default 10)\n");
+    printf("\t-e\t\tInject edges, so the manchester decoder is part of the test\n");
+    printf("\t-D dir\t\tdebugfs directory of the module (default %s)\n", LOAD_DEBUGFS_DIR);
+    printf("\t-P device\tDevice of the latency probe sensor %#x (default %s)\n", LOAD_PROBE_ADDRESS, LOAD_PROBE_DEVICE);
+    printf("\t-i interval\tTime between latency probes in ms, 0 disables them (default 100)\n");
+}
+
+int main(int argc, char *argv[]) {
+    long long allocated;
+    long long failures;
+    long long injected;
+    long long rejected;
+    pthread_t prober;
+    int probing;
+    struct sigaction sa;
+    char path[256];
+    uint64_t start;
+    double seconds;
+    int c;
+
+    opterr = 0;
+
+    while ((c = getopt (argc, argv, "n:r:t:eD:P:i:")) != -1) {
+	switch (c) {
+	    case 'n': {
+		config.sensors = atoi(optarg);
+		break;
+	    }
+	    case 'r': {
+		config.rate = atof(optarg);
+		break;
+	    }
+	    case 't': {
+		config.seconds = atoi(optarg);
+		break;
+	    }
+	    case 'e': {
+		config.edges = 1;
+		break;
+	    }
+	    case 'D': {
+		config.debugfs_dir = optarg;
+		break;
+	    }
+	    case 'P': {
+		config.probe_device = optarg;
+		break;
+	    }
+	    case 'i': {
+		config.probe_interval_ms = atoi(optarg);
+		break;
+	    }
+	    case '?': {
+		if (isprint (optopt))
+		    fprintf (stderr, "Unknown option or missing argument `-%c'.\n", optopt);
+		usage(argv[0]);
+		return 1;
+	    }
+	    default: {
+		abort ();
+	    }
+	}
+    }
+
+    if(config.sensors < 1 || config.sensors > LOAD_MAX_SENSORS || config.rate <= 0) {
+	usage(argv[0]);
+	return 1;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", config.debugfs_dir, config.edges ? "inject_edges" : "inject_datagrams");
+    inject_fd = open(path, O_WRONLY);
+    if(inject_fd < 0) {
+	fprintf(stderr, "Couldn't open %s: %s\n", path, strerror(errno));
+	return -1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    init_sensors();
+    allocated = read_counter(LOAD_PARAMETER_DIR, "measurements_allocated");
+    failures = read_counter(LOAD_PARAMETER_DIR, "decrypt_failures");
+    injected = read_counter(config.debugfs_dir, "datagrams_injected");
+    rejected = read_counter(config.debugfs_dir, "datagrams_rejected");
+
+    probing = config.probe_interval_ms > 0;
+    if(probing) {
+	probes.latencies_ns = malloc(LOAD_MAX_PROBES * sizeof(uint64_t));
+	if(NULL == probes.latencies_ns || pthread_create(&prober, NULL, probe_thread, NULL)) {
+	    fprintf(stderr, "Couldn't start latency probe\n");
+	    return -1;
+	}
+    }
+
+    start = monotonic_ns();
+    run_load();
+    running = 0;
+    if(probing) {
+	pthread_join(prober, NULL);
+    }
+    seconds = (monotonic_ns() - start) / 1e9;
+
+    //give the module time to process what's queued
+    usleep(500000);
+    close(inject_fd);
+
+    printf("%d sensors, %.0f datagrams/s offered for %.1f s%s\n", config.sensors, config.sensors * config.rate, seconds,
+	   config.edges ? " as edges" : "");
+    printf("Offered %llu datagrams (%.0f/s), accepted %llu (%.0f/s), rejected %llu\n",
+	   stats.offered, stats.offered / seconds, stats.accepted, stats.accepted / seconds, stats.rejected);
+    if(config.edges) {
+	printf("Injected %llu edges (%.0f/s)\n", stats.edges, stats.edges / seconds);
+    }
+    if(injected >= 0 && rejected >= 0) {
+	printf("Module: %lld datagrams queued, %lld rejected (FIFO full)\n",
+	       read_counter(config.debugfs_dir, "datagrams_injected") - injected,
+	       read_counter(config.debugfs_dir, "datagrams_rejected") - rejected);
+    }
+    if(allocated >= 0 && failures >= 0) {
+	long long published = read_counter(LOAD_PARAMETER_DIR, "measurements_allocated") - allocated;
+	printf("Module: %lld measurements published (%.0f/s), %lld decrypt failures\n", published, published / seconds,
+	       read_counter(LOAD_PARAMETER_DIR, "decrypt_failures") - failures);
+    }
+
+    if(probing && probes.count > 0) {
+	uint64_t sum = 0;
+	size_t i;
+
+	qsort(probes.latencies_ns, probes.count, sizeof(uint64_t), compare_latencies);
+	for(i = 0; i < probes.count; i++) {
+	    sum += probes.latencies_ns[i];
+	}
+	printf("Publish latency (%zu probes, %lu timeouts): avg %llu us, p50 %llu us, p99 %llu us, max %llu us\n",
+	       probes.count, probes.timeouts,
+	       (unsigned long long) (sum / probes.count / 1000),
+	       (unsigned long long) (probes.latencies_ns[probes.count / 2] / 1000),
+	       (unsigned long long) (probes.latencies_ns[probes.count * 99 / 100] / 1000),
+	       (unsigned long long) (probes.latencies_ns[probes.count - 1] / 1000));
+    } else if(probing) {
+	printf("No latency probe succeeded (%lu timeouts), is %s the probe sensor's device?\n", probes.timeouts, config.probe_device);
+    }
+    free(probes.latencies_ns);
+    return 0;
+}
@@ -0,0 +1,188 @@
+/*
+ * Shared memory ring of measurement records.
+ *
+ * Single producer, any number of consumers. The producer never waits
+ * for consumers and consumers don't write to the ring at all, so a
+ * crashed or stopped consumer can't disturb crestad or the others.
+ * Consumers detect records overwritten while they copied them by
+ * checking head again afterwards, like readers of /dev/cresta_raw.
+ *
+ * License: GPLv3. See license.txt
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cresta_ring.h"
+
+
+static size_t ring_size(uint32_t record_count) {
+    return CRESTA_RING_HEADER_SIZE + (size_t) record_count * sizeof(struct cresta_measurement_record);
+}
+
+/*
+ * Maps an existing or new shared memory object of the given size
+ */
+static int map_ring(struct cresta_ring *ring, int fd, size_t size, int prot) {
+    ring->map = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+    if(MAP_FAILED == ring->map) {
+	ring->map = NULL;
+	return -1;
+    }
+    ring->size = size;
+    ring->header = ring->map;
+    ring->records = (uint8_t*) ring->map + CRESTA_RING_HEADER_SIZE;
+    ring->position = 0;
+    ring->overruns = 0;
+    return 0;
+}
+
+int cresta_ring_create(struct cresta_ring *ring, const char *name, uint32_t record_count) {
+    struct cresta_measurement_ring_header *header;
+    size_t size = ring_size(record_count);
+    struct stat st;
+    int fd;
+
+    if(0 == record_count || (record_count & (record_count - 1))) {
+	fprintf(stderr, "Ring size must be a power of 2\n");
+	return -1;
+    }
+
+    fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if(fd >= 0 && 0 == fstat(fd, &st) && st.st_size != 0 && st.st_size != size) {
+	//consumers may still map the old size, don't truncate it under them
+	close(fd);
+	shm_unlink(name);
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    }
+    if(fd < 0 || fstat(fd, &st) || (st.st_size != size && ftruncate(fd, size))) {
+	fprintf(stderr, "Couldn't create shared memory %s: %s\n", name, strerror(errno));
+	if(fd >= 0) {
+	    close(fd);
+	}
+	return -1;
+    }
+    if(map_ring(ring, fd, size, PROT_READ | PROT_WRITE)) {
+	fprintf(stderr, "Couldn't map shared memory %s: %s\n", name, strerror(errno));
+	close(fd);
+	return -1;
+    }
+    close(fd);
+
+    header = ring->header;
+    ring->record_count = record_count;
+    ring->record_len = sizeof(struct cresta_measurement_record);
+    if(header->magic == CRESTA_RING_MAGIC && header->version == CRESTA_RING_VERSION &&
+       header->header_size == CRESTA_RING_HEADER_SIZE && header->record_count == record_count &&
+       header->record_len == sizeof(struct cresta_measurement_record)) {
+	//left by a previous run, consumers just keep reading
+	return 0;
+    }
+
+    //consumers check the magic, so it is set last
+    header->magic = 0;
+    header->version = CRESTA_RING_VERSION;
+    header->header_size = CRESTA_RING_HEADER_SIZE;
+    header->record_count = record_count;
+    header->record_len = sizeof(struct cresta_measurement_record);
+    header->head = 0;
+    __atomic_store_n(&header->magic, CRESTA_RING_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void cresta_ring_publish(struct cresta_ring *ring, const struct cresta_measurement_record *record) {
+    struct cresta_measurement_ring_header *header = ring->header;
+    uint64_t head = header->head;
+
+    //consumers have to see head pass the slot's previous record before its data changes
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(ring->records + (head & (ring->record_count - 1)) * ring->record_len, record, sizeof(*record));
+    __atomic_store_n(&header->head, head + 1, __ATOMIC_RELEASE);
+}
+
+int cresta_ring_open(struct cresta_ring *ring, const char *name) {
+    struct cresta_measurement_ring_header *header;
+    uint32_t header_size;
+    struct stat st;
+    int fd = shm_open(name, O_RDONLY, 0);
+
+    if(fd < 0 || fstat(fd, &st) || st.st_size < CRESTA_RING_HEADER_SIZE ||
+       map_ring(ring, fd, st.st_size, PROT_READ)) {
+	fprintf(stderr, "Couldn't map shared memory %s: %s\n", name, strerror(errno));
+	if(fd >= 0) {
+	    close(fd);
+	}
+	return -1;
+    }
+    close(fd);
+
+    header = ring->header;
+    if(__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != CRESTA_RING_MAGIC || header->version != CRESTA_RING_VERSION) {
+	fprintf(stderr, "Unsupported measurement ring version\n");
+	cresta_ring_close(ring);
+	return -1;
+    }
+
+    //anybody may write the header, so its geometry is checked and used from copies
+    header_size = header->header_size;
+    ring->record_count = header->record_count;
+    ring->record_len = header->record_len;
+    if(header_size < sizeof(*header) || header_size > ring->size || ring->record_len < sizeof(struct cresta_measurement_record) ||
+       0 == ring->record_count || (ring->record_count & (ring->record_count - 1)) ||
+       (uint64_t) ring->record_count * ring->record_len > ring->size - header_size) {
+	fprintf(stderr, "Invalid measurement ring header\n");
+	cresta_ring_close(ring);
+	return -1;
+    }
+    ring->records = (uint8_t*) ring->map + header_size;
+
+    //start with the oldest record still in the ring
+    ring->position = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+    ring->position -= ring->position < ring->record_count ? ring->position : ring->record_count - 1;
+    return 0;
+}
+
+int cresta_ring_read(struct cresta_ring *ring, struct cresta_measurement_record *records, int count) {
+    const struct cresta_measurement_ring_header *header = ring->header;
+    uint64_t head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+    uint64_t torn;
+    int n = 0;
+
+    //the slot of position head - record_count is being overwritten
+    if(head - ring->position >= ring->record_count) {
+	ring->overruns += head - ring->position - (ring->record_count - 1);
+	ring->position = head - (ring->record_count - 1);
+    }
+
+    while(n < count && ring->position + n != head) {
+	memcpy(&records[n], ring->records + ((ring->position + n) & (ring->record_count - 1)) * ring->record_len, sizeof(records[0]));
+	n++;
+    }
+
+    //records overwritten while we copied them can't be trusted
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    head = __atomic_load_n(&header->head, __ATOMIC_RELAXED);
+    if(head - ring->position >= ring->record_count) {
+	torn = head - ring->position - (ring->record_count - 1);
+	if(torn > n) {
+	    torn = n;
+	}
+	memmove(records, records + torn, (n - torn) * sizeof(records[0]));
+	n -= torn;
+	ring->overruns += torn;
+	ring->position += torn;
+    }
+
+    ring->position += n;
+    return n;
+}
+
+void cresta_ring_close(struct cresta_ring *ring) {
+    if(NULL != ring->map) {
+	munmap(ring->map, ring->size);
+	ring->map = NULL;
+    }
+}
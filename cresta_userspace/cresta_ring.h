@@ -0,0 +1,59 @@
+/*
+ * Shared memory ring of measurement records, published by crestad
+ * and read by any number of local consumers, see
+ * struct cresta_measurement_ring_header in cresta_common.h.
+ *
+ * License: GPLv3. See license.txt
+ */
+#ifndef _CRESTA_RING_H_
+#define _CRESTA_RING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../cresta_common/cresta_common.h"
+
+//shared memory object crestad publishes to by default
+#define CRESTA_RING_NAME "/cresta"
+
+//records in the ring, about 20 minutes of 32 sensors
+#define CRESTA_RING_RECORDS 1024
+
+//offset of the first record, keeps head out of the records' cache lines
+#define CRESTA_RING_HEADER_SIZE 64
+
+/*
+ * A mapping of the ring. Consumers keep their own position, so each
+ * of them sees every measurement unless it falls behind by more than
+ * the size of the ring
+ */
+struct cresta_ring {
+    void *map;
+    size_t size;
+    struct cresta_measurement_ring_header *header;
+    uint8_t *records;
+    uint32_t record_count;	//validated copies of the shared header's
+    uint32_t record_len;
+    uint64_t position;		//next record to read, consumers only
+    uint64_t overruns;		//records lost by falling behind, consumers only
+};
+
+/*
+ * Producer side. Creates the ring or reuses an existing one of the
+ * same size, so consumers keep reading across restarts of crestad
+ */
+int  cresta_ring_create(struct cresta_ring *ring, const char *name, uint32_t record_count);
+void cresta_ring_publish(struct cresta_ring *ring, const struct cresta_measurement_record *record);
+
+/*
+ * Consumer side. Opening starts with the oldest record still in the
+ * ring, set position to head to skip them. Reading copies up to count
+ * records and returns their number, 0 if there is nothing new. It
+ * involves no system calls or locks, records lost by falling behind
+ * are added to overruns
+ */
+int  cresta_ring_open(struct cresta_ring *ring, const char *name);
+int  cresta_ring_read(struct cresta_ring *ring, struct cresta_measurement_record *records, int count);
+
+void cresta_ring_close(struct cresta_ring *ring);
+
+#endif
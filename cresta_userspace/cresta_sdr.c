@@ -0,0 +1,636 @@
+/*
+ * Front end for sample files of software defined radios.
+ *
+ * The power of every sample (I^2 + Q^2, or the amplitude squared) is
+ * computed in integers and summed up over CRESTA_SDR_DECIMATION
+ * samples. Single samples are too noisy for a threshold, the sums
+ * average out the noise and still resolve edges to a few microseconds,
+ * far less than the manchester decoder needs. The sums are compared
+ * against the threshold, giving a bit per sum. This runs with SSE2 or
+ * AVX2 on x86-64 and NEON on 64 bit ARM, 64 samples at a time. Edges
+ * are then found 64 bits at a time in the bit masks, so the per sample
+ * work is a few vector instructions, which keeps up with 2 MS/s many
+ * times over.
+ *
+ * The threshold is a fixed ratio above the envelope peaks of the noise.
+ * These are estimated from the maximum of blocks without signal, which
+ * all implementations compute exactly, so their edges are identical.
+ *
+ * License: GPLv3. See license.txt
+ */
+#include <string.h>
+#include <math.h>
+#include "cresta_sdr.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CRESTA_SDR_X86
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CRESTA_SDR_ARM64
+#endif
+
+//the noise estimate follows the block maximums by this fraction
+#define SDR_NOISE_SMOOTHING 8
+
+//blocks above the threshold for this long are taken as noise after all
+#define SDR_MAX_BUSY_S 1
+
+/*
+ * Sums up the power of count samples (a multiple of
+ * CRESTA_SDR_DECIMATION), sets a bit in mask for every sum above the
+ * threshold and returns the maximum sum
+ */
+typedef int32_t (*threshold_kernel)(const uint8_t *samples, enum cresta_sdr_format format, size_t count, int32_t threshold, uint64_t *mask);
+
+/*
+ * Power of sample n. 16 bit samples are quartered, so the
+ * sums of every format fit into an int32_t
+ */
+static inline int32_t sample_power(const uint8_t *samples, enum cresta_sdr_format format, size_t n) {
+    int32_t i;
+    int32_t q;
+
+    switch(format) {
+	case CRESTA_SDR_CU8: {
+	    //centered around 127.5, doubled to stay in integers
+	    i = 2 * samples[2 * n] - 255;
+	    q = 2 * samples[2 * n + 1] - 255;
+	    break;
+	}
+	case CRESTA_SDR_CS8: {
+	    i = (int8_t) samples[2 * n];
+	    q = (int8_t) samples[2 * n + 1];
+	    break;
+	}
+	case CRESTA_SDR_CS16: {
+	    i = (int16_t) (samples[4 * n] | samples[4 * n + 1] << 8) >> 2;
+	    q = (int16_t) (samples[4 * n + 2] | samples[4 * n + 3] << 8) >> 2;
+	    break;
+	}
+	default: {
+	    i = (int16_t) (samples[2 * n] | samples[2 * n + 1] << 8) >> 2;
+	    q = 0;
+	    break;
+	}
+    }
+    return i * i + q * q;
+}
+
+/*
+ * Sums from number first on. The vector implementations leave what
+ * doesn't fill 64 samples to this one
+ */
+static int32_t threshold_sums_scalar(const uint8_t *samples, enum cresta_sdr_format format, size_t first, size_t sums,
+				     int32_t threshold, uint64_t *mask) {
+    int32_t max = 0;
+    size_t sum;
+
+    for(sum = first; sum < first + sums; sum++) {
+	int32_t envelope = 0;
+	size_t n;
+
+	for(n = sum * CRESTA_SDR_DECIMATION; n < (sum + 1) * CRESTA_SDR_DECIMATION; n++) {
+	    envelope += sample_power(samples, format, n);
+	}
+	if(sum % 64 == 0) {
+	    mask[sum / 64] = 0;
+	}
+	mask[sum / 64] |= (uint64_t) (envelope > threshold) << (sum % 64);
+	if(envelope > max) {
+	    max = envelope;
+	}
+    }
+    return max;
+}
+
+static int32_t threshold_scalar(const uint8_t *samples, enum cresta_sdr_format format, size_t count, int32_t threshold, uint64_t *mask) {
+    return threshold_sums_scalar(samples, format, 0, count / CRESTA_SDR_DECIMATION, threshold, mask);
+}
+
+//8 bits of the sums from number sum on
+static inline void set_mask_bits(uint64_t *mask, size_t sum, uint32_t bits) {
+    if(sum % 64 == 0) {
+	mask[sum / 64] = 0;
+    }
+    mask[sum / 64] |= (uint64_t) bits << (sum % 64);
+}
+
+#ifdef CRESTA_SDR_X86
+/*
+ * Sum of the powers of 8 samples, in 4 lanes. Inlined with a constant
+ * format, so the switch is gone
+ */
+__attribute__((target("sse2"), always_inline))
+static inline __m128i power_sse2(const uint8_t *p, enum cresta_sdr_format format) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a;
+    __m128i b;
+
+    switch(format) {
+	case CRESTA_SDR_CU8: {
+	    const __m128i center = _mm_set1_epi16(255);
+	    __m128i v = _mm_loadu_si128((const __m128i*) p);
+
+	    a = _mm_sub_epi16(_mm_slli_epi16(_mm_unpacklo_epi8(v, zero), 1), center);
+	    b = _mm_sub_epi16(_mm_slli_epi16(_mm_unpackhi_epi8(v, zero), 1), center);
+	    break;
+	}
+	case CRESTA_SDR_CS8: {
+	    __m128i v = _mm_loadu_si128((const __m128i*) p);
+
+	    a = _mm_srai_epi16(_mm_unpacklo_epi8(zero, v), 8);
+	    b = _mm_srai_epi16(_mm_unpackhi_epi8(zero, v), 8);
+	    break;
+	}
+	case CRESTA_SDR_CS16: {
+	    a = _mm_srai_epi16(_mm_loadu_si128((const __m128i*) p), 2);
+	    b = _mm_srai_epi16(_mm_loadu_si128((const __m128i*) (p + 16)), 2);
+	    break;
+	}
+	default: {
+	    //amplitude next to a zero, so the pairs below give its square
+	    __m128i v = _mm_srai_epi16(_mm_loadu_si128((const __m128i*) p), 2);
+
+	    a = _mm_unpacklo_epi16(v, zero);
+	    b = _mm_unpackhi_epi16(v, zero);
+	    break;
+	}
+    }
+    //I*I + Q*Q of each pair
+    return _mm_add_epi32(_mm_madd_epi16(a, a), _mm_madd_epi16(b, b));
+}
+
+//sums of the lanes of 4 vectors, SSE2 has no phaddd
+__attribute__((target("sse2"), always_inline))
+static inline __m128i hsum4_sse2(__m128i a, __m128i b, __m128i c, __m128i d) {
+    __m128i ab = _mm_add_epi32(_mm_unpacklo_epi32(a, b), _mm_unpackhi_epi32(a, b));
+    __m128i cd = _mm_add_epi32(_mm_unpacklo_epi32(c, d), _mm_unpackhi_epi32(c, d));
+
+    return _mm_add_epi32(_mm_unpacklo_epi64(ab, cd), _mm_unpackhi_epi64(ab, cd));
+}
+
+//SSE2 lacks pmaxsd
+__attribute__((target("sse2"), always_inline))
+static inline __m128i max_sse2(__m128i a, __m128i b) {
+    __m128i greater = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(greater, a), _mm_andnot_si128(greater, b));
+}
+
+__attribute__((target("sse2"), always_inline))
+static inline int32_t threshold_sse2_format(const uint8_t *samples, enum cresta_sdr_format format, size_t count, int32_t threshold, uint64_t *mask) {
+    const __m128i limit = _mm_set1_epi32(threshold);
+    const size_t size = cresta_sdr_sample_size(format) * CRESTA_SDR_DECIMATION;
+    __m128i max = _mm_setzero_si128();
+    int32_t lanes[4];
+    int32_t tail;
+    size_t sum;
+    int k;
+
+    for(sum = 0; (sum + 8) * CRESTA_SDR_DECIMATION <= count; sum += 8) {
+	const uint8_t *p = samples + sum * size;
+	__m128i low = hsum4_sse2(power_sse2(p, format), power_sse2(p + size, format),
+				 power_sse2(p + 2 * size, format), power_sse2(p + 3 * size, format));
+	__m128i high = hsum4_sse2(power_sse2(p + 4 * size, format), power_sse2(p + 5 * size, format),
+				  power_sse2(p + 6 * size, format), power_sse2(p + 7 * size, format));
+
+	max = max_sse2(max, max_sse2(low, high));
+	set_mask_bits(mask, sum, _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(low, limit))) |
+				 _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(high, limit))) << 4);
+    }
+    _mm_storeu_si128((__m128i*) lanes, max);
+    tail = threshold_sums_scalar(samples, format, sum, count / CRESTA_SDR_DECIMATION - sum, threshold, mask);
+    for(k = 0; k < 4; k++) {
+	if(lanes[k] > tail) {
+	    tail = lanes[k];
+	}
+    }
+    return tail;
+}
+
+__attribute__((target("sse2")))
+static int32_t threshold_sse2(const uint8_t *samples, enum cresta_sdr_format format, size_t count, int32_t threshold, uint64_t *mask) {
+    switch(format) {
+	case CRESTA_SDR_CU8: {
+	    return threshold_sse2_format(samples, CRESTA_SDR_CU8, count, threshold, mask);
+	}
+	case CRESTA_SDR_CS8: {
+	    return threshold_sse2_format(samples, CRESTA_SDR_CS8, count, threshold, mask);
+	}
+	case CRESTA_SDR_CS16: {
+	    return threshold_sse2_format(samples, CRESTA_SDR_CS16, count, threshold, mask);
+	}
+	default: {
+	    return threshold_sse2_format(samples, CRESTA_SDR_AM16, count, threshold, mask);
+	}
+    }
+}
+
+/*
+ * Powers of 16 samples, the first 8 summed up into 4 lanes of the
+ * lower half, the others into the upper half. The 128 bit halves
+ * are processed separately by most AVX2 instructions, so this
+ * needs no shuffling across them
+ */
+__attribute__((target("avx2"), always_inline))
+static inline __m256i power_avx2(const uint8_t *p, enum cresta_sdr_format format) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i a;
+    __m256i b;
+
+    switch(format) {
+	case CRESTA_SDR_CU8: {
+	    const __m256i center = _mm256_set1_epi16(255);
+	    __m256i v = _mm256_loadu_si256((const __m256i*) p);
+
+	    a = _mm256_sub_epi16(_mm256_slli_epi16(_mm256_unpacklo_epi8(v, zero), 1), center);
+	    b = _mm256_sub_epi16(_mm256_slli_epi16(_mm256_unpackhi_epi8(v, zero), 1), center);
+	    break;
+	}
+	case CRESTA_SDR_CS8: {
+	    __m256i v = _mm256_loadu_si256((const __m256i*) p);
+
+	    a = _mm256_srai_epi16(_mm256_unpacklo_epi8(zero, v), 8);
+	    b = _mm256_srai_epi16(_mm256_unpackhi_epi8(zero, v), 8);
+	    break;
+	}
+	case CRESTA_SDR_CS16: {
+	    //8 samples per load, its halves are added up
+	    __m256i first = _mm256_srai_epi16(_mm256_loadu_si256((const __m256i*) p), 2);
+	    __m256i second = _mm256_srai_epi16(_mm256_loadu_si256((const __m256i*) (p + 32)), 2);
+
+	    first = _mm256_madd_epi16(first, first);
+	    second = _mm256_madd_epi16(second, second);
+	    return _mm256_add_epi32(_mm256_permute2x128_si256(first, second, 0x20),
+				    _mm256_permute2x128_si256(first, second, 0x31));
+	}
+	default: {
+	    __m256i v = _mm256_srai_epi16(_mm256_loadu_si256((const __m256i*) p), 2);
+
+	    a = _mm256_unpacklo_epi16(v, zero);
+	    b = _mm256_unpackhi_epi16(v, zero);
+	    break;
+	}
+    }
+    return _mm256_add_epi32(_mm256_madd_epi16(a, a), _mm256_madd_epi16(b, b));
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline int32_t threshold_avx2_format(const uint8_t *samples, enum cresta_sdr_format format, size_t count, int32_t threshold, uint64_t *mask) {
+    const __m256i limit = _mm256_set1_epi32(threshold);
+    //phaddd leaves the sums of even groups in the lower half
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    const size_t size = cresta_sdr_sample_size(format) * CRESTA_SDR_DECIMATION;
+    __m256i max = _mm256_setzero_si256();
+    int32_t lanes[8];
+    int32_t tail;
+    size_t sum;
+    int k;
+
+    for(sum = 0; (sum + 8) * CRESTA_SDR_DECIMATION <= count; sum += 8) {
+	const uint8_t *p = samples + sum * size;
+	__m256i envelope = _mm256_hadd_epi32(
+			       _mm256_hadd_epi32(power_avx2(p, format), power_avx2(p + 2 * size, format)),
+			       _mm256_hadd_epi32(power_avx2(p + 4 * size, format), power_avx2(p + 6 * size, format)));
+
+	envelope = _mm256_permutevar8x32_epi32(envelope, order);
+	max = _mm256_max_epi32(max, envelope);
+	set_mask_bits(mask, sum, _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(envelope, limit))));
+    }
+    _mm256_storeu_si256((__m256i*) lanes, max);
+    tail = threshold_sums_scalar(samples, format, sum, count / CRESTA_SDR_DECIMATION - sum, threshold, mask);
+    for(k = 0; k < 8; k++) {
+	if(lanes[k] > tail) {
+	    tail = lanes[k];
+	}
+    }
+    return tail;
+}
+
+__attribute__((target("avx2")))
+static int32_t threshold_avx2(const uint8_t *samples, enum cresta_sdr_format format, size_t count, int32_t threshold, uint64_t *mask) {
+    switch(format) {
+	case CRESTA_SDR_CU8: {
+	    return threshold_avx2_format(samples, CRESTA_SDR_CU8, count, threshold, mask);
+	}
+	case CRESTA_SDR_CS8: {
+	    return threshold_avx2_format(samples, CRESTA_SDR_CS8, count, threshold, mask);
+	}
+	case CRESTA_SDR_CS16: {
+	    return threshold_avx2_format(samples, CRESTA_SDR_CS16, count, threshold, mask);
+	}
+	default: {
+	    return threshold_avx2_format(samples, CRESTA_SDR_AM16, count, threshold, mask);
+	}
+    }
+}
+#endif
+
+#ifdef CRESTA_SDR_ARM64
+//sum of the powers of 8 samples, in 4 lanes
+static inline int32x4_t power_neon(const uint8_t *p, enum cresta_sdr_format format) {
+    int16x8_t i;
+    int16x8_t q;
+
+    switch(format) {
+	case CRESTA_SDR_CU8: {
+	    //vld2 splits I and Q
+	    uint8x8x2_t iq = vld2_u8(p);
+	    const int16x8_t center = vdupq_n_s16(255);
+
+	    i = vsubq_s16(vreinterpretq_s16_u16(vshll_n_u8(iq.val[0], 1)), center);
+	    q = vsubq_s16(vreinterpretq_s16_u16(vshll_n_u8(iq.val[1], 1)), center);
+	    break;
+	}
+	case CRESTA_SDR_CS8: {
+	    int8x8x2_t iq = vld2_s8((const int8_t*) p);
+
+	    i = vmovl_s8(iq.val[0]);
+	    q = vmovl_s8(iq.val[1]);
+	    break;
+	}
+	case CRESTA_SDR_CS16: {
+	    int16x8x2_t iq = vld2q_s16((const int16_t*) p);
+
+	    i = vshrq_n_s16(iq.val[0], 2);
+	    q = vshrq_n_s16(iq.val[1], 2);
+	    break;
+	}
+	default: {
+	    i = vshrq_n_s16(vld1q_s16((const int16_t*) p), 2);
+	    return vmlal_high_s16(vmull_s16(vget_low_s16(i), vget_low_s16(i)), i, i);
+	}
+    }
+    return vaddq_s32(vmlal_s16(vmull_s16(vget_low_s16(i), vget_low_s16(i)), vget_low_s16(q), vget_low_s16(q)),
+		     vmlal_high_s16(vmull_high_s16(i, i), q, q));
+}
+
+//sums of the lanes of 4 vectors
+static inline int32x4_t hsum4_neon(int32x4_t a, int32x4_t b, int32x4_t c, int32x4_t d) {
+    return vpaddq_s32(vpaddq_s32(a, b), vpaddq_s32(c, d));
+}
+
+static inline __attribute__((always_inline)) int32_t threshold_neon_format(const uint8_t *samples, enum cresta_sdr_format format, size_t count, int32_t threshold, uint64_t *mask) {
+    static const uint32_t weights[4] = { 1, 2, 4, 8 };
+    const uint32x4_t bit = vld1q_u32(weights);
+    const int32x4_t limit = vdupq_n_s32(threshold);
+    const size_t size = cresta_sdr_sample_size(format) * CRESTA_SDR_DECIMATION;
+    int32x4_t max = vdupq_n_s32(0);
+    int32_t tail;
+    size_t sum;
+
+    for(sum = 0; (sum + 8) * CRESTA_SDR_DECIMATION <= count; sum += 8) {
+	const uint8_t *p = samples + sum * size;
+	int32x4_t low = hsum4_neon(power_neon(p, format), power_neon(p + size, format),
+				   power_neon(p + 2 * size, format), power_neon(p + 3 * size, format));
+	int32x4_t high = hsum4_neon(power_neon(p + 4 * size, format), power_neon(p + 5 * size, format),
+				    power_neon(p + 6 * size, format), power_neon(p + 7 * size, format));
+
+	max = vmaxq_s32(max, vmaxq_s32(low, high));
+	//no movemask on ARM, the lanes' bits are summed up instead
+	set_mask_bits(mask, sum, vaddvq_u32(vandq_u32(vcgtq_s32(low, limit), bit)) |
+				 vaddvq_u32(vandq_u32(vcgtq_s32(high, limit), bit)) << 4);
+    }
+    tail = threshold_sums_scalar(samples, format, sum, count / CRESTA_SDR_DECIMATION - sum, threshold, mask);
+    return vmaxvq_s32(max) > tail ? vmaxvq_s32(max) : tail;
+}
+
+static int32_t threshold_neon(const uint8_t *samples, enum cresta_sdr_format format, size_t count, int32_t threshold, uint64_t *mask) {
+    switch(format) {
+	case CRESTA_SDR_CU8: {
+	    return threshold_neon_format(samples, CRESTA_SDR_CU8, count, threshold, mask);
+	}
+	case CRESTA_SDR_CS8: {
+	    return threshold_neon_format(samples, CRESTA_SDR_CS8, count, threshold, mask);
+	}
+	case CRESTA_SDR_CS16: {
+	    return threshold_neon_format(samples, CRESTA_SDR_CS16, count, threshold, mask);
+	}
+	default: {
+	    return threshold_neon_format(samples, CRESTA_SDR_AM16, count, threshold, mask);
+	}
+    }
+}
+#endif
+
+static const char *format_names[CRESTA_SDR_FORMAT_COUNT] = { "cu8", "cs8", "cs16", "am16" };
+
+static const char *impl_names[CRESTA_SDR_IMPL_COUNT] = { "scalar", "sse2", "avx2", "neon" };
+
+static const threshold_kernel kernels[CRESTA_SDR_IMPL_COUNT] = {
+    threshold_scalar,
+#ifdef CRESTA_SDR_X86
+    threshold_sse2,
+    threshold_avx2,
+#else
+    NULL,
+    NULL,
+#endif
+#ifdef CRESTA_SDR_ARM64
+    threshold_neon,
+#else
+    NULL,
+#endif
+};
+
+//CRESTA_SDR_IMPL_COUNT until the first block or cresta_sdr_select
+static int selected = CRESTA_SDR_IMPL_COUNT;
+
+
+int cresta_sdr_parse_format(const char *name, enum cresta_sdr_format *format) {
+    int i;
+
+    for(i = 0; i < CRESTA_SDR_FORMAT_COUNT; i++) {
+	if(0 == strcmp(name, format_names[i])) {
+	    *format = i;
+	    return 0;
+	}
+    }
+    return -1;
+}
+
+const char* cresta_sdr_format_name(enum cresta_sdr_format format) {
+    if(format < 0 || format >= CRESTA_SDR_FORMAT_COUNT) {
+	return "unknown";
+    }
+    return format_names[format];
+}
+
+static int is_supported(enum cresta_sdr_impl impl) {
+    if(impl < 0 || impl >= CRESTA_SDR_IMPL_COUNT || NULL == kernels[impl]) {
+	return 0;
+    }
+#ifdef CRESTA_SDR_X86
+    if(CRESTA_SDR_SSE2 == impl) {
+	return __builtin_cpu_supports("sse2");
+    }
+    if(CRESTA_SDR_AVX2 == impl) {
+	return __builtin_cpu_supports("avx2");
+    }
+#endif
+    return 1;
+}
+
+int cresta_sdr_select(enum cresta_sdr_impl impl) {
+    if(!is_supported(impl)) {
+	return -1;
+    }
+    __atomic_store_n(&selected, impl, __ATOMIC_RELAXED);
+    return 0;
+}
+
+enum cresta_sdr_impl cresta_sdr_selected(void) {
+    int impl = __atomic_load_n(&selected, __ATOMIC_RELAXED);
+
+    if(CRESTA_SDR_IMPL_COUNT == impl) {
+	for(impl = CRESTA_SDR_IMPL_COUNT - 1; !is_supported(impl); impl--);
+	__atomic_store_n(&selected, impl, __ATOMIC_RELAXED);
+    }
+    return impl;
+}
+
+const char* cresta_sdr_name(enum cresta_sdr_impl impl) {
+    if(impl < 0 || impl >= CRESTA_SDR_IMPL_COUNT) {
+	return "unknown";
+    }
+    return impl_names[impl];
+}
+
+void cresta_sdr_init(struct cresta_sdr *sdr, enum cresta_sdr_format format, uint32_t rate, double level_db,
+		     cresta_sdr_edge_fn edge, void *arg) {
+    memset(sdr, 0, sizeof(*sdr));
+    sdr->format = format;
+    sdr->rate = rate;
+    sdr->level = lround(pow(10, level_db / 10) * 256);
+    sdr->glitch = (uint64_t) rate * CRESTA_SDR_GLITCH_US / 1000000;
+    sdr->edge = edge;
+    sdr->arg = arg;
+    sdr->noise = -1;
+    //nothing is above it until the noise of the first block is known
+    sdr->threshold = INT32_MAX;
+}
+
+/*
+ * Without overflows for captures of any length
+ */
+static uint64_t sample_to_ns(const struct cresta_sdr *sdr, uint64_t sample) {
+    return sample / sdr->rate * 1000000000ULL + sample % sdr->rate * 1000000000ULL / sdr->rate;
+}
+
+/*
+ * Glitch filter. Every edge is held back until the next one is known
+ * to be far enough away, or to come close enough to take both out
+ */
+static void add_edge(struct cresta_sdr *sdr, uint64_t sample, uint32_t level) {
+    if(sdr->pending && sample - sdr->pending_sample < sdr->glitch) {
+	sdr->pending = 0;
+	return;
+    }
+    if(sdr->pending) {
+	sdr->edge(sdr->arg, sample_to_ns(sdr, sdr->pending_sample), sdr->pending_level);
+    }
+    sdr->pending = 1;
+    sdr->pending_sample = sample;
+    sdr->pending_level = level;
+}
+
+/*
+ * Finds the edges in the bit masks of the sums of a block
+ */
+static void find_edges(struct cresta_sdr *sdr, size_t sums) {
+    size_t word;
+
+    for(word = 0; word * 64 < sums; word++) {
+	uint64_t bits = sdr->mask[word];
+	size_t valid = sums - word * 64 < 64 ? sums - word * 64 : 64;
+	uint64_t changes = bits ^ (bits << 1 | sdr->signal_level);
+
+	if(valid < 64) {
+	    changes &= (1ULL << valid) - 1;
+	}
+	while(changes) {
+	    int bit = __builtin_ctzll(changes);
+
+	    add_edge(sdr, sdr->samples + (word * 64 + bit) * CRESTA_SDR_DECIMATION, (bits >> bit) & 1);
+	    changes &= changes - 1;
+	}
+	sdr->signal_level = (bits >> (valid - 1)) & 1;
+    }
+
+    //no edge can come close enough anymore
+    if(sdr->pending && sdr->samples + sums * CRESTA_SDR_DECIMATION - sdr->pending_sample >= sdr->glitch) {
+	sdr->edge(sdr->arg, sample_to_ns(sdr, sdr->pending_sample), sdr->pending_level);
+	sdr->pending = 0;
+    }
+}
+
+/*
+ * Follows the noise with the maximum of blocks staying below the
+ * threshold. A signal switched on for good would never let the
+ * threshold adapt, so long runs of busy blocks count as noise as well
+ */
+static void update_threshold(struct cresta_sdr *sdr, int32_t max) {
+    int64_t threshold;
+
+    if(sdr->noise < 0) {
+	sdr->noise = max;
+    } else if(max <= sdr->threshold) {
+	sdr->noise += (max - sdr->noise) / SDR_NOISE_SMOOTHING;
+	sdr->busy_blocks = 0;
+    } else if(++sdr->busy_blocks > (uint64_t) sdr->rate * SDR_MAX_BUSY_S / CRESTA_SDR_BLOCK) {
+	sdr->noise += (max - sdr->noise) / SDR_NOISE_SMOOTHING;
+    }
+    threshold = sdr->noise * sdr->level >> 8;
+    sdr->threshold = threshold > INT32_MAX ? INT32_MAX : threshold;
+}
+
+static void process_block(struct cresta_sdr *sdr, const uint8_t *samples, size_t count) {
+    int32_t max = kernels[cresta_sdr_selected()](samples, sdr->format, count, sdr->threshold, sdr->mask);
+
+    find_edges(sdr, count / CRESTA_SDR_DECIMATION);
+    update_threshold(sdr, max);
+    sdr->samples += count;
+}
+
+void cresta_sdr_process(struct cresta_sdr *sdr, const void *data, size_t len) {
+    const uint8_t *bytes = data;
+    size_t block_size = CRESTA_SDR_BLOCK * cresta_sdr_sample_size(sdr->format);
+
+    //blocks always start at the same samples, however the data comes in
+    if(sdr->partial) {
+	size_t n = block_size - sdr->partial < len ? block_size - sdr->partial : len;
+
+	memcpy(sdr->buffer + sdr->partial, bytes, n);
+	sdr->partial += n;
+	bytes += n;
+	len -= n;
+	if(sdr->partial < block_size) {
+	    return;
+	}
+	process_block(sdr, sdr->buffer, CRESTA_SDR_BLOCK);
+	sdr->partial = 0;
+    }
+
+    for(; len >= block_size; bytes += block_size, len -= block_size) {
+	process_block(sdr, bytes, CRESTA_SDR_BLOCK);
+    }
+
+    memcpy(sdr->buffer, bytes, len);
+    sdr->partial = len;
+}
+
+/*
+ * Samples not filling a sum at the very end are dropped
+ */
+void cresta_sdr_flush(struct cresta_sdr *sdr) {
+    size_t count = sdr->partial / cresta_sdr_sample_size(sdr->format) / CRESTA_SDR_DECIMATION * CRESTA_SDR_DECIMATION;
+
+    if(count) {
+	process_block(sdr, sdr->buffer, count);
+    }
+    sdr->partial = 0;
+    if(sdr->pending) {
+	sdr->edge(sdr->arg, sample_to_ns(sdr, sdr->pending_sample), sdr->pending_level);
+	sdr->pending = 0;
+    }
+}
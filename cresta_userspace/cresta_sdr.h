@@ -0,0 +1,107 @@
+/*
+ * Front end for sample files of software defined radios, e.g. IQ
+ * captures of rtl_sdr. Turns the samples into the edges a 433MHz
+ * receiver would produce, so they can be fed into the manchester
+ * decoder like the edges of the GPIO line.
+ *
+ * The envelope (power summed up over CRESTA_SDR_DECIMATION samples) is
+ * compared against a threshold above the noise, which is estimated
+ * from blocks without signal. Pulses shorter than the glitch time are
+ * dropped.
+ *
+ * Results don't depend on how the samples are split up into calls of
+ * cresta_sdr_process, nor on the implementation used.
+ *
+ * License: GPLv3. See license.txt
+ */
+#ifndef _CRESTA_SDR_H_
+#define _CRESTA_SDR_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+//samples are thresholded in blocks of this size, the noise is estimated per block
+#define CRESTA_SDR_BLOCK 4096
+
+//samples per value of the envelope, 4 to 8 us at 1 to 2 MS/s
+#define CRESTA_SDR_DECIMATION 8
+
+#define CRESTA_SDR_DEFAULT_RATE     1024000
+#define CRESTA_SDR_DEFAULT_LEVEL_DB 3
+#define CRESTA_SDR_GLITCH_US        20
+
+enum cresta_sdr_format {
+    CRESTA_SDR_CU8,	//interleaved unsigned 8 bit I and Q, as written by rtl_sdr
+    CRESTA_SDR_CS8,	//interleaved signed 8 bit I and Q, e.g. hackrf_transfer
+    CRESTA_SDR_CS16,	//interleaved signed 16 bit I and Q, little endian
+    CRESTA_SDR_AM16,	//signed 16 bit amplitude, little endian
+    CRESTA_SDR_FORMAT_COUNT
+};
+
+enum cresta_sdr_impl {
+    CRESTA_SDR_SCALAR,
+    CRESTA_SDR_SSE2,
+    CRESTA_SDR_AVX2,
+    CRESTA_SDR_NEON,
+    CRESTA_SDR_IMPL_COUNT
+};
+
+/*
+ * Called for every edge, timestamp_ns counts from the first sample,
+ * level is the level after the edge
+ */
+typedef void (*cresta_sdr_edge_fn)(void *arg, uint64_t timestamp_ns, uint32_t level);
+
+struct cresta_sdr {
+    enum cresta_sdr_format format;
+    uint32_t rate;			//samples per second
+    uint32_t level;			//ratio of the threshold to the noise peaks, in 1/256
+    uint32_t glitch;			//in samples
+    cresta_sdr_edge_fn edge;
+    void *arg;
+
+    uint64_t samples;			//thresholded so far
+    int64_t  noise;			//estimated peak envelope of the noise, -1 until the first block
+    int32_t  threshold;
+    uint32_t busy_blocks;		//in a row without a quiet one
+    uint32_t signal_level;		//after the last sample
+    uint64_t pending_sample;		//edge held back by the glitch filter
+    uint32_t pending_level;
+    int      pending;
+
+    size_t   partial;			//bytes of an incomplete block in buffer
+    uint64_t mask[CRESTA_SDR_BLOCK / CRESTA_SDR_DECIMATION / 64];
+    uint8_t  buffer[CRESTA_SDR_BLOCK * 4];
+};
+
+static inline size_t cresta_sdr_sample_size(enum cresta_sdr_format format) {
+    return CRESTA_SDR_CS16 == format ? 4 : 2;
+}
+
+int         cresta_sdr_parse_format(const char *name, enum cresta_sdr_format *format);
+const char* cresta_sdr_format_name(enum cresta_sdr_format format);
+
+/*
+ * The fastest implementation the CPU supports is used by default.
+ * Selecting one the CPU or build doesn't support returns -1
+ */
+int                  cresta_sdr_select(enum cresta_sdr_impl impl);
+enum cresta_sdr_impl cresta_sdr_selected(void);
+const char*          cresta_sdr_name(enum cresta_sdr_impl impl);
+
+/*
+ * level_db is the threshold above the peaks of the noise, in dB
+ */
+void cresta_sdr_init(struct cresta_sdr *sdr, enum cresta_sdr_format format, uint32_t rate, double level_db,
+		     cresta_sdr_edge_fn edge, void *arg);
+
+/*
+ * Takes any number of bytes of samples. Full blocks are processed
+ * right away, the rest waits for more or cresta_sdr_flush
+ */
+void cresta_sdr_process(struct cresta_sdr *sdr, const void *data, size_t len);
+
+//processes what is left at the end of the samples
+void cresta_sdr_flush(struct cresta_sdr *sdr);
+
+#endif
@@ -0,0 +1,542 @@
+/*
+ * User space receiver for wireless weather station sensor data (433MHz).
+ *
+ * Reads timestamped edges of the 433MHz receiver from the GPIO character
+ * device (line event interface) and runs them through the same manchester
+ * decoder and decryption as the kernel module, see
+ * cresta_common/cresta_protocol.h. This way no kernel module has to be
+ * built for every kernel update.
+ *
+ * Measurements are published as files in an output directory, one per
+ * sensor. File names and file format are the same as for the
+ * /dev/cresta_* devices of the kernel module, so the cresta tool can
+ * read them with -c.
+ *
+ * With -m, measurements are also published into a shared memory ring,
+ * so local consumers get them decoded once without polling the files,
+ * see cresta_ring.h.
+ *
+ * Edge captures of /dev/cresta_raw (see cresta_capture) can be replayed
+ * through the same pipeline for offline analysis. So can sample files
+ * of software defined radios, which are turned into edges first, see
+ * cresta_sdr.h.
+ *
+ * License: GPLv3. See license.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <linux/gpio.h>
+#include "../cresta_common/cresta_protocol.h"
+#include "cresta_decoder.h"
+#include "cresta_ring.h"
+#include "cresta_sdr.h"
+
+//defaults match the kernel module
+#define CRESTAD_GPIO_CHIP   "/dev/gpiochip0"
+#define CRESTAD_GPIO_LINE   27
+#define CRESTAD_OUTPUT_DIR  "/run/cresta"
+#define CRESTAD_CONSUMER    "crestad"
+
+//number of edge events fetched per read()
+#define CRESTAD_EVENT_BATCH 64
+
+//bytes of samples fetched per read, 16 to 32 ms at 1 MS/s
+#define CRESTAD_SAMPLE_BATCH 65536
+
+/*
+ * Sensors we have seen so far, indexed by sensor address
+ */
+struct crestad_sensor {
+    int  known;
+    char name[64];
+    struct cresta_measurement_record last;	//last measurement, sequence 0 if none
+};
+
+/*
+ * Base names handed out so far, needed for numbering
+ * multiple sensors of the same kind
+ */
+struct crestad_name_count {
+    const char *base;
+    int count;
+};
+
+struct crestad_stats {
+    unsigned long edges;
+    unsigned long packets;
+    unsigned long valid;
+    unsigned long published;
+    unsigned long repeated;
+    uint64_t latency_sum_ns;
+    uint64_t latency_max_ns;
+    uint64_t samples;		//of sample files
+    uint32_t sample_rate;
+};
+
+static struct crestad_sensor sensors[256];
+static struct crestad_name_count name_counts[16];
+static struct crestad_stats stats;
+static const char *output_dir = CRESTAD_OUTPUT_DIR;
+static struct cresta_ring ring;
+static int publish = 1;
+static int replay = 0;
+static int verbose = 0;
+static volatile sig_atomic_t running = 1;
+
+
+static void handle_signal(int sig) {
+    running = 0;
+}
+
+static uint64_t realtime_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/*
+ * Assigns a file name to a new sensor, following the naming
+ * scheme of the kernel module
+ */
+static int name_sensor(uint8_t sensor_address, uint8_t sensor_type) {
+    struct crestad_sensor *sensor = &sensors[sensor_address];
+    const char *base = cresta_sensor_base_name(sensor_type, sensor_address);
+    int i;
+
+    if(NULL == base) {
+	return -1;
+    }
+
+    for(i = 0; i < sizeof(name_counts) / sizeof(name_counts[0]); i++) {
+	if(NULL == name_counts[i].base || 0 == strcmp(name_counts[i].base, base)) {
+	    name_counts[i].base = base;
+	    break;
+	}
+    }
+    if(i == sizeof(name_counts) / sizeof(name_counts[0])) {
+	return -1;
+    }
+
+    if(++name_counts[i].count == 1) {
+	snprintf(sensor->name, sizeof(sensor->name), "%s", base);
+    } else {
+	snprintf(sensor->name, sizeof(sensor->name), "%s_%d", base, name_counts[i].count);
+    }
+    sensor->known = 1;
+    printf("Received data of new sensor %02x. Publishing as %s/%s\n", sensor_address, output_dir, sensor->name);
+    return 0;
+}
+
+/*
+ * Writes the measurement to the sensor's file. The file is replaced
+ * atomically, so readers never see partial data
+ */
+static int publish_measurement(struct cresta_measurement_data *data) {
+    struct crestad_sensor *sensor = &sensors[data->sensor_address];
+    char path[256];
+    char tmppath[256];
+    int fd;
+
+    if(!sensor->known && name_sensor(data->sensor_address, data->sensor_type)) {
+	if(verbose) {
+	    printf("Ignoring sensor %02x of unknown type %x\n", data->sensor_address, data->sensor_type);
+	}
+	return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", output_dir, sensor->name);
+    snprintf(tmppath, sizeof(tmppath), "%s/.%s.tmp", output_dir, sensor->name);
+
+    fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0444);
+    if(fd < 0) {
+	fprintf(stderr, "Couldn't open %s: %s\n", tmppath, strerror(errno));
+	return -1;
+    }
+    if(write(fd, &data->measurement, sizeof(data->measurement)) != sizeof(data->measurement)) {
+	fprintf(stderr, "Couldn't write %s: %s\n", tmppath, strerror(errno));
+	close(fd);
+	unlink(tmppath);
+	return -1;
+    }
+    close(fd);
+
+    if(rename(tmppath, path)) {
+	fprintf(stderr, "Couldn't rename %s: %s\n", tmppath, strerror(errno));
+	unlink(tmppath);
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * Decrypts a datagram completed by the manchester decoder
+ * and publishes it. Counterpart of handle_encrypted_sensor_data
+ * in the kernel module
+ */
+static void handle_packet(const uint8_t *packet, uint64_t edge_time_ns) {
+    struct cresta_measurement_data data;
+    struct crestad_sensor *sensor;
+    uint64_t latency;
+
+    stats.packets++;
+    memset(&data, 0, sizeof(data));
+    memcpy(data.measurement.decrypted_data, packet, sizeof(data.measurement.decrypted_data));
+    if(decrypt_and_check(data.measurement.decrypted_data)) {
+	return;
+    }
+    stats.valid++;
+
+    data.sensor_address = get_sensor_address_from_decrypted_data(data.measurement.decrypted_data);
+    data.len            = get_packet_length_from_decrypted_data(data.measurement.decrypted_data);
+    data.sensor_type    = get_sensor_type_from_decrypted_data(data.measurement.decrypted_data);
+    //replays run much faster than the sensors sent, only the edge times
+    //keep their transmissions apart, see cresta_is_repeated_transmission
+    cresta_init_measurement_record(&data, replay ? edge_time_ns : realtime_ns());
+
+    //numbered like the kernel module does, repetitions aren't published
+    sensor = &sensors[data.sensor_address];
+    if(sensor->last.sequence && cresta_is_repeated_transmission(&sensor->last, &data.measurement)) {
+	stats.repeated++;
+	return;
+    }
+    data.measurement.sequence = sensor->last.sequence + 1;
+    sensor->last = data.measurement;
+
+    if(NULL != ring.map) {
+	cresta_ring_publish(&ring, &data.measurement);
+    }
+
+    if(publish) {
+	if(publish_measurement(&data)) {
+	    return;
+	}
+	stats.published++;
+    }
+
+    //edge timestamps are CLOCK_MONOTONIC, so we can tell how long we took
+    if(!replay) {
+	latency = monotonic_ns() - edge_time_ns;
+	stats.latency_sum_ns += latency;
+	if(latency > stats.latency_max_ns) {
+	    stats.latency_max_ns = latency;
+	}
+    }
+
+    if(verbose) {
+	print_measurement_data_short(&data);
+    }
+}
+
+/*
+ * Requests the GPIO line for edge detection on both edges.
+ * Returns the line request file descriptor or -1
+ */
+static int request_line(const char *chip, unsigned int line) {
+    struct gpio_v2_line_request req;
+    int fd = open(chip, O_RDONLY | O_CLOEXEC);
+
+    if(fd < 0) {
+	fprintf(stderr, "Couldn't open %s: %s\n", chip, strerror(errno));
+	return -1;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.offsets[0] = line;
+    req.num_lines = 1;
+    req.event_buffer_size = 1024;	//a thermohygro packet has ~120 edges, sensors repeat 3 times
+    strncpy(req.consumer, CRESTAD_CONSUMER, sizeof(req.consumer) - 1);
+    req.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+
+    if(ioctl(fd, GPIO_V2_GET_LINE_IOCTL, &req) < 0) {
+	fprintf(stderr, "Couldn't request line %u of %s: %s\n", line, chip, strerror(errno));
+	close(fd);
+	return -1;
+    }
+    close(fd);
+    return req.fd;
+}
+
+/*
+ * Feeds the next edge into the decoder
+ */
+static void handle_edge(struct cresta_manchester_multi *decoder, uint64_t timestamp_ns) {
+    static uint64_t last_edge_ns = 0;
+    uint64_t delta_us = (timestamp_ns - last_edge_ns) / 1000;
+
+    //note: very first duration is bogus, as for the kernel module
+    last_edge_ns = timestamp_ns;
+    stats.edges++;
+    if(cresta_manchester_multi_decode(decoder, delta_us > UINT32_MAX ? UINT32_MAX : (uint32_t) delta_us)) {
+	handle_packet(decoder->packet, timestamp_ns);
+    }
+}
+
+/*
+ * Receives edges from the GPIO line until we're told to stop
+ */
+static int receive_gpio(int fd, struct cresta_manchester_multi *decoder) {
+    struct gpio_v2_line_event events[CRESTAD_EVENT_BATCH];
+
+    while(running) {
+	ssize_t len = read(fd, events, sizeof(events));
+	int i;
+
+	if(len < 0) {
+	    if(errno == EINTR) {
+		continue;
+	    }
+	    fprintf(stderr, "Couldn't read edge events: %s\n", strerror(errno));
+	    return -1;
+	}
+
+	for(i = 0; i < len / sizeof(events[0]); i++) {
+	    handle_edge(decoder, events[i].timestamp_ns);
+	}
+    }
+    return 0;
+}
+
+/*
+ * Replays an edge capture file
+ */
+static int receive_capture(FILE *fp, struct cresta_manchester_multi *decoder) {
+    struct cresta_raw_edge edges[CRESTAD_EVENT_BATCH];
+    unsigned long dropped = 0;
+    size_t n;
+    int i;
+
+    while(running && (n = fread(edges, sizeof(edges[0]), CRESTAD_EVENT_BATCH, fp)) > 0) {
+	for(i = 0; i < n; i++) {
+	    dropped += edges[i].dropped;
+	    handle_edge(decoder, edges[i].timestamp_ns);
+	}
+    }
+    if(dropped) {
+	printf("Capture lacks %lu edges\n", dropped);
+    }
+    return ferror(fp) ? -1 : 0;
+}
+
+static void handle_sample_edge(void *decoder, uint64_t timestamp_ns, uint32_t level) {
+    handle_edge(decoder, timestamp_ns);
+}
+
+/*
+ * Decodes a sample file of an SDR
+ */
+static int receive_samples(FILE *fp, struct cresta_manchester_multi *decoder, enum cresta_sdr_format format,
+			   uint32_t rate, double level_db) {
+    static uint8_t buffer[CRESTAD_SAMPLE_BATCH];
+    static struct cresta_sdr sdr;
+    size_t n;
+
+    cresta_sdr_init(&sdr, format, rate, level_db, handle_sample_edge, decoder);
+    while(running && (n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+	cresta_sdr_process(&sdr, buffer, n);
+    }
+    cresta_sdr_flush(&sdr);
+    stats.samples = sdr.samples;
+    stats.sample_rate = rate;
+    return ferror(fp) ? -1 : 0;
+}
+
+static void print_stats(void) {
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    printf("%lu edges, %lu packets, %lu valid, %lu repeated, %lu measurements published\n",
+	   stats.edges, stats.packets, stats.valid, stats.repeated, stats.published);
+    if(stats.published) {
+	printf("Publish latency: avg %llu us, max %llu us\n",
+	       (unsigned long long) (stats.latency_sum_ns / stats.published / 1000),
+	       (unsigned long long) (stats.latency_max_ns / 1000));
+    }
+    printf("CPU time: user %ld.%06ld s, system %ld.%06ld s\n",
+	   (long) usage.ru_utime.tv_sec, (long) usage.ru_utime.tv_usec,
+	   (long) usage.ru_stime.tv_sec, (long) usage.ru_stime.tv_usec);
+    if(stats.samples) {
+	double signal_s = (double) stats.samples / stats.sample_rate;
+	double cpu_s = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+		       (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+
+	printf("%llu samples (%.1f s) with %s, %.0fx realtime\n", (unsigned long long) stats.samples, signal_s,
+	       cresta_sdr_name(cresta_sdr_selected()), cpu_s > 0 ? signal_s / cpu_s : 0);
+    }
+}
+
+static void usage(const char *name) {
+    printf("Usage: %s [-v] [-d gpiochip] [-l line] [-o directory] [-m ring] [-H hypotheses]\n", name);
+    printf("       %s -r capturefile [-o directory] [-m ring] [-H hypotheses]\n", name);
+    printf("       %s -s samplefile [-f format] [-R rate] [-T level] [-o directory] [-m ring] [-H hypotheses]\n", name);
+    printf("\t-d gpiochip\tGPIO character device (default %s)\n", CRESTAD_GPIO_CHIP);
+    printf("\t-l line\t\tGPIO line the 433MHz receiver is connected to (default %d)\n", CRESTAD_GPIO_LINE);
+    printf("\t-o directory\tDirectory to publish measurements in (default %s)\n", CRESTAD_OUTPUT_DIR);
+    printf("\t-m ring\t\tAlso publish measurements into this shared memory ring, e.g. %s\n", CRESTA_RING_NAME);
+    printf("\t-r capturefile\tDecode an edge capture instead of the GPIO line, - for stdin.\n");
+    printf("\t\t\tImplies -v, measurements are only published with -o\n");
+    printf("\t-s samplefile\tDecode a sample file of an SDR instead, - for stdin. Implies -v like -r\n");
+    printf("\t-f format\tcu8 (rtl_sdr, default), cs8, cs16 (IQ) or am16 (amplitude)\n");
+    printf("\t-R rate\t\tSamples per second (default %d)\n", CRESTA_SDR_DEFAULT_RATE);
+    printf("\t-T level\tThreshold above the peaks of the noise in dB (default %d)\n", CRESTA_SDR_DEFAULT_LEVEL_DB);
+    printf("\t-H hypotheses\tNumber of parallel manchester decoders (1-%d, default 1)\n", CRESTA_MAX_HYPOTHESES);
+    printf("\t-v\t\tPrint every received measurement\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *chip = CRESTAD_GPIO_CHIP;
+    const char *capture = NULL;
+    const char *samplefile = NULL;
+    enum cresta_sdr_format format = CRESTA_SDR_CU8;
+    uint32_t rate = CRESTA_SDR_DEFAULT_RATE;
+    double level_db = CRESTA_SDR_DEFAULT_LEVEL_DB;
+    const char *ring_name = NULL;
+    unsigned int line = CRESTAD_GPIO_LINE;
+    int hypotheses = 1;
+    int output_dir_given = 0;
+    struct cresta_manchester_multi decoder;
+    struct sigaction sa;
+    int ret;
+    int c;
+
+    opterr = 0;
+
+    while ((c = getopt (argc, argv, "vd:l:o:m:r:s:f:R:T:H:")) != -1) {
+	switch (c) {
+	    case 'v': {
+		verbose = 1;
+		break;
+	    }
+	    case 'd': {
+		chip = optarg;
+		break;
+	    }
+	    case 'l': {
+		line = atoi(optarg);
+		break;
+	    }
+	    case 'o': {
+		output_dir = optarg;
+		output_dir_given = 1;
+		break;
+	    }
+	    case 'm': {
+		ring_name = optarg;
+		break;
+	    }
+	    case 'r': {
+		capture = optarg;
+		break;
+	    }
+	    case 's': {
+		samplefile = optarg;
+		break;
+	    }
+	    case 'f': {
+		if(cresta_sdr_parse_format(optarg, &format)) {
+		    fprintf(stderr, "Unknown sample format: %s\n", optarg);
+		    return 1;
+		}
+		break;
+	    }
+	    case 'R': {
+		rate = atoi(optarg);
+		break;
+	    }
+	    case 'T': {
+		level_db = atof(optarg);
+		break;
+	    }
+	    case 'H': {
+		hypotheses = atoi(optarg);
+		break;
+	    }
+	    case '?': {
+		if (isprint (optopt))
+		    fprintf (stderr, "Unknown option or missing argument `-%c'.\n", optopt);
+		usage(argv[0]);
+		return 1;
+	    }
+	    default: {
+		abort ();
+	    }
+	}
+    }
+
+    if(NULL != samplefile && 0 == rate) {
+	usage(argv[0]);
+	return 1;
+    }
+
+    //the decoder takes a uint8_t, 300 would become 44
+    if(hypotheses < 1 || hypotheses > CRESTA_MAX_HYPOTHESES) {
+	usage(argv[0]);
+	return 1;
+    }
+
+    if(NULL != capture || NULL != samplefile) {
+	replay = 1;
+	verbose = 1;
+	publish = output_dir_given;
+    }
+
+    if(publish && mkdir(output_dir, 0755) && errno != EEXIST) {
+	fprintf(stderr, "Couldn't create %s: %s\n", output_dir, strerror(errno));
+	return -1;
+    }
+
+    if(NULL != ring_name && cresta_ring_create(&ring, ring_name, CRESTA_RING_RECORDS)) {
+	return -1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    cresta_manchester_multi_init(&decoder, hypotheses);
+
+    if(replay) {
+	const char *filename = NULL != samplefile ? samplefile : capture;
+	FILE *fp = strcmp(filename, "-") ? fopen(filename, "rb") : stdin;
+
+	if(NULL == fp) {
+	    fprintf(stderr, "Couldn't open %s: %s\n", filename, strerror(errno));
+	    return -1;
+	}
+	if(NULL != samplefile) {
+	    ret = receive_samples(fp, &decoder, format, rate, level_db);
+	} else {
+	    ret = receive_capture(fp, &decoder);
+	}
+	fclose(fp);
+    } else {
+	int fd = request_line(chip, line);
+
+	if(fd < 0) {
+	    return -1;
+	}
+	ret = receive_gpio(fd, &decoder);
+	close(fd);
+    }
+
+    print_stats();
+    //the ring stays, consumers keep their mapping until we're back
+    cresta_ring_close(&ring);
+    return ret;
+}